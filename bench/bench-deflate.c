@@ -0,0 +1,186 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * permessage-deflate benchmark
+ *
+ * Compresses representative datasync frames the way the permessage-deflate
+ * extension of libwebsockets does (raw deflate stream, sync flush at the end
+ * of each message, sliding window kept between messages unless
+ * no_context_takeover is negotiated), for several window sizes and
+ * compression levels, and reports the compression ratio and the CPU cost of
+ * both directions.
+ *
+ * usage: webcom-bench-deflate [messages per payload kind]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#define FRAME_MAX (256 * 1024)
+
+struct payload {
+	const char *name;
+	char *(*build)(unsigned seq, size_t *len);
+};
+
+static char frame[FRAME_MAX];
+
+/* a data push of a big subtree, with very repetitive keys */
+static char *build_push(unsigned seq, size_t *len) {
+	size_t n;
+	unsigned i;
+
+	n = (size_t)snprintf(frame, FRAME_MAX, "{\"t\":\"d\",\"d\":{\"a\":\"d\",\"b\":{\"p\":\"fleet/sensors\",\"d\":{");
+	for (i = 0 ; i < 200 ; i++) {
+		n += (size_t)snprintf(frame + n, FRAME_MAX - n, "%s\"sensor-%04u\":{\"temperature\":%u.%u,\"humidity\":%u,\"battery\":%u,\"status\":\"%s\",\"updated\":%u}",
+				i ? "," : "", i, 15 + (seq + i) % 20, (seq * 7 + i) % 10, 30 + (seq + 3 * i) % 50, 100 - (seq + i) % 100,
+				(seq + i) % 17 ? "ok" : "degraded", 1540000000u + seq * 60 + i);
+	}
+	n += (size_t)snprintf(frame + n, FRAME_MAX - n, "}}}}");
+	*len = n;
+	return frame;
+}
+
+/* a small put request */
+static char *build_put(unsigned seq, size_t *len) {
+	*len = (size_t)snprintf(frame, FRAME_MAX, "{\"t\":\"d\",\"d\":{\"r\":%u,\"a\":\"p\",\"b\":{\"p\":\"fleet/sensors/sensor-%04u/temperature\",\"d\":%u.%u}}}",
+			seq + 1, seq % 200, 15 + seq % 20, seq % 10);
+	return frame;
+}
+
+/* a merge of pseudo-random tokens, hardly compressible */
+static char *build_tokens(unsigned seq, size_t *len) {
+	static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+	uint32_t x = 2463534242u + seq;
+	size_t n;
+	unsigned i, j;
+
+	n = (size_t)snprintf(frame, FRAME_MAX, "{\"t\":\"d\",\"d\":{\"r\":%u,\"a\":\"m\",\"b\":{\"p\":\"tokens\",\"d\":{", seq + 1);
+	for (i = 0 ; i < 32 ; i++) {
+		n += (size_t)snprintf(frame + n, FRAME_MAX - n, "%s\"t%u\":\"", i ? "," : "", i);
+		for (j = 0 ; j < 40 ; j++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			frame[n++] = b64[x & 63];
+		}
+		frame[n++] = '"';
+	}
+	n += (size_t)snprintf(frame + n, FRAME_MAX - n, "}}}}");
+	*len = n;
+	return frame;
+}
+
+static const struct payload payloads[] = {
+	{"push 200 sensors", build_push},
+	{"small put", build_put},
+	{"random tokens", build_tokens},
+};
+
+static double cpu_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void bench(const struct payload *p, unsigned nmsg, int bits, int level, int takeover) {
+	static unsigned char out[FRAME_MAX + 1024], back[FRAME_MAX];
+	z_stream def, inf;
+	size_t raw = 0, wire = 0, len, clen;
+	double t0, tdef = 0, tinf = 0;
+	unsigned i;
+	char *msg;
+
+	memset(&def, 0, sizeof(def));
+	memset(&inf, 0, sizeof(inf));
+	deflateInit2(&def, level, Z_DEFLATED, -bits, 8, Z_DEFAULT_STRATEGY);
+	inflateInit2(&inf, -bits);
+
+	for (i = 0 ; i < nmsg ; i++) {
+		msg = p->build(i, &len);
+		raw += len;
+
+		t0 = cpu_seconds();
+		if (!takeover) {
+			deflateReset(&def);
+		}
+		def.next_in = (unsigned char *)msg;
+		def.avail_in = (uInt)len;
+		def.next_out = out;
+		def.avail_out = sizeof(out);
+		deflate(&def, Z_SYNC_FLUSH);
+		/* the 00 00 ff ff trailer of the sync flush is not sent */
+		clen = sizeof(out) - def.avail_out - 4;
+		tdef += cpu_seconds() - t0;
+		wire += clen;
+
+		t0 = cpu_seconds();
+		if (!takeover) {
+			inflateReset(&inf);
+		}
+		memcpy(out + clen, "\x00\x00\xff\xff", 4);
+		inf.next_in = out;
+		inf.avail_in = (uInt)clen + 4;
+		inf.next_out = back;
+		inf.avail_out = sizeof(back);
+		inflate(&inf, Z_SYNC_FLUSH);
+		tinf += cpu_seconds() - t0;
+
+		if (sizeof(back) - inf.avail_out != len || memcmp(back, msg, len) != 0) {
+			fprintf(stderr, "round trip error on message %u of \"%s\"\n", i, p->name);
+			exit(1);
+		}
+	}
+
+	printf("%-18s %4d %5d %8s %12zu %12zu %7.1f%% %10.1f %10.1f\n",
+			p->name, bits, level, takeover ? "yes" : "no", raw, wire, 100. * (double)wire / (double)raw,
+			(double)raw / tdef / 1e6, (double)raw / tinf / 1e6);
+
+	deflateEnd(&def);
+	inflateEnd(&inf);
+}
+
+int main(int argc, char *argv[]) {
+	static const int bits[] = {9, 12, 15};
+	static const int levels[] = {1, 6, 9};
+	unsigned nmsg = argc > 1 ? (unsigned)atoi(argv[1]) : 1000;
+	unsigned p, b, l;
+
+	printf("%-18s %4s %5s %8s %12s %12s %8s %10s %10s\n",
+			"payload", "bits", "level", "takeover", "raw bytes", "wire bytes", "ratio", "def MB/s", "inf MB/s");
+
+	for (p = 0 ; p < sizeof(payloads) / sizeof(*payloads) ; p++) {
+		for (b = 0 ; b < sizeof(bits) / sizeof(*bits) ; b++) {
+			for (l = 0 ; l < sizeof(levels) / sizeof(*levels) ; l++) {
+				bench(&payloads[p], nmsg, bits[b], levels[l], 1);
+			}
+		}
+		bench(&payloads[p], nmsg, 15, 6, 0);
+	}
+
+	return 0;
+}
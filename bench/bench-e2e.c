@@ -0,0 +1,469 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * end-to-end benchmark: clients on the epoll loop against the mock datasync
+ * server (test/mock), both serviced in this thread
+ *
+ * - put_rtt: sequential puts, round-trip latency percentiles
+ * - fanout: one write pushed to NSUBS value subscriptions of a client
+ * - snapshot_ingest: a listen on a large tree, until its value is delivered
+ * - merge_burst: merges sent without waiting, until they are all answered
+ * - reconnect_resume: the server closes a connection with NLISTENS listens,
+ *   time until the client is connected again, and until the listens are all
+ *   acknowledged by the server
+ * - cache_memory: heap bytes per node of the local data cache
+ *
+ * the server and the clients are polled without waiting, so that the figures
+ * measure the SDK and not the loop timeouts; the counts are multiplied by the
+ * scale factor
+ *
+ * the results are printed as a JSON document, to be compared across versions;
+ * a scenario that does not complete within DEADLINE_US (e.g. a lost listen) is
+ * reported with "ok": false and the exit status is 1
+ *
+ * usage: webcom-bench-e2e [-b] [-n scale] [-p port] [-o results.json]
+ *   -b: binary framing of the datasync protocol
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#include "webcom-c/webcom.h"
+#include "webcom-c/webcom-epoll.h"
+#include "../lib/datasync/cache/treenode_cache.h"
+#include "mock_server.h"
+
+#define NPUTS 2000
+#define NSUBS 1000
+#define NROUNDS 50
+#define NSNAP 50000
+#define NMERGES 5000
+#define NLISTENS 10000
+
+#define DEADLINE_US 60000000
+
+static wc_loop_t *loop;
+static struct mock_server *server;
+static int binary = 0;
+static uint16_t port = 18082;
+static FILE *out;
+static int failed = 0;
+static int scenario_ok;
+
+static unsigned connected;
+static unsigned nresults;
+static unsigned nvalues;
+
+static int64_t now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t heap_bytes(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	return mallinfo2().uordblks;
+#else
+	return (size_t)mallinfo().uordblks;
+#endif
+}
+
+static int cmp_int64(const void *a, const void *b) {
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int64_t percentile(int64_t *sorted, unsigned n, unsigned p) {
+	return n == 0 ? 0 : sorted[(size_t)(n - 1) * p / 100];
+}
+
+static void on_connected(UNUSED_PARAM(wc_context_t *ctx)) {
+	connected++;
+}
+
+static int on_disconnected(UNUSED_PARAM(wc_context_t *ctx)) {
+	return 1;
+}
+
+static void on_result(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(int64_t id), UNUSED_PARAM(wc_action_type_t type),
+		wc_req_pending_result_t status, UNUSED_PARAM(char *reason), UNUSED_PARAM(char *data), UNUSED_PARAM(void *user))
+{
+	nresults++;
+	if (status != WC_REQ_OK) {
+		failed = 1;
+	}
+}
+
+static int on_value(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(on_handle_t handle), UNUSED_PARAM(char *data),
+		UNUSED_PARAM(char *current_key), UNUSED_PARAM(char *previous_key))
+{
+	nvalues++;
+	return 1;
+}
+
+static void poll_once(void) {
+	mock_server_service(server, 0);
+	wc_loop_run_once(loop, 0);
+}
+
+/* polls until *counter reaches n, returns 0 on timeout */
+static int wait_for(unsigned *counter, unsigned n) {
+	int64_t deadline = now_us() + DEADLINE_US;
+
+	while (*counter < n) {
+		if (now_us() > deadline) {
+			fprintf(stderr, "timeout (%u/%u)\n", *counter, n);
+			failed = 1;
+			scenario_ok = 0;
+			return 0;
+		}
+		poll_once();
+	}
+	return 1;
+}
+
+static void idle(unsigned ms) {
+	int64_t end = now_us() + ms * 1000;
+
+	while (now_us() < end) {
+		poll_once();
+	}
+}
+
+static unsigned server_listens(void) {
+	struct mock_server_stats stats;
+
+	mock_server_get_stats(server, &stats);
+	return stats.listens;
+}
+
+/* polls until the server has exactly n active listens, returns 0 on timeout */
+static int wait_for_listens(unsigned n) {
+	int64_t deadline = now_us() + DEADLINE_US;
+	unsigned listens;
+
+	while ((listens = server_listens()) != n) {
+		if (now_us() > deadline) {
+			fprintf(stderr, "timeout (%u/%u listens)\n", listens, n);
+			failed = 1;
+			scenario_ok = 0;
+			return 0;
+		}
+		poll_once();
+	}
+	return 1;
+}
+
+static const char *scenario_status(void) {
+	return scenario_ok ? "true" : "false";
+}
+
+static wc_context_t *new_client(void) {
+	static struct wc_eli_callbacks callbacks = {.on_connected = on_connected, .on_disconnected = on_disconnected};
+	struct wc_context_options options;
+	wc_context_t *ctx;
+	unsigned n = connected;
+
+	memset(&options, 0, sizeof(options));
+	options.host = "localhost";
+	options.port = port;
+	options.app_name = "bench";
+	options.no_tls = 1;
+	options.binary_framing = binary;
+	options.tx_high_watermark = 1 << 28;
+	options.reconnect_initial_ms = 1;
+
+	ctx = wc_context_create_with_epoll(&options, loop, &callbacks);
+	wc_datasync_connect(ctx);
+	wait_for(&connected, n + 1);
+
+	return ctx;
+}
+
+/* {"k0000000":{"id":0,"on":true,"name":"node-0"},...}, 4 nodes per entry */
+static char *make_tree(unsigned entries, size_t *nodes) {
+	char *json, *p;
+	unsigned i;
+
+	json = malloc((size_t)entries * 64 + 3);
+	p = json;
+	*p++ = '{';
+	for (i = 0 ; i < entries ; i++) {
+		p += sprintf(p, "%s\"k%07u\":{\"id\":%u,\"on\":%s,\"name\":\"node-%u\"}", i ? "," : "", i, i, i % 2 ? "true" : "false", i);
+	}
+	*p++ = '}';
+	*p = '\0';
+	*nodes = (size_t)entries * 4 + 1;
+
+	return json;
+}
+
+static void bench_put_rtt(unsigned n) {
+	int64_t *samples, start, t0;
+	wc_context_t *ctx;
+	unsigned i;
+	char value[32];
+
+	scenario_ok = 1;
+	ctx = new_client();
+	samples = malloc(n * sizeof(*samples));
+	nresults = 0;
+	start = now_us();
+	for (i = 0 ; i < n ; i++) {
+		sprintf(value, "%u", i);
+		t0 = now_us();
+		wc_datasync_put(ctx, "/bench/rtt", value, on_result, NULL);
+		if (!wait_for(&nresults, i + 1)) {
+			break;
+		}
+		samples[i] = now_us() - t0;
+	}
+	qsort(samples, i, sizeof(*samples), cmp_int64);
+
+	fprintf(out, "\t\t\"put_rtt\": {\"ok\": %s, \"puts\": %u, \"ops_per_s\": %.0f, \"p50_us\": %"PRId64", \"p90_us\": %"PRId64", \"p99_us\": %"PRId64", \"max_us\": %"PRId64"},\n",
+			scenario_status(), i, i * 1e6 / (double)(now_us() - start), percentile(samples, i, 50), percentile(samples, i, 90),
+			percentile(samples, i, 99), percentile(samples, i, 100));
+
+	free(samples);
+	wc_context_destroy(ctx);
+}
+
+static void bench_fanout(unsigned nsubs, unsigned rounds) {
+	wc_context_t *sub, *pub;
+	int64_t *samples, t0;
+	unsigned i, r;
+	char path[32], *json, *p;
+
+	scenario_ok = 1;
+	sub = new_client();
+	pub = new_client();
+	for (i = 0 ; i < nsubs ; i++) {
+		sprintf(path, "/bench/fan/s%u", i);
+		wc_datasync_on_value(sub, path, on_value);
+	}
+	if (wait_for_listens(nsubs)) {
+		idle(100);
+	} else {
+		rounds = 0;
+	}
+
+	samples = malloc((rounds ? rounds : 1) * sizeof(*samples));
+	json = malloc((size_t)nsubs * 24 + 3);
+	nvalues = 0;
+	for (r = 0 ; r < rounds ; r++) {
+		p = json;
+		*p++ = '{';
+		for (i = 0 ; i < nsubs ; i++) {
+			p += sprintf(p, "%s\"s%u\":%u", i ? "," : "", i, r);
+		}
+		*p++ = '}';
+		*p = '\0';
+		t0 = now_us();
+		wc_datasync_put(pub, "/bench/fan", json, NULL, NULL);
+		if (!wait_for(&nvalues, (r + 1) * nsubs)) {
+			break;
+		}
+		samples[r] = now_us() - t0;
+	}
+	qsort(samples, r, sizeof(*samples), cmp_int64);
+
+	fprintf(out, "\t\t\"fanout\": {\"ok\": %s, \"subscriptions\": %u, \"rounds\": %u, \"p50_us\": %"PRId64", \"p99_us\": %"PRId64", \"callbacks_per_s\": %.0f},\n",
+			scenario_status(), nsubs, r, percentile(samples, r, 50), percentile(samples, r, 99),
+			r ? nsubs * 1e6 / (double)percentile(samples, r, 50) : 0.);
+
+	free(json);
+	free(samples);
+	wc_context_destroy(pub);
+	wc_context_destroy(sub);
+}
+
+static void bench_snapshot_ingest(unsigned entries) {
+	wc_context_t *sub, *pub;
+	size_t nodes, len;
+	int64_t t0, t;
+	char *json;
+
+	scenario_ok = 1;
+	json = make_tree(entries, &nodes);
+	len = strlen(json);
+	pub = new_client();
+	nresults = 0;
+	wc_datasync_put(pub, "/bench/snap", json, on_result, NULL);
+	wait_for(&nresults, 1);
+	free(json);
+
+	sub = new_client();
+	nvalues = 0;
+	t0 = now_us();
+	wc_datasync_on_value(sub, "/bench/snap", on_value);
+	wait_for(&nvalues, 1);
+	t = now_us() - t0;
+
+	fprintf(out, "\t\t\"snapshot_ingest\": {\"ok\": %s, \"nodes\": %zu, \"bytes\": %zu, \"ms\": %.1f, \"nodes_per_s\": %.0f},\n",
+			scenario_status(), nodes, len, t / 1e3, nodes * 1e6 / (double)t);
+
+	wc_context_destroy(sub);
+	wc_context_destroy(pub);
+}
+
+static void bench_merge_burst(unsigned n) {
+	wc_context_t *ctx;
+	int64_t t0, t;
+	unsigned i;
+	char json[64];
+
+	scenario_ok = 1;
+	ctx = new_client();
+	nresults = 0;
+	t0 = now_us();
+	for (i = 0 ; i < n ; i++) {
+		sprintf(json, "{\"m%u\":%u,\"last\":%u}", i % 100, i, i);
+		wc_datasync_merge(ctx, "/bench/merge", json, on_result, NULL);
+	}
+	wait_for(&nresults, n);
+	t = now_us() - t0;
+
+	fprintf(out, "\t\t\"merge_burst\": {\"ok\": %s, \"merges\": %u, \"ms\": %.1f, \"merges_per_s\": %.0f},\n",
+			scenario_status(), n, t / 1e3, n * 1e6 / (double)t);
+
+	wc_context_destroy(ctx);
+}
+
+static void bench_reconnect_resume(unsigned n) {
+	struct wc_datasync_listen_stats ls;
+	int64_t t0, t_cnx, t_resume;
+	wc_context_t *ctx;
+	unsigned i;
+	char path[32];
+
+	scenario_ok = 1;
+	ctx = new_client();
+	for (i = 0 ; i < n ; i++) {
+		sprintf(path, "/bench/resume/l%u", i);
+		wc_datasync_on_value(ctx, path, on_value);
+	}
+	t_cnx = t_resume = 0;
+	memset(&ls, 0, sizeof(ls));
+	if (!wait_for_listens(n)) {
+		goto report;
+	}
+	idle(100);
+
+	t0 = now_us();
+	i = connected;
+	mock_server_disconnect_all(server);
+	/* the listens of the closed session are dropped by the server */
+	if (!wait_for_listens(0) || !wait_for(&connected, i + 1)) {
+		goto report;
+	}
+	t_cnx = now_us() - t0;
+	wait_for_listens(n);
+	t_resume = now_us() - t0;
+	wc_datasync_get_listen_stats(ctx, &ls);
+
+report:
+	fprintf(out, "\t\t\"reconnect_resume\": {\"ok\": %s, \"listens\": %u, \"reconnect_ms\": %.1f, \"resume_ms\": %.1f, \"resume_sent\": %u},\n",
+			scenario_status(), n, t_cnx / 1e3, t_resume / 1e3, ls.resume_sent);
+
+	wc_context_destroy(ctx);
+}
+
+static void bench_cache_memory(unsigned entries) {
+	data_cache_t *cache;
+	size_t nodes, before, after;
+	char *json;
+
+	json = make_tree(entries, &nodes);
+	before = heap_bytes();
+	cache = data_cache_new();
+	data_cache_set(cache, "/bench", json);
+	after = heap_bytes();
+	data_cache_destroy(cache);
+	free(json);
+
+	fprintf(out, "\t\t\"cache_memory\": {\"nodes\": %zu, \"bytes\": %zu, \"bytes_per_node\": %.1f}\n",
+			nodes, after - before, (double)(after - before) / (double)nodes);
+}
+
+int main(int argc, char *argv[]) {
+	struct mock_server_options so;
+	double scale = 1.;
+	int opt;
+
+	out = stdout;
+	while ((opt = getopt(argc, argv, "bn:p:o:")) != -1) {
+		switch (opt) {
+		case 'b':
+			binary = 1;
+			break;
+		case 'n':
+			scale = atof(optarg);
+			break;
+		case 'p':
+			port = (uint16_t)atoi(optarg);
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (out == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b] [-n scale] [-p port] [-o results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	memset(&so, 0, sizeof(so));
+	so.port = port;
+	server = mock_server_new(&so);
+	loop = wc_loop_new();
+	if (server == NULL || loop == NULL) {
+		fprintf(stderr, "could not start the mock server on port %u\n", port);
+		return 1;
+	}
+
+	fprintf(out, "{\n\t\"sdk_version\": \"%s\",\n\t\"framing\": \"%s\",\n\t\"scale\": %g,\n\t\"scenarios\": {\n",
+			WEBCOM_SDK_VERSION_STR, binary ? "cbor" : "json", scale);
+	bench_put_rtt((unsigned)(NPUTS * scale));
+	bench_fanout((unsigned)(NSUBS * scale), NROUNDS);
+	bench_snapshot_ingest((unsigned)(NSNAP * scale));
+	bench_merge_burst((unsigned)(NMERGES * scale));
+	bench_reconnect_resume((unsigned)(NLISTENS * scale));
+	bench_cache_memory((unsigned)(NSNAP * scale));
+	fprintf(out, "\t},\n\t\"ok\": %s\n}\n", failed ? "false" : "true");
+
+	if (out != stdout) {
+		fclose(out);
+	}
+	wc_loop_destroy(loop);
+	mock_server_destroy(server);
+
+	return failed;
+}
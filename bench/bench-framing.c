@@ -0,0 +1,133 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * message encoding benchmark: JSON text framing vs CBOR binary framing
+ *
+ * representative messages are encoded and decoded with both encodings, the
+ * time per message and the encoded sizes are measured:
+ * - small: a put request of a small object (e.g. a sensor reading)
+ * - large: a data update push of an object of 1000 children
+ * - response: a response to a write request
+ *
+ * usage: webcom-bench-framing [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "webcom-c/webcom.h"
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void bench(const char *name, wc_msg_t *msg, unsigned n) {
+	double t_enc, t_dec, t_cenc, t_cdec;
+	unsigned char *cbor = NULL;
+	char *json = NULL;
+	size_t json_len, cbor_len;
+	wc_msg_t parsed;
+	unsigned i;
+
+	t_enc = now();
+	for (i = 0 ; i < n ; i++) {
+		free(json);
+		json = wc_datasync_msg_to_json_str(msg);
+	}
+	t_enc = now() - t_enc;
+	json_len = strlen(json);
+
+	t_dec = now();
+	for (i = 0 ; i < n ; i++) {
+		wc_datasync_parse_msg(json, &parsed);
+		wc_datasync_msg_free(&parsed);
+	}
+	t_dec = now() - t_dec;
+
+	t_cenc = now();
+	for (i = 0 ; i < n ; i++) {
+		free(cbor);
+		cbor = wc_datasync_msg_to_cbor(msg, &cbor_len);
+	}
+	t_cenc = now() - t_cenc;
+
+	t_cdec = now();
+	for (i = 0 ; i < n ; i++) {
+		wc_datasync_parse_msg_cbor(cbor, cbor_len, &parsed);
+		wc_datasync_msg_free(&parsed);
+	}
+	t_cdec = now() - t_cdec;
+
+	printf("%-10s json %7zu B  enc %8.2f us  dec %8.2f us   cbor %7zu B  enc %8.2f us  dec %8.2f us\n",
+			name,
+			json_len, t_enc / n * 1e6, t_dec / n * 1e6,
+			cbor_len, t_cenc / n * 1e6, t_cdec / n * 1e6);
+
+	free(json);
+	free(cbor);
+}
+
+int main(int argc, char *argv[]) {
+	unsigned n = argc > 1 ? (unsigned)atoi(argv[1]) : 10000;
+	char *large, *p;
+	wc_msg_t msg;
+	int i;
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_ACTION;
+	msg.u.data.u.action.type = WC_ACTION_PUT;
+	msg.u.data.u.action.r = 1234;
+	msg.u.data.u.action.u.put.path = "/sensors/42/last";
+	msg.u.data.u.action.u.put.data = "{\"ts\":1519900000000,\"temperature\":21.5,\"humidity\":48,\"battery\":true}";
+	bench("small", &msg, n);
+
+	large = malloc(1000 * 64 + 2);
+	p = large;
+	*p++ = '{';
+	for (i = 0 ; i < 1000 ; i++) {
+		p += sprintf(p, "%s\"-L%07d\":{\"x\":%d,\"y\":%d.25,\"on\":false}", i ? "," : "", i, i, i * 3);
+	}
+	strcpy(p, "}");
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_PUSH;
+	msg.u.data.u.push.type = WC_PUSH_DATA_UPDATE_PUT;
+	msg.u.data.u.push.u.update_put.path = "/bricks";
+	msg.u.data.u.push.u.update_put.data = large;
+	bench("large", &msg, n / 100 ? n / 100 : 1);
+	free(large);
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_RESPONSE;
+	msg.u.data.u.response.r = 1234;
+	msg.u.data.u.response.status = "ok";
+	bench("response", &msg, n);
+
+	return 0;
+}
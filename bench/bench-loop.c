@@ -0,0 +1,299 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * event loop benchmark: built-in epoll loop vs libev integration
+ *
+ * - timers: NCTX contexts each re-arm a 1 ms internal timer as soon as it
+ *   fires, this goes through the SET_TIMER/DEL_TIMER events of the event loop
+ *   integration; the number of expirations and their lateness are measured
+ * - I/O: NPAIRS socket pairs play ping-pong, one byte at a time; the number
+ *   of round trips and their latency are measured
+ *
+ * usage: webcom-bench-loop [duration in seconds]
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "webcom-c/webcom.h"
+#include "webcom-c/webcom-epoll.h"
+#include "webcom-c/webcom-libev.h"
+#include "../lib/timer.h"
+
+#define NCTX 100
+#define NPAIRS 100
+#define NSAMPLES (1 << 20)
+
+struct bench_timer {
+	struct wc_timer t;
+	int64_t expected;
+};
+
+static wc_context_t *contexts[NCTX];
+static struct bench_timer timers[NCTX];
+static int64_t samples[NSAMPLES];
+static unsigned nsamples;
+static uint64_t count;
+static int64_t end;
+static int pairs[NPAIRS][2];
+static int64_t sent_at[NPAIRS];
+
+static int64_t now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sample(int64_t v) {
+	if (nsamples < NSAMPLES) {
+		samples[nsamples++] = v;
+	}
+	count++;
+}
+
+static int cmp_int64(const void *a, const void *b) {
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void report(const char *loop, const char *what, const char *unit, double seconds) {
+	qsort(samples, nsamples, sizeof(*samples), cmp_int64);
+	printf("%-8s %-8s %12.0f/s   p50 %6"PRId64" %s   p99 %6"PRId64" %s   max %6"PRId64" %s\n",
+			loop, what, (double)count / seconds,
+			nsamples ? samples[nsamples / 2] : 0, unit,
+			nsamples ? samples[nsamples * 99 / 100] : 0, unit,
+			nsamples ? samples[nsamples - 1] : 0, unit);
+	nsamples = 0;
+	count = 0;
+}
+
+static int stop_now(void) {
+	return now_us() >= end;
+}
+
+static void on_bench_timer(wc_context_t *ctx, struct wc_timer *t) {
+	struct bench_timer *bt = (struct bench_timer *)t;
+	int64_t now = now_us();
+
+	sample(now - bt->expected);
+	if (now < end) {
+		bt->expected = now + 1000;
+		wc_timer_arm(ctx, t, 1);
+	}
+}
+
+static void arm_timers(void) {
+	int i;
+
+	for (i = 0 ; i < NCTX ; i++) {
+		wc_timer_init(&timers[i].t, on_bench_timer, NULL);
+		timers[i].expected = now_us() + 1000;
+		wc_timer_arm(contexts[i], &timers[i].t, 1);
+	}
+}
+
+static void ping(int i) {
+	sent_at[i] = now_us();
+	if (write(pairs[i][0], "p", 1) != 1) {
+		perror("write");
+	}
+}
+
+/* returns 1 if the exchange goes on */
+static int pong(int fd, int i) {
+	char c;
+
+	if (read(fd, &c, 1) != 1) {
+		return 0;
+	}
+	if (c == 'p') {
+		/* echo side */
+		return write(fd, "o", 1) == 1;
+	}
+	sample(now_us() - sent_at[i]);
+	if (!stop_now()) {
+		ping(i);
+		return 1;
+	}
+	return 0;
+}
+
+static void open_pairs(void) {
+	int i;
+
+	for (i = 0 ; i < NPAIRS ; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) != 0) {
+			perror("socketpair");
+			exit(1);
+		}
+	}
+}
+
+static void close_pairs(void) {
+	int i;
+
+	for (i = 0 ; i < NPAIRS ; i++) {
+		close(pairs[i][0]);
+		close(pairs[i][1]);
+	}
+}
+
+/* built-in epoll loop */
+
+static void epoll_on_fd(wc_loop_t *loop, int fd, UNUSED_PARAM(short events), void *data) {
+	if (!pong(fd, (int)(intptr_t)data)) {
+		wc_loop_del_fd(loop, fd);
+	}
+}
+
+static void bench_epoll(struct wc_context_options *options, double seconds) {
+	struct wc_eli_callbacks callbacks;
+	wc_loop_t *loop;
+	int i;
+
+	memset(&callbacks, 0, sizeof(callbacks));
+	loop = wc_loop_new();
+
+	for (i = 0 ; i < NCTX ; i++) {
+		contexts[i] = wc_context_create_with_epoll(options, loop, &callbacks);
+	}
+	end = now_us() + (int64_t)(seconds * 1e6);
+	arm_timers();
+	wc_loop_run(loop);
+	report("epoll", "timers", "us late", seconds);
+	for (i = 0 ; i < NCTX ; i++) {
+		wc_context_destroy(contexts[i]);
+	}
+
+	open_pairs();
+	for (i = 0 ; i < NPAIRS ; i++) {
+		wc_loop_add_fd(loop, pairs[i][0], WC_POLLIN, epoll_on_fd, (void *)(intptr_t)i);
+		wc_loop_add_fd(loop, pairs[i][1], WC_POLLIN, epoll_on_fd, (void *)(intptr_t)i);
+	}
+	end = now_us() + (int64_t)(seconds * 1e6);
+	for (i = 0 ; i < NPAIRS ; i++) {
+		ping(i);
+	}
+	while (!stop_now()) {
+		wc_loop_run_once(loop, 10);
+	}
+	report("epoll", "io", "us", seconds);
+	for (i = 0 ; i < NPAIRS ; i++) {
+		wc_loop_del_fd(loop, pairs[i][0]);
+		wc_loop_del_fd(loop, pairs[i][1]);
+	}
+	close_pairs();
+
+	wc_loop_destroy(loop);
+}
+
+#ifdef WITH_LIBEV
+
+/* libev integration */
+
+static void libev_on_fd(struct ev_loop *loop, ev_io *w, UNUSED_PARAM(int revents)) {
+	if (!pong(w->fd, (int)(intptr_t)w->data)) {
+		ev_io_stop(loop, w);
+	}
+}
+
+static void libev_on_tick(struct ev_loop *loop, UNUSED_PARAM(ev_timer *w), UNUSED_PARAM(int revents)) {
+	if (stop_now()) {
+		ev_break(loop, EVBREAK_ALL);
+	}
+}
+
+static void bench_libev(struct wc_context_options *options, double seconds) {
+	static ev_io watchers[NPAIRS][2];
+	struct wc_eli_callbacks callbacks;
+	struct ev_loop *loop = ev_loop_new(EVFLAG_AUTO);
+	ev_timer tick;
+	int i, j;
+
+	memset(&callbacks, 0, sizeof(callbacks));
+
+	for (i = 0 ; i < NCTX ; i++) {
+		contexts[i] = wc_context_create_with_libev(options, loop, &callbacks);
+	}
+	end = now_us() + (int64_t)(seconds * 1e6);
+	arm_timers();
+	ev_run(loop, 0);
+	report("libev", "timers", "us late", seconds);
+	for (i = 0 ; i < NCTX ; i++) {
+		wc_context_destroy(contexts[i]);
+	}
+
+	open_pairs();
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstrict-aliasing"
+	for (i = 0 ; i < NPAIRS ; i++) {
+		for (j = 0 ; j < 2 ; j++) {
+			ev_io_init(&watchers[i][j], libev_on_fd, pairs[i][j], EV_READ);
+			watchers[i][j].data = (void *)(intptr_t)i;
+			ev_io_start(loop, &watchers[i][j]);
+		}
+	}
+	ev_timer_init(&tick, libev_on_tick, 0.01, 0.01);
+#pragma GCC diagnostic pop
+	ev_timer_start(loop, &tick);
+	end = now_us() + (int64_t)(seconds * 1e6);
+	for (i = 0 ; i < NPAIRS ; i++) {
+		ping(i);
+	}
+	ev_run(loop, 0);
+	report("libev", "io", "us", seconds);
+	for (i = 0 ; i < NPAIRS ; i++) {
+		ev_io_stop(loop, &watchers[i][0]);
+		ev_io_stop(loop, &watchers[i][1]);
+	}
+	ev_timer_stop(loop, &tick);
+	close_pairs();
+
+	ev_loop_destroy(loop);
+}
+
+#endif /* WITH_LIBEV */
+
+int main(int argc, char *argv[]) {
+	struct wc_context_options options;
+	double seconds = argc > 1 ? atof(argv[1]) : 2.;
+
+	memset(&options, 0, sizeof(options));
+	options.host = "localhost";
+	options.port = 443;
+	options.app_name = "bench";
+
+	wc_set_log_level(WC_LOG_ALL, WC_LOG_ERR);
+
+	printf("%d contexts re-arming 1 ms timers, %d socket pairs ping-ponging, %.1f s per run\n", NCTX, NPAIRS, seconds);
+	bench_epoll(&options, seconds);
+#ifdef WITH_LIBEV
+	bench_libev(&options, seconds);
+#endif
+
+	return 0;
+}
@@ -0,0 +1,534 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * microbenchmarks of the collection and cache primitives
+ *
+ * every benchmark runs its operations on SIZE keys of the chosen
+ * distribution, and reports the time, the number of heap allocations and the
+ * number of allocated bytes per operation:
+ * - avl_*: insertion (in key generation order), lookup and removal (in random
+ *   order), in-order iteration of an avl of the keys
+ * - ht_*: same, with a hash table
+ * - key_cmp: comparisons of random pairs of keys
+ * - path_parse: parsing of 4 levels deep paths made of the keys
+ * - cache_set_ex: puts of a number under /bench/<key>
+ * - cache_merge_ex: merges of {"<key>":number} into /bench
+ * - hash_cold: hash of a tree of SIZE leaves, the operation being a node
+ * - hash_update: put of a leaf of the tree, then hash of its root, which
+ *   hashes all the leaves again (at most HASH_UPDATES operations)
+ * - to_json: serialization of the tree, the operation being a node
+ *
+ * the allocations are counted by replacing malloc() and friends, this needs
+ * glibc (the counts are 0 otherwise)
+ *
+ * usage: webcom-bench-micro [-n SIZE] [-k numeric|pushid|random] [-s seed] [filter]
+ *   the filter only reports the benchmarks whose name contains it
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <json-c/json.h>
+
+#include "webcom-c/webcom.h"
+#include "../lib/collection/avl.h"
+#include "../lib/collection/ht.h"
+#include "../lib/datasync/path.h"
+#include "../lib/datasync/cache/treenode.h"
+#include "../lib/datasync/cache/treenode_cache.h"
+
+#define HASH_UPDATES 1000
+/* up to 19 random characters and 8 hex digits of uniqueness suffix */
+#define KEY_SIZE 32
+
+/* allocation counters */
+
+static uint64_t nallocs;
+static uint64_t nbytes;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+	nallocs++;
+	nbytes += size;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	nallocs++;
+	nbytes += nmemb * size;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	nallocs++;
+	nbytes += size;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+	__libc_free(ptr);
+}
+#endif
+
+/* measurements */
+
+static const char *filter = NULL;
+static int64_t t0;
+static uint64_t allocs0, bytes0;
+
+static int64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* name is a benchmark name, or a space separated list of them */
+static int enabled(const char *name) {
+	return filter == NULL || strstr(name, filter) != NULL;
+}
+
+static void measure_start(void) {
+	allocs0 = nallocs;
+	bytes0 = nbytes;
+	t0 = now_ns();
+}
+
+static void measure_end(const char *name, unsigned ops) {
+	int64_t t = now_ns() - t0;
+	uint64_t allocs = nallocs - allocs0, bytes = nbytes - bytes0;
+
+	if (!enabled(name)) {
+		return;
+	}
+	printf("%-16s %10u %12.1f %12.2f %12.1f\n", name, ops,
+			(double)t / ops, (double)allocs / ops, (double)bytes / ops);
+}
+
+/* keys */
+
+enum key_dist {KEYS_NUMERIC, KEYS_PUSHID, KEYS_RANDOM};
+
+static uint64_t rng_state;
+
+static uint64_t rng(void) {
+	/* xorshift64* */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+static const char push_chars[] = "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+
+/* 8 characters of timestamp, then 12 random characters, like the push ids */
+static void make_push_id(uint64_t ts, char *id) {
+	int i;
+
+	for (i = 7 ; i >= 0 ; i--) {
+		id[i] = push_chars[ts % 64];
+		ts /= 64;
+	}
+	for (i = 8 ; i < 20 ; i++) {
+		id[i] = push_chars[rng() % 64];
+	}
+	id[20] = '\0';
+}
+
+static char **make_keys(unsigned n, enum key_dist dist) {
+	char **keys = malloc(n * sizeof(*keys));
+	uint64_t ts = 1500000000000ULL;
+	unsigned i, j, len;
+
+	for (i = 0 ; i < n ; i++) {
+		keys[i] = malloc(KEY_SIZE);
+		switch (dist) {
+		case KEYS_NUMERIC:
+			snprintf(keys[i], KEY_SIZE, "%u", i);
+			break;
+		case KEYS_PUSHID:
+			ts += rng() % 3;
+			make_push_id(ts, keys[i]);
+			break;
+		case KEYS_RANDOM:
+			len = 4 + (unsigned)(rng() % 16);
+			for (j = 0 ; j < len ; j++) {
+				keys[i][j] = push_chars[1 + rng() % 63];
+			}
+			/* unique */
+			snprintf(keys[i] + len, KEY_SIZE - len, "%x", i);
+			break;
+		}
+	}
+	return keys;
+}
+
+static char **shuffled(char **keys, unsigned n) {
+	char **ret = malloc(n * sizeof(*ret)), *tmp;
+	unsigned i, j;
+
+	memcpy(ret, keys, n * sizeof(*ret));
+	for (i = n - 1 ; i > 0 ; i--) {
+		j = (unsigned)(rng() % (i + 1));
+		tmp = ret[i];
+		ret[i] = ret[j];
+		ret[j] = tmp;
+	}
+	return ret;
+}
+
+/* avl */
+
+struct bench_elem {
+	char *key;
+	unsigned value;
+};
+
+static int elem_cmp(void *a, void *b) {
+	return strcmp(((struct bench_elem *)a)->key, ((struct bench_elem *)b)->key);
+}
+
+static void elem_copy(void *from, void *to) {
+	*(struct bench_elem *)to = *(struct bench_elem *)from;
+}
+
+static size_t elem_size(UNUSED_PARAM(void *data)) {
+	return sizeof(struct bench_elem);
+}
+
+static void elem_cleanup(UNUSED_PARAM(void *data)) {
+	/* the keys are not owned by the avl */
+}
+
+static void bench_avl(char **keys, char **random, unsigned n) {
+	struct bench_elem e = {.value = 0};
+	struct avl_it it;
+	avl_t *avl;
+	unsigned i;
+
+	avl = avl_new(elem_cmp, elem_copy, elem_size, elem_cleanup);
+	measure_start();
+	for (i = 0 ; i < n ; i++) {
+		e.key = keys[i];
+		avl_insert(avl, &e);
+	}
+	measure_end("avl_insert", n);
+
+	measure_start();
+	for (i = 0 ; i < n ; i++) {
+		e.key = random[i];
+		if (avl_get(avl, &e) == NULL) {
+			abort();
+		}
+	}
+	measure_end("avl_get", n);
+
+	measure_start();
+	i = 0;
+	for (avl_it_start(&it, avl) ; avl_it_has_next(&it) ; avl_it_next(&it)) {
+		i++;
+	}
+	measure_end("avl_iterate", i);
+
+	measure_start();
+	for (i = 0 ; i < n ; i++) {
+		e.key = random[i];
+		avl_remove(avl, &e);
+	}
+	measure_end("avl_remove", n);
+	if (avl_count(avl) != 0) {
+		abort();
+	}
+
+	avl_destroy(avl);
+}
+
+/* ht */
+
+static wc_hash_t key_hash(ht_key_t *key) {
+	return wc_djb2_hash(key);
+}
+
+static int key_eq(ht_key_t *a, ht_key_t *b) {
+	return strcmp(a, b) == 0;
+}
+
+static void bench_ht(char **keys, char **random, unsigned n) {
+	ht_iter_t it;
+	ht_t *ht;
+	unsigned i;
+
+	ht = ht_new(key_hash, key_eq, NULL, NULL);
+	measure_start();
+	for (i = 0 ; i < n ; i++) {
+		ht_insert(ht, keys[i], keys[i]);
+	}
+	measure_end("ht_insert", n);
+
+	measure_start();
+	for (i = 0 ; i < n ; i++) {
+		if (ht_get(ht, random[i]) == NULL) {
+			abort();
+		}
+	}
+	measure_end("ht_get", n);
+
+	measure_start();
+	i = 0;
+	for (ht_it_init(&it, ht) ; ht_it_fetch_next(&it) ; ) {
+		i++;
+	}
+	measure_end("ht_iterate", i);
+
+	measure_start();
+	for (i = 0 ; i < n ; i++) {
+		ht_remove(ht, random[i]);
+	}
+	measure_end("ht_remove", n);
+	if (ht_count(ht) != 0) {
+		abort();
+	}
+
+	ht_destroy(ht);
+}
+
+/* paths and keys */
+
+static volatile int sink;
+
+static void bench_key_cmp(char **keys, char **random, unsigned n) {
+	unsigned i;
+	int acc = 0;
+
+	measure_start();
+	for (i = 0 ; i < n ; i++) {
+		acc += wc_datasync_key_cmp(keys[i], random[i]) > 0;
+	}
+	measure_end("key_cmp", n);
+	sink = acc;
+}
+
+static void bench_path_parse(char **keys, char **random, unsigned n) {
+	char *paths = malloc((size_t)n * 64), *p;
+	char parsed_buf[PATH_STRUCT_MAX_SIZE];
+	struct wc_ds_path *parsed = (struct wc_ds_path *)parsed_buf;
+	unsigned i;
+
+	for (i = 0 ; i < n ; i++) {
+		snprintf(paths + (size_t)i * 64, 64, "/bench/%s/items/%s", keys[i], random[i]);
+	}
+
+	measure_start();
+	for (i = 0, p = paths ; i < n ; i++, p += 64) {
+		wc_datasync_path_parse(p, parsed);
+		wc_datasync_path_cleanup(parsed);
+	}
+	measure_end("path_parse", n);
+
+	free(paths);
+}
+
+/* cache */
+
+static wc_ds_path_t **make_paths(char **keys, unsigned n) {
+	wc_ds_path_t **paths = malloc(n * sizeof(*paths));
+	char path[64];
+	unsigned i;
+
+	for (i = 0 ; i < n ; i++) {
+		snprintf(path, sizeof(path), "/bench/%s", keys[i]);
+		paths[i] = wc_datasync_path_new(path);
+	}
+	return paths;
+}
+
+static void destroy_paths(wc_ds_path_t **paths, unsigned n) {
+	unsigned i;
+
+	for (i = 0 ; i < n ; i++) {
+		wc_datasync_path_destroy(paths[i]);
+	}
+	free(paths);
+}
+
+static void bench_cache(char **keys, unsigned n) {
+	wc_ds_path_t **paths, *bench_path;
+	json_object *value, **objects;
+	struct treenode *root;
+	data_cache_t *cache;
+	char *json;
+	unsigned i;
+	int len;
+
+	paths = make_paths(keys, n);
+	value = json_object_new_int(42);
+
+	if (enabled("cache_set_ex")) {
+		cache = data_cache_new();
+		measure_start();
+		for (i = 0 ; i < n ; i++) {
+			data_cache_set_ex(cache, paths[i], value);
+		}
+		measure_end("cache_set_ex", n);
+		data_cache_destroy(cache);
+	}
+
+	if (enabled("cache_merge_ex")) {
+		objects = malloc(n * sizeof(*objects));
+		for (i = 0 ; i < n ; i++) {
+			objects[i] = json_object_new_object();
+			json_object_object_add(objects[i], keys[i], json_object_new_int((int32_t)i));
+		}
+		bench_path = wc_datasync_path_new("/bench");
+		cache = data_cache_new();
+		measure_start();
+		for (i = 0 ; i < n ; i++) {
+			data_cache_merge_ex(cache, bench_path, objects[i]);
+		}
+		measure_end("cache_merge_ex", n);
+		data_cache_destroy(cache);
+		wc_datasync_path_destroy(bench_path);
+		for (i = 0 ; i < n ; i++) {
+			json_object_put(objects[i]);
+		}
+		free(objects);
+	}
+
+	/* tree of n leaves under /bench */
+	cache = data_cache_new();
+	for (i = 0 ; i < n ; i++) {
+		data_cache_set_ex(cache, paths[i], value);
+	}
+	root = data_cache_get(cache, "/bench");
+
+	if (enabled("hash_cold")) {
+		measure_start();
+		treenode_hash_get(root);
+		measure_end("hash_cold", n + 1);
+	}
+
+	if (enabled("hash_update")) {
+		treenode_hash_get(root);
+		len = n < HASH_UPDATES ? (int)n : HASH_UPDATES;
+		measure_start();
+		for (i = 0 ; i < (unsigned)len ; i++) {
+			/* scattered over the tree */
+			data_cache_set_ex(cache, paths[(uint64_t)i * 7919 % n], value);
+			root = data_cache_get(cache, "/bench");
+			treenode_hash_get(root);
+		}
+		measure_end("hash_update", (unsigned)len);
+	}
+
+	if (enabled("to_json")) {
+		root = data_cache_get(cache, "/bench");
+		measure_start();
+		len = treenode_to_json_len(root);
+		json = malloc((size_t)len + 1);
+		treenode_to_json(root, json);
+		measure_end("to_json", n + 1);
+		free(json);
+	}
+
+	data_cache_destroy(cache);
+	json_object_put(value);
+	destroy_paths(paths, n);
+}
+
+int main(int argc, char *argv[]) {
+	enum key_dist dist = KEYS_PUSHID;
+	unsigned n = 100000, seed = 1;
+	char **keys, **random;
+	int opt;
+	unsigned i;
+
+	while ((opt = getopt(argc, argv, "n:k:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = (unsigned)atoi(optarg);
+			break;
+		case 'k':
+			if (strcmp(optarg, "numeric") == 0) {
+				dist = KEYS_NUMERIC;
+			} else if (strcmp(optarg, "pushid") == 0) {
+				dist = KEYS_PUSHID;
+			} else if (strcmp(optarg, "random") == 0) {
+				dist = KEYS_RANDOM;
+			} else {
+				fprintf(stderr, "unknown key distribution \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			seed = (unsigned)atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n SIZE] [-k numeric|pushid|random] [-s seed] [filter]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc) {
+		filter = argv[optind];
+	}
+	if (n < 2) {
+		n = 2;
+	}
+
+	rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+	keys = make_keys(n, dist);
+	random = shuffled(keys, n);
+
+	printf("%u %s keys\n", n, dist == KEYS_NUMERIC ? "numeric" : dist == KEYS_PUSHID ? "push id" : "random");
+	printf("%-16s %10s %12s %12s %12s\n", "benchmark", "ops", "ns/op", "allocs/op", "bytes/op");
+
+	if (enabled("avl_insert avl_get avl_iterate avl_remove")) {
+		bench_avl(keys, random, n);
+	}
+	if (enabled("ht_insert ht_get ht_iterate ht_remove")) {
+		bench_ht(keys, random, n);
+	}
+	if (enabled("key_cmp")) {
+		bench_key_cmp(keys, random, n);
+	}
+	if (enabled("path_parse")) {
+		bench_path_parse(keys, random, n);
+	}
+	if (enabled("cache_set_ex cache_merge_ex hash_cold hash_update to_json")) {
+		bench_cache(keys, n);
+	}
+
+	for (i = 0 ; i < n ; i++) {
+		free(keys[i]);
+	}
+	free(keys);
+	free(random);
+
+	return 0;
+}
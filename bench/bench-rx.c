@@ -0,0 +1,178 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * large frame reception benchmark: json-c parser vs streaming parser
+ *
+ * a data update push of about SIZE megabytes is fed to the parser in
+ * fragments of the size libwebsockets hands them over (rx_buffer_size), then
+ * applied to a cache:
+ * - json-c: wc_datasync_parse_msg_ex() + data_cache_set(), the default path
+ * - stream: rx_stream_feed() + rx_stream_finish() + data_cache_set_tree(),
+ *   the path taken with the rx_streaming context option
+ * each mode runs in its own process so that the peak RSS can be measured
+ *
+ * usage: webcom-bench-rx [SIZE in MB] [fragment size in bytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "webcom-c/webcom.h"
+#include "../lib/datasync/rx_stream.h"
+#include "../lib/datasync/cache/treenode_cache.h"
+
+static char *message;
+static size_t message_len;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static long max_rss_kb(void) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+static void make_message(size_t size) {
+	size_t n = 0, i = 0, cap = size + 1024;
+	int w;
+
+	message = malloc(cap);
+	n += (size_t)sprintf(message, "{\"t\":\"d\",\"d\":{\"a\":\"d\",\"b\":{\"p\":\"/bench\",\"d\":{");
+	while (n < size) {
+		w = snprintf(message + n, cap - n,
+				"%s\"k%07zu\":{\"name\":\"item number %zu\",\"n\":%zu.5,\"ok\":true,\"tags\":[\"a\",\"b\",null]}",
+				i ? "," : "", i, i, i * 7);
+		n += (size_t)w;
+		i++;
+	}
+	n += (size_t)sprintf(message + n, "}}}}");
+	message_len = n;
+}
+
+static int run_jsonc(data_cache_t *cache, size_t frag) {
+	wc_parser_t *parser = wc_datasync_parser_new();
+	size_t off, n;
+	wc_msg_t msg;
+	int ret = 1;
+
+	for (off = 0 ; off < message_len ; off += n) {
+		n = message_len - off < frag ? message_len - off : frag;
+		switch (wc_datasync_parse_msg_ex(parser, message + off, n, &msg)) {
+		case WC_PARSER_OK:
+			data_cache_set(cache, msg.u.data.u.push.u.update_put.path, msg.u.data.u.push.u.update_put.data);
+			wc_datasync_msg_free(&msg);
+			ret = 0;
+			break;
+		case WC_PARSER_CONTINUE:
+			break;
+		case WC_PARSER_ERROR:
+			goto end;
+		}
+	}
+end:
+	wc_datasync_parser_free(parser);
+	return ret;
+}
+
+static int run_stream(data_cache_t *cache, size_t frag) {
+	struct rx_stream s;
+	struct rx_tree *trees;
+	unsigned ntrees, i;
+	size_t off, n, used;
+	wc_msg_t msg;
+	int ret = 1;
+
+	rx_stream_init(&s);
+	for (off = 0 ; off < message_len ; off += used) {
+		n = message_len - off < frag ? message_len - off : frag;
+		switch (rx_stream_feed(&s, message + off, n, &used)) {
+		case WC_PARSER_OK:
+			if (rx_stream_finish(&s, &msg, &trees, &ntrees)) {
+				for (i = 0 ; i < ntrees ; i++) {
+					data_cache_set_tree(cache, trees[i].path, trees[i].tree);
+					trees[i].tree = NULL;
+				}
+				rx_trees_free(trees, ntrees);
+				wc_datasync_msg_free(&msg);
+				ret = 0;
+			}
+			break;
+		case WC_PARSER_CONTINUE:
+			break;
+		case WC_PARSER_ERROR:
+			goto end;
+		}
+	}
+end:
+	rx_stream_cleanup(&s);
+	return ret;
+}
+
+static void bench(const char *name, int (*run)(data_cache_t *, size_t), size_t size, size_t frag) {
+	data_cache_t *cache;
+	long rss_before;
+	double t;
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		make_message(size);
+		cache = data_cache_new();
+		rss_before = max_rss_kb();
+		t = now();
+		if (run(cache, frag) != 0) {
+			fprintf(stderr, "%s: parse error\n", name);
+			_exit(1);
+		}
+		t = now() - t;
+		printf("%-8s %8.3f s   %8.1f MB/s   peak RSS %8ld kB   (+%ld kB)\n",
+				name, t, (double)message_len / t / 1e6, max_rss_kb(), max_rss_kb() - rss_before);
+		fflush(stdout);
+		_exit(0);
+	}
+	waitpid(pid, &status, 0);
+}
+
+int main(int argc, char *argv[]) {
+	size_t size = (size_t)((argc > 1 ? atof(argv[1]) : 50.) * 1e6);
+	size_t frag = argc > 2 ? (size_t)atol(argv[2]) : 4096;
+
+	wc_set_log_level(WC_LOG_ALL, WC_LOG_ERR);
+
+	printf("data update push of %zu bytes, %zu bytes fragments\n", size, frag);
+	bench("json-c", run_jsonc, size, frag);
+	bench("stream", run_stream, size, frag);
+
+	return 0;
+}
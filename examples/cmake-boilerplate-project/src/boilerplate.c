@@ -121,11 +121,15 @@ void webcom_service_cb(wc_event_t event, wc_context_t *cnx, void *data,
 			 *
 			 * if (msg->type == WC_MSG_DATA
 			 *     && msg->u.data.type == WC_DATA_MSG_PUSH
-			 *     && msg->u.data.u.push.type == WC_PUSH_DATA_UPDATE_PUT)
+			 *     && msg->u.data.u.push.type == WC_PUSH_DATA_UPDATE_PUT
+			 *     && msg->u.data.u.push.u.update_put.data != NULL)
 			 * {
 			 *     do_something_with_the(msg->u.data.u.push.u.update_put.data);
 			 * }
 			 *
+			 * (the data is NULL with the rx_streaming or parse_threads
+			 * options, use wc_datasync_on_value() to get it then)
+			 *
 			 */
 			break;
 		case WC_EVENT_ON_CNX_CLOSED:
@@ -88,17 +88,26 @@ typedef struct wc_auth_context wc_auth_context_t;
 enum wc_pollsrc {
 	WC_POLL_DATASYNC,           //!< the event relates to the datasync socket
 	WC_POLL_AUTH,               //!< the event relates to the authentication socket
+	WC_POLL_SUBMIT,             //!< the event relates to the wake up descriptor of the cross-thread submission queue
+	WC_POLL_WORKERS,            //!< the event relates to the wake up descriptor of the parser threads
 
 	_WC_POLL_MAX /* keep last *///!< special value, holds the actual number of possible socket event sources
 };
 
 /**
  * the origin of a timer event
+ *
+ * All the timers of a context (keepalive, reconnection, authentication
+ * requests, deferred data events, ...) are multiplexed by the SDK in an
+ * internal timer wheel, that needs a single event loop timer: WC_TIMER_MUX.
+ * The other values are kept for the code written against the SDK 2.0 API,
+ * the SDK does not request such timers anymore.
  */
 enum wc_timersrc {
-	WC_TIMER_DATASYNC_KEEPALIVE, //!< the event relates to the datasync socket keepalive
-	WC_TIMER_DATASYNC_RECONNECT, //!< the event relates to the datasync reconnection timer
-	WC_TIMER_AUTH,               //!< the event relates to the authentication HTTP request handling
+	WC_TIMER_DATASYNC_KEEPALIVE, //!< @deprecated not used anymore, multiplexed in WC_TIMER_MUX
+	WC_TIMER_DATASYNC_RECONNECT, //!< @deprecated not used anymore, multiplexed in WC_TIMER_MUX
+	WC_TIMER_AUTH,               //!< @deprecated not used anymore, multiplexed in WC_TIMER_MUX
+	WC_TIMER_MUX,                //!< the event relates to the internal timer wheel of the context
 
 	_WC_TIMER_MAX /* keep last *///!< special value, holds the actual number of possible timers
 };
@@ -150,8 +159,9 @@ typedef enum {
 	/**
 	 * This event instructs that a timer whose properties are passed in data as
 	 * a pointer to a `struct wc_timerargs` object must be set and armed. When
-	 * the timer fires, you must call the wc_handle_timer() function, with the
-	 * appropriate wc_timersrc argument set.
+	 * the timer fires, you must call the wc_dispatch_timer_event() function,
+	 * with the appropriate wc_timersrc argument set. If the timer is already
+	 * armed, it must be re-armed with the new delay.
 	 */
 	WC_EVENT_SET_TIMER,                               //!< WC_EVENT_SET_TIMER
 	/**
@@ -171,7 +181,8 @@ typedef enum {
 	/**
 	 * This event indicates that the webcom server has sent its handshake
 	 * message. From this point, it's safe to start sending requests to the
-	 * webcom server through this connection.
+	 * webcom server through this connection. The writes queued offline, or
+	 * logged in the journal, are already sent when this event is triggered.
 	 *
 	 * Return 1 to trigger automatic reconnection.
 	 */
@@ -189,6 +200,24 @@ typedef enum {
 	 * Return 1 to trigger automatic reconnection.
 	 */
 	WC_EVENT_ON_CNX_ERROR,                            //!< WC_EVENT_ON_CNX_ERROR
+	/**
+	 * This event indicates that the outbound queue of the connection has
+	 * reached its high watermark (see `tx_high_watermark` in
+	 * wc_context_options): the socket does not keep up with the requests, and
+	 * the requests are rejected until the queue is drained. The current queue
+	 * statistics are passed in data as a pointer to a
+	 * `struct wc_datasync_tx_stats`.
+	 */
+	WC_EVENT_ON_TX_BACKPRESSURE,                      //!< WC_EVENT_ON_TX_BACKPRESSURE
+	/**
+	 * This event indicates that the outbound queue has been drained below half
+	 * of its high watermark after a WC_EVENT_ON_TX_BACKPRESSURE event, and that
+	 * requests are accepted again. The current queue statistics are passed in
+	 * data as a pointer to a `struct wc_datasync_tx_stats`. This event is not
+	 * sent if the connection is closed in the meantime, the queue is then
+	 * discarded.
+	 */
+	WC_EVENT_ON_TX_DRAINED,                           //!< WC_EVENT_ON_TX_DRAINED
 
 	/* Authentication */
 
@@ -213,6 +242,27 @@ typedef enum {
  */
 typedef int (*wc_on_event_cb_t) (wc_event_t event, wc_context_t *ctx, void *data, size_t len);
 
+/**
+ * durability policy of the write-ahead journal (see `journal_path` in
+ * `struct wc_context_options`)
+ */
+enum wc_journal_sync {
+	WC_JOURNAL_SYNC_BATCHED, //!< the records are written and synced to disk by groups, at most `journal_commit_interval_ms` after being logged (the default)
+	WC_JOURNAL_SYNC_ALWAYS,  //!< each record is written and synced to disk as soon as it is logged
+	WC_JOURNAL_SYNC_NONE,    //!< the records are written by groups but never explicitly synced to disk
+};
+
+/**
+ * randomization of the delays between the automatic reconnection attempts, so
+ * that the clients disconnected at the same time (e.g. by a server restart) do
+ * not reconnect in synchronized waves
+ */
+enum wc_backoff_jitter {
+	WC_BACKOFF_JITTER_FULL,         //!< each delay is uniformly distributed between 0 and the exponential delay (the default)
+	WC_BACKOFF_JITTER_DECORRELATED, //!< each delay is uniformly distributed between `reconnect_initial_ms` and the previous delay times `reconnect_multiplier`
+	WC_BACKOFF_JITTER_NONE,         //!< the delays are exactly exponential, the first attempt is immediate
+};
+
 struct wc_context_options {
 	char *app_name;
 	char *host;
@@ -220,6 +270,35 @@ struct wc_context_options {
 	wc_on_event_cb_t callback;
 	int no_tls;
 	void *user_data;
+	unsigned dispatch_budget_callbacks; //!< max data event callbacks per event loop iteration, 0 for no limit
+	unsigned dispatch_budget_us;        //!< max time in data event callbacks per iteration (us), 0 for no limit
+	unsigned dispatch_backlog_max;      //!< max queued data events, 0 for the default (4096)
+	size_t tx_high_watermark;           //!< max bytes in the outbound queue, 0 for the default (1 MiB)
+	int offline_writes;                 //!< if not 0, the writes issued while disconnected are queued
+	size_t offline_max_bytes;           //!< max bytes of queued offline writes, 0 for no limit
+	unsigned offline_max_count;         //!< max number of queued offline writes, 0 for no limit
+	int optimistic_writes;              //!< if not 0, the writes are applied to the local cache right away
+	unsigned request_timeout_ms;        //!< default deadline of the requests (ms), 0 for none
+	char *journal_path;                 //!< path of the write-ahead journal, NULL for none
+	enum wc_journal_sync journal_sync;  //!< durability policy of the journal
+	unsigned journal_commit_interval_ms;//!< max delay before writing the journal records (ms), 0 for the default (10 ms)
+	char *cache_snapshot_path;          //!< path of the cache snapshot, NULL for none
+	unsigned cache_snapshot_interval_ms;//!< period of the cache snapshot saves (ms), 0 for none
+	unsigned listen_burst;              //!< max listen/unlisten requests sent at once, 0 for the default (32)
+	unsigned reconnect_initial_ms;      //!< base reconnection delay (ms), 0 for the default (1000 ms)
+	double reconnect_multiplier;        //!< growth factor of the reconnection delay, 0 for the default (2)
+	unsigned reconnect_max_ms;          //!< max reconnection delay (ms), 0 for the default (256 s)
+	enum wc_backoff_jitter reconnect_jitter; //!< randomization of the reconnection delays
+	unsigned reconnect_stable_ms;       //!< age of a stable connection (ms), 0 for the default (30 s)
+	int ws_deflate;                     //!< if not 0, offer the permessage-deflate extension
+	unsigned ws_deflate_window_bits;    //!< compression window size (9 to 15), 0 for the default (15)
+	int ws_deflate_level;               //!< compression level (1 to 9), 0 for the default
+	unsigned submit_queue_size;         //!< slots of the cross-thread submission queue, 0 to disable it
+	unsigned parse_threads;             //!< number of parser threads, 0 to parse on the event loop thread
+	size_t parse_offload_bytes;         //!< min size of the offloaded messages, 0 for the default (64 KiB)
+	size_t rx_buffer_size;              //!< size of the receive buffer, 0 for the default (4 KiB)
+	int rx_streaming;                   //!< if not 0, the messages are parsed as they are received
+	int binary_framing;                 //!< if not 0, ask the server for the CBOR framing
 };
 
 /**
@@ -259,7 +338,58 @@ void *wc_context_get_user_data(wc_context_t *ctx);
  * creates a Webcom context
  *
  * This function creates and initializes a new Webcom context using the
- * given options.
+ * given options. The fields left to 0 keep the default behaviour:
+ *
+ * - **dispatch_budget_callbacks**, **dispatch_budget_us**: the data events are
+ *   queued, then delivered within this budget per event loop iteration (see
+ *   wc_on_priority); above **dispatch_backlog_max** queued events, the oldest
+ *   ones are delivered regardless of the budget.
+ * - **tx_high_watermark**: the requests are rejected while the outbound
+ *   queue holds more bytes than this.
+ * - **offline_writes**: the puts, merges and on disconnect requests issued
+ *   while disconnected are queued (consecutive puts to the same path being
+ *   collapsed), up to **offline_max_bytes** and **offline_max_count**, and
+ *   sent once reconnected.
+ * - **optimistic_writes**: the puts and merges are applied to the local cache,
+ *   and the data event callbacks called, right away; they are rolled back if
+ *   the server rejects them.
+ * - **request_timeout_ms**: the requests not answered in time fail with the
+ *   WC_REQ_REASON_TIMEOUT reason.
+ * - **journal_path**: the puts and merges are logged in this write-ahead
+ *   journal, the ones not answered when the process stopped are issued again
+ *   once connected; see wc_journal_sync for **journal_sync** and
+ *   **journal_commit_interval_ms**.
+ * - **cache_snapshot_path**: the local data cache is loaded from this file
+ *   when the datasync service is initialized, and saved when the context is
+ *   destroyed, and every **cache_snapshot_interval_ms** from the event loop
+ *   thread (see wc_datasync_cache_save()).
+ * - **listen_burst**: the next listen/unlisten requests are sent once the
+ *   outbound queue is empty.
+ * - **reconnect_initial_ms**, **reconnect_multiplier**, **reconnect_max_ms**,
+ *   **reconnect_jitter**: the delay before the second reconnection attempt
+ *   (the first one is immediate, or jittered), multiplied after each failed
+ *   attempt, up to the max; a connection lost after **reconnect_stable_ms**
+ *   starts over from the first attempt.
+ * - **ws_deflate**: the permessage-deflate websocket extension compresses the
+ *   messages in both directions; smaller **ws_deflate_window_bits** use less
+ *   memory but compress less, **ws_deflate_level** is the zlib level of the
+ *   sent messages.
+ * - **submit_queue_size**: enables the cross-thread submission queue (see
+ *   wc_datasync_submit_put()) with at least this number of slots.
+ * - **parse_threads**: the received messages of at least
+ *   **parse_offload_bytes** are parsed, and turned into cache trees, by these
+ *   threads; they are still handled in the order they were received.
+ * - **rx_buffer_size**: the max size of the fragments in which the messages
+ *   are received.
+ * - **rx_streaming**: the messages are parsed as their fragments are
+ *   received, straight into cache trees, and never held in memory as a whole.
+ *   With **rx_streaming** or **parse_threads**, the `data` field of the data
+ *   update pushes is NULL in the WC_EVENT_ON_MSG_RECEIVED event.
+ * - **binary_framing**: the messages are CBOR encoded (see
+ *   wc_datasync_msg_to_cbor()) and sent in binary websocket frames, if the
+ *   server sends its handshake in a binary frame; this needs a compatible
+ *   server.
+ *
  * @param options a pointer to a wc_context_options structure with each
  * field set to the desired value
  * @return a pointer to the context (it's an opaque structure)
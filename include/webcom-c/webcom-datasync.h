@@ -85,6 +85,144 @@ void wc_datasync_connect(wc_context_t *ctx);
  */
 void wc_datasync_close_cnx(wc_context_t *ctx);
 
+/**
+ * Statistics about the outbound queue of a datasync connection
+ *
+ * The requests are not written to the socket right away, they are queued and
+ * written one frame at a time whenever the socket is writable. The depth of
+ * the queue tells how far behind the socket the application is.
+ */
+struct wc_datasync_tx_stats {
+	unsigned depth;          //!< current number of frames waiting to be written
+	size_t bytes;            //!< current number of bytes waiting to be written
+	unsigned max_depth;      //!< highest number of waiting frames observed
+	size_t max_bytes;        //!< highest number of waiting bytes observed
+	size_t high_watermark;   //!< max number of waiting bytes, above which requests are rejected
+	uint64_t frames_sent;    //!< number of frames written so far
+	uint64_t bytes_sent;     //!< number of bytes written so far
+	uint64_t partial_writes; //!< number of frames the socket did not accept in one go (libwebsockets buffers the remainder)
+	uint64_t rejected;       //!< number of requests rejected because the queue (or the offline queue) was full
+	unsigned offline_depth;  //!< current number of write requests waiting for the connection to be established
+	size_t offline_bytes;    //!< current number of bytes waiting for the connection to be established
+	uint64_t collapsed;      //!< number of offline puts replaced by a later put to the same path
+};
+
+/**
+ * Gets the statistics of the outbound queue of the datasync connection
+ *
+ * @param ctx the context
+ * @param stats a pointer to a structure that will be filled with the current
+ * statistics
+ */
+void wc_datasync_get_tx_stats(wc_context_t *ctx, struct wc_datasync_tx_stats *stats);
+
+/**
+ * statistics of the websocket compression (see `ws_deflate` in
+ * `struct wc_context_options`)
+ */
+struct wc_datasync_compression_stats {
+	int active;             //!< 1 if the permessage-deflate extension was negotiated for the current connection
+	uint64_t tx_bytes;      //!< number of message bytes sent so far, before compression
+	uint64_t rx_bytes;      //!< number of message bytes received so far, after decompression
+	uint64_t tx_wire_bytes; //!< number of bytes sent (and acknowledged) on the TCP connections so far, including the websocket and TLS overhead, 0 if not supported by the system
+	uint64_t rx_wire_bytes; //!< number of bytes received on the TCP connections so far, 0 if not supported by the system
+};
+
+/**
+ * Gets the statistics of the websocket compression
+ *
+ * The ratio of the message bytes and the wire bytes gives the effective
+ * compression, the wire bytes being counted with or without the
+ * permessage-deflate extension.
+ *
+ * @param ctx the context
+ * @param stats a pointer to a structure that will be filled with the current
+ * statistics
+ */
+void wc_datasync_get_compression_stats(wc_context_t *ctx, struct wc_datasync_compression_stats *stats);
+
+/**
+ * statistics of the parser threads (see `parse_threads` in
+ * `struct wc_context_options`)
+ */
+struct wc_datasync_parse_stats {
+	uint64_t offloaded;       //!< number of messages parsed by the parser threads
+	uint64_t offloaded_bytes; //!< number of bytes of these messages
+	uint64_t deferred;        //!< number of small messages that had to wait for a previous message being parsed by a thread
+	unsigned pending;         //!< current number of received messages not handled yet
+	unsigned max_pending;     //!< highest number of received messages not handled yet observed
+};
+
+/**
+ * Gets the statistics of the parser threads
+ *
+ * All the fields are 0 if the parser threads are disabled.
+ *
+ * @param ctx the context
+ * @param stats a pointer to a structure that will be filled with the current
+ * statistics
+ */
+void wc_datasync_get_parse_stats(wc_context_t *ctx, struct wc_datasync_parse_stats *stats);
+
+/**
+ * statistics of the listen and unlisten requests queued by the SDK
+ */
+struct wc_datasync_listen_stats {
+	unsigned queued;         //!< current number of listen/unlisten requests waiting to be sent
+	uint64_t listens_sent;   //!< number of listen requests sent so far
+	uint64_t unlistens_sent; //!< number of unlisten requests sent so far
+	uint64_t deduplicated;   //!< number of requests never sent because they were cancelled by a later request on the same path (e.g. a listen followed by an unlisten)
+	unsigned resume_total;   //!< number of listen requests queued by the last reconnection
+	unsigned resume_sent;    //!< how many of them were sent so far
+};
+
+/**
+ * Gets the statistics of the listen and unlisten requests
+ *
+ * The listen and unlisten requests are queued and sent by bursts of at most
+ * `listen_burst` requests, the next burst being sent once the outbound queue
+ * is empty. A listen request followed by an unlisten request of the same path
+ * before being sent cancel each other.
+ *
+ * @param ctx the context
+ * @param stats a pointer to a structure that will be filled with the current
+ * statistics
+ */
+void wc_datasync_get_listen_stats(wc_context_t *ctx, struct wc_datasync_listen_stats *stats);
+
+/**
+ * Saves the contents of the local data cache in a binary snapshot file
+ *
+ * The snapshot is written to a temporary file, synced, and renamed to `path`,
+ * so that an existing snapshot is replaced atomically. This is done
+ * synchronously, and the sync to disk can block the calling thread for a
+ * while (typically milliseconds, more on a loaded disk): avoid saving often
+ * from the event loop thread.
+ *
+ * Only the data confirmed by the server is saved: while some optimistic writes
+ * (see `optimistic_writes` in wc_context_options) are not answered, the
+ * snapshot is not saved and -1 is returned.
+ *
+ * @param ctx the context
+ * @param path the path of the snapshot file
+ * @return 0 on success, -1 on error
+ */
+int wc_datasync_cache_save(wc_context_t *ctx, const char *path);
+
+/**
+ * Replaces the contents of the local data cache with a snapshot saved by
+ * wc_datasync_cache_save()
+ *
+ * The snapshot is verified before being loaded, the cache is left untouched if
+ * it is corrupted. The value event callbacks registered on any path are
+ * called.
+ *
+ * @param ctx the context
+ * @param path the path of the snapshot file
+ * @return 0 on success, -1 on error
+ */
+int wc_datasync_cache_load(wc_context_t *ctx, const char *path);
+
 /**
  * @}
  */
@@ -0,0 +1,148 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef INCLUDE_WEBCOM_C_WEBCOM_EPOLL_H_
+#define INCLUDE_WEBCOM_C_WEBCOM_EPOLL_H_
+
+#include "webcom-config.h"
+
+#ifdef WITH_EPOLL
+
+#include "webcom-eli.h"
+
+/**
+ * @ingroup webcom-epoll
+ * @{
+ * Built-in Linux event loop, based on epoll and timerfd.
+ *
+ * This event loop does not depend on any third-party library. It can drive
+ * any number of Webcom contexts, as well as the application's own file
+ * descriptors (see wc_loop_add_fd()). The datasync sockets are watched in
+ * edge-triggered mode, and all the events returned by one `epoll_wait()` call
+ * are dispatched before waiting again.
+ *
+ * 	@code{c}
+ * 	wc_loop_t *loop = wc_loop_new();
+ * 	wc_context_t *ctx = wc_context_create_with_epoll(&options, loop, &callbacks);
+ * 	wc_datasync_connect(ctx);
+ * 	wc_loop_run(loop);
+ * 	@endcode
+ */
+
+typedef struct wc_loop wc_loop_t;
+
+/**
+ * callback of the file descriptors added with wc_loop_add_fd()
+ *
+ * @param loop the loop
+ * @param fd the file descriptor
+ * @param events the events that occurred (WC_POLL* macros)
+ * @param data the data passed to wc_loop_add_fd()
+ */
+typedef void (*wc_loop_fd_cb_t)(wc_loop_t *loop, int fd, short events, void *data);
+
+/**
+ * Creates an event loop
+ *
+ * @return the loop, or NULL on error
+ */
+wc_loop_t *wc_loop_new(void);
+
+/**
+ * Destroys an event loop
+ *
+ * The contexts created for this loop must be destroyed before.
+ *
+ * @param loop the loop
+ */
+void wc_loop_destroy(wc_loop_t *loop);
+
+/**
+ * Create a webcom context using the built-in epoll event loop.
+ *
+ * This function creates a new Webcom context, whose I/O and timer events will
+ * be taken care of by the given loop. The context is destroyed with
+ * wc_context_destroy(), as usual.
+ *
+ * @param options a pointer to a structure bearing the connection informations
+ * @param loop a loop created with wc_loop_new()
+ * @param callbacks a structure containing the callbacks to trigger for various
+ * events
+ * @return a pointer to the newly created context on success, NULL on
+ * failure to create the context
+ */
+wc_context_t *wc_context_create_with_epoll(struct wc_context_options *options, wc_loop_t *loop, struct wc_eli_callbacks *callbacks);
+
+/**
+ * Watches a file descriptor of the application (level-triggered)
+ *
+ * @param loop the loop
+ * @param fd the file descriptor
+ * @param events the events to watch (WC_POLLIN and/or WC_POLLOUT)
+ * @param cb the function called when some events occur
+ * @param data some data passed to `cb`
+ * @return 0 on success, -1 on error
+ */
+int wc_loop_add_fd(wc_loop_t *loop, int fd, short events, wc_loop_fd_cb_t cb, void *data);
+
+/**
+ * Stops watching a file descriptor added with wc_loop_add_fd()
+ *
+ * @param loop the loop
+ * @param fd the file descriptor
+ * @return 0 on success, -1 if the file descriptor was not watched
+ */
+int wc_loop_del_fd(wc_loop_t *loop, int fd);
+
+/**
+ * Waits for some events and dispatches them
+ *
+ * @param loop the loop
+ * @param timeout_ms the max time to wait, in milliseconds, -1 to wait
+ * indefinitely
+ * @return the number of events dispatched, -1 on error
+ */
+int wc_loop_run_once(wc_loop_t *loop, int timeout_ms);
+
+/**
+ * Runs the loop until wc_loop_break() is called, or there is nothing to watch
+ * any more
+ *
+ * @param loop the loop
+ * @return 0 on success, -1 on error
+ */
+int wc_loop_run(wc_loop_t *loop);
+
+/**
+ * Makes wc_loop_run() return after the current iteration
+ *
+ * @param loop the loop
+ */
+void wc_loop_break(wc_loop_t *loop);
+
+/**
+ * @}
+ */
+
+#endif /* WITH_EPOLL */
+
+#endif /* INCLUDE_WEBCOM_C_WEBCOM_EPOLL_H_ */
@@ -28,6 +28,7 @@
 #ifdef WITH_LIBUV
 
 #include "webcom-eli.h"
+#include "webcom-utils.h"
 
 #include <uv.h>
 
@@ -46,6 +47,21 @@
  * @note this function is partly synchronous and returns once the DNS lookup
  * and TCP handshake have succeeded or failed.
  *
+ * @param options a pointer to a structure bearing the connection informations
+ * @param loop a pointer to a libuv loop object
+ * @param callbacks a structure containing the callbacks to trigger for various
+ * events
+ * @return a pointer to the newly created connection on success, NULL on
+ * failure to create the context
+ */
+wc_context_t *wc_context_create_with_libuv(struct wc_context_options *options, uv_loop_t *loop, struct wc_eli_callbacks *callbacks);
+
+/**
+ * Create a webcom context using libuv, with the default options.
+ *
+ * @deprecated use wc_context_create_with_libuv(), this function is kept for the
+ * code written against the SDK 2.0 API
+ *
  * @param host the webcom server host name
  * @param port the webcom server port
  * @param application the name of the webcom application to tie to (e.g.
@@ -56,7 +72,7 @@
  * @return a pointer to the newly created connection on success, NULL on
  * failure to create the context
  */
-wc_context_t *wc_context_new_with_libuv(char *host, uint16_t port, char *application, uv_loop_t *loop, struct wc_eli_callbacks *callbacks);
+wc_context_t *wc_context_new_with_libuv(char *host, uint16_t port, char *application, uv_loop_t *loop, struct wc_eli_callbacks *callbacks) WC_DEPRECATED;
 
 /**
  * @}
@@ -23,6 +23,7 @@
 #ifndef WEBCOM_MSG_H_
 #define WEBCOM_MSG_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -69,6 +70,7 @@ typedef struct {
 typedef struct {
 	char *path;
 	void *query_ids;
+	char *hash;
 } wc_action_listen_t;
 
 typedef struct {
@@ -126,14 +128,19 @@ typedef struct {
 	char *path;
 } wc_push_listen_revoked_t;
 
+/**
+ * With the `rx_streaming` or `parse_threads` context options, the data of the
+ * pushes goes straight into the cache: `data` is then NULL, read the value
+ * from the cache (e.g. with wc_datasync_on_value()) instead.
+ */
 typedef struct {
 	char *path;
-	char *data;
+	char *data; /* NULL if parsed into the cache, see above */
 } wc_push_data_update_put_t;
 
 typedef struct {
 	char *path;
-	char *data;
+	char *data; /* NULL if parsed into the cache, see above */
 } wc_push_data_update_merge_t;
 
 typedef struct {
@@ -222,6 +229,22 @@ void wc_datasync_msg_free(wc_msg_t *msg);
  */
 char *wc_datasync_msg_to_json_str(wc_msg_t *msg);
 
+/**
+ * makes a CBOR (RFC 7049) representation of a Webcom message
+ *
+ * This is the encoding of the binary framing of the datasync protocol (see
+ * the `binary_framing` context option): the same document as
+ * wc_datasync_msg_to_json_str(), with the JSON values mapped to their CBOR
+ * counterparts.
+ *
+ * @param msg the webcom message
+ * @param[out] len the length of the CBOR data
+ *
+ * @return a newly malloc'd buffer (must be manually free'd after use), or
+ * NULL if out of memory
+ */
+unsigned char *wc_datasync_msg_to_cbor(wc_msg_t *msg, size_t *len);
+
 /**
  * @}
  */
@@ -69,11 +69,80 @@ enum on_event_type {
 	/* update the ON_EVENT_TYPE_COUNT macro if you add new events */
 };
 
+/**
+ * Priority classes of the data event callbacks.
+ *
+ * The data events are not delivered directly to the callbacks: they are first
+ * queued, then delivered in priority order (and in arrival order within a
+ * given class), within the per event loop iteration budget set by the
+ * `dispatch_budget_callbacks` and `dispatch_budget_us` fields of
+ * `wc_context_options`. When the budget is exhausted, the SDK yields to the
+ * event loop and delivers the remaining events on the next iteration.
+ *
+ * Consecutive **ON_VALUE** events that are still queued for a given
+ * subscription are merged: only the latest value is delivered.
+ */
+enum wc_on_priority {
+	WC_ON_PRIORITY_HIGH,   //!< delivered first
+	WC_ON_PRIORITY_NORMAL, //!< the default priority
+	WC_ON_PRIORITY_LOW,    //!< delivered once no other event is pending
+
+	_WC_ON_PRIORITY_COUNT /* keep last */
+};
+
+/**
+ * Statistics about the data event callbacks scheduling
+ */
+struct wc_on_dispatch_stats {
+	unsigned depth[_WC_ON_PRIORITY_COUNT]; //!< current number of queued events, per priority class
+	unsigned max_depth;                    //!< highest number of queued events observed
+	uint64_t delivered;                    //!< number of callbacks called so far
+	uint64_t coalesced;                    //!< number of ON_VALUE events merged in an already queued one
+	uint64_t yields;                       //!< number of times the budget was exhausted
+	uint64_t overflows;                    //!< number of events delivered ahead of the budget because the backlog was full
+	uint64_t latency_avg_us;               //!< average time spent in the queue, in microseconds
+	uint64_t latency_max_us;               //!< maximum time spent in the queue, in microseconds
+};
+
+/**
+ * Delivery rate options of a subscription, for data that changes much more
+ * often than the application needs to be notified.
+ *
+ * The intermediate states of the data that are suppressed by these options
+ * are skipped entirely: they are neither hashed nor serialized.
+ *
+ * If several subscriptions are registered on the same path, the least
+ * restrictive options apply to all of them.
+ */
+struct wc_on_options {
+	/**
+	 * minimum interval between two deliveries, in milliseconds (0 for no
+	 * limit): the first change is delivered right away, the following ones
+	 * are suppressed until the interval has elapsed
+	 */
+	unsigned min_interval_ms;
+	/**
+	 * debounce window, in milliseconds (0 for none): a change is only
+	 * delivered once the data has not changed for this duration. If
+	 * `min_interval_ms` is also set, it bounds the time a delivery can be
+	 * postponed.
+	 */
+	unsigned debounce_ms;
+	/**
+	 * if non-zero, the latest suppressed state is delivered at the end of the
+	 * interval or debounce window, otherwise it is dropped (and the debounce
+	 * window delivers the first change of a burst instead of the last one)
+	 */
+	int trailing;
+};
+
 /**
  * Registers a callback to monitor any change in the data under the given path.
  * When this method is called, the callback will be called once with the
  * current value of the database at the given path, and will be called again
- * each time a change occurs at this path.
+ * each time a change occurs at this path. If a dispatch budget is set, or if
+ * some data events are still queued, this first call is queued as well and
+ * happens on a later event loop iteration.
  * @param ctx the Webcom context
  * @param path the path
  * @param callback the callback
@@ -81,6 +150,16 @@ enum on_event_type {
  */
 on_handle_t wc_datasync_on_value(wc_context_t *ctx, char *path, on_callback_f callback);
 
+/**
+ * Same as wc_datasync_on_value(), with delivery rate options.
+ * @param ctx the Webcom context
+ * @param path the path
+ * @param callback the callback
+ * @param options the delivery rate options, or NULL for none
+ * @return the subscription handle
+ */
+on_handle_t wc_datasync_on_value_ex(wc_context_t *ctx, char *path, on_callback_f callback, struct wc_on_options *options);
+
 /**
  * Registers a callback to monitor the apparition of a new key at the given
  * node (path).
@@ -94,6 +173,16 @@ on_handle_t wc_datasync_on_value(wc_context_t *ctx, char *path, on_callback_f ca
  */
 on_handle_t wc_datasync_on_child_added(wc_context_t *ctx, char *path, on_callback_f callback);
 
+/**
+ * Same as wc_datasync_on_child_added(), with delivery rate options.
+ * @param ctx the Webcom context
+ * @param path the path
+ * @param callback the callback
+ * @param options the delivery rate options, or NULL for none
+ * @return the subscription handle
+ */
+on_handle_t wc_datasync_on_child_added_ex(wc_context_t *ctx, char *path, on_callback_f callback, struct wc_on_options *options);
+
 /**
  * Registers a callback to monitor the modification of a child element of the
  * given path.
@@ -106,6 +195,16 @@ on_handle_t wc_datasync_on_child_added(wc_context_t *ctx, char *path, on_callbac
  */
 on_handle_t wc_datasync_on_child_changed(wc_context_t *ctx, char *path, on_callback_f callback);
 
+/**
+ * Same as wc_datasync_on_child_changed(), with delivery rate options.
+ * @param ctx the Webcom context
+ * @param path the path
+ * @param callback the callback
+ * @param options the delivery rate options, or NULL for none
+ * @return the subscription handle
+ */
+on_handle_t wc_datasync_on_child_changed_ex(wc_context_t *ctx, char *path, on_callback_f callback, struct wc_on_options *options);
+
 /**
  * Registers a callback to monitor the deletion of a child element of the given
  * path.
@@ -118,6 +217,16 @@ on_handle_t wc_datasync_on_child_changed(wc_context_t *ctx, char *path, on_callb
  */
 on_handle_t wc_datasync_on_child_removed(wc_context_t *ctx, char *path, on_callback_f callback);
 
+/**
+ * Same as wc_datasync_on_child_removed(), with delivery rate options.
+ * @param ctx the Webcom context
+ * @param path the path
+ * @param callback the callback
+ * @param options the delivery rate options, or NULL for none
+ * @return the subscription handle
+ */
+on_handle_t wc_datasync_on_child_removed_ex(wc_context_t *ctx, char *path, on_callback_f callback, struct wc_on_options *options);
+
 /**
  * Gets the path associated to a subscription handle
  * @param h the handle
@@ -132,6 +241,22 @@ char *wc_datasync_on_handle_get_path(on_handle_t h);
  */
 wc_context_t *wc_datasync_on_handle_get_ctx(on_handle_t h);
 
+/**
+ * Sets the priority class of a subscription (**WC_ON_PRIORITY_NORMAL** by
+ * default)
+ * @param h the subscription handle
+ * @param priority the priority class
+ */
+void wc_datasync_on_set_priority(on_handle_t h, enum wc_on_priority priority);
+
+/**
+ * Gets the statistics of the data event callbacks scheduling
+ * @param ctx the webcom context
+ * @param stats a pointer to a structure that will be filled with the current
+ * statistics
+ */
+void wc_datasync_on_get_dispatch_stats(wc_context_t *ctx, struct wc_on_dispatch_stats *stats);
+
 /**
  * Unsubscribes and deletes a subscription
  * @param h the subscription handle
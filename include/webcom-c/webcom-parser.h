@@ -88,6 +88,21 @@ const char *wc_datasync_parser_get_error(wc_parser_t *parser);
  */
 int wc_datasync_parse_msg(char *str, wc_msg_t *res);
 
+/**
+ * Parses a CBOR encoded webcom message.
+ *
+ * This function parses a complete message received in a binary frame (see
+ * the `binary_framing` context option) and populates the wc_msg_t object
+ * given as parameter.
+ *
+ * @param buf       the CBOR data
+ * @param len       the length of the CBOR data
+ * @param[out] res  the wc_msg_t object to populate
+ *
+ * @return 1 on success, 0 on error
+ */
+int wc_datasync_parse_msg_cbor(const void *buf, size_t len, wc_msg_t *res);
+
 /**
  * Frees a wc_parser_t object previously allocated by wc_parser_new()
  *
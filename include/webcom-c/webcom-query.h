@@ -0,0 +1,147 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef INCLUDE_WEBCOM_C_WEBCOM_QUERY_H_
+#define INCLUDE_WEBCOM_C_WEBCOM_QUERY_H_
+
+#include "webcom-base.h"
+#include "webcom-on.h"
+
+/**
+ * @addtogroup webcom-query
+ * @{
+ * This set of functions runs queries over the children of a node of the local
+ * data cache: the children can be ordered by key or by the value of one of
+ * their own children (e.g. "lastSeen"), restricted to a range of keys or
+ * values, and limited to the first or last N results.
+ *
+ * The local cache only holds the data under the paths that are watched (see
+ * wc_datasync_on_value()), queries never trigger any network activity.
+ *
+ * Ordering by a child value is done according to the type of the values,
+ * then their value:
+ *
+ * 1. children that lack the ordering value (or whose value is null),
+ * 2. `false`, then `true`,
+ * 3. numbers, in ascending order,
+ * 4. strings, in lexicographical order,
+ * 5. objects.
+ *
+ * The children that have equal values are ordered by key.
+ *
+ * The children containers keep the size of their subtrees, so that the range
+ * bounds, the offset and the limits are resolved by position in O(log n),
+ * whatever the number of children.
+ *
+ * Ordering by a child value is done by sorting the children each time the
+ * query runs, unless an index was declared on this child for this path using
+ * wc_datasync_index_add(). Indexes are maintained incrementally as the cache
+ * is updated.
+ */
+
+/**
+ * how the children are ordered by a query
+ */
+enum wc_query_order {
+	WC_QUERY_ORDER_BY_KEY,   //!< order by key
+	WC_QUERY_ORDER_BY_CHILD, //!< order by the value of a child of each child
+};
+
+/**
+ * Description of a query.
+ *
+ * The bounds are plain keys when ordering by key, and JSON scalar values when
+ * ordering by a child value, e.g.: `"42"`, `"\"foo\""`, `"true"`, `"null"`.
+ */
+struct wc_query {
+	enum wc_query_order order_by; //!< the ordering of the children
+	char *child;                  //!< the path of the ordering value, relative to each child, if ordering by child (e.g. "lastSeen" or "stats/score")
+	char *start_at;               //!< lower bound (inclusive), NULL for none
+	char *end_at;                 //!< upper bound (inclusive), NULL for none
+	char *equal_to;               //!< if not NULL, sets both bounds to this value
+	unsigned offset;              //!< number of results to skip, from the start of the range
+	unsigned limit_to_first;      //!< if not 0, only keep the first N results
+	unsigned limit_to_last;       //!< if not 0, only keep the last N results (ignored if limit_to_first is set)
+};
+
+/**
+ * Runs a query over the children of the given path in the local cache.
+ *
+ * @param ctx the webcom context
+ * @param path the path of the node whose children are queried
+ * @param query the query
+ * @return a JSON array of `[key, value]` pairs, in the query order, that must
+ * be freed by the caller, or NULL if the query is invalid
+ */
+char *wc_datasync_query(wc_context_t *ctx, char *path, struct wc_query *query);
+
+/**
+ * Registers a callback on the result of a query.
+ *
+ * When this method is called, the callback will be called once with the
+ * current result of the query (formatted as for wc_datasync_query()), and will
+ * be called again each time the result changes. Changes of the data under the
+ * path that don't affect the result of the query don't trigger the callback.
+ *
+ * The callback is called as an **ON_VALUE** callback, the returned handle can
+ * be used with the other **wc_datasync_on_XXX()** and **wc_datasync_off()**
+ * functions.
+ *
+ * @param ctx the webcom context
+ * @param path the path of the node whose children are queried
+ * @param query the query, it is copied and can be released once this
+ * function returns
+ * @param callback the callback
+ * @param options the delivery rate options, or NULL for none
+ * @return the subscription handle, or NULL if the query is invalid
+ */
+on_handle_t wc_datasync_on_query(wc_context_t *ctx, char *path, struct wc_query *query, on_callback_f callback, struct wc_on_options *options);
+
+/**
+ * Declares an index on a child value of the children of a path.
+ *
+ * The queries on this path ordered by this child will use the index instead
+ * of sorting the children. Declaring the same index several times requires as
+ * many calls to wc_datasync_index_remove().
+ *
+ * @param ctx the webcom context
+ * @param path the path of the node whose children are indexed
+ * @param child the path of the indexed value, relative to each child
+ * @return 0 on success, -1 on error
+ */
+int wc_datasync_index_add(wc_context_t *ctx, char *path, char *child);
+
+/**
+ * Removes an index declared with wc_datasync_index_add().
+ *
+ * @param ctx the webcom context
+ * @param path the path of the node whose children are indexed
+ * @param child the path of the indexed value, relative to each child
+ * @return 0 on success, -1 if there is no such index
+ */
+int wc_datasync_index_remove(wc_context_t *ctx, char *path, char *child);
+
+/**
+ * @}
+ */
+
+#endif /* INCLUDE_WEBCOM_C_WEBCOM_QUERY_H_ */
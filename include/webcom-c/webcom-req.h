@@ -28,6 +28,13 @@
 
 typedef enum {WC_REQ_OK, WC_REQ_ERROR} wc_req_pending_result_t;
 
+/** reason of a request that failed because it was not answered in time */
+#define WC_REQ_REASON_TIMEOUT "timeout"
+/** reason of a request that failed because the connection was lost */
+#define WC_REQ_REASON_DISCONNECTED "disconnected"
+/** reason of a deferred request that could not be sent */
+#define WC_REQ_REASON_NOT_SENT "not_sent"
+
 /**
  * @ingroup webcom-requests
  * @{
@@ -113,6 +120,24 @@ int64_t wc_datasync_push(wc_context_t *cnx, char *path, char *json, wc_on_req_re
  */
 int64_t wc_datasync_listen(wc_context_t *cnx, char *path, wc_on_req_result_t callback, void *user);
 
+/**
+ * sends a listen request carrying the hash of the locally known data
+ *
+ * This function behaves like wc_datasync_listen(), but the request carries the
+ * hash of the data the client already has at this path. If the data on the
+ * server has the same hash, the server does not send it again.
+ *
+ * @param cnx the webcom connection
+ * @param path a string representing the path to listen to
+ * @param hash the hash of the locally known data at this path, NULL for none
+ * @param callback callback that will be called when the status of the request
+ * is sent back from the server
+ * @param user a custom pointer that will be passed to the callback
+ *
+ * @return the listen request id (>0) if it was sent successfully, -1 otherwise
+ */
+int64_t wc_datasync_listen_hash(wc_context_t *cnx, char *path, char *hash, wc_on_req_result_t callback, void *user);
+
 /**
  * sends a un-listen request to the webcom server and get notified of the status
  *
@@ -201,6 +226,196 @@ int64_t wc_datasync_on_disc_merge(wc_context_t *cnx, char *path, char *json, wc_
  */
 int64_t wc_datasync_on_disc_cancel(wc_context_t *cnx, char *path, wc_on_req_result_t callback, void *user);
 
+/**
+ * sets the deadline of a pending request
+ *
+ * If the server has not answered the request when the deadline expires, the
+ * request callback is called with the WC_REQ_ERROR status and the
+ * WC_REQ_REASON_TIMEOUT reason. Note that the request may still have been
+ * processed by the server, unless it was waiting in the offline queue: it is
+ * then dropped and will not be sent once the connection is back.
+ *
+ * A default deadline can be set for all requests with the
+ * `request_timeout_ms` context option.
+ *
+ * @param cnx the webcom connection
+ * @param id the request id
+ * @param ms the deadline, in milliseconds from now, or 0 to remove it
+ * @return 0 on success, -1 if there is no such pending request
+ */
+int wc_datasync_req_set_timeout(wc_context_t *cnx, int64_t id, unsigned ms);
+
+/**
+ * opaque type of a batch of write operations
+ */
+typedef struct wc_batch wc_batch_t;
+
+/**
+ * Statistics about the batches of write operations
+ */
+struct wc_datasync_batch_stats {
+	uint64_t committed;       //!< number of committed batches
+	uint64_t folded;          //!< number of batches sent as a single merge request
+	uint64_t ops;             //!< number of operations in the committed batches
+	uint64_t requests;        //!< number of requests sent for the committed batches
+	uint64_t bytes;           //!< size of the JSON data of the committed batches
+	uint64_t completed;       //!< number of batches whose result is known
+	uint64_t failed;          //!< number of completed batches that failed
+	uint64_t latency_last_us; //!< time between the commit and the result of the last completed batch, in microseconds
+	uint64_t latency_avg_us;  //!< average time between the commit and the result of a batch, in microseconds
+	uint64_t latency_max_us;  //!< maximum time between the commit and the result of a batch, in microseconds
+};
+
+/**
+ * starts a batch of write operations
+ *
+ * The operations added to the batch with wc_datasync_batch_put() and
+ * wc_datasync_batch_merge() are only sent by wc_datasync_batch_commit(), with
+ * a single result notification for the whole batch.
+ *
+ * If all the operations are puts to the children of a common ancestor, or
+ * merges on this ancestor, the batch is sent as a single merge request on this
+ * ancestor, which the server applies atomically. Otherwise the operations are
+ * sent in order, as separate requests.
+ *
+ * @param cnx the webcom connection
+ * @return the batch, or NULL in case of allocation failure
+ */
+wc_batch_t *wc_datasync_batch_begin(wc_context_t *cnx);
+
+/**
+ * adds a put operation to a batch
+ *
+ * @param batch the batch
+ * @param path a string representing the path of the data
+ * @param json a string containing the JSON-encoded data to store at the given
+ * path
+ * @return 0 on success, -1 otherwise
+ */
+int wc_datasync_batch_put(wc_batch_t *batch, char *path, char *json);
+
+/**
+ * adds a merge operation to a batch
+ *
+ * @param batch the batch
+ * @param path a string representing the path of the data
+ * @param json a string containing the JSON-encoded object to merge at the
+ * given path
+ * @return 0 on success, -1 otherwise
+ */
+int wc_datasync_batch_merge(wc_batch_t *batch, char *path, char *json);
+
+/**
+ * sends all the operations of a batch, and frees it
+ *
+ * The callback is called once, when the result of all the requests of the
+ * batch is known: it gets WC_REQ_OK if they all succeeded, or WC_REQ_ERROR
+ * with the reason of the first failure. The data parameter is only set if the
+ * batch was sent as a single request.
+ *
+ * @param batch the batch
+ * @param callback callback that will be called with the result of the batch
+ * @param user a custom pointer that will be passed to the callback
+ * @return the id of the first request of the batch (>0) if it was sent
+ * successfully, -1 otherwise
+ */
+int64_t wc_datasync_batch_commit(wc_batch_t *batch, wc_on_req_result_t callback, void *user);
+
+/**
+ * discards a batch without sending it
+ *
+ * @param batch the batch
+ */
+void wc_datasync_batch_abort(wc_batch_t *batch);
+
+/**
+ * gets the statistics about the batches of write operations
+ *
+ * @param cnx the webcom connection
+ * @param stats a pointer to a structure that will be filled with the current
+ * statistics
+ */
+void wc_datasync_batch_get_stats(wc_context_t *cnx, struct wc_datasync_batch_stats *stats);
+
+/**
+ * Statistics about the cross-thread submission queue
+ */
+struct wc_datasync_submit_stats {
+	uint64_t submitted; //!< number of commands accepted in the queue
+	uint64_t rejected;  //!< number of commands refused because the queue was full
+	uint64_t executed;  //!< number of commands executed by the event loop thread
+	uint64_t batches;   //!< number of times the queue was drained
+	unsigned max_batch; //!< highest number of commands executed in one batch
+};
+
+/**
+ * submits a put request from any thread
+ *
+ * Unlike the other **wc_datasync_XXX()** functions, that must be called on
+ * the thread running the event loop of the context, the
+ * **wc_datasync_submit_XXX()** functions can be called from any thread, without
+ * any locking. They require the `submit_queue_size` context option to be set,
+ * and must not be called before wc_datasync_init() has returned, or after
+ * wc_context_destroy() was called.
+ *
+ * The path and data are copied in a command, that is queued in a bounded
+ * lock-free ring. The event loop is then woken through a file descriptor that
+ * the SDK asks to watch with the **WC_EVENT_ADD_FD** event (the
+ * **WC_POLL_SUBMIT** source), and executes the queued commands in batches, in
+ * submission order. The callback is called on the event loop thread.
+ *
+ * @param cnx the webcom connection
+ * @param path a string representing the path of the data
+ * @param json a string containing the JSON-encoded data to store at the given
+ * path
+ * @param callback callback that will be called on the event loop thread with
+ * the result of the request, can be NULL
+ * @param user a custom pointer that will be passed to the callback
+ * @return 0 if the command was queued, -1 if the queue is full or not enabled
+ */
+int wc_datasync_submit_put(wc_context_t *cnx, const char *path, const char *json, wc_on_req_result_t callback, void *user);
+
+/**
+ * submits a merge request from any thread
+ *
+ * See wc_datasync_submit_put().
+ *
+ * @param cnx the webcom connection
+ * @param path a string representing the path of the data
+ * @param json a string containing the JSON-encoded object to merge at the
+ * given path
+ * @param callback callback that will be called on the event loop thread with
+ * the result of the request, can be NULL
+ * @param user a custom pointer that will be passed to the callback
+ * @return 0 if the command was queued, -1 if the queue is full or not enabled
+ */
+int wc_datasync_submit_merge(wc_context_t *cnx, const char *path, const char *json, wc_on_req_result_t callback, void *user);
+
+/**
+ * submits a push request from any thread
+ *
+ * See wc_datasync_submit_put(). The push id is generated when the command is
+ * executed.
+ *
+ * @param cnx the webcom connection
+ * @param path a string representing the path of the parent of the new node
+ * @param json a string containing the JSON-encoded data of the new node
+ * @param callback callback that will be called on the event loop thread with
+ * the result of the request, can be NULL
+ * @param user a custom pointer that will be passed to the callback
+ * @return 0 if the command was queued, -1 if the queue is full or not enabled
+ */
+int wc_datasync_submit_push(wc_context_t *cnx, const char *path, const char *json, wc_on_req_result_t callback, void *user);
+
+/**
+ * gets the statistics about the cross-thread submission queue
+ *
+ * @param cnx the webcom connection
+ * @param stats a pointer to a structure that will be filled with the current
+ * statistics
+ */
+void wc_datasync_submit_get_stats(wc_context_t *cnx, struct wc_datasync_submit_stats *stats);
+
 /**
  * @}
  */
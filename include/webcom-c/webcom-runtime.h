@@ -0,0 +1,175 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef INCLUDE_WEBCOM_C_WEBCOM_RUNTIME_H_
+#define INCLUDE_WEBCOM_C_WEBCOM_RUNTIME_H_
+
+#include "webcom-config.h"
+
+#ifdef WITH_EPOLL
+
+#include "webcom-epoll.h"
+#include "webcom-req.h"
+#include "webcom-on.h"
+
+/**
+ * @ingroup webcom-runtime
+ * @{
+ * Multi-threaded runtime, for applications that handle many Webcom contexts.
+ *
+ * A runtime starts a number of worker threads (the "shards"), each one pinned
+ * to a CPU core and running its own built-in event loop (see
+ * @ref webcom-epoll). The contexts created with wc_runtime_context_create()
+ * are spread over the shards: all the processing of a context (I/O, parsing,
+ * cache updates, callbacks) happens on the thread of its shard, so the
+ * contexts of different shards are processed in parallel.
+ *
+ * A Webcom context is not thread-safe: the only functions that can be called
+ * on a context of a runtime from another thread than its shard's are the
+ * wc_runtime_XXX() ones below. They copy their arguments, and queue the
+ * operation to the shard, where it is executed in submission order. All the
+ * callbacks (event loop callbacks, request results, data events) are called
+ * on the shard's thread, where any Webcom function can be used.
+ *
+ * 	@code{c}
+ * 	static void connect(wc_context_t *ctx, void *data) {
+ * 		wc_datasync_connect(ctx);
+ * 	}
+ *
+ * 	wc_runtime_t *rt = wc_runtime_new(0);
+ * 	for (i = 0 ; i < ntenants ; i++) {
+ * 		ctx[i] = wc_runtime_context_create(rt, &options[i], &callbacks);
+ * 		wc_runtime_call(ctx[i], connect, NULL);
+ * 	}
+ * 	// from any thread:
+ * 	wc_runtime_put(ctx[0], "/foo", "{\"bar\":42}", NULL, NULL);
+ * 	@endcode
+ */
+
+typedef struct wc_runtime wc_runtime_t;
+
+/**
+ * function called on the shard of a context by wc_runtime_call()
+ * @param ctx the context
+ * @param data the data passed to wc_runtime_call()
+ */
+typedef void (*wc_runtime_call_f)(wc_context_t *ctx, void *data);
+
+/**
+ * Starts a runtime
+ * @param nshards the number of worker threads, 0 for one per available CPU
+ * core
+ * @return the runtime, or NULL on error
+ */
+wc_runtime_t *wc_runtime_new(unsigned nshards);
+
+/**
+ * Stops a runtime
+ * The contexts still attached to the runtime are destroyed, then the worker
+ * threads are stopped and joined. This function must not be called from a
+ * shard's thread.
+ * @param rt the runtime
+ */
+void wc_runtime_destroy(wc_runtime_t *rt);
+
+/**
+ * Gets the number of shards of a runtime
+ * @param rt the runtime
+ * @return the number of worker threads
+ */
+unsigned wc_runtime_shard_count(wc_runtime_t *rt);
+
+/**
+ * Creates a Webcom context on one of the shards of a runtime
+ * The shards are assigned in a round robin fashion. This function can be
+ * called from any thread, it returns once the context is created.
+ * @param rt the runtime
+ * @param options a pointer to a structure bearing the connection informations
+ * @param callbacks the event loop callbacks, they will be called on the
+ * shard's thread
+ * @return a pointer to the newly created context on success, NULL on
+ * failure to create the context
+ */
+wc_context_t *wc_runtime_context_create(wc_runtime_t *rt, struct wc_context_options *options, struct wc_eli_callbacks *callbacks);
+
+/**
+ * Destroys a context created with wc_runtime_context_create()
+ * The context is destroyed asynchronously on its shard, after the operations
+ * submitted before. It must not be used any more once this function returns.
+ * @param ctx the context
+ */
+void wc_runtime_context_destroy(wc_context_t *ctx);
+
+/**
+ * Calls a function on the shard of a context
+ * @param ctx the context
+ * @param fn the function
+ * @param data some data passed to `fn`
+ * @return 0 on success, -1 on error
+ */
+int wc_runtime_call(wc_context_t *ctx, wc_runtime_call_f fn, void *data);
+
+/**
+ * Submits a wc_datasync_put() call to the shard of a context
+ * @param ctx the context
+ * @param path the path
+ * @param json the data, as a JSON string
+ * @param callback the function called on the shard's thread with the result
+ * of the request, or with WC_REQ_REASON_NOT_SENT if it could not be sent,
+ * can be NULL
+ * @param user some user data passed to `callback`
+ * @return 0 on success, -1 on error
+ */
+int wc_runtime_put(wc_context_t *ctx, const char *path, const char *json, wc_on_req_result_t callback, void *user);
+
+/**
+ * Submits a wc_datasync_merge() call to the shard of a context
+ * @param ctx the context
+ * @param path the path
+ * @param json the data, as a JSON string
+ * @param callback the function called on the shard's thread with the result
+ * of the request, or with WC_REQ_REASON_NOT_SENT if it could not be sent,
+ * can be NULL
+ * @param user some user data passed to `callback`
+ * @return 0 on success, -1 on error
+ */
+int wc_runtime_merge(wc_context_t *ctx, const char *path, const char *json, wc_on_req_result_t callback, void *user);
+
+/**
+ * Submits a wc_datasync_on_XXX() call to the shard of a context
+ * The subscription handle is passed to the callback, which can return 0 to
+ * cancel it.
+ * @param ctx the context
+ * @param type the type of event
+ * @param path the path
+ * @param callback the callback, called on the shard's thread
+ * @return 0 on success, -1 on error
+ */
+int wc_runtime_on(wc_context_t *ctx, enum on_event_type type, const char *path, on_callback_f callback);
+
+/**
+ * @}
+ */
+
+#endif /* WITH_EPOLL */
+
+#endif /* INCLUDE_WEBCOM_C_WEBCOM_RUNTIME_H_ */
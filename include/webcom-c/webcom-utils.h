@@ -60,6 +60,12 @@
 
 #define WC_INLINE __attribute__((always_inline)) inline
 
+/**
+ * marks a function of the API as deprecated, the compiler warns about its
+ * uses
+ */
+#define WC_DEPRECATED __attribute__ ((deprecated))
+
 /**
  * @}
  */
@@ -122,11 +122,14 @@
  *
  * 	@defgroup webcom-base			Create a base context without libev (the hard way)
  * 	@defgroup webcom-libev			Create a base context with libev (the easy way)
+ * 	@defgroup webcom-epoll			Create a base context with the built-in epoll event loop (Linux only)
+ * 	@defgroup webcom-runtime		Spread many contexts over several threads (Linux only)
  *	@defgroup webcom-log			Logging functions
  * 	@defgroup datasync				Interact with a Webcom datasync server
  * 	@{
  * 		@defgroup webcom-datasync-cnx	Control the websocket connection to the datasync server
  * 		@defgroup webcom-on				Access to the Webcom database and be notified of data changes
+ * 		@defgroup webcom-query			Query the children of a node of the local cache
  * 		@defgroup webcom-requests		Send requests: send data, subscribe to data change, ...
  * 	@}
  * 	@defgroup auth					Interact with a Webcom auth service
@@ -173,6 +176,7 @@
 #include "webcom-datasync.h"
 #include "webcom-req.h"
 #include "webcom-on.h"
+#include "webcom-query.h"
 
 /* Authentication */
 #include "webcom-auth.h"
@@ -212,22 +212,21 @@ static int curl_sock_cb(CURL *e, curl_socket_t s, int what, void *data, void *so
 	return 0;
 }
 
+static void auth_timer_cb(wc_context_t *ctx, UNUSED_PARAM(struct wc_timer *timer)) {
+	wc_auth_service(ctx, -1);
+}
+
 static int curl_timer_cb(CURLM *multi, long timeout_ms, void *userp) {
 	WL_DBG("timer request on %p: %ld ms", multi, timeout_ms);
 	int handles;
-	struct wc_timerargs wcta;
 	wc_context_t *ctx = userp;
 
 	if (timeout_ms == 0) {
 		curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &handles);
 	} else if (timeout_ms > 0) {
-		wcta.ms = timeout_ms;
-		wcta.repeat = 0;
-		wcta.timer = WC_TIMER_AUTH;
-		ctx->callback(WC_EVENT_SET_TIMER, ctx, &wcta, 0);
+		wc_timer_arm(ctx, &ctx->auth.timer, timeout_ms);
 	} else if (timeout_ms == -1) {
-		wcta.timer = WC_TIMER_AUTH;
-		ctx->callback(WC_EVENT_DEL_TIMER, ctx, &wcta.timer, 0);
+		wc_timer_cancel(ctx, &ctx->auth.timer);
 	}
 	return 0;
 }
@@ -249,6 +248,7 @@ int wc_auth_with_password(wc_context_t *ctx, const char *email, const char *pass
 
 	if (ctx->auth.auth_curl_multi_handle == NULL) {
 		ctx->auth.auth_curl_multi_handle = curl_multi_init();
+		wc_timer_init(&ctx->auth.timer, auth_timer_cb, NULL);
 
 		curl_multi_setopt(ctx->auth.auth_curl_multi_handle, CURLMOPT_SOCKETFUNCTION, curl_sock_cb);
 		curl_multi_setopt(ctx->auth.auth_curl_multi_handle, CURLMOPT_SOCKETDATA, ctx);
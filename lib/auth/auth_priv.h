@@ -26,6 +26,8 @@
 #include <curl/curl.h>
 #include <json-c/json.h>
 
+#include "../timer.h"
+
 struct wc_auth_context {
 	struct wc_context *webcom;
 	char *auth_url;
@@ -34,6 +36,7 @@ struct wc_auth_context {
 	json_tokener *auth_parser;
 	char auth_error[CURL_ERROR_SIZE];
 	char *auth_form_data;
+	struct wc_timer timer;
 };
 
 #endif /* LIB_AUTH_AUTH_PRIV_H_ */
@@ -0,0 +1,93 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include "backoff.h"
+
+/* xorshift64*, good enough to spread the clients over time */
+static uint64_t backoff_rand(struct wc_backoff *b) {
+	b->rand ^= b->rand >> 12;
+	b->rand ^= b->rand << 25;
+	b->rand ^= b->rand >> 27;
+	return b->rand * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniformly distributed in [lo, hi] */
+static unsigned backoff_between(struct wc_backoff *b, unsigned lo, unsigned hi) {
+	if (hi <= lo) {
+		return lo;
+	}
+	return lo + (unsigned)(backoff_rand(b) % ((uint64_t)hi - lo + 1));
+}
+
+void wc_backoff_init(struct wc_backoff *b, unsigned initial_ms, double multiplier, unsigned max_ms, enum wc_backoff_jitter jitter, uint64_t seed) {
+	b->initial_ms = initial_ms ? initial_ms : WC_BACKOFF_DEFAULT_INITIAL_MS;
+	b->multiplier = multiplier >= 1. ? multiplier : WC_BACKOFF_DEFAULT_MULTIPLIER;
+	b->max_ms = max_ms ? max_ms : WC_BACKOFF_DEFAULT_MAX_MS;
+	if (b->max_ms < b->initial_ms) {
+		b->max_ms = b->initial_ms;
+	}
+	b->jitter = jitter;
+	/* the state of xorshift must not be 0 */
+	b->rand = seed ? seed : 0x9e3779b97f4a7c15ULL;
+	wc_backoff_reset(b);
+}
+
+void wc_backoff_reset(struct wc_backoff *b) {
+	b->attempt = 0;
+	b->ceil_ms = b->initial_ms;
+	b->prev_ms = b->initial_ms;
+}
+
+/* returns the delay before the next attempt, in milliseconds */
+unsigned wc_backoff_next(struct wc_backoff *b) {
+	unsigned ret;
+	double hi;
+
+	if (b->attempt++ == 0) {
+		return b->jitter == WC_BACKOFF_JITTER_NONE ? 0 : backoff_between(b, 0, b->initial_ms);
+	}
+
+	switch (b->jitter) {
+	case WC_BACKOFF_JITTER_NONE:
+		ret = (unsigned)b->ceil_ms;
+		break;
+	case WC_BACKOFF_JITTER_DECORRELATED:
+		/* sleep = min(cap, random_between(base, sleep * multiplier)) */
+		hi = b->prev_ms * b->multiplier;
+		ret = backoff_between(b, b->initial_ms, hi < b->max_ms ? (unsigned)hi : b->max_ms);
+		b->prev_ms = ret;
+		break;
+	case WC_BACKOFF_JITTER_FULL:
+	default:
+		ret = backoff_between(b, 0, (unsigned)b->ceil_ms);
+		break;
+	}
+
+	if (b->ceil_ms < b->max_ms) {
+		b->ceil_ms *= b->multiplier;
+		if (b->ceil_ms > b->max_ms) {
+			b->ceil_ms = b->max_ms;
+		}
+	}
+
+	return ret;
+}
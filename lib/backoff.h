@@ -0,0 +1,58 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_BACKOFF_H_
+#define LIB_BACKOFF_H_
+
+#include <stdint.h>
+
+#include "webcom-c/webcom-base.h"
+
+#define WC_BACKOFF_DEFAULT_INITIAL_MS 1000
+#define WC_BACKOFF_DEFAULT_MULTIPLIER 2.
+#define WC_BACKOFF_DEFAULT_MAX_MS 256000
+#define WC_BACKOFF_DEFAULT_STABLE_MS 30000
+
+/*
+ * exponential backoff of the reconnection attempts
+ *
+ * The first attempt is immediate (or delayed by a random time up to
+ * `initial_ms` if some jitter is used), the following ones are delayed by
+ * `initial_ms`, `initial_ms * multiplier`, ... up to `max_ms`, each delay
+ * being randomized depending on the jitter policy.
+ */
+struct wc_backoff {
+	unsigned initial_ms;
+	unsigned max_ms;
+	double multiplier;
+	enum wc_backoff_jitter jitter;
+	unsigned attempt;  /* number of delays computed since the last reset */
+	double ceil_ms;    /* un-randomized delay of the next attempt */
+	unsigned prev_ms;  /* previous delay, for the decorrelated jitter */
+	uint64_t rand;     /* xorshift64* state */
+};
+
+void wc_backoff_init(struct wc_backoff *b, unsigned initial_ms, double multiplier, unsigned max_ms, enum wc_backoff_jitter jitter, uint64_t seed);
+void wc_backoff_reset(struct wc_backoff *b);
+unsigned wc_backoff_next(struct wc_backoff *b);
+
+#endif /* LIB_BACKOFF_H_ */
@@ -42,10 +42,13 @@
 
 #include "avl.h"
 
+/* every node records the number of nodes of its subtree, which gives
+ * O(log n) positional access (avl_nth(), avl_rank(), avl_it_start_nth()) */
 struct avl_node {
 	struct avl_node *l;
 	struct avl_node *r;
 	int height;
+	unsigned size;
 	unsigned char data[];
 };
 
@@ -83,7 +86,12 @@ unsigned avl_count(avl_t *avl) {
 	return avl->count;
 }
 
-static void avl_update_height(struct avl_node *n) {
+static inline unsigned avl_size(struct avl_node *n) {
+	return n ? n->size : 0;
+}
+
+static void avl_update(struct avl_node *n) {
+	n->size = avl_size(n->l) + avl_size(n->r) + 1;
 	n->height = 0;
 	if (n->l && n->l->height > n->height) {
 		n->height = n->l->height;
@@ -102,8 +110,8 @@ static struct avl_node *avl_rotl(struct avl_node *n) {
 	struct avl_node *r = n->r;
 	n->r = r->l;
 	r->l = n;
-	avl_update_height(n);
-	avl_update_height(r);
+	avl_update(n);
+	avl_update(r);
 	return r;
 }
 
@@ -111,8 +119,8 @@ static struct avl_node *avl_rotr(struct avl_node *n) {
 	struct avl_node *l = n->l;
 	n->l = l->r;
 	l->r = n;
-	avl_update_height(n);
-	avl_update_height(l);
+	avl_update(n);
+	avl_update(l);
 	return l;
 }
 
@@ -130,7 +138,7 @@ static struct avl_node *avl_balance(struct avl_node *n) {
 		}
 		return avl_rotr(n);
 	}
-	avl_update_height(n);
+	avl_update(n);
 	return n;
 }
 
@@ -142,6 +150,7 @@ static struct avl_node *avl_insert_rec(avl_key_cmp_f cmp, struct avl_node **root
 		*root = entry;
 		entry->l = entry->r = NULL;
 		entry->height = 1;
+		entry->size = 1;
 		*ins = 1;
 		return entry;
 	}
@@ -161,6 +170,60 @@ static struct avl_node *avl_insert_rec(avl_key_cmp_f cmp, struct avl_node **root
 	return node;
 }
 
+static struct avl_node *avl_build_rec(struct avl_node **nodes, unsigned lo, unsigned hi) {
+	struct avl_node *n;
+	unsigned mid;
+
+	if (lo >= hi) {
+		return NULL;
+	}
+
+	mid = lo + (hi - lo) / 2;
+	n = nodes[mid];
+	n->l = avl_build_rec(nodes, lo, mid);
+	n->r = avl_build_rec(nodes, mid + 1, hi);
+	avl_update(n);
+
+	return n;
+}
+
+int avl_bulk_load(avl_t *avl, void *sorted, size_t stride, unsigned n) {
+	struct avl_node **nodes;
+	unsigned char *data = sorted;
+	size_t size;
+	unsigned i;
+
+	if (avl->root != NULL) {
+		return -1;
+	} else if (n == 0) {
+		return 0;
+	}
+
+	nodes = malloc(n * sizeof(*nodes));
+	if (nodes == NULL) {
+		return -1;
+	}
+
+	for (i = 0 ; i < n ; i++) {
+		size = avl->data_size(data + i * stride);
+		nodes[i] = malloc(sizeof(**nodes) + size);
+		if (nodes[i] == NULL) {
+			while (i-- > 0) {
+				free(nodes[i]);
+			}
+			free(nodes);
+			return -1;
+		}
+		memcpy(nodes[i]->data, data + i * stride, size);
+	}
+
+	avl->root = avl_build_rec(nodes, 0, n);
+	avl->count = n;
+	free(nodes);
+
+	return 0;
+}
+
 void *avl_get(avl_t *avl, void *key) {
 	void *ret = NULL;
 	struct avl_node *n;
@@ -183,6 +246,41 @@ void *avl_get(avl_t *avl, void *key) {
 	return ret;
 }
 
+void *avl_nth(avl_t *avl, unsigned n) {
+	struct avl_node *cur = avl->root;
+	unsigned ls;
+
+	while (cur != NULL) {
+		ls = avl_size(cur->l);
+		if (n < ls) {
+			cur = cur->l;
+		} else if (n > ls) {
+			n -= ls + 1;
+			cur = cur->r;
+		} else {
+			return cur->data;
+		}
+	}
+
+	return NULL;
+}
+
+unsigned avl_rank(avl_t *avl, void *key) {
+	struct avl_node *cur = avl->root;
+	unsigned ret = 0;
+
+	while (cur != NULL) {
+		if (avl->key_cmp(key, cur->data) <= 0) {
+			cur = cur->l;
+		} else {
+			ret += avl_size(cur->l) + 1;
+			cur = cur->r;
+		}
+	}
+
+	return ret;
+}
+
 void *avl_insert(avl_t *avl, void *data) {
 	struct avl_node *ret = NULL;
 	int ins = 0;
@@ -201,6 +299,26 @@ void *avl_insert(avl_t *avl, void *data) {
 	return &ret->data;
 }
 
+void *avl_insert_move(avl_t *avl, void *data) {
+	struct avl_node *ret = NULL;
+	size_t size;
+	int ins = 0;
+
+	if (avl_get(avl, data)) {
+		return NULL;
+	}
+
+	size = avl->data_size(data);
+	ret = malloc(sizeof(*ret) + size);
+
+	memcpy(&ret->data, data, size);
+
+	avl_insert_rec(avl->key_cmp, &avl->root, ret, &ins);
+	avl->count++;
+
+	return &ret->data;
+}
+
 static struct avl_node *avl_movr(struct avl_node *n, struct avl_node *r) {
 	if (!n)
 		return r;
@@ -289,6 +407,36 @@ void avl_it_start_at(struct avl_it *it, avl_t *avl, void *key) {
 	}
 }
 
+void avl_it_start_nth(struct avl_it *it, avl_t *avl, unsigned n) {
+	struct avl_node *cur;
+	unsigned ls;
+
+	avl_it_init(it);
+
+	if (avl == NULL) {
+		return;
+	}
+
+	cur = avl->root;
+
+	while (cur != NULL) {
+		it->_c = cur;
+		it->_rt = it->__rt;
+		ls = avl_size(cur->l);
+		if (n < ls) {
+			*it->_sp++ = cur; /* push(cur) */
+			cur = cur->l;
+		} else if (n > ls) {
+			it->__rt = cur;
+			n -= ls + 1;
+			cur = cur->r;
+		} else {
+			*it->_sp++ = cur; /* push(cur) */
+			break;
+		}
+	}
+}
+
 void *avl_it_next(struct avl_it *it) {
 	struct avl_node *top, *cur;
 
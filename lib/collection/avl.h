@@ -41,7 +41,11 @@ avl_t *avl_new(
 		avl_data_cleanup_f data_cleanup);
 unsigned avl_count(avl_t *avl);
 void *avl_get(avl_t *avl, void *key);
+void *avl_nth(avl_t *avl, unsigned n); /* n-th element (from 0) in order, NULL if out of bounds */
+unsigned avl_rank(avl_t *avl, void *key); /* number of elements lower than key */
 void *avl_insert(avl_t *avl, void *data);
+void *avl_insert_move(avl_t *avl, void *data); /* same as avl_insert(), but the data is moved (not copied with data_copy) */
+int avl_bulk_load(avl_t *avl, void *sorted, size_t stride, unsigned n); /* fills an empty avl with n elements sorted by key, moved (not copied with data_copy), in O(n) */
 void avl_remove(avl_t *avl, void *key);
 void avl_remove_all(avl_t *avl);
 void avl_walk(avl_t *avl, enum avl_order order, avl_walker_f walker, void* param);
@@ -58,6 +62,7 @@ struct avl_it {
 
 void avl_it_start(struct avl_it *it, avl_t *avl);
 void avl_it_start_at(struct avl_it *it, avl_t *avl, void *key);
+void avl_it_start_nth(struct avl_it *it, avl_t *avl, unsigned n); /* next is the n-th element */
 void *avl_it_next(struct avl_it *it);
 int avl_it_has_next(struct avl_it *it);
 void *avl_it_peek_prev(struct avl_it *it);
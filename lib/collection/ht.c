@@ -169,6 +169,9 @@ int ht_insert(ht_t *t, ht_key_t *key, ht_val_t *val) {
 
 	if (!ht_contains(t, key)) {
 		e = malloc(sizeof (*e));
+		if (e == NULL) {
+			return 0;
+		}
 		e->hash = t->key_hash(key);
 		e->key = key;
 		e->value = val;
@@ -198,7 +201,9 @@ int ht_get_ex(ht_t *t, ht_key_t *key, ht_val_t **ret) {
 		}
 	}
 
-	*ret = NULL;
+	if (ret != NULL) {
+		*ret = NULL;
+	}
 	return 0;
 }
 
@@ -231,7 +236,7 @@ int ht_remove(ht_t *t, ht_key_t *key) {
 			ret = 1;
 			break;
 		}
-		prev = &e;
+		prev = &e->next;
 		e = e->next;
 	}
 
@@ -0,0 +1,145 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mpsc.h"
+
+void mpsc_init(struct mpsc_queue *q) {
+	q->stub.next = NULL;
+	q->head = &q->stub;
+	q->tail = &q->stub;
+}
+
+void mpsc_push(struct mpsc_queue *q, struct mpsc_node *n) {
+	struct mpsc_node *prev;
+
+	__atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&q->head, n, __ATOMIC_ACQ_REL);
+	/* the queue is "broken" between these two lines: see mpsc_pop() */
+	__atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+struct mpsc_node *mpsc_pop(struct mpsc_queue *q) {
+	struct mpsc_node *tail = q->tail;
+	struct mpsc_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	struct mpsc_node *head;
+
+	if (tail == &q->stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		q->tail = next;
+		tail = next;
+		next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next != NULL) {
+		q->tail = next;
+		return tail;
+	}
+
+	head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	if (tail != head) {
+		/* a producer has not linked its element yet */
+		return NULL;
+	}
+
+	/* tail is the last element: put the stub behind it so it can be popped */
+	mpsc_push(q, &q->stub);
+
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next != NULL) {
+		q->tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+struct mpsc_ring *mpsc_ring_new(unsigned size) {
+	struct mpsc_ring *r;
+	size_t n = 2, i;
+
+	while (n < size) {
+		n <<= 1;
+	}
+	if (posix_memalign((void **)&r, MPSC_CACHELINE, sizeof(*r) + n * sizeof(r->slots[0])) != 0) {
+		return NULL;
+	}
+	r->mask = n - 1;
+	r->head = 0;
+	r->tail = 0;
+	for (i = 0 ; i < n ; i++) {
+		r->slots[i].seq = i;
+		r->slots[i].data = NULL;
+	}
+	return r;
+}
+
+void mpsc_ring_destroy(struct mpsc_ring *r) {
+	free(r);
+}
+
+int mpsc_ring_push(struct mpsc_ring *r, void *data) {
+	struct mpsc_ring_slot *slot;
+	size_t pos, seq;
+	intptr_t diff;
+
+	pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &r->slots[pos & r->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			/* the consumer has not freed this slot yet */
+			return -1;
+		} else {
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->data = data;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void *mpsc_ring_pop(struct mpsc_ring *r) {
+	struct mpsc_ring_slot *slot = &r->slots[r->tail & r->mask];
+	void *data;
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != r->tail + 1) {
+		return NULL;
+	}
+	data = slot->data;
+	/* free the slot for the producer of the next lap */
+	__atomic_store_n(&slot->seq, r->tail + r->mask + 1, __ATOMIC_RELEASE);
+	r->tail++;
+
+	return data;
+}
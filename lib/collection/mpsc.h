@@ -0,0 +1,83 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_COLLECTION_MPSC_H_
+#define LIB_COLLECTION_MPSC_H_
+
+#include <stddef.h>
+
+/*
+ * Intrusive, lock-free, multiple producers / single consumer FIFO queue
+ * (D. Vyukov's algorithm). Any thread can push, only one thread at a time can
+ * pop.
+ *
+ * mpsc_pop() may return NULL while the queue is not empty: this happens when a
+ * producer was interrupted in the middle of mpsc_push(). The element becomes
+ * visible as soon as this producer finishes its push, so the consumer must be
+ * woken again by the producer after each push (see lib/runtime.c).
+ */
+
+struct mpsc_node {
+	struct mpsc_node *next;
+};
+
+struct mpsc_queue {
+	struct mpsc_node *head; /* last pushed element, written by the producers */
+	struct mpsc_node *tail; /* next element to pop, owned by the consumer */
+	struct mpsc_node stub;
+};
+
+void mpsc_init(struct mpsc_queue *q);
+void mpsc_push(struct mpsc_queue *q, struct mpsc_node *n);
+struct mpsc_node *mpsc_pop(struct mpsc_queue *q);
+
+/*
+ * Bounded, lock-free, multiple producers / single consumer ring of pointers.
+ * Each slot bears a sequence number telling whether it is free for the
+ * producer of a given position, or filled for the consumer. The producers
+ * reserve a position with a CAS on the head, mpsc_ring_push() fails if the
+ * ring is full instead of blocking.
+ *
+ * Like mpsc_pop(), mpsc_ring_pop() may return NULL while a producer is
+ * filling the next slot.
+ */
+
+#define MPSC_CACHELINE 64
+
+struct mpsc_ring_slot {
+	size_t seq;
+	void *data;
+};
+
+struct mpsc_ring {
+	size_t mask;                                          /* number of slots - 1 */
+	size_t head __attribute__((aligned(MPSC_CACHELINE))); /* next position to fill, shared by the producers */
+	size_t tail __attribute__((aligned(MPSC_CACHELINE))); /* next position to read, owned by the consumer */
+	struct mpsc_ring_slot slots[] __attribute__((aligned(MPSC_CACHELINE)));
+};
+
+struct mpsc_ring *mpsc_ring_new(unsigned size);
+void mpsc_ring_destroy(struct mpsc_ring *r);
+int mpsc_ring_push(struct mpsc_ring *r, void *data);
+void *mpsc_ring_pop(struct mpsc_ring *r);
+
+#endif /* LIB_COLLECTION_MPSC_H_ */
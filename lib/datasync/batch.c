@@ -0,0 +1,358 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#define LOCAL_LOG_FACILITY WC_LOG_CONNECTION
+
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+
+#include "webcom-c/webcom.h"
+
+#include "../webcom_base_priv.h"
+#include "../timer.h"
+#include "path.h"
+
+struct wc_batch_op {
+	struct wc_batch_op *next;
+	unsigned merge:1;
+	char *path;
+	char *json;
+	wc_ds_path_t *parsed_path;
+};
+
+struct wc_batch {
+	wc_context_t *ctx;
+	struct wc_batch_op *ops;
+	struct wc_batch_op **tail;
+	unsigned count;
+	size_t bytes;
+};
+
+/* a committed batch waiting for the result of its requests */
+struct batch_inflight {
+	wc_context_t *ctx;
+	wc_on_req_result_t callback;
+	void *user;
+	int64_t id;
+	wc_action_type_t type;
+	unsigned refs;       /* one per request sent, plus one during the commit */
+	unsigned requests;
+	int failed;
+	char *reason;
+	char *data;
+	int64_t started_us;
+};
+
+wc_batch_t *wc_datasync_batch_begin(wc_context_t *cnx) {
+	struct wc_batch *b;
+
+	b = calloc(1, sizeof(*b));
+	if (b != NULL) {
+		b->ctx = cnx;
+		b->tail = &b->ops;
+	}
+	return b;
+}
+
+static int wc_datasync_batch_add(wc_batch_t *batch, char *path, char *json, int merge) {
+	struct wc_batch_op *op;
+
+	op = calloc(1, sizeof(*op));
+	if (op == NULL) {
+		return -1;
+	}
+
+	op->merge = !!merge;
+	op->path = strdup(path);
+	op->json = strdup(json);
+	op->parsed_path = wc_datasync_path_new(path);
+
+	if (op->path == NULL || op->json == NULL || op->parsed_path == NULL) {
+		free(op->path);
+		free(op->json);
+		wc_datasync_path_destroy(op->parsed_path);
+		free(op);
+		return -1;
+	}
+
+	*batch->tail = op;
+	batch->tail = &op->next;
+	batch->count++;
+	batch->bytes += strlen(json);
+
+	return 0;
+}
+
+int wc_datasync_batch_put(wc_batch_t *batch, char *path, char *json) {
+	return wc_datasync_batch_add(batch, path, json, 0);
+}
+
+int wc_datasync_batch_merge(wc_batch_t *batch, char *path, char *json) {
+	return wc_datasync_batch_add(batch, path, json, 1);
+}
+
+void wc_datasync_batch_abort(wc_batch_t *batch) {
+	struct wc_batch_op *op, *next;
+
+	for (op = batch->ops ; op != NULL ; op = next) {
+		next = op->next;
+		free(op->path);
+		free(op->json);
+		wc_datasync_path_destroy(op->parsed_path);
+		free(op);
+	}
+	free(batch);
+}
+
+/*
+ * number of leading path elements shared by all the operations
+ */
+static unsigned batch_common_depth(struct wc_batch *b) {
+	struct wc_batch_op *op;
+	unsigned depth, u;
+
+	depth = wc_datasync_path_get_part_count(b->ops->parsed_path);
+	for (op = b->ops->next ; op != NULL ; op = op->next) {
+		if (wc_datasync_path_get_part_count(op->parsed_path) < depth) {
+			depth = wc_datasync_path_get_part_count(op->parsed_path);
+		}
+		for (u = 0 ; u < depth ; u++) {
+			if (strcmp(wc_datasync_path_get_part(op->parsed_path, u), wc_datasync_path_get_part(b->ops->parsed_path, u)) != 0) {
+				depth = u;
+				break;
+			}
+		}
+	}
+	return depth;
+}
+
+/*
+ * builds the data of a merge request at the given depth that is equivalent
+ * to all the operations of the batch: each put must target a direct child of
+ * the ancestor, and each merge the ancestor itself. Returns NULL if this is
+ * not possible.
+ */
+static json_object *batch_fold(struct wc_batch *b, unsigned depth) {
+	struct wc_batch_op *op;
+	json_object *merge, *data;
+	enum json_tokener_error jte;
+	unsigned n;
+
+	merge = json_object_new_object();
+
+	for (op = b->ops ; op != NULL ; op = op->next) {
+		n = wc_datasync_path_get_part_count(op->parsed_path);
+		data = json_tokener_parse_verbose(op->json, &jte);
+		if (jte != json_tokener_success) {
+			/* NULL also stands for a valid "null", that deletes the key: a
+			 * malformed value is sent as is, for the server to reject it */
+			WL_DBG("batch not folded, malformed value for %s: %s", op->path, json_tokener_error_desc(jte));
+			json_object_put(merge);
+			return NULL;
+		} else if (op->merge && n == depth && json_object_is_type(data, json_type_object)) {
+			json_object_object_foreach(data, key, val) {
+				json_object_object_add(merge, key, json_object_get(val));
+			}
+			json_object_put(data);
+		} else if (!op->merge && n == depth + 1) {
+			json_object_object_add(merge, wc_datasync_path_get_part(op->parsed_path, depth), data);
+		} else {
+			json_object_put(data);
+			json_object_put(merge);
+			return NULL;
+		}
+	}
+
+	return merge;
+}
+
+static char *batch_ancestor_path(struct wc_batch *b, unsigned depth) {
+	size_t len = 1;
+	unsigned u;
+	char *ret;
+
+	for (u = 0 ; u < depth ; u++) {
+		len += strlen(wc_datasync_path_get_part(b->ops->parsed_path, u)) + 1;
+	}
+
+	ret = malloc(len);
+	if (ret == NULL) {
+		return NULL;
+	}
+
+	ret[0] = '/';
+	ret[1] = '\0';
+	for (u = 0 ; u < depth ; u++) {
+		if (u > 0) {
+			strcat(ret, "/");
+		}
+		strcat(ret, wc_datasync_path_get_part(b->ops->parsed_path, u));
+	}
+
+	return ret;
+}
+
+static void batch_inflight_release(struct batch_inflight *inf) {
+	struct wc_datasync_batch_stats *stats;
+	uint64_t latency;
+
+	if (--inf->refs > 0) {
+		return;
+	}
+
+	if (inf->requests > 0) {
+		stats = &inf->ctx->datasync.batch_stats;
+		latency = (uint64_t)(wc_timer_now_us() - inf->started_us);
+		stats->latency_avg_us = (stats->latency_avg_us * stats->completed + latency) / (stats->completed + 1);
+		stats->completed++;
+		stats->latency_last_us = latency;
+		if (latency > stats->latency_max_us) {
+			stats->latency_max_us = latency;
+		}
+		if (inf->failed) {
+			stats->failed++;
+		}
+
+		if (inf->callback != NULL) {
+			inf->callback(
+					inf->ctx,
+					inf->id,
+					inf->type,
+					inf->failed ? WC_REQ_ERROR : WC_REQ_OK,
+					inf->reason != NULL ? inf->reason : "ok",
+					inf->requests == 1 ? inf->data : NULL,
+					inf->user);
+		}
+	}
+
+	free(inf->reason);
+	free(inf->data);
+	free(inf);
+}
+
+static void batch_req_cb(UNUSED_PARAM(wc_context_t *cnx), UNUSED_PARAM(int64_t id), UNUSED_PARAM(wc_action_type_t type), wc_req_pending_result_t status, char *reason, char *data, void *user) {
+	struct batch_inflight *inf = user;
+
+	if (status != WC_REQ_OK && !inf->failed) {
+		inf->failed = 1;
+		free(inf->reason);
+		inf->reason = reason != NULL ? strdup(reason) : NULL;
+	}
+	if (data != NULL && inf->data == NULL) {
+		inf->data = strdup(data);
+	}
+
+	batch_inflight_release(inf);
+}
+
+static int64_t batch_send(struct batch_inflight *inf, int merge, char *path, char *json) {
+	int64_t id;
+
+	inf->refs++;
+	if (merge) {
+		id = wc_datasync_merge(inf->ctx, path, json, batch_req_cb, inf);
+	} else {
+		id = wc_datasync_put(inf->ctx, path, json, batch_req_cb, inf);
+	}
+
+	if (id < 0) {
+		inf->refs--;
+	} else {
+		if (inf->requests++ == 0) {
+			inf->id = id;
+			inf->type = merge ? WC_ACTION_MERGE : WC_ACTION_PUT;
+		}
+		inf->ctx->datasync.batch_stats.requests++;
+	}
+
+	return id;
+}
+
+int64_t wc_datasync_batch_commit(wc_batch_t *batch, wc_on_req_result_t callback, void *user) {
+	struct wc_datasync_batch_stats *stats = &batch->ctx->datasync.batch_stats;
+	struct batch_inflight *inf;
+	struct wc_batch_op *op;
+	json_object *merge = NULL;
+	unsigned depth;
+	char *path;
+	int64_t ret = -1;
+
+	if (batch->count == 0 || (inf = calloc(1, sizeof(*inf))) == NULL) {
+		wc_datasync_batch_abort(batch);
+		return -1;
+	}
+
+	inf->ctx = batch->ctx;
+	inf->callback = callback;
+	inf->user = user;
+	inf->refs = 1;
+	inf->started_us = wc_timer_now_us();
+
+	if (batch->count > 1) {
+		depth = batch_common_depth(batch);
+		merge = batch_fold(batch, depth);
+		if (merge == NULL && depth > 0) {
+			merge = batch_fold(batch, --depth);
+		}
+	}
+
+	if (merge != NULL) {
+		path = batch_ancestor_path(batch, depth);
+		if (path != NULL) {
+			WL_DBG("batch of %u operations folded in a merge on %s", batch->count, path);
+			ret = batch_send(inf, 1, path, (char *)json_object_to_json_string(merge));
+			free(path);
+		}
+		json_object_put(merge);
+		if (ret > 0) {
+			stats->folded++;
+		}
+	} else {
+		for (op = batch->ops ; op != NULL ; op = op->next) {
+			if (batch_send(inf, op->merge, op->path, op->json) < 0) {
+				if (inf->requests > 0) {
+					WL_WARN("batch partially sent, %u operations out of %u", inf->requests, batch->count);
+					inf->failed = 1;
+					inf->reason = strdup("batch partially sent");
+				}
+				break;
+			}
+		}
+		ret = inf->requests > 0 ? inf->id : -1;
+	}
+
+	if (ret > 0) {
+		stats->committed++;
+		stats->ops += batch->count;
+		stats->bytes += batch->bytes;
+	}
+
+	batch_inflight_release(inf);
+	wc_datasync_batch_abort(batch);
+
+	return ret;
+}
+
+void wc_datasync_batch_get_stats(wc_context_t *cnx, struct wc_datasync_batch_stats *stats) {
+	*stats = cnx->datasync.batch_stats;
+}
@@ -0,0 +1,255 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "overlay.h"
+#include "treenode.h"
+#include "../on/on_registry.h"
+
+void cache_overlays_init(struct cache_overlays *ov) {
+	ov->head = NULL;
+	ov->tail = &ov->head;
+	ov->count = 0;
+	ov->by_id = NULL;
+}
+
+static wc_hash_t overlay_id_hash(int64_t *id) {
+	return (wc_hash_t)(*id ^ (*id >> 32));
+}
+
+static int overlay_id_eq(int64_t *a, int64_t *b) {
+	return *a == *b;
+}
+
+static char *overlay_snapshot(data_cache_t *cache, char *path) {
+	struct treenode *n;
+	char *json;
+
+	n = data_cache_get(cache, path);
+	json = malloc(treenode_to_json_len(n) + 1);
+	if (json != NULL) {
+		treenode_to_json(n, json);
+	}
+	return json;
+}
+
+static void overlay_write(data_cache_t *cache, struct on_registry *reg, char *path, char *data, int merge) {
+	if (merge) {
+		data_cache_merge(cache, path, data);
+	} else {
+		data_cache_set(cache, path, data);
+	}
+	if (reg != NULL) {
+		on_registry_dispatch_on_event(reg, cache, path);
+	}
+}
+
+static void overlay_free(struct cache_overlay *o) {
+	free(o->path);
+	wc_datasync_path_destroy(o->parsed_path);
+	free(o->data);
+	free(o->prev);
+	free(o);
+}
+
+static int overlay_overlaps(wc_ds_path_t *a, wc_ds_path_t *b) {
+	return wc_datasync_path_starts_with(a, b) || wc_datasync_path_starts_with(b, a);
+}
+
+/*
+ * applies again, in order, the overlays starting at `from` that touch the
+ * dirty part of the tree. An overlay applied again makes its own path dirty,
+ * so that the later overlays are kept on top of it.
+ */
+static void overlay_replay(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg, struct cache_overlay *from, wc_ds_path_t *dirty, int pending_only) {
+	wc_ds_path_t **dirty_set;
+	struct cache_overlay *o;
+	unsigned n = 0, i;
+	char *prev;
+
+	if (from == NULL) {
+		return;
+	}
+
+	dirty_set = malloc((ov->count + 1) * sizeof(*dirty_set));
+	if (dirty_set == NULL) {
+		return;
+	}
+	dirty_set[n++] = dirty;
+
+	for (o = from ; o != NULL ; o = o->next) {
+		if (pending_only && o->confirmed) {
+			continue;
+		}
+		for (i = 0 ; i < n ; i++) {
+			if (overlay_overlaps(o->parsed_path, dirty_set[i])) {
+				break;
+			}
+		}
+		if (i == n) {
+			continue;
+		}
+		prev = overlay_snapshot(cache, o->path);
+		if (prev != NULL) {
+			free(o->prev);
+			o->prev = prev;
+		}
+		overlay_write(cache, reg, o->path, o->data, o->merge);
+		dirty_set[n++] = o->parsed_path;
+	}
+
+	free(dirty_set);
+}
+
+int cache_overlay_apply(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg, int64_t id, int merge, char *path, char *data) {
+	struct cache_overlay *o;
+
+	if (ov->by_id == NULL) {
+		ov->by_id = ht_new((ht_hash_f)overlay_id_hash, (ht_key_eq_f)overlay_id_eq, NULL, NULL);
+		if (ov->by_id == NULL) {
+			return -1;
+		}
+	}
+
+	o = calloc(1, sizeof(*o));
+	if (o == NULL) {
+		return -1;
+	}
+
+	o->id = id;
+	o->merge = !!merge;
+	o->path = strdup(path);
+	o->parsed_path = wc_datasync_path_new(path);
+	o->data = strdup(data);
+	o->prev = overlay_snapshot(cache, path);
+
+	if (o->path == NULL || o->parsed_path == NULL || o->data == NULL || o->prev == NULL
+			|| ht_insert(ov->by_id, &o->id, o) != 1)
+	{
+		overlay_free(o);
+		return -1;
+	}
+
+	o->pprev = ov->tail;
+	*ov->tail = o;
+	ov->tail = &o->next;
+	ov->count++;
+
+	overlay_write(cache, reg, path, data, merge);
+
+	return 0;
+}
+
+static void overlay_unlink(struct cache_overlays *ov, struct cache_overlay **link) {
+	struct cache_overlay *o = *link;
+
+	*link = o->next;
+	if (o->next != NULL) {
+		o->next->pprev = link;
+	} else {
+		ov->tail = link;
+	}
+	ov->count--;
+	ht_remove(ov->by_id, &o->id);
+	overlay_free(o);
+}
+
+static void overlay_rollback(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg, struct cache_overlay **link) {
+	struct cache_overlay *o = *link;
+
+	overlay_write(cache, reg, o->path, o->prev, 0);
+	overlay_replay(ov, cache, reg, o->next, o->parsed_path, 0);
+	overlay_unlink(ov, link);
+}
+
+/*
+ * the confirmed overlays are only needed to roll back an earlier overlay,
+ * they are dropped once all the earlier ones are confirmed too
+ */
+static void overlay_purge(struct cache_overlays *ov) {
+	while (ov->head != NULL && ov->head->confirmed) {
+		overlay_unlink(ov, &ov->head);
+	}
+}
+
+void cache_overlay_ack(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg, int64_t id, int accepted) {
+	struct cache_overlay *o;
+
+	if (ov->by_id == NULL || (o = ht_get(ov->by_id, &id)) == NULL) {
+		return;
+	}
+
+	if (accepted) {
+		o->confirmed = 1;
+	} else {
+		overlay_rollback(ov, cache, reg, o->pprev);
+	}
+	overlay_purge(ov);
+}
+
+void cache_overlay_reconcile(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg, char *path) {
+	wc_ds_path_t *parsed_path;
+
+	if (ov->head == NULL) {
+		return;
+	}
+
+	parsed_path = wc_datasync_path_new(path);
+	if (parsed_path != NULL) {
+		overlay_replay(ov, cache, reg, ov->head, parsed_path, 1);
+		wc_datasync_path_destroy(parsed_path);
+	}
+}
+
+/* the overlay whose `next` field is the given link */
+static inline struct cache_overlay *overlay_of_next(struct cache_overlay **link) {
+	return (struct cache_overlay *)(((char *)link) - offsetof(struct cache_overlay, next));
+}
+
+void cache_overlay_rollback_all(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg) {
+	struct cache_overlay **link, *o;
+
+	/* roll back the pending overlays from the most recent one, walking the
+	 * list backwards through the pprev links */
+	for (link = ov->tail ; link != &ov->head ; ) {
+		o = overlay_of_next(link);
+		link = o->pprev;
+		if (!o->confirmed) {
+			overlay_rollback(ov, cache, reg, link);
+		}
+	}
+
+	overlay_purge(ov);
+}
+
+void cache_overlays_clear(struct cache_overlays *ov) {
+	while (ov->head != NULL) {
+		overlay_unlink(ov, &ov->head);
+	}
+	if (ov->by_id != NULL) {
+		ht_destroy(ov->by_id);
+		ov->by_id = NULL;
+	}
+}
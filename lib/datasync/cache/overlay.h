@@ -0,0 +1,75 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_CACHE_OVERLAY_H_
+#define LIB_DATASYNC_CACHE_OVERLAY_H_
+
+#include <stdint.h>
+
+#include "treenode_cache.h"
+#include "../path.h"
+#include "../../collection/ht.h"
+
+struct on_registry;
+
+/*
+ * Optimistic writes: the puts and merges issued by the application are
+ * applied to the cache right away, and recorded in an ordered list of
+ * overlays, one per request, until the server has answered.
+ *
+ * If the server rejects a write, its overlay is rolled back: the value the
+ * path had before the write is restored, and the later overlays touching the
+ * same part of the tree are applied again on top of it. Likewise, when the
+ * server pushes a new value, the overlays that are not confirmed yet and
+ * touch the updated part of the tree are applied again on top of it.
+ *
+ * The data event callbacks of `reg` are called for the changes made to the
+ * cache, `reg` can be NULL to change it silently.
+ */
+
+struct cache_overlay {
+	struct cache_overlay *next;
+	struct cache_overlay **pprev; /* the link pointing to this overlay */
+	int64_t id;              /* id of the write request */
+	unsigned merge:1;        /* 1 for a merge, 0 for a put */
+	unsigned confirmed:1;    /* the server has accepted the write */
+	char *path;
+	wc_ds_path_t *parsed_path;
+	char *data;              /* the written value */
+	char *prev;              /* the value of path before the write */
+};
+
+struct cache_overlays {
+	struct cache_overlay *head;
+	struct cache_overlay **tail;
+	unsigned count;
+	ht_t *by_id;             /* the overlays indexed by request id, NULL until the first one */
+};
+
+void cache_overlays_init(struct cache_overlays *ov);
+int cache_overlay_apply(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg, int64_t id, int merge, char *path, char *data);
+void cache_overlay_ack(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg, int64_t id, int accepted);
+void cache_overlay_reconcile(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg, char *path);
+void cache_overlay_rollback_all(struct cache_overlays *ov, data_cache_t *cache, struct on_registry *reg);
+void cache_overlays_clear(struct cache_overlays *ov);
+
+#endif /* LIB_DATASYNC_CACHE_OVERLAY_H_ */
@@ -0,0 +1,746 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+
+#include "../../sha1.h"
+#include "../../collection/avl.h"
+#include "../json.h"
+
+#include "query.h"
+
+struct index_entry {
+	char *key;
+	struct query_value value;
+};
+
+/* the ordered view of an index points to the entries owned by the by_key
+ * view, the AVL nodes never move once allocated */
+struct index_ref {
+	struct index_entry *e;
+};
+
+struct cache_index {
+	struct cache_index *next;
+	wc_ds_path_t *path;
+	wc_ds_path_t *child;
+	unsigned ref;
+	avl_t *by_key;
+	avl_t *ordered;
+};
+
+struct query_item {
+	char *key;
+	struct treenode *node;
+	struct query_value value;
+};
+
+/* the selected children, in query order: a plain array, or a ring buffer
+ * keeping the last items for limit_to_last queries */
+struct query_window {
+	struct query_item *items;
+	unsigned cap;
+	unsigned len;
+	unsigned head;
+	unsigned limit;
+	unsigned skip;
+	unsigned ring:1;
+};
+
+/* probe keys that sort before/after any key having the same value */
+#define INDEX_KEY_MIN NULL
+static char index_key_max[] = "";
+
+static int query_value_rank(struct query_value *v) {
+	switch (v->type) {
+	case TREENODE_TYPE_LEAF_NULL:
+		return 0;
+	case TREENODE_TYPE_LEAF_BOOL:
+		return v->uval.bool == TN_TRUE ? 2 : 1;
+	case TREENODE_TYPE_LEAF_NUMBER:
+		return 3;
+	case TREENODE_TYPE_LEAF_STRING:
+		return 4;
+	case TREENODE_TYPE_INTERNAL:
+	default:
+		return 5;
+	}
+}
+
+int query_value_cmp(struct query_value *a, struct query_value *b) {
+	int ra = query_value_rank(a);
+	int rb = query_value_rank(b);
+
+	if (ra != rb) {
+		return ra - rb;
+	}
+
+	switch (a->type) {
+	case TREENODE_TYPE_LEAF_NUMBER:
+		return (a->uval.number > b->uval.number) - (a->uval.number < b->uval.number);
+	case TREENODE_TYPE_LEAF_STRING:
+		return strcmp(a->uval.str, b->uval.str);
+	default:
+		return 0;
+	}
+}
+
+/* borrows the value of `path` under `node`, the null value if missing */
+static void query_value_of(struct treenode *node, wc_ds_path_t *path, struct query_value *v) {
+	unsigned i;
+
+	for (i = 0 ; node != NULL && i < wc_datasync_path_get_part_count(path) ; i++) {
+		node = node->type == TREENODE_TYPE_INTERNAL
+				? internal_get(node, wc_datasync_path_get_part(path, i))
+				: NULL;
+	}
+
+	if (node == NULL) {
+		v->type = TREENODE_TYPE_LEAF_NULL;
+		v->uval.null = NULL;
+	} else {
+		v->type = node->type;
+		v->uval = node->uval;
+	}
+}
+
+static void query_value_cleanup(struct query_value *v) {
+	if (v->type == TREENODE_TYPE_LEAF_STRING) {
+		free(v->uval.str);
+	}
+}
+
+static int query_value_parse(char *json, struct query_value *v) {
+	json_object *j;
+	int ret = 0;
+
+	j = json_tokener_parse(json);
+
+	switch (json_object_get_type(j)) {
+	case json_type_null:
+		/* json-c returns NULL for both "null" and parse errors */
+		v->type = TREENODE_TYPE_LEAF_NULL;
+		ret = strspn(json, " \t\r\n") + 4 <= strlen(json)
+				&& strncmp(json + strspn(json, " \t\r\n"), "null", 4) == 0 ? 0 : -1;
+		break;
+	case json_type_boolean:
+		v->type = TREENODE_TYPE_LEAF_BOOL;
+		v->uval.bool = json_object_get_boolean(j) ? TN_TRUE : TN_FALSE;
+		break;
+	case json_type_double:
+		v->type = TREENODE_TYPE_LEAF_NUMBER;
+		v->uval.number = json_object_get_double(j);
+		break;
+	case json_type_int:
+		v->type = TREENODE_TYPE_LEAF_NUMBER;
+		v->uval.number = (double)json_object_get_int64(j);
+		break;
+	case json_type_string:
+		v->type = TREENODE_TYPE_LEAF_STRING;
+		v->uval.str = strdup(json_object_get_string(j));
+		break;
+	default:
+		ret = -1;
+		break;
+	}
+
+	json_object_put(j);
+
+	return ret;
+}
+
+static int query_bound_init(struct cache_query *q, char *bound, struct query_value *v) {
+	if (q->order_by == WC_QUERY_ORDER_BY_KEY) {
+		v->type = TREENODE_TYPE_LEAF_STRING;
+		v->uval.str = strdup(bound);
+		return 0;
+	} else {
+		return query_value_parse(bound, v);
+	}
+}
+
+struct cache_query *cache_query_new(struct wc_query *query) {
+	struct cache_query *ret;
+	char *start, *end;
+
+	if (query->order_by != WC_QUERY_ORDER_BY_KEY
+			&& (query->order_by != WC_QUERY_ORDER_BY_CHILD || query->child == NULL))
+	{
+		return NULL;
+	}
+
+	ret = calloc(1, sizeof(*ret));
+	ret->order_by = query->order_by;
+	ret->offset = query->offset;
+	ret->limit_first = query->limit_to_first;
+	ret->limit_last = query->limit_to_first == 0 ? query->limit_to_last : 0;
+
+	if (query->order_by == WC_QUERY_ORDER_BY_CHILD) {
+		ret->child = wc_datasync_path_new(query->child);
+	}
+
+	start = query->equal_to != NULL ? query->equal_to : query->start_at;
+	end = query->equal_to != NULL ? query->equal_to : query->end_at;
+
+	if (start != NULL) {
+		if (query_bound_init(ret, start, &ret->start) != 0) {
+			goto error;
+		}
+		ret->has_start = 1;
+	}
+	if (end != NULL) {
+		if (query_bound_init(ret, end, &ret->end) != 0) {
+			goto error;
+		}
+		ret->has_end = 1;
+	}
+
+	return ret;
+error:
+	cache_query_destroy(ret);
+	return NULL;
+}
+
+void cache_query_destroy(struct cache_query *q) {
+	if (q == NULL) {
+		return;
+	}
+
+	if (q->has_start) {
+		query_value_cleanup(&q->start);
+	}
+	if (q->has_end) {
+		query_value_cleanup(&q->end);
+	}
+	if (q->child != NULL) {
+		wc_datasync_path_destroy(q->child);
+	}
+	free(q);
+}
+
+/* a positional window gets the offset and the limits already applied by
+ * position, a scanning window applies them to the items it is pushed */
+static void query_window_init(struct query_window *w, struct cache_query *q, int positional) {
+	memset(w, 0, sizeof(*w));
+
+	if (positional) {
+		w->limit = q->limit_first ? q->limit_first : q->limit_last;
+	} else {
+		w->skip = q->offset;
+		if (q->limit_last) {
+			w->ring = 1;
+			w->cap = q->limit_last;
+			w->items = malloc(w->cap * sizeof(*w->items));
+		} else {
+			w->limit = q->limit_first;
+		}
+	}
+}
+
+/* returns 0 once the window is full and no more items need to be pushed */
+static int query_window_push(struct query_window *w, char *key, struct treenode *node) {
+	struct query_item *item;
+
+	if (w->skip > 0) {
+		w->skip--;
+		return 1;
+	}
+
+	if (w->ring) {
+		if (w->len < w->cap) {
+			item = &w->items[(w->head + w->len++) % w->cap];
+		} else {
+			item = &w->items[w->head];
+			w->head = (w->head + 1) % w->cap;
+		}
+	} else {
+		if (w->len == w->cap) {
+			w->cap = w->cap ? 2 * w->cap : 16;
+			w->items = realloc(w->items, w->cap * sizeof(*w->items));
+		}
+		item = &w->items[w->len++];
+	}
+
+	item->key = key;
+	item->node = node;
+
+	return !w->limit || w->len < w->limit;
+}
+
+static inline struct query_item *query_window_get(struct query_window *w, unsigned i) {
+	return &w->items[(w->head + i) % w->cap];
+}
+
+static char *query_window_to_json(struct query_window *w) {
+	struct query_item *item;
+	char *ret, *p;
+	unsigned i;
+	int len = 2; /* enclosing [ ... ] */
+
+	for (i = 0 ; i < w->len ; i++) {
+		item = query_window_get(w, i);
+		len += 3 /* [,] */ + json_escaped_str_len(item->key) + treenode_to_json_len(item->node);
+	}
+	if (w->len > 0) {
+		len += w->len - 1; /* separating commas */
+	}
+
+	p = ret = malloc(len + 1);
+
+	*p++ = '[';
+	for (i = 0 ; i < w->len ; i++) {
+		item = query_window_get(w, i);
+		if (i > 0) {
+			*p++ = ',';
+		}
+		*p++ = '[';
+		p += json_escape_str(item->key, p);
+		*p++ = ',';
+		p += treenode_to_json(item->node, p);
+		*p++ = ']';
+	}
+	*p++ = ']';
+	*p = 0;
+
+	return ret;
+}
+
+static struct cache_index *cache_index_find(data_cache_t *cache, wc_ds_path_t *path, wc_ds_path_t *child) {
+	struct cache_index *idx;
+
+	for (idx = cache->indexes ; idx != NULL ; idx = idx->next) {
+		if (wc_datasync_path_cmp(idx->path, path) == 0
+				&& wc_datasync_path_cmp(idx->child, child) == 0)
+		{
+			break;
+		}
+	}
+
+	return idx;
+}
+
+/* key order scan, for the nodes that hold null children */
+static void query_select_by_key(struct cache_query *q, struct treenode *parent, struct query_window *w) {
+	struct avl_it it;
+	struct internal_node_element *e;
+
+	if (q->has_start) {
+		avl_it_start_at(&it, parent->uval.children, &q->start.uval.str);
+	} else {
+		avl_it_start(&it, parent->uval.children);
+	}
+
+	while ((e = avl_it_next(&it)) != NULL) {
+		if (e->node.type == TREENODE_TYPE_LEAF_NULL) {
+			continue;
+		}
+		if (q->has_end && wc_datasync_key_cmp(e->key, q->end.uval.str) > 0) {
+			break;
+		}
+		if (!query_window_push(w, e->key, &e->node)) {
+			break;
+		}
+	}
+}
+
+/*
+ * Selects the elements [lo, hi[ of an ordered container, the offset and the
+ * limits are resolved by position. Returns 0 if a null child is met, up to the
+ * end of the selection, the positions are then meaningless and the children
+ * must be scanned instead.
+ */
+static int query_select_range(struct cache_query *q, avl_t *avl, unsigned lo, unsigned hi, struct treenode *parent, int by_index, struct query_window *w) {
+	struct avl_it it;
+	struct internal_node_element *e;
+	struct index_ref *r;
+	unsigned i, from;
+
+	from = lo + q->offset < hi ? lo + q->offset : hi;
+	if (q->limit_last && hi - from > q->limit_last) {
+		from = hi - q->limit_last;
+	}
+
+	if (by_index || q->offset == 0) {
+		avl_it_start_nth(&it, avl, from);
+	} else {
+		/* the skipped positions must not hold a null child either, the offset
+		 * would count it */
+		avl_it_start_nth(&it, avl, lo);
+		for (i = lo ; i < from ; i++) {
+			e = avl_it_next(&it);
+			if (e->node.type == TREENODE_TYPE_LEAF_NULL) {
+				return 0;
+			}
+		}
+	}
+
+	for (i = from ; i < hi ; i++) {
+		if (by_index) {
+			r = avl_it_next(&it);
+			if (!query_window_push(w, r->e->key, internal_get(parent, r->e->key))) {
+				break;
+			}
+		} else {
+			e = avl_it_next(&it);
+			if (e->node.type == TREENODE_TYPE_LEAF_NULL) {
+				return 0;
+			}
+			if (!query_window_push(w, e->key, &e->node)) {
+				break;
+			}
+		}
+	}
+
+	return 1;
+}
+
+static unsigned index_rank(struct cache_index *idx, struct query_value *value, char *key) {
+	struct index_entry probe;
+	struct index_ref ref;
+
+	probe.key = key;
+	probe.value = *value;
+	ref.e = &probe;
+
+	return avl_rank(idx->ordered, &ref);
+}
+
+static int query_item_cmp(const void *a, const void *b) {
+	const struct query_item *ia = a, *ib = b;
+	int cmp;
+
+	cmp = query_value_cmp((struct query_value *)&ia->value, (struct query_value *)&ib->value);
+
+	return cmp != 0 ? cmp : wc_datasync_key_cmp(ia->key, ib->key);
+}
+
+static void query_select_by_sort(struct cache_query *q, struct treenode *parent, struct query_window *w) {
+	struct avl_it it;
+	struct internal_node_element *e;
+	struct query_item *items;
+	unsigned i, n = 0;
+
+	items = malloc(avl_count(parent->uval.children) * sizeof(*items) + 1);
+
+	avl_it_start(&it, parent->uval.children);
+	while ((e = avl_it_next(&it)) != NULL) {
+		if (e->node.type == TREENODE_TYPE_LEAF_NULL) {
+			continue;
+		}
+		query_value_of(&e->node, q->child, &items[n].value);
+		if ((q->has_start && query_value_cmp(&items[n].value, &q->start) < 0)
+				|| (q->has_end && query_value_cmp(&items[n].value, &q->end) > 0))
+		{
+			continue;
+		}
+		items[n].key = e->key;
+		items[n].node = &e->node;
+		n++;
+	}
+
+	qsort(items, n, sizeof(*items), query_item_cmp);
+
+	for (i = 0 ; i < n && query_window_push(w, items[i].key, items[i].node) ; i++);
+
+	free(items);
+}
+
+char *cache_query_run(data_cache_t *cache, wc_ds_path_t *path, struct cache_query *q) {
+	struct treenode *parent;
+	struct cache_index *idx;
+	struct query_window w;
+	unsigned lo, hi;
+	avl_t *children;
+	char *ret;
+
+	parent = data_cache_get_parsed(cache, path);
+
+	if (parent == NULL || parent->type != TREENODE_TYPE_INTERNAL) {
+		query_window_init(&w, q, 1);
+	} else if (q->order_by == WC_QUERY_ORDER_BY_KEY) {
+		children = parent->uval.children;
+		lo = q->has_start ? avl_rank(children, &q->start.uval.str) : 0;
+		hi = q->has_end
+				? avl_rank(children, &q->end.uval.str) + (avl_get(children, &q->end.uval.str) != NULL)
+				: avl_count(children);
+
+		query_window_init(&w, q, 1);
+		if (!query_select_range(q, children, lo, hi, parent, 0, &w)) {
+			free(w.items);
+			query_window_init(&w, q, 0);
+			query_select_by_key(q, parent, &w);
+		}
+	} else if ((idx = cache_index_find(cache, path, q->child)) != NULL) {
+		lo = q->has_start ? index_rank(idx, &q->start, INDEX_KEY_MIN) : 0;
+		hi = q->has_end ? index_rank(idx, &q->end, index_key_max) : avl_count(idx->ordered);
+
+		query_window_init(&w, q, 1);
+		query_select_range(q, idx->ordered, lo, hi, parent, 1, &w);
+	} else {
+		query_window_init(&w, q, 0);
+		query_select_by_sort(q, parent, &w);
+	}
+
+	ret = query_window_to_json(&w);
+	free(w.items);
+
+	return ret;
+}
+
+int cache_query_result_changed(struct cache_query *q, char *result) {
+	wc_SHA1_CTX sha1;
+	unsigned char digest[20];
+	int ret;
+
+	wc_SHA1Init(&sha1);
+	wc_SHA1Update(&sha1, (unsigned char *)result, strlen(result));
+	wc_SHA1Final(digest, &sha1);
+
+	ret = !q->has_hash || memcmp(digest, q->hash, sizeof(digest)) != 0;
+
+	memcpy(q->hash, digest, sizeof(digest));
+	q->has_hash = 1;
+
+	return ret;
+}
+
+static int index_entry_cmp(void *a, void *b) {
+	return wc_datasync_key_cmp(((struct index_entry *)a)->key, ((struct index_entry *)b)->key);
+}
+
+static size_t index_entry_size(UNUSED_PARAM(void *data)) {
+	return sizeof(struct index_entry);
+}
+
+static void index_entry_copy(void *from, void *to) {
+	struct index_entry *efrom = from, *eto = to;
+
+	eto->key = strdup(efrom->key);
+	eto->value = efrom->value;
+	if (eto->value.type == TREENODE_TYPE_LEAF_STRING) {
+		eto->value.uval.str = strdup(efrom->value.uval.str);
+	}
+}
+
+static void index_entry_cleanup(void *data) {
+	struct index_entry *e = data;
+
+	free(e->key);
+	query_value_cleanup(&e->value);
+}
+
+static int index_ref_cmp(void *a, void *b) {
+	struct index_entry *ea = ((struct index_ref *)a)->e;
+	struct index_entry *eb = ((struct index_ref *)b)->e;
+	int cmp;
+
+	cmp = query_value_cmp(&ea->value, &eb->value);
+
+	if (cmp == 0) {
+		if (ea->key == eb->key) {
+			cmp = 0;
+		} else if (ea->key == INDEX_KEY_MIN || eb->key == index_key_max) {
+			cmp = -1;
+		} else if (eb->key == INDEX_KEY_MIN || ea->key == index_key_max) {
+			cmp = 1;
+		} else {
+			cmp = wc_datasync_key_cmp(ea->key, eb->key);
+		}
+	}
+
+	return cmp;
+}
+
+static size_t index_ref_size(UNUSED_PARAM(void *data)) {
+	return sizeof(struct index_ref);
+}
+
+static void index_ref_copy(void *from, void *to) {
+	memcpy(to, from, sizeof(struct index_ref));
+}
+
+static void index_ref_cleanup(UNUSED_PARAM(void *data)) {
+}
+
+static void cache_index_insert(struct cache_index *idx, char *key, struct treenode *node) {
+	struct index_entry tmp;
+	struct index_ref ref;
+
+	tmp.key = key;
+	query_value_of(node, idx->child, &tmp.value);
+
+	ref.e = avl_insert(idx->by_key, &tmp);
+	if (ref.e != NULL) {
+		avl_insert(idx->ordered, &ref);
+	}
+}
+
+static void cache_index_rebuild(data_cache_t *cache, struct cache_index *idx) {
+	struct treenode *parent;
+	struct internal_node_element *e;
+	struct avl_it it;
+
+	avl_remove_all(idx->ordered);
+	avl_remove_all(idx->by_key);
+
+	parent = data_cache_get_parsed(cache, idx->path);
+
+	if (parent != NULL && parent->type == TREENODE_TYPE_INTERNAL) {
+		avl_it_start(&it, parent->uval.children);
+		while ((e = avl_it_next(&it)) != NULL) {
+			if (e->node.type != TREENODE_TYPE_LEAF_NULL) {
+				cache_index_insert(idx, e->key, &e->node);
+			}
+		}
+	}
+}
+
+static void cache_index_refresh(data_cache_t *cache, struct cache_index *idx, char *key) {
+	struct treenode *parent, *node;
+	struct index_ref ref;
+
+	if ((ref.e = avl_get(idx->by_key, &key)) != NULL) {
+		avl_remove(idx->ordered, &ref);
+		avl_remove(idx->by_key, &key);
+	}
+
+	parent = data_cache_get_parsed(cache, idx->path);
+
+	if (parent != NULL && parent->type == TREENODE_TYPE_INTERNAL
+			&& (node = internal_get(parent, key)) != NULL
+			&& node->type != TREENODE_TYPE_LEAF_NULL)
+	{
+		cache_index_insert(idx, key, node);
+	}
+}
+
+int cache_index_add(data_cache_t *cache, wc_ds_path_t *path, char *child) {
+	struct cache_index *idx;
+	wc_ds_path_t *parsed_child;
+
+	parsed_child = wc_datasync_path_new(child);
+	if (parsed_child == NULL) {
+		return -1;
+	}
+
+	if ((idx = cache_index_find(cache, path, parsed_child)) != NULL) {
+		wc_datasync_path_destroy(parsed_child);
+		idx->ref++;
+		return 0;
+	}
+
+	idx = calloc(1, sizeof(*idx));
+	idx->ref = 1;
+	idx->child = parsed_child;
+	idx->path = malloc(PATH_STRUCT_MAX_SIZE);
+	wc_datasync_path_copy(path, idx->path);
+	idx->by_key = avl_new(index_entry_cmp, index_entry_copy, index_entry_size, index_entry_cleanup);
+	idx->ordered = avl_new(index_ref_cmp, index_ref_copy, index_ref_size, index_ref_cleanup);
+
+	cache_index_rebuild(cache, idx);
+
+	idx->next = cache->indexes;
+	cache->indexes = idx;
+
+	return 0;
+}
+
+static void cache_index_destroy(struct cache_index *idx) {
+	avl_destroy(idx->ordered);
+	avl_destroy(idx->by_key);
+	wc_datasync_path_destroy(idx->path);
+	wc_datasync_path_destroy(idx->child);
+	free(idx);
+}
+
+int cache_index_remove(data_cache_t *cache, wc_ds_path_t *path, char *child) {
+	struct cache_index **prev, *idx;
+	wc_ds_path_t *parsed_child;
+	int ret = -1;
+
+	parsed_child = wc_datasync_path_new(child);
+	if (parsed_child == NULL) {
+		return -1;
+	}
+
+	for (prev = &cache->indexes ; (idx = *prev) != NULL ; prev = &idx->next) {
+		if (wc_datasync_path_cmp(idx->path, path) == 0
+				&& wc_datasync_path_cmp(idx->child, parsed_child) == 0)
+		{
+			if (--idx->ref == 0) {
+				*prev = idx->next;
+				cache_index_destroy(idx);
+			}
+			ret = 0;
+			break;
+		}
+	}
+
+	wc_datasync_path_destroy(parsed_child);
+
+	return ret;
+}
+
+/*
+ * Called after the data at `path`, or at `path`/`key` if key is not NULL,
+ * was updated: the indexes below the updated path are rebuilt, the indexes
+ * above it only refresh the entry of the child that contains the update.
+ */
+void cache_index_touch(data_cache_t *cache, wc_ds_path_t *path, char *key) {
+	struct cache_index *idx;
+	unsigned i, n, m, len;
+	char *part;
+
+	len = wc_datasync_path_get_part_count(path);
+	n = len + (key != NULL);
+
+	for (idx = cache->indexes ; idx != NULL ; idx = idx->next) {
+		m = wc_datasync_path_get_part_count(idx->path);
+
+		for (i = 0 ; i < n && i < m ; i++) {
+			part = i < len ? wc_datasync_path_get_part(path, i) : key;
+			if (strcmp(part, wc_datasync_path_get_part(idx->path, i)) != 0) {
+				break;
+			}
+		}
+
+		if (i < n && i < m) {
+			/* unrelated paths */
+			continue;
+		} else if (n <= m) {
+			cache_index_rebuild(cache, idx);
+		} else {
+			cache_index_refresh(cache, idx, m < len ? wc_datasync_path_get_part(path, m) : key);
+		}
+	}
+}
+
+void cache_index_destroy_all(data_cache_t *cache) {
+	struct cache_index *idx;
+
+	while ((idx = cache->indexes) != NULL) {
+		cache->indexes = idx->next;
+		cache_index_destroy(idx);
+	}
+}
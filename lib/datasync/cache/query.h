@@ -0,0 +1,74 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_CACHE_QUERY_H_
+#define LIB_DATASYNC_CACHE_QUERY_H_
+
+#include "webcom-c/webcom.h"
+
+#include "treenode.h"
+#include "treenode_cache.h"
+#include "../path.h"
+
+/*
+ * Local queries over the children of a cached node, and the secondary
+ * indexes that speed up the queries ordered by a child value.
+ *
+ * An index on (path, child) keeps the children of the node at path ordered
+ * by (value of child, key). It is refreshed incrementally by
+ * cache_index_touch(), that the cache calls for every updated path.
+ */
+
+/* an ordering value, scalars only, a TREENODE_TYPE_INTERNAL value only
+ * records the type */
+struct query_value {
+	enum treenode_type type;
+	union treenode_value uval;
+};
+
+struct cache_query {
+	enum wc_query_order order_by;
+	wc_ds_path_t *child;
+	struct query_value start;
+	struct query_value end;
+	unsigned has_start:1;
+	unsigned has_end:1;
+	unsigned has_hash:1;
+	unsigned offset;
+	unsigned limit_first;
+	unsigned limit_last;
+	unsigned char hash[20]; /* digest of the last delivered result */
+};
+
+struct cache_query *cache_query_new(struct wc_query *query);
+void cache_query_destroy(struct cache_query *q);
+char *cache_query_run(data_cache_t *cache, wc_ds_path_t *path, struct cache_query *q);
+int cache_query_result_changed(struct cache_query *q, char *result);
+
+int query_value_cmp(struct query_value *a, struct query_value *b);
+
+int cache_index_add(data_cache_t *cache, wc_ds_path_t *path, char *child);
+int cache_index_remove(data_cache_t *cache, wc_ds_path_t *path, char *child);
+void cache_index_touch(data_cache_t *cache, wc_ds_path_t *path, char *key);
+void cache_index_destroy_all(data_cache_t *cache);
+
+#endif /* LIB_DATASYNC_CACHE_QUERY_H_ */
@@ -0,0 +1,78 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+
+#include "../../webcom_base_priv.h"
+#include "webcom-c/webcom.h"
+#include "../path.h"
+#include "treenode_cache.h"
+#include "query.h"
+
+char *wc_datasync_query(wc_context_t *ctx, char *path, struct wc_query *query) {
+	struct cache_query *q;
+	wc_ds_path_t *parsed_path;
+	char *ret = NULL;
+
+	if (!ctx->datasync_init || (parsed_path = wc_datasync_path_new(path)) == NULL) {
+		return NULL;
+	}
+
+	if ((q = cache_query_new(query)) != NULL) {
+		ret = cache_query_run(ctx->datasync.cache, parsed_path, q);
+		cache_query_destroy(q);
+	}
+
+	wc_datasync_path_destroy(parsed_path);
+
+	return ret;
+}
+
+int wc_datasync_index_add(wc_context_t *ctx, char *path, char *child) {
+	wc_ds_path_t *parsed_path;
+	int ret;
+
+	if (!ctx->datasync_init || (parsed_path = wc_datasync_path_new(path)) == NULL) {
+		return -1;
+	}
+
+	ret = cache_index_add(ctx->datasync.cache, parsed_path, child);
+
+	wc_datasync_path_destroy(parsed_path);
+
+	return ret;
+}
+
+int wc_datasync_index_remove(wc_context_t *ctx, char *path, char *child) {
+	wc_ds_path_t *parsed_path;
+	int ret;
+
+	if (!ctx->datasync_init || (parsed_path = wc_datasync_path_new(path)) == NULL) {
+		return -1;
+	}
+
+	ret = cache_index_remove(ctx->datasync.cache, parsed_path, child);
+
+	wc_datasync_path_destroy(parsed_path);
+
+	return ret;
+}
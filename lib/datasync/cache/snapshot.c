@@ -0,0 +1,380 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "treenode.h"
+#include "query.h"
+#include "../../sha1.h"
+#include "webcom-c/webcom-log.h"
+
+#define SNAPSHOT_MAX_DEPTH 1024 /* bounds the recursion on malformed snapshots */
+
+struct snapshot_writer {
+	FILE *f;
+	wc_SHA1_CTX sha1;
+	uint64_t len;
+	uint64_t nodes;
+	int error;
+};
+
+struct snapshot_reader {
+	const unsigned char *p;
+	const unsigned char *end;
+	unsigned depth;
+	uint64_t nodes;
+};
+
+/* an element of an internal node, with room for the hash of its node */
+struct snapshot_elem {
+	struct internal_node_element e;
+	char hash[sizeof(treenode_hash_t)];
+};
+
+static void snapshot_put(struct snapshot_writer *w, const void *buf, size_t len) {
+	if (len == 0 || w->error) {
+		return;
+	}
+	if (fwrite(buf, 1, len, w->f) != len) {
+		w->error = 1;
+		return;
+	}
+	wc_SHA1Update(&w->sha1, buf, (uint32_t)len);
+	w->len += len;
+}
+
+static void snapshot_put_str(struct snapshot_writer *w, const char *s) {
+	uint32_t len = (uint32_t)strlen(s);
+
+	snapshot_put(w, &len, sizeof(len));
+	snapshot_put(w, s, len);
+}
+
+static void snapshot_put_node(struct snapshot_writer *w, struct treenode *n) {
+	uint8_t type = (uint8_t)n->type, b;
+	uint32_t count;
+	struct avl_it it;
+	struct internal_node_element *e;
+
+	w->nodes++;
+	if (n->hash_cached && n->type != TREENODE_TYPE_LEAF_BOOL && n->type != TREENODE_TYPE_LEAF_NULL) {
+		type |= SNAPSHOT_HAS_HASH;
+	}
+	snapshot_put(w, &type, 1);
+	if (type & SNAPSHOT_HAS_HASH) {
+		snapshot_put(w, n->hash, sizeof(treenode_hash_t));
+	}
+
+	switch (n->type) {
+	case TREENODE_TYPE_LEAF_NUMBER:
+		snapshot_put(w, &n->uval.number, sizeof(n->uval.number));
+		break;
+	case TREENODE_TYPE_LEAF_BOOL:
+		b = n->uval.bool == TN_TRUE;
+		snapshot_put(w, &b, 1);
+		break;
+	case TREENODE_TYPE_LEAF_STRING:
+		snapshot_put_str(w, n->uval.str);
+		break;
+	case TREENODE_TYPE_INTERNAL:
+		count = avl_count(n->uval.children);
+		snapshot_put(w, &count, sizeof(count));
+		avl_it_start(&it, n->uval.children);
+		while ((e = avl_it_next(&it)) != NULL) {
+			snapshot_put_str(w, e->key);
+			snapshot_put_node(w, &e->node);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void snapshot_header(unsigned char *header, uint64_t nodes, uint64_t len, const unsigned char *digest) {
+	uint32_t version = SNAPSHOT_VERSION;
+
+	memset(header, 0, SNAPSHOT_HEADER_LEN);
+	memcpy(header, SNAPSHOT_MAGIC, 4);
+	memcpy(header + 4, &version, 4);
+	memcpy(header + 8, &nodes, 8);
+	memcpy(header + 16, &len, 8);
+	memcpy(header + 24, digest, 20);
+}
+
+int cache_snapshot_save(data_cache_t *cache, const char *path) {
+	struct snapshot_writer w;
+	unsigned char header[SNAPSHOT_HEADER_LEN], digest[20];
+	char *tmp_path;
+	int ret = -1;
+
+	tmp_path = malloc(strlen(path) + sizeof(".tmp"));
+	if (tmp_path == NULL) {
+		return -1;
+	}
+	sprintf(tmp_path, "%s.tmp", path);
+
+	memset(&w, 0, sizeof(w));
+	w.f = fopen(tmp_path, "w");
+	if (w.f == NULL) {
+		WL_ERR("could not create the cache snapshot %s: %s", tmp_path, strerror(errno));
+		free(tmp_path);
+		return -1;
+	}
+
+	memset(header, 0, sizeof(header));
+	if (fwrite(header, 1, sizeof(header), w.f) != sizeof(header)) {
+		w.error = 1;
+	}
+	wc_SHA1Init(&w.sha1);
+	snapshot_put_node(&w, cache->root);
+	wc_SHA1Final(digest, &w.sha1);
+	snapshot_header(header, w.nodes, w.len, digest);
+
+	if (w.error
+			|| fseek(w.f, 0, SEEK_SET) != 0
+			|| fwrite(header, 1, sizeof(header), w.f) != sizeof(header)
+			|| fflush(w.f) != 0
+			|| fsync(fileno(w.f)) != 0)
+	{
+		WL_ERR("could not write the cache snapshot %s: %s", tmp_path, strerror(errno));
+		fclose(w.f);
+		unlink(tmp_path);
+	} else if (fclose(w.f) != 0 || rename(tmp_path, path) != 0) {
+		WL_ERR("could not save the cache snapshot %s: %s", path, strerror(errno));
+		unlink(tmp_path);
+	} else {
+		WL_DBG("cache snapshot %s saved: %"PRIu64" nodes, %"PRIu64" bytes", path, w.nodes, w.len + SNAPSHOT_HEADER_LEN);
+		ret = 0;
+	}
+
+	free(tmp_path);
+	return ret;
+}
+
+static int snapshot_get(struct snapshot_reader *r, void *buf, size_t len) {
+	if ((size_t)(r->end - r->p) < len) {
+		return -1;
+	}
+	memcpy(buf, r->p, len);
+	r->p += len;
+	return 0;
+}
+
+static char *snapshot_get_str(struct snapshot_reader *r) {
+	uint32_t len;
+	char *ret;
+
+	if (snapshot_get(r, &len, sizeof(len)) != 0 || (size_t)(r->end - r->p) < len) {
+		return NULL;
+	}
+	ret = malloc((size_t)len + 1);
+	if (ret != NULL) {
+		memcpy(ret, r->p, len);
+		ret[len] = '\0';
+		r->p += len;
+	}
+	return ret;
+}
+
+static int snapshot_get_node(struct snapshot_reader *r, struct treenode *n);
+
+static int snapshot_get_children(struct snapshot_reader *r, struct treenode *n) {
+	struct snapshot_elem *elems = NULL;
+	uint32_t count, i;
+	unsigned hash_cached;
+	char *key;
+
+	/* every child takes at least 5 bytes: the key length and the node type */
+	if (snapshot_get(r, &count, sizeof(count)) != 0 || count > (size_t)(r->end - r->p) / 5) {
+		return -1;
+	}
+	if (count > 0 && (elems = malloc(count * sizeof(*elems))) == NULL) {
+		return -1;
+	}
+
+	for (i = 0 ; i < count ; i++) {
+		key = snapshot_get_str(r);
+		if (key == NULL || (i > 0 && wc_datasync_key_cmp(elems[i - 1].e.key, key) >= 0)) {
+			free(key);
+			goto error;
+		}
+		elems[i].e.key = key;
+		if (snapshot_get_node(r, &elems[i].e.node) != 0) {
+			free(key);
+			goto error;
+		}
+	}
+
+	hash_cached = n->hash_cached;
+	treenode_init_internal(n);
+	n->hash_cached = hash_cached;
+	if (internal_bulk_load(n, elems, sizeof(*elems), count) != 0) {
+		treenode_cleanup(n);
+		goto error;
+	}
+	free(elems);
+	return 0;
+
+error:
+	while (i-- > 0) {
+		free(elems[i].e.key);
+		treenode_cleanup(&elems[i].e.node);
+	}
+	free(elems);
+	return -1;
+}
+
+/* decodes a node in n, which must have room for a hash */
+static int snapshot_get_node(struct snapshot_reader *r, struct treenode *n) {
+	uint8_t type, b;
+	int ret = 0;
+
+	if (r->depth >= SNAPSHOT_MAX_DEPTH || snapshot_get(r, &type, 1) != 0) {
+		return -1;
+	}
+	r->depth++;
+	r->nodes++;
+
+	n->hash_cached = 0;
+	if (type & SNAPSHOT_HAS_HASH) {
+		type &= ~SNAPSHOT_HAS_HASH;
+		if (type == TREENODE_TYPE_LEAF_BOOL || type == TREENODE_TYPE_LEAF_NULL
+				|| snapshot_get(r, n->hash, sizeof(treenode_hash_t)) != 0) {
+			return -1;
+		}
+		n->hash_cached = 1;
+	}
+
+	switch (type) {
+	case TREENODE_TYPE_LEAF_NULL:
+		n->type = TREENODE_TYPE_LEAF_NULL;
+		n->uval.null = NULL;
+		break;
+	case TREENODE_TYPE_LEAF_BOOL:
+		n->type = TREENODE_TYPE_LEAF_BOOL;
+		ret = snapshot_get(r, &b, 1);
+		n->uval.bool = b ? TN_TRUE : TN_FALSE;
+		break;
+	case TREENODE_TYPE_LEAF_NUMBER:
+		n->type = TREENODE_TYPE_LEAF_NUMBER;
+		ret = snapshot_get(r, &n->uval.number, sizeof(n->uval.number));
+		break;
+	case TREENODE_TYPE_LEAF_STRING:
+		n->type = TREENODE_TYPE_LEAF_STRING;
+		n->uval.str = snapshot_get_str(r);
+		ret = n->uval.str == NULL ? -1 : 0;
+		break;
+	case TREENODE_TYPE_INTERNAL:
+		ret = snapshot_get_children(r, n);
+		break;
+	default:
+		ret = -1;
+		break;
+	}
+
+	r->depth--;
+	return ret;
+}
+
+int cache_snapshot_load(data_cache_t *cache, const char *path) {
+	static wc_ds_path_t root_path = {._buf = "", ._norm = "/", .nparts = 0};
+	unsigned char digest[20];
+	const unsigned char *map;
+	struct snapshot_reader r;
+	struct treenode *root;
+	struct stat st;
+	uint64_t nodes, len;
+	uint32_t version;
+	wc_SHA1_CTX sha1;
+	int fd, ret = -1;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return -1;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < SNAPSHOT_HEADER_LEN) {
+		WL_ERR("cache snapshot %s: truncated", path);
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		WL_ERR("could not map the cache snapshot %s: %s", path, strerror(errno));
+		return -1;
+	}
+	madvise((void *)map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	memcpy(&version, map + 4, 4);
+	memcpy(&nodes, map + 8, 8);
+	memcpy(&len, map + 16, 8);
+	if (memcmp(map, SNAPSHOT_MAGIC, 4) != 0 || version != SNAPSHOT_VERSION
+			|| len != (uint64_t)st.st_size - SNAPSHOT_HEADER_LEN || len > UINT32_MAX)
+	{
+		WL_ERR("cache snapshot %s: bad header", path);
+		goto end;
+	}
+
+	wc_SHA1Init(&sha1);
+	wc_SHA1Update(&sha1, map + SNAPSHOT_HEADER_LEN, (uint32_t)len);
+	wc_SHA1Final(digest, &sha1);
+	if (memcmp(digest, map + 24, 20) != 0) {
+		WL_ERR("cache snapshot %s: digest mismatch", path);
+		goto end;
+	}
+
+	root = calloc(1, sizeof(*root) + sizeof(treenode_hash_t));
+	if (root == NULL) {
+		goto end;
+	}
+	memset(&r, 0, sizeof(r));
+	r.p = map + SNAPSHOT_HEADER_LEN;
+	r.end = r.p + len;
+	if (snapshot_get_node(&r, root) != 0) {
+		WL_ERR("cache snapshot %s: malformed tree", path);
+		free(root);
+		goto end;
+	} else if (r.p != r.end || r.nodes != nodes) {
+		WL_ERR("cache snapshot %s: unexpected size", path);
+		treenode_destroy(root);
+		goto end;
+	}
+
+	treenode_destroy(cache->root);
+	cache->root = root;
+	cache_index_touch(cache, &root_path, NULL);
+	WL_DBG("cache snapshot %s loaded: %"PRIu64" nodes", path, nodes);
+	ret = 0;
+
+end:
+	munmap((void *)map, (size_t)st.st_size);
+	return ret;
+}
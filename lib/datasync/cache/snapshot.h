@@ -0,0 +1,62 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_CACHE_SNAPSHOT_H_
+#define LIB_DATASYNC_CACHE_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include "treenode_cache.h"
+
+/*
+ * Binary snapshots of the data cache.
+ *
+ * A snapshot is a 48 bytes header followed by the tree, serialized in
+ * pre-order, in host byte order:
+ *
+ *     header: "WCS1", uint32_t version, uint64_t node count, uint64_t body
+ *             length, SHA-1 digest of the body (20 bytes), 4 reserved bytes
+ *     node:   uint8_t type (enum treenode_type), ORed with
+ *             SNAPSHOT_HAS_HASH if the 28 bytes hash of the node follows,
+ *             then, depending on the type:
+ *               number:   double
+ *               bool:     uint8_t
+ *               string:   uint32_t length, bytes
+ *               internal: uint32_t child count, then for each child in key
+ *                         order: uint32_t key length, key bytes, node
+ *
+ * Loading maps the file, verifies its digest and builds the tree bottom-up:
+ * the children of every internal node are already sorted, and are loaded in
+ * their AVL tree in linear time, without any comparison nor rebalancing. The
+ * node hashes saved in the snapshot are restored, so that they don't need to
+ * be computed again.
+ */
+
+#define SNAPSHOT_MAGIC "WCS1"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_LEN 48
+#define SNAPSHOT_HAS_HASH 0x80
+
+int cache_snapshot_save(data_cache_t *cache, const char *path);
+int cache_snapshot_load(data_cache_t *cache, const char *path);
+
+#endif /* LIB_DATASYNC_CACHE_SNAPSHOT_H_ */
@@ -21,6 +21,7 @@
  */
 
 #include <string.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -98,6 +99,18 @@ struct treenode *internal_get(struct treenode *internal, char *key) {
 	return tmp != NULL ? &tmp->node : NULL;
 }
 
+struct internal_node_element *internal_nth(struct treenode *internal, unsigned n) {
+	assert(internal->type == TREENODE_TYPE_INTERNAL);
+
+	return avl_nth(internal->uval.children, n);
+}
+
+unsigned internal_rank(struct treenode *internal, char *key) {
+	assert(internal->type == TREENODE_TYPE_INTERNAL);
+
+	return avl_rank(internal->uval.children, &key);
+}
+
 void internal_add(struct treenode *internal, char *key, struct treenode *node) {
 	struct internal_node_element tmp;
 
@@ -111,6 +124,43 @@ void internal_add(struct treenode *internal, char *key, struct treenode *node) {
 	treenode_destroy(node);
 }
 
+/* same as internal_add(), but the node is moved instead of being deep copied,
+ * including its hash if it is cached: it must have been allocated by one of
+ * the treenode_new_XXX() functions, and must not be used afterwards */
+void internal_add_move(struct treenode *internal, char *key, struct treenode *node) {
+	struct {
+		struct internal_node_element e;
+		char h[sizeof(treenode_hash_t)];
+	} tmp;
+
+	assert(internal->type == TREENODE_TYPE_INTERNAL);
+
+	tmp.e.key = strdup(key);
+	memcpy(&tmp.e.node, node, internal_element_size(&tmp.e) - offsetof(struct internal_node_element, node));
+
+	if (avl_insert_move(internal->uval.children, &tmp.e) == NULL) {
+		internal_element_data_cleanup(&tmp.e);
+	}
+
+	free(node);
+}
+
+/* moves the node of an element of an internal node out of it, to a new node
+ * that can be passed to internal_add_move(), the element is left with a null
+ * node */
+struct treenode *internal_steal(struct internal_node_element *e) {
+	size_t size = internal_element_size(e) - offsetof(struct internal_node_element, node);
+	struct treenode *ret;
+
+	ret = malloc(size);
+	if (ret != NULL) {
+		memcpy(ret, &e->node, size);
+		e->node.type = TREENODE_TYPE_LEAF_NULL;
+	}
+
+	return ret;
+}
+
 void internal_remove(struct treenode *internal, char *key) {
 	assert(internal->type == TREENODE_TYPE_INTERNAL);
 
@@ -240,6 +290,20 @@ struct treenode *treenode_new_internal() {
 	return ret;
 }
 
+void treenode_init_internal(struct treenode *n) {
+	n->type = TREENODE_TYPE_INTERNAL;
+	n->hash_cached = 0;
+	n->uval.children = avl_new(internal_element_key_cmp, internal_element_copy, internal_element_size, internal_element_data_cleanup);
+}
+
+/* fills an empty internal node with n elements (struct internal_node_element
+ * followed by room for their hash) sorted by key, they are moved into it */
+int internal_bulk_load(struct treenode *internal, void *sorted, size_t stride, unsigned n) {
+	assert(internal->type == TREENODE_TYPE_INTERNAL);
+
+	return avl_bulk_load(internal->uval.children, sorted, stride, n);
+}
+
 void treenode_cleanup(struct treenode *node) {
 	if (node->type == TREENODE_TYPE_INTERNAL) {
 		avl_destroy(node->uval.children);
@@ -73,12 +73,18 @@ void ftreenode_to_json(struct treenode *n, FILE *stream);
 int treenode_hash_eq(treenode_hash_t *h1, treenode_hash_t *h2);
 
 struct treenode *internal_get(struct treenode *internal, char *key);
+struct internal_node_element *internal_nth(struct treenode *internal, unsigned n);
+unsigned internal_rank(struct treenode *internal, char *key);
 void internal_remove(struct treenode *internal, char *key);
 struct treenode *internal_add_new_number(struct treenode *internal, char *key, double number);
 struct treenode *internal_add_new_bool(struct treenode *internal, char *key, enum treenode_bool bool);
 struct treenode *internal_add_new_string(struct treenode *internal, char *key, char *string);
 struct treenode *internal_add_new_null(struct treenode *internal, char *key);
 struct treenode *internal_add_new_internal(struct treenode *internal, char *key);
+int internal_bulk_load(struct treenode *internal, void *sorted, size_t stride, unsigned n);
+void internal_add_move(struct treenode *internal, char *key, struct treenode *node);
+struct treenode *internal_steal(struct internal_node_element *e);
+void treenode_init_internal(struct treenode *n);
 struct treenode *treenode_new(enum treenode_type type, union treenode_value uval);
 struct treenode *treenode_new_number(double number);
 struct treenode *treenode_new_bool(enum treenode_bool bool);
@@ -33,6 +33,7 @@
 
 #include "treenode_cache.h"
 #include "treenode.h"
+#include "query.h"
 
 static void data_cache_mkpath_w(data_cache_t *cache, wc_ds_path_t *path, int reset_hash, int empty_target);
 static struct treenode *data_cache_get_r(struct treenode *node, wc_ds_path_t *path, unsigned depth);
@@ -55,6 +56,7 @@ static void data_cache_empty(data_cache_t *cache) {
 }
 
 void data_cache_destroy(data_cache_t *cache) {
+	cache_index_destroy_all(cache);
 	data_cache_empty(cache);
 	on_registry_destroy(cache->registry);
 	free(cache);
@@ -115,6 +117,7 @@ void data_cache_set_leaf(data_cache_t *cache, char *path, enum treenode_type typ
 			break;
 		}
 	}
+	cache_index_touch(cache, parsed_path, NULL);
 	wc_datasync_path_destroy(parsed_path);
 }
 
@@ -209,6 +212,8 @@ void data_cache_set_ex(data_cache_t *cache, wc_ds_path_t * parsed_path, json_obj
 
 		data_cache_set_r(cache, n, wc_datasync_path_get_part(parsed_path, nparts - 1), parsed_json);
 	}
+
+	cache_index_touch(cache, parsed_path, NULL);
 }
 
 static void data_cache_set_r(data_cache_t *cache, struct treenode *root, char *key, json_object *value) {
@@ -293,6 +298,8 @@ void data_cache_merge_ex(data_cache_t *cache, wc_ds_path_t * parsed_path, json_o
 		data_cache_empty(cache);
 
 		data_cache_set_r(cache, NULL, NULL, parsed_json);
+
+		cache_index_touch(cache, parsed_path, NULL);
 	} else {
 		struct treenode *n;
 
@@ -302,10 +309,53 @@ void data_cache_merge_ex(data_cache_t *cache, wc_ds_path_t * parsed_path, json_o
 		json_object_object_foreach(parsed_json, obj_key, obj_val) {
 			avl_remove(n->uval.children, &obj_key);
 			data_cache_set_r(cache, n, obj_key, obj_val);
+			cache_index_touch(cache, parsed_path, obj_key);
 		}
 	}
 }
+/* returns NULL for a JSON null, as setting null at some path removes it */
+struct treenode *data_cache_tree_new(json_object *value) {
+	data_cache_t detached = {.root = NULL};
+
+	if (json_object_get_type(value) == json_type_null) {
+		return NULL;
+	}
 
+	data_cache_set_r(&detached, NULL, NULL, value);
+
+	return detached.root;
+}
+
+/* same as data_cache_set_ex(), from a tree returned by data_cache_tree_new(),
+ * which is moved into the cache (O(depth), the hashes it already computed
+ * are kept) */
+void data_cache_set_tree(data_cache_t *cache, wc_ds_path_t *parsed_path, struct treenode *tree) {
+	unsigned nparts;
+
+	nparts = wc_datasync_path_get_part_count(parsed_path);
+	if (nparts == 0) {
+		data_cache_empty(cache);
+
+		cache->root = tree != NULL ? tree : treenode_new_null();
+	} else {
+		struct treenode *n;
+		char *key;
+
+		parsed_path->nparts--; /* push(hack) */
+		data_cache_mkpath_w(cache, parsed_path, 1, 0);
+		n = data_cache_get_r(cache->root, parsed_path, 0);
+		parsed_path->nparts++; /* pop() */
+
+		key = wc_datasync_path_get_part(parsed_path, nparts - 1);
+		internal_remove(n, key);
+
+		if (tree != NULL) {
+			internal_add_move(n, key, tree);
+		}
+	}
+
+	cache_index_touch(cache, parsed_path, NULL);
+}
 
 static void data_cache_mkpath_w(data_cache_t *cache, wc_ds_path_t *path, int reset_hash, int empty_target) {
 	struct treenode *cur;
@@ -347,6 +397,7 @@ static void data_cache_mkpath_w(data_cache_t *cache, wc_ds_path_t *path, int res
 void data_cache_mkpath(data_cache_t *cache, char *path) {
 	wc_ds_path_t *parsed_path = wc_datasync_path_new(path);
 	data_cache_mkpath_w(cache, parsed_path, 1, 0);
+	cache_index_touch(cache, parsed_path, NULL);
 	wc_datasync_path_destroy(parsed_path);
 }
 
@@ -379,3 +430,26 @@ struct treenode *data_cache_get(data_cache_t *cache, char *path) {
 struct treenode *data_cache_get_parsed(data_cache_t *cache, wc_ds_path_t *path) {
 	return data_cache_get_r(cache->root, path, 0);
 }
+
+unsigned data_cache_child_count(data_cache_t *cache, wc_ds_path_t *path) {
+	struct treenode *n = data_cache_get_r(cache->root, path, 0);
+
+	return (n != NULL && n->type == TREENODE_TYPE_INTERNAL) ? avl_count(n->uval.children) : 0;
+}
+
+struct internal_node_element *data_cache_child_nth(data_cache_t *cache, wc_ds_path_t *path, unsigned n) {
+	struct treenode *node = data_cache_get_r(cache->root, path, 0);
+
+	return (node != NULL && node->type == TREENODE_TYPE_INTERNAL) ? internal_nth(node, n) : NULL;
+}
+
+/* returns the position of key among the children of path, -1 if absent */
+int data_cache_child_rank(data_cache_t *cache, wc_ds_path_t *path, char *key) {
+	struct treenode *node = data_cache_get_r(cache->root, path, 0);
+
+	if (node == NULL || node->type != TREENODE_TYPE_INTERNAL || internal_get(node, key) == NULL) {
+		return -1;
+	}
+
+	return (int)internal_rank(node, key);
+}
@@ -33,6 +33,7 @@
 typedef struct data_cache {
 	struct treenode *root;
 	struct on_registry *registry;
+	struct cache_index *indexes; /* secondary indexes used by the queries */
 } data_cache_t;
 
 data_cache_t *data_cache_new();
@@ -45,10 +46,20 @@ void data_cache_set_ex(data_cache_t *cache, wc_ds_path_t * parsed_path, json_obj
 void data_cache_merge(data_cache_t *cache, char *path, char *json_doc);
 void data_cache_merge_ex(data_cache_t *cache, wc_ds_path_t * parsed_path, json_object *parsed_json);
 void data_cache_mkpath(data_cache_t *cache, char *path);
+
+/* detached subtrees: built from a parsed document without touching any cache
+ * (safe from any thread), then moved into the cache at some path */
+struct treenode *data_cache_tree_new(json_object *value);
+void data_cache_set_tree(data_cache_t *cache, wc_ds_path_t *parsed_path, struct treenode *tree);
 void data_cache_set_leaf(data_cache_t *cache, char *path, enum treenode_type type, union treenode_value uval);
 
 struct treenode *data_cache_get(data_cache_t *cache, char *path);
 struct treenode *data_cache_get_parsed(data_cache_t *cache, wc_ds_path_t *path);
 
+/* positional access to the children of a node, in key order, O(log n) */
+unsigned data_cache_child_count(data_cache_t *cache, wc_ds_path_t *path);
+struct internal_node_element *data_cache_child_nth(data_cache_t *cache, wc_ds_path_t *path, unsigned n);
+int data_cache_child_rank(data_cache_t *cache, wc_ds_path_t *path, char *key);
+
 
 #endif /* SRC_TREENODE_CACHE_H_ */
@@ -0,0 +1,355 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cbor.h"
+
+/* major types */
+#define CBOR_UINT   0
+#define CBOR_NEGINT 1
+#define CBOR_BYTES  2
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+#define CBOR_MAP    5
+#define CBOR_TAG    6
+#define CBOR_SIMPLE 7
+
+#define CBOR_FALSE   0xf4
+#define CBOR_TRUE    0xf5
+#define CBOR_NULL    0xf6
+#define CBOR_FLOAT16 0xf9
+#define CBOR_FLOAT32 0xfa
+#define CBOR_FLOAT64 0xfb
+
+struct cbor_reader {
+	const unsigned char *p;
+	const unsigned char *end;
+	unsigned depth;
+};
+
+void cbor_buf_init(struct cbor_buf *b) {
+	memset(b, 0, sizeof(*b));
+}
+
+void cbor_buf_cleanup(struct cbor_buf *b) {
+	free(b->data);
+	cbor_buf_init(b);
+}
+
+int cbor_buf_append(struct cbor_buf *b, const void *data, size_t len) {
+	unsigned char *tmp;
+	size_t size;
+
+	if (b->len + len > b->size) {
+		for (size = b->size ? b->size : 256 ; size < b->len + len ; size *= 2);
+		tmp = realloc(b->data, size);
+		if (tmp == NULL) {
+			return -1;
+		}
+		b->data = tmp;
+		b->size = size;
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	return 0;
+}
+
+/* the initial byte, followed by the argument in the shortest form */
+static int cbor_put_head(struct cbor_buf *b, unsigned major, uint64_t arg) {
+	unsigned char head[9];
+	size_t n, i;
+
+	if (arg < 24) {
+		head[0] = (unsigned char)(major << 5 | arg);
+		return cbor_buf_append(b, head, 1);
+	}
+	if (arg <= UINT8_MAX) {
+		head[0] = (unsigned char)(major << 5 | 24);
+		n = 1;
+	} else if (arg <= UINT16_MAX) {
+		head[0] = (unsigned char)(major << 5 | 25);
+		n = 2;
+	} else if (arg <= UINT32_MAX) {
+		head[0] = (unsigned char)(major << 5 | 26);
+		n = 4;
+	} else {
+		head[0] = (unsigned char)(major << 5 | 27);
+		n = 8;
+	}
+	for (i = 0 ; i < n ; i++) {
+		head[n - i] = (unsigned char)(arg >> (8 * i));
+	}
+	return cbor_buf_append(b, head, n + 1);
+}
+
+static int cbor_put_text(struct cbor_buf *b, const char *s, size_t len) {
+	return cbor_put_head(b, CBOR_TEXT, len) || cbor_buf_append(b, s, len);
+}
+
+static int cbor_put_double(struct cbor_buf *b, double d) {
+	unsigned char buf[9];
+	uint64_t bits;
+	int i;
+
+	memcpy(&bits, &d, sizeof(bits));
+	buf[0] = CBOR_FLOAT64;
+	for (i = 0 ; i < 8 ; i++) {
+		buf[8 - i] = (unsigned char)(bits >> (8 * i));
+	}
+	return cbor_buf_append(b, buf, sizeof(buf));
+}
+
+int cbor_encode(json_object *jobj, struct cbor_buf *out) {
+	unsigned char simple;
+	int64_t i;
+	size_t n, k;
+
+	switch (json_object_get_type(jobj)) {
+	case json_type_null:
+		simple = CBOR_NULL;
+		return cbor_buf_append(out, &simple, 1);
+	case json_type_boolean:
+		simple = json_object_get_boolean(jobj) ? CBOR_TRUE : CBOR_FALSE;
+		return cbor_buf_append(out, &simple, 1);
+	case json_type_int:
+		i = json_object_get_int64(jobj);
+		return i >= 0
+				? cbor_put_head(out, CBOR_UINT, (uint64_t)i)
+				: cbor_put_head(out, CBOR_NEGINT, (uint64_t)-(i + 1));
+	case json_type_double:
+		return cbor_put_double(out, json_object_get_double(jobj));
+	case json_type_string:
+		return cbor_put_text(out, json_object_get_string(jobj), (size_t)json_object_get_string_len(jobj));
+	case json_type_array:
+		n = json_object_array_length(jobj);
+		if (cbor_put_head(out, CBOR_ARRAY, n)) {
+			return -1;
+		}
+		for (k = 0 ; k < n ; k++) {
+			if (cbor_encode(json_object_array_get_idx(jobj, k), out)) {
+				return -1;
+			}
+		}
+		return 0;
+	case json_type_object:
+		if (cbor_put_head(out, CBOR_MAP, (uint64_t)json_object_object_length(jobj))) {
+			return -1;
+		}
+		json_object_object_foreach(jobj, key, val) {
+			if (cbor_put_text(out, key, strlen(key)) || cbor_encode(val, out)) {
+				return -1;
+			}
+		}
+		return 0;
+	}
+	return -1;
+}
+
+static int cbor_get_arg(struct cbor_reader *r, unsigned info, uint64_t *arg) {
+	size_t n, i;
+
+	if (info < 24) {
+		*arg = info;
+		return 0;
+	}
+	switch (info) {
+	case 24: n = 1; break;
+	case 25: n = 2; break;
+	case 26: n = 4; break;
+	case 27: n = 8; break;
+	default:
+		/* indefinite lengths are not produced by the encoder */
+		return -1;
+	}
+	if ((size_t)(r->end - r->p) < n) {
+		return -1;
+	}
+	for (*arg = 0, i = 0 ; i < n ; i++) {
+		*arg = *arg << 8 | *r->p++;
+	}
+	return 0;
+}
+
+static double cbor_half_to_double(uint16_t h) {
+	int exp = (h >> 10) & 0x1f;
+	double d = h & 0x3ff;
+
+	if (exp == 31) {
+		d = d == 0 ? INFINITY : NAN;
+	} else {
+		/* mantissa * 2^(exp - 25), exact (no libm dependency) */
+		if (exp != 0) {
+			d += 1024;
+		} else {
+			exp = 1;
+		}
+		for (exp -= 25 ; exp > 0 ; exp--) d *= 2;
+		for ( ; exp < 0 ; exp++) d /= 2;
+	}
+	return h & 0x8000 ? -d : d;
+}
+
+static json_object *cbor_get_float(unsigned info, uint64_t bits) {
+	uint32_t b32;
+	double d;
+	float f;
+
+	switch (info) {
+	case 25:
+		d = cbor_half_to_double((uint16_t)bits);
+		break;
+	case 26:
+		b32 = (uint32_t)bits;
+		memcpy(&f, &b32, sizeof(f));
+		d = f;
+		break;
+	default:
+		memcpy(&d, &bits, sizeof(d));
+		break;
+	}
+	return json_object_new_double(d);
+}
+
+static int cbor_get_item(struct cbor_reader *r, json_object **res) {
+	json_object *jobj, *jkey, *jval;
+	unsigned major, info;
+	uint64_t arg, k;
+	int ret;
+
+	if (r->p == r->end || r->depth >= CBOR_MAX_DEPTH) {
+		return -1;
+	}
+	major = *r->p >> 5;
+	info = *r->p++ & 0x1f;
+	if (cbor_get_arg(r, info, &arg)) {
+		return -1;
+	}
+
+	switch (major) {
+	case CBOR_UINT:
+		if (arg > INT64_MAX) {
+			return -1;
+		}
+		*res = json_object_new_int64((int64_t)arg);
+		return 0;
+	case CBOR_NEGINT:
+		if (arg > INT64_MAX) {
+			return -1;
+		}
+		*res = json_object_new_int64(-(int64_t)arg - 1);
+		return 0;
+	case CBOR_TEXT:
+		if (arg > (uint64_t)(r->end - r->p) || arg > INT32_MAX) {
+			return -1;
+		}
+		*res = json_object_new_string_len((const char *)r->p, (int)arg);
+		r->p += arg;
+		return 0;
+	case CBOR_ARRAY:
+		/* every item takes at least one byte */
+		if (arg > (uint64_t)(r->end - r->p)) {
+			return -1;
+		}
+		jobj = json_object_new_array();
+		r->depth++;
+		for (k = 0 ; k < arg ; k++) {
+			if (cbor_get_item(r, &jval)) {
+				json_object_put(jobj);
+				return -1;
+			}
+			json_object_array_add(jobj, jval);
+		}
+		r->depth--;
+		*res = jobj;
+		return 0;
+	case CBOR_MAP:
+		if (arg > (uint64_t)(r->end - r->p) / 2) {
+			return -1;
+		}
+		jobj = json_object_new_object();
+		r->depth++;
+		for (k = 0 ; k < arg ; k++) {
+			/* the keys must be text strings */
+			if (r->p == r->end || *r->p >> 5 != CBOR_TEXT || cbor_get_item(r, &jkey)) {
+				json_object_put(jobj);
+				return -1;
+			}
+			if (cbor_get_item(r, &jval)) {
+				json_object_put(jkey);
+				json_object_put(jobj);
+				return -1;
+			}
+			json_object_object_add(jobj, json_object_get_string(jkey), jval);
+			json_object_put(jkey);
+		}
+		r->depth--;
+		*res = jobj;
+		return 0;
+	case CBOR_TAG:
+		r->depth++;
+		ret = cbor_get_item(r, res);
+		r->depth--;
+		return ret;
+	case CBOR_SIMPLE:
+		switch (info) {
+		case CBOR_FALSE & 0x1f:
+			*res = json_object_new_boolean(0);
+			return 0;
+		case CBOR_TRUE & 0x1f:
+			*res = json_object_new_boolean(1);
+			return 0;
+		case CBOR_NULL & 0x1f:
+			*res = NULL;
+			return 0;
+		case 25:
+		case 26:
+		case 27:
+			*res = cbor_get_float(info, arg);
+			return 0;
+		}
+		return -1;
+	case CBOR_BYTES:
+	default:
+		return -1;
+	}
+}
+
+/*
+ * decodes a complete CBOR item, returns 0 on success (a JSON null is decoded
+ * as NULL), -1 if the buffer is not valid CBOR, or has trailing bytes
+ */
+int cbor_decode(const unsigned char *buf, size_t len, json_object **res) {
+	struct cbor_reader r = {.p = buf, .end = buf + len, .depth = 0};
+
+	if (cbor_get_item(&r, res)) {
+		return -1;
+	}
+	if (r.p != r.end) {
+		json_object_put(*res);
+		return -1;
+	}
+	return 0;
+}
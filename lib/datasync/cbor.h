@@ -0,0 +1,54 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_CBOR_H_
+#define LIB_DATASYNC_CBOR_H_
+
+#include <stddef.h>
+#include <json-c/json.h>
+
+/*
+ * CBOR (RFC 7049) encoding of the JSON documents exchanged with the server,
+ * used by the binary framing of the datasync protocol.
+ *
+ * Only the subset matching the JSON data model is produced: maps with text
+ * keys, arrays, text strings, integers, float64, booleans and null, all with
+ * definite lengths. The decoder also accepts half and single precision
+ * floats, and skips the semantic tags.
+ */
+
+#define CBOR_MAX_DEPTH 32 /* as json-c's default */
+
+struct cbor_buf {
+	unsigned char *data;
+	size_t len;
+	size_t size;
+};
+
+void cbor_buf_init(struct cbor_buf *b);
+void cbor_buf_cleanup(struct cbor_buf *b);
+int cbor_buf_append(struct cbor_buf *b, const void *data, size_t len);
+
+int cbor_encode(json_object *jobj, struct cbor_buf *out);
+int cbor_decode(const unsigned char *buf, size_t len, json_object **res);
+
+#endif /* LIB_DATASYNC_CBOR_H_ */
@@ -33,19 +33,41 @@
 #include <libwebsockets.h>
 #include <assert.h>
 #include <poll.h>
+#include <inttypes.h>
 
 #include "../webcom_base_priv.h"
 #include "webcom-c/webcom.h"
 
 #include "on/on_registry.h"
 #include "cache/treenode_cache.h"
+#include "cache/snapshot.h"
 #include "listen/listen_registry.h"
 
+#ifdef HAVE_TCPI_BYTES_RECEIVED
+#include <linux/tcp.h>
+#endif
+
 #define WEBCOM_PROTOCOL_VERSION "5"
 #define WEBCOM_WS_PATH "/_wss/.ws"
+#define WEBCOM_BINARY_FRAMING_ARG "&enc=cbor"
+#define WEBCOM_KEEPALIVE_MS 50000
+#define WEBCOM_TX_DEFAULT_HIGH_WATERMARK (1 << 20)
+#define WEBCOM_DEFLATE_EXT_NAME "permessage-deflate"
+
+static void _wc_datasync_offline_replay(wc_context_t *ctx);
+static void _wc_datasync_journal_replay(wc_context_t *ctx);
+
+/* moves the trees built by a parser thread (see rx_offload.c) into the cache */
+static void _wc_datasync_set_trees(wc_context_t *ctx, struct rx_tree *trees, unsigned ntrees) {
+	unsigned i;
 
-static int _wc_datasync_process_message(wc_context_t *ctx, wc_msg_t *msg) {
-	struct wc_timerargs ta;
+	for (i = 0 ; i < ntrees ; i++) {
+		data_cache_set_tree(ctx->datasync.cache, trees[i].path, trees[i].tree);
+		trees[i].tree = NULL;
+	}
+}
+
+void wc_datasync_process_message(wc_context_t *ctx, wc_msg_t *msg, struct rx_tree *trees, unsigned ntrees) {
 	if (msg->type == WC_MSG_CTRL && msg->u.ctrl.type == WC_CTRL_MSG_HANDSHAKE) {
 		int64_t now = wc_datasync_now();
 		srand48_r((long int)now, &ctx->datasync.pids.rand_buffer);
@@ -54,32 +76,79 @@ static int _wc_datasync_process_message(wc_context_t *ctx, wc_msg_t *msg) {
 		ctx->datasync.time_offset = wc_datasync_now() - msg->u.ctrl.u.handshake.ts;
 		ctx->datasync.stamp++;
 		wc_listen_resume_all(ctx);
+		/* the older writes are sent before the ones the application may issue
+		 * from the handshake event */
+		_wc_datasync_journal_replay(ctx);
+		_wc_datasync_offline_replay(ctx);
 		ctx->callback(WC_EVENT_ON_SERVER_HANDSHAKE, ctx, msg, sizeof(wc_msg_t));
-		ta.ms = 50000;
-		ta.repeat = 1;
-		ta.timer = WC_TIMER_DATASYNC_KEEPALIVE;
-		ctx->datasync.ws_next_reconnect_timer = 1;
-		ctx->callback(WC_EVENT_SET_TIMER, ctx, &ta, 0);
+		ctx->datasync.connected_at = wc_timer_now();
+		wc_timer_arm(ctx, &ctx->datasync.keepalive_timer, WEBCOM_KEEPALIVE_MS);
 	} else if (msg->type == WC_MSG_DATA
 			&& msg->u.data.type == WC_DATA_MSG_PUSH)
 	{
 		if (msg->u.data.u.push.type == WC_PUSH_DATA_UPDATE_PUT) {
-			data_cache_set(ctx->datasync.cache, msg->u.data.u.push.u.update_put.path, msg->u.data.u.push.u.update_put.data);
+			if (trees != NULL) {
+				_wc_datasync_set_trees(ctx, trees, ntrees);
+			} else {
+				data_cache_set(ctx->datasync.cache, msg->u.data.u.push.u.update_put.path, msg->u.data.u.push.u.update_put.data);
+			}
+			cache_overlay_reconcile(&ctx->datasync.overlays, ctx->datasync.cache, ctx->datasync.on_reg, msg->u.data.u.push.u.update_put.path);
 			on_registry_dispatch_on_event(ctx->datasync.on_reg, ctx->datasync.cache, msg->u.data.u.push.u.update_put.path);
 		} else if (msg->u.data.u.push.type == WC_PUSH_DATA_UPDATE_MERGE) {
-			data_cache_merge(ctx->datasync.cache, msg->u.data.u.push.u.update_put.path, msg->u.data.u.push.u.update_put.data);
+			if (trees != NULL) {
+				_wc_datasync_set_trees(ctx, trees, ntrees);
+			} else {
+				data_cache_merge(ctx->datasync.cache, msg->u.data.u.push.u.update_put.path, msg->u.data.u.push.u.update_put.data);
+			}
+			cache_overlay_reconcile(&ctx->datasync.overlays, ctx->datasync.cache, ctx->datasync.on_reg, msg->u.data.u.push.u.update_put.path);
 			on_registry_dispatch_on_event(ctx->datasync.on_reg, ctx->datasync.cache, msg->u.data.u.push.u.update_put.path);
 		}
 	} else if (msg->type == WC_MSG_DATA && msg->u.data.type == WC_DATA_MSG_RESPONSE) {
 		wc_datasync_req_response_dispatch(ctx, &msg->u.data.u.response);
 	}
 	ctx->callback(WC_EVENT_ON_MSG_RECEIVED, ctx, msg, sizeof(wc_msg_t));
-	return 1;
+}
+
+/* the fragments are parsed as they come (see rx_stream.c) */
+static void _wc_datasync_process_stream(wc_context_t *ctx, char *buf, size_t len) {
+	struct rx_tree *trees;
+	unsigned ntrees;
+	size_t used;
+	wc_msg_t msg;
+
+	while (len > 0) {
+		switch (rx_stream_feed(ctx->datasync.rxs, buf, len, &used)) {
+		case WC_PARSER_OK:
+			if (rx_stream_finish(ctx->datasync.rxs, &msg, &trees, &ntrees)) {
+				wc_datasync_process_message(ctx, &msg, trees, ntrees);
+				wc_datasync_msg_free(&msg);
+				rx_trees_free(trees, ntrees);
+			}
+			break;
+		case WC_PARSER_ERROR:
+			WL_WARN("dropping an invalid message in context %p: %s", ctx, ctx->datasync.rxs->error);
+			break;
+		case WC_PARSER_CONTINUE:
+			break;
+		}
+		buf += used;
+		len -= used;
+	}
 }
 
 void _wc_datasync_process_data(wc_context_t *ctx, char *buf, size_t len) {
 	wc_msg_t msg;
 
+	if (ctx->datasync.rxo != NULL) {
+		WL_DBG("%zu bytes received", len);
+		wc_datasync_rx_offload_data(ctx, buf, len);
+		return;
+	} else if (ctx->datasync.rxs != NULL) {
+		WL_DBG("%zu bytes received", len);
+		_wc_datasync_process_stream(ctx, buf, len);
+		return;
+	}
+
 	if (ctx->datasync.parser == NULL) {
 		if (*buf == '{') {
 			ctx->datasync.parser = wc_datasync_parser_new();
@@ -92,7 +161,7 @@ void _wc_datasync_process_data(wc_context_t *ctx, char *buf, size_t len) {
 
 	switch (wc_datasync_parse_msg_ex(ctx->datasync.parser, buf, (size_t)len, &msg)) {
 	case WC_PARSER_OK:
-		_wc_datasync_process_message(ctx, &msg);
+		wc_datasync_process_message(ctx, &msg, NULL, 0);
 		wc_datasync_parser_free(ctx->datasync.parser);
 		ctx->datasync.parser = NULL;
 		wc_datasync_msg_free(&msg);
@@ -106,16 +175,425 @@ void _wc_datasync_process_data(wc_context_t *ctx, char *buf, size_t len) {
 	}
 }
 
+/*
+ * binary framing: the fragments are gathered until the end of the message,
+ * which is decoded at once
+ */
+static void _wc_datasync_process_binary(wc_context_t *ctx, struct lws *wsi, char *buf, size_t len) {
+	struct cbor_buf *b = &ctx->datasync.rx_bin;
+	wc_msg_t msg;
+
+	if (cbor_buf_append(b, buf, len) != 0) {
+		/* the rest of the message will not decode */
+		WL_ERR("could not allocate %zu bytes for a binary message", b->len + len);
+		b->len = 0;
+	}
+	if (!lws_is_final_fragment(wsi) || lws_remaining_packet_payload(wsi) > 0) {
+		return;
+	}
+
+	WL_DBG("%zu bytes received in a binary message", b->len);
+	if (wc_datasync_parse_msg_cbor(b->data, b->len, &msg)) {
+		if (msg.type == WC_MSG_CTRL && msg.u.ctrl.type == WC_CTRL_MSG_HANDSHAKE && ctx->binary_framing) {
+			/* before the handshake is processed: it triggers the replays */
+			ctx->datasync.binary_active = 1;
+		}
+		wc_datasync_process_message(ctx, &msg, NULL, 0);
+		wc_datasync_msg_free(&msg);
+	} else {
+		WL_WARN("dropping an invalid binary message of %zu bytes in context %p", b->len, ctx);
+	}
+
+	if (b->size > WC_RX_BIN_KEEP) {
+		cbor_buf_cleanup(b);
+	} else {
+		b->len = 0;
+	}
+}
+
+/*
+ * forgets what was received on a closed connection, a message cut off by the
+ * disconnection must not be continued by the first frames of the next one
+ */
+static void _wc_datasync_rx_reset(wc_context_t *ctx) {
+	if (ctx->datasync.parser != NULL) {
+		wc_datasync_parser_free(ctx->datasync.parser);
+		ctx->datasync.parser = NULL;
+	}
+	wc_datasync_rx_offload_reset(ctx);
+	if (ctx->datasync.rxs != NULL) {
+		rx_stream_reset(ctx->datasync.rxs);
+	}
+	ctx->datasync.rx_bin.len = 0;
+}
+
+static void _wc_datasync_reconnect_cb(wc_context_t *ctx, UNUSED_PARAM(struct wc_timer *timer)) {
+	_wc_datasync_connect(ctx);
+}
+
+static void _wc_datasync_keepalive_cb(wc_context_t *ctx, struct wc_timer *timer) {
+	wc_timer_arm(ctx, timer, WEBCOM_KEEPALIVE_MS);
+	wc_datasync_keepalive(ctx);
+}
+
+static void _wc_datasync_snapshot_cb(wc_context_t *ctx, struct wc_timer *timer) {
+	/* retried at the next interval if some writes are not confirmed yet */
+	wc_datasync_cache_save(ctx, ctx->cache_snapshot_path);
+	wc_timer_arm(ctx, timer, ctx->cache_snapshot_interval_ms);
+}
+
 static void _wc_datasync_schedule_reconnect(wc_context_t *ctx) {
-	struct wc_timerargs wcta;
+	unsigned stable_ms = ctx->reconnect_stable_ms ? ctx->reconnect_stable_ms : WC_BACKOFF_DEFAULT_STABLE_MS;
+	unsigned delay;
+
+	/* a connection lost after a while is not a server failing to accept us */
+	if (ctx->datasync.connected_at != 0 && wc_timer_now() - ctx->datasync.connected_at >= stable_ms) {
+		wc_backoff_reset(&ctx->datasync.reconnect_backoff);
+	}
+	ctx->datasync.connected_at = 0;
+
+	delay = wc_backoff_next(&ctx->datasync.reconnect_backoff);
+	WL_INFO("reconnection attempt %u of context %p in %u ms", ctx->datasync.reconnect_backoff.attempt, ctx, delay);
+	wc_timer_arm(ctx, &ctx->datasync.reconnect_timer, delay);
+}
+
+void wc_datasync_get_tx_stats(wc_context_t *ctx, struct wc_datasync_tx_stats *stats) {
+	struct tx_queue *q = &ctx->datasync.txq;
+
+	stats->depth = q->depth;
+	stats->bytes = q->bytes;
+	stats->max_depth = q->max_depth;
+	stats->max_bytes = q->max_bytes;
+	stats->high_watermark = q->high_watermark;
+	stats->frames_sent = q->frames_sent;
+	stats->bytes_sent = q->bytes_sent;
+	stats->partial_writes = q->partial_writes;
+	stats->rejected = q->rejected + ctx->datasync.offline_q.rejected;
+	stats->offline_depth = ctx->datasync.offline_q.depth;
+	stats->offline_bytes = ctx->datasync.offline_q.bytes;
+	stats->collapsed = ctx->datasync.offline_q.collapsed;
+}
+
+/*
+ * queues a frame and asks libwebsockets to tell us when the socket is
+ * writable, returns the number of bytes queued, or -1 if the queue is full
+ */
+static int _wc_datasync_tx_enqueue(wc_context_t *ctx, const char *data, size_t len, int force, int64_t id, int binary) {
+	struct tx_queue *q = &ctx->datasync.txq;
+	struct wc_datasync_tx_stats stats;
+	int congested = q->congested;
+
+	switch (tx_queue_push_ex(q, data, len, force, id, NULL)) {
+	case 0:
+		tx_queue_last(q)->binary = binary;
+		lws_callback_on_writable(ctx->datasync.lws_conn);
+		return (int)len;
+	case 1:
+		WL_WARN("outbound queue full in context %p (%u frames, %zu bytes)", ctx, q->depth, q->bytes);
+		if (!congested) {
+			wc_datasync_get_tx_stats(ctx, &stats);
+			ctx->callback(WC_EVENT_ON_TX_BACKPRESSURE, ctx, &stats, sizeof(stats));
+		}
+		return -1;
+	default:
+		WL_ERR("could not allocate a frame of %zu bytes", len);
+		return -1;
+	}
+}
+
+/*
+ * writes the frame at the head of the outbound queue, one frame per writable
+ * callback as libwebsockets requires it
+ */
+static int _wc_datasync_tx_write_next(wc_context_t *ctx) {
+	struct tx_queue *q = &ctx->datasync.txq;
+	struct wc_datasync_tx_stats stats;
+	struct tx_frame *f;
+	int sent;
+
+	if ((f = tx_queue_pop(q)) == NULL) {
+		return 0;
+	}
 
-	wcta.ms = 1000 * ctx->datasync.ws_next_reconnect_timer;
-	wcta.repeat = 0;
-	wcta.timer = WC_TIMER_DATASYNC_RECONNECT;
-	ctx->callback(WC_EVENT_SET_TIMER, ctx, &wcta, 0);
-	if (ctx->datasync.ws_next_reconnect_timer < (1 << 8)) {
-		ctx->datasync.ws_next_reconnect_timer <<= 1;
+	sent = lws_write(ctx->datasync.lws_conn, tx_frame_payload(f), f->len, f->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
+	if (sent < 0) {
+		WL_ERR("error writing a frame of %zu bytes", f->len);
+		free(f);
+		return -1;
+	}
+	if (f->binary) {
+		WL_DBG("%d bytes sent in a binary frame", sent);
+	} else {
+		WL_DBG("%d bytes sent:\n>>>\t%.*s", sent, (int)f->len, (char *)tx_frame_payload(f));
+	}
+
+	q->frames_sent++;
+	q->bytes_sent += f->len;
+	if ((size_t)sent < f->len) {
+		q->partial_writes++;
+	}
+	free(f);
+
+	if (q->congested && q->bytes <= q->high_watermark / 2) {
+		q->congested = 0;
+		wc_datasync_get_tx_stats(ctx, &stats);
+		ctx->callback(WC_EVENT_ON_TX_DRAINED, ctx, &stats, sizeof(stats));
 	}
+
+	if (!tx_queue_empty(q)) {
+		lws_callback_on_writable(ctx->datasync.lws_conn);
+	} else {
+		/* the next burst of listen requests */
+		wc_listen_queue_next_burst(ctx);
+	}
+	return 0;
+}
+
+/*
+ * discards the frames that were not written before the connection was lost,
+ * except the write requests if the offline writes are enabled: they are put
+ * back in front of the offline queue, to be replayed once reconnected. All
+ * the other pending requests fail.
+ */
+static void _wc_datasync_tx_reset(wc_context_t *ctx) {
+	struct tx_queue unsent;
+	struct tx_frame *f;
+
+	if (ctx->offline_writes) {
+		tx_queue_init(&unsent, 0);
+		while ((f = tx_queue_pop(&ctx->datasync.txq)) != NULL) {
+			if (f->id != 0) {
+				tx_queue_append(&unsent, f);
+			} else {
+				free(f);
+			}
+		}
+		tx_queue_splice(&unsent, &ctx->datasync.offline_q);
+		tx_queue_splice(&ctx->datasync.offline_q, &unsent);
+		for (f = tx_queue_peek(&ctx->datasync.offline_q) ; f != NULL ; f = f->next) {
+			wc_datasync_req_hold(ctx, f->id);
+		}
+	} else {
+		/* the pending writes will never be answered */
+		cache_overlay_rollback_all(&ctx->datasync.overlays, ctx->datasync.cache, ctx->datasync.on_reg);
+	}
+	tx_queue_clear(&ctx->datasync.txq);
+
+	/* the requests that will not be replayed will never be answered */
+	wc_datasync_req_fail_all(ctx, WC_REQ_REASON_DISCONNECTED);
+}
+
+void wc_datasync_overlay_apply(wc_context_t *ctx, int64_t id, int merge, char *path, char *data) {
+	if (ctx->optimistic_writes && ctx->datasync_init) {
+		if (cache_overlay_apply(&ctx->datasync.overlays, ctx->datasync.cache, ctx->datasync.on_reg, id, merge, path, data) != 0) {
+			WL_WARN("could not apply the write request %"PRId64" to the local cache", id);
+		}
+	}
+}
+
+void wc_datasync_overlay_ack(wc_context_t *ctx, int64_t id, int accepted) {
+	if (ctx->datasync_init) {
+		cache_overlay_ack(&ctx->datasync.overlays, ctx->datasync.cache, ctx->datasync.on_reg, id, accepted);
+	}
+}
+
+int wc_datasync_journal_action(wc_context_t *ctx, int64_t id, wc_action_type_t type, char *path, char *data) {
+	if (!ctx->datasync_init || ctx->datasync.journal.fd == -1) {
+		return -1;
+	}
+	return journal_log_action(ctx, &ctx->datasync.journal, id, type, path, data);
+}
+
+void wc_datasync_journal_done(wc_context_t *ctx, int64_t id) {
+	if (ctx->datasync_init && ctx->datasync.journal.fd != -1) {
+		journal_log_done(ctx, &ctx->datasync.journal, ctx->datasync.journal.session, id);
+	}
+}
+
+/*
+ * issues again the writes of the previous sessions that were never answered,
+ * they are journaled again under new ids, and marked done under their old ones
+ */
+static void _wc_datasync_journal_replay(wc_context_t *ctx) {
+	struct wc_journal *j = &ctx->datasync.journal;
+	struct journal_entry *e, **p = &j->replay;
+	int64_t id;
+
+	while ((e = *p) != NULL) {
+		if (e->type == WC_ACTION_PUT) {
+			id = wc_datasync_put(ctx, e->path, e->data, NULL, NULL);
+		} else if (e->type == WC_ACTION_MERGE) {
+			id = wc_datasync_merge(ctx, e->path, e->data, NULL, NULL);
+		} else {
+			id = 0;
+		}
+		if (id == -1) {
+			/* kept for the next connection */
+			p = &e->next;
+			continue;
+		}
+		WL_DBG("journaled write %"PRIu32"/%"PRId64" to %s replayed as request %"PRId64, e->session, e->id, e->path, id);
+		journal_log_done(ctx, j, e->session, e->id);
+		*p = e->next;
+		journal_entry_free(e);
+	}
+}
+
+static int _wc_datasync_is_write(wc_msg_t *msg) {
+	if (msg->type != WC_MSG_DATA || msg->u.data.type != WC_DATA_MSG_ACTION) {
+		return 0;
+	}
+
+	switch (msg->u.data.u.action.type) {
+	case WC_ACTION_PUT:
+	case WC_ACTION_MERGE:
+	case WC_ACTION_ON_DISCONNECT_PUT:
+	case WC_ACTION_ON_DISCONNECT_MERGE:
+	case WC_ACTION_ON_DISCONNECT_CANCEL:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * queues a write request issued while the connection is down, a put
+ * following a put to the same path replaces it
+ */
+static int _wc_datasync_offline_enqueue(wc_context_t *ctx, wc_msg_t *msg) {
+	struct tx_queue *q = &ctx->datasync.offline_q;
+	wc_action_t *action = &msg->u.data.u.action;
+	char *jsonstr, *key;
+	int64_t replaced;
+	size_t len;
+	int ret;
+
+	jsonstr = wc_datasync_msg_to_json_str(msg);
+	if (jsonstr == NULL) {
+		return -1;
+	}
+	len = strlen(jsonstr);
+	key = action->type == WC_ACTION_PUT ? action->u.put.path : NULL;
+
+	ret = tx_queue_replace_last(q, jsonstr, len, action->r, key, &replaced);
+	if (ret == 0) {
+		WL_DBG("offline put to %s collapsed with the previous one", key);
+		wc_datasync_req_supersede(ctx, replaced, action->r);
+	} else if (ret == 2) {
+		ret = tx_queue_push_ex(q, jsonstr, len, 0, action->r, key);
+	}
+	free(jsonstr);
+
+	if (ret != 0) {
+		WL_WARN("message not queued, the offline queue of context %p is full (%u messages, %zu bytes)", ctx, q->depth, q->bytes);
+		return -1;
+	}
+
+	return (int)len;
+}
+
+/*
+ * forgets the offline write of the given request, if it was not replayed yet:
+ * called when the request expires, so that a write reported as failed is not
+ * performed afterwards
+ */
+void wc_datasync_offline_drop(wc_context_t *ctx, int64_t id) {
+	if (tx_queue_remove(&ctx->datasync.offline_q, id)) {
+		WL_DBG("offline request %"PRId64" expired, dropped from the offline queue", id);
+	}
+}
+
+/*
+ * the offline writes are queued as JSON, before the framing is negotiated: on
+ * a binary connection, they are encoded again in CBOR before being replayed
+ */
+static void _wc_datasync_offline_to_cbor(wc_context_t *ctx) {
+	struct tx_queue *q = &ctx->datasync.offline_q;
+	struct tx_frame *f;
+	unsigned char *cbor;
+	unsigned n;
+	wc_msg_t msg;
+	char *json;
+	size_t len;
+
+	for (n = q->depth ; n > 0 && (f = tx_queue_pop(q)) != NULL ; n--) {
+		cbor = NULL;
+		json = strndup((char *)tx_frame_payload(f), f->len);
+		if (json != NULL && wc_datasync_parse_msg(json, &msg)) {
+			cbor = wc_datasync_msg_to_cbor(&msg, &len);
+			wc_datasync_msg_free(&msg);
+		}
+		free(json);
+
+		/* forced, as the frames are already accounted for in the queue */
+		if (cbor != NULL && tx_queue_push_ex(q, (char *)cbor, len, 1, f->id, NULL) == 0) {
+			tx_queue_last(q)->binary = 1;
+			free(f);
+		} else {
+			WL_ERR("could not encode the offline request %"PRId64" in CBOR, replayed as JSON", f->id);
+			tx_queue_append(q, f);
+		}
+		free(cbor);
+	}
+}
+
+static void _wc_datasync_offline_replay(wc_context_t *ctx) {
+	if (tx_queue_empty(&ctx->datasync.offline_q)) {
+		return;
+	}
+
+	WL_DBG("replaying %u offline messages", ctx->datasync.offline_q.depth);
+	if (ctx->datasync.binary_active) {
+		_wc_datasync_offline_to_cbor(ctx);
+	}
+	tx_queue_splice(&ctx->datasync.txq, &ctx->datasync.offline_q);
+	lws_callback_on_writable(ctx->datasync.lws_conn);
+}
+
+/* bytes sent and received on the current TCP connection */
+static void _wc_datasync_wire_bytes(wc_context_t *ctx, uint64_t *tx, uint64_t *rx) {
+	*tx = *rx = 0;
+#ifdef HAVE_TCPI_BYTES_RECEIVED
+	struct tcp_info ti;
+	socklen_t ti_len = sizeof(ti);
+	int fd;
+
+	if (ctx->datasync.lws_conn != NULL
+			&& (fd = lws_get_socket_fd(ctx->datasync.lws_conn)) >= 0
+			&& getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &ti_len) == 0
+			&& ti_len >= offsetof(struct tcp_info, tcpi_bytes_received) + sizeof(ti.tcpi_bytes_received))
+	{
+		*tx = ti.tcpi_bytes_acked;
+		*rx = ti.tcpi_bytes_received;
+	}
+#else
+	(void)ctx;
+#endif
+}
+
+static void _wc_datasync_wire_bytes_save(wc_context_t *ctx) {
+	uint64_t tx, rx;
+
+	_wc_datasync_wire_bytes(ctx, &tx, &rx);
+	ctx->datasync.wire_tx_bytes += tx;
+	ctx->datasync.wire_rx_bytes += rx;
+}
+
+void wc_datasync_get_compression_stats(wc_context_t *ctx, struct wc_datasync_compression_stats *stats) {
+	uint64_t tx = 0, rx = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!ctx->datasync_init) {
+		return;
+	}
+	if (ctx->datasync.state != WC_CNX_STATE_DISCONNECTED) {
+		_wc_datasync_wire_bytes(ctx, &tx, &rx);
+	}
+	stats->active = ctx->datasync.deflate_active;
+	stats->tx_bytes = ctx->datasync.txq.bytes_sent;
+	stats->rx_bytes = ctx->datasync.rx_bytes;
+	stats->tx_wire_bytes = ctx->datasync.wire_tx_bytes + tx;
+	stats->rx_wire_bytes = ctx->datasync.wire_rx_bytes + rx;
 }
 
 void wc_datasync_service_socket(wc_context_t *ctx, struct wc_pollargs *pa) {
@@ -128,10 +606,46 @@ void wc_datasync_service_socket(wc_context_t *ctx, struct wc_pollargs *pa) {
 	lws_service_fd(ctx->datasync.lws_cci.context, &pfd);
 }
 
-static int _wc_lws_callback(UNUSED_PARAM(struct lws *wsi), enum lws_callback_reasons reason, void *user, void *in, size_t len) {
+/*
+ * services the data libwebsockets has already read from the socket but not
+ * processed yet (e.g. the remainder of a TLS record), which an edge-triggered
+ * event loop would not be notified of
+ */
+void wc_datasync_service_pending(wc_context_t *ctx) {
+#if defined(LWS_LIBRARY_VERSION_MAJOR) && LWS_LIBRARY_VERSION_MAJOR >= 2
+	if (ctx->datasync_init && lws_service_adjust_timeout(ctx->datasync.lws_cci.context, 1, 0) == 0) {
+		lws_service_tsi(ctx->datasync.lws_cci.context, -1, 0);
+	}
+#else
+	(void)ctx;
+#endif
+}
+
+/* looks for permessage-deflate in the Sec-WebSocket-Extensions header of the server's answer */
+static int _wc_datasync_deflate_accepted(struct lws *wsi) {
+	size_t name_len = sizeof(WEBCOM_DEFLATE_EXT_NAME) - 1;
+	char ext[256], *p;
+	int len;
+
+	len = lws_hdr_total_length(wsi, WSI_TOKEN_EXTENSIONS);
+	if (len <= 0 || len >= (int)sizeof(ext) || lws_hdr_copy(wsi, ext, sizeof(ext), WSI_TOKEN_EXTENSIONS) < 0) {
+		return 0;
+	}
+
+	for (p = ext ; (p = strstr(p, WEBCOM_DEFLATE_EXT_NAME)) != NULL ; p += name_len) {
+		if ((p == ext || p[-1] == ' ' || p[-1] == ',')
+				&& (p[name_len] == '\0' || strchr(";, ", p[name_len]) != NULL))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int _wc_lws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
 	wc_context_t *ctx = (wc_context_t *) user;
 	struct wc_pollargs wcpa;
-	struct wc_timerargs wcta;
 	struct lws_pollargs *pa;
 
 	WL_EXDBG("EVENT %d, user %p, in %p, %zu", reason, user, in, len);
@@ -168,11 +682,28 @@ static int _wc_lws_callback(UNUSED_PARAM(struct lws *wsi), enum lws_callback_rea
 		WL_DBG("request to modify fd %d from events %d to %hd", wcpa.fd, pa->prev_events, wcpa.events);
 		ctx->callback(WC_EVENT_MODIFY_FD, ctx, &wcpa, 0);
 		break;
+	case LWS_CALLBACK_CLIENT_FILTER_PRE_ESTABLISH:
+		/* the extension is offered, the server's answer tells if it is used */
+		ctx->datasync.deflate_active = _wc_datasync_deflate_accepted(wsi);
+		break;
 	case LWS_CALLBACK_CLIENT_ESTABLISHED:
 		WL_DBG("client websocket established for context %p", ctx);
+		if (ctx->datasync.deflate_active) {
+			WL_INFO("websocket compression enabled for context %p", ctx);
+#if defined(LWS_LIBRARY_VERSION_MAJOR) && LWS_LIBRARY_VERSION_MAJOR >= 2
+			if (ctx->ws_deflate_level > 0) {
+				char level[4];
+				snprintf(level, sizeof(level), "%d", ctx->ws_deflate_level > 9 ? 9 : ctx->ws_deflate_level);
+				lws_set_extension_option(wsi, WEBCOM_DEFLATE_EXT_NAME, "compression_level", level);
+			}
+#endif
+		}
 		break;
 	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
 		ctx->datasync.state = WC_CNX_STATE_DISCONNECTED;
+		ctx->datasync.deflate_active = 0;
+		_wc_datasync_tx_reset(ctx);
+		_wc_datasync_rx_reset(ctx);
 		WL_ERR("connection error \"%.*s\"", (int)len, (char*)in);
 		wc_listen_suspend_all(ctx);
 		if (ctx->callback(WC_EVENT_ON_CNX_ERROR, ctx, in, len)) {
@@ -180,14 +711,23 @@ static int _wc_lws_callback(UNUSED_PARAM(struct lws *wsi), enum lws_callback_rea
 		}
 		break;
 	case LWS_CALLBACK_CLIENT_RECEIVE:
-		if (ctx->datasync.state != WC_CNX_STATE_DISCONNECTING) {
+		ctx->datasync.rx_bytes += len;
+		if (ctx->datasync.state == WC_CNX_STATE_DISCONNECTING) {
+			break;
+		}
+		if (lws_frame_is_binary(wsi)) {
+			_wc_datasync_process_binary(ctx, wsi, (char*)in, len);
+		} else {
 			_wc_datasync_process_data(ctx, (char*)in, len);
 		}
 		break;
 	case LWS_CALLBACK_CLOSED:
+		_wc_datasync_wire_bytes_save(ctx);
 		ctx->datasync.state = WC_CNX_STATE_DISCONNECTED;
-		wcta.timer = WC_TIMER_DATASYNC_KEEPALIVE;
-		ctx->callback(WC_EVENT_DEL_TIMER, ctx, &wcta.timer, 0);
+		ctx->datasync.deflate_active = 0;
+		wc_timer_cancel(ctx, &ctx->datasync.keepalive_timer);
+		_wc_datasync_tx_reset(ctx);
+		_wc_datasync_rx_reset(ctx);
 		wc_listen_suspend_all(ctx);
 		if (ctx->callback(WC_EVENT_ON_CNX_CLOSED, ctx, NULL, 0)) {
 			_wc_datasync_schedule_reconnect(ctx);
@@ -197,7 +737,7 @@ static int _wc_lws_callback(UNUSED_PARAM(struct lws *wsi), enum lws_callback_rea
 		if (ctx->datasync.state == WC_CNX_STATE_DISCONNECTING) {
 			return -1;
 		}
-		break;
+		return _wc_datasync_tx_write_next(ctx);
 	default:
 		break;
 	}
@@ -205,31 +745,39 @@ static int _wc_lws_callback(UNUSED_PARAM(struct lws *wsi), enum lws_callback_rea
 }
 
 int wc_datasync_send_msg(wc_context_t *ctx, wc_msg_t *msg) {
+	unsigned char *cbor;
 	char *jsonstr;
-	unsigned char *buf;
-	long len;
-	int sent;
+	size_t len;
+	int ret;
 
 	if (ctx->datasync.state != WC_CNX_STATE_CONNECTED) {
+		if (ctx->offline_writes && ctx->datasync_init && _wc_datasync_is_write(msg)) {
+			return _wc_datasync_offline_enqueue(ctx, msg);
+		}
 		WL_WARN("message not sent, the context %p is not connected (state %d)", ctx, ctx->datasync.state);
 		return -1;
 	}
 
+	if (ctx->datasync.binary_active) {
+		cbor = wc_datasync_msg_to_cbor(msg, &len);
+		if (cbor == NULL) {
+			return -1;
+		}
+		ret = _wc_datasync_tx_enqueue(ctx, (char *)cbor, len, 0,
+				_wc_datasync_is_write(msg) ? msg->u.data.u.action.r : 0, 1);
+		free(cbor);
+		return ret;
+	}
+
 	jsonstr = wc_datasync_msg_to_json_str(msg);
 	if (jsonstr == NULL) {
 		return -1;
 	}
-	len = strlen(jsonstr);
-
-	buf = malloc (LWS_SEND_BUFFER_PRE_PADDING + len + LWS_SEND_BUFFER_POST_PADDING);
 
-	memcpy(buf + LWS_SEND_BUFFER_PRE_PADDING, jsonstr, len);
-
-	sent = lws_write(ctx->datasync.lws_conn, buf + LWS_SEND_BUFFER_PRE_PADDING, len, LWS_WRITE_TEXT);
-	WL_DBG("%d bytes sent:\n>>>\t%s", sent, jsonstr);
+	ret = _wc_datasync_tx_enqueue(ctx, jsonstr, strlen(jsonstr), 0,
+			_wc_datasync_is_write(msg) ? msg->u.data.u.action.r : 0, 0);
 	free(jsonstr);
-	free(buf);
-	return sent;
+	return ret;
 }
 
 void wc_datasync_close_cnx(wc_context_t *ctx) {
@@ -262,10 +810,40 @@ wc_datasync_context_t *wc_datasync_init(wc_context_t *ctx) {
 	memset(&lws_ctx_creation_nfo, 0, sizeof(lws_ctx_creation_nfo));
 
 	lws_ctx_creation_nfo.port = CONTEXT_PORT_NO_LISTEN;
-	lws_ctx_creation_nfo.protocols = protocols;
+	/* per context, for the size of the receive buffer */
+	memcpy(ctx->datasync.protocols, protocols, sizeof(protocols));
+	if (ctx->rx_buffer_size) {
+		ctx->datasync.protocols[0].rx_buffer_size = ctx->rx_buffer_size;
+	}
+	lws_ctx_creation_nfo.protocols = ctx->datasync.protocols;
 #if defined(LWS_LIBRARY_VERSION_MAJOR) && LWS_LIBRARY_VERSION_MAJOR >= 2
 	lws_ctx_creation_nfo.options |= LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
 #endif
+	if (ctx->ws_deflate) {
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+		unsigned bits = ctx->ws_deflate_window_bits;
+
+		if (bits == 0) {
+			ctx->datasync.deflate_offer = strdup(WEBCOM_DEFLATE_EXT_NAME "; client_max_window_bits");
+		} else {
+			/* zlib does not support raw deflate streams with 8 bits windows */
+			bits = bits < 9 ? 9 : bits > 15 ? 15 : bits;
+			ctx->datasync.deflate_offer = malloc(sizeof(WEBCOM_DEFLATE_EXT_NAME "; client_max_window_bits=15; server_max_window_bits=15"));
+			if (ctx->datasync.deflate_offer != NULL) {
+				sprintf(ctx->datasync.deflate_offer, WEBCOM_DEFLATE_EXT_NAME "; client_max_window_bits=%u; server_max_window_bits=%u", bits, bits);
+			}
+		}
+		if (ctx->datasync.deflate_offer != NULL) {
+			memset(ctx->datasync.extensions, 0, sizeof(ctx->datasync.extensions));
+			ctx->datasync.extensions[0].name = WEBCOM_DEFLATE_EXT_NAME;
+			ctx->datasync.extensions[0].callback = lws_extension_callback_pm_deflate;
+			ctx->datasync.extensions[0].client_offer = ctx->datasync.deflate_offer;
+			lws_ctx_creation_nfo.extensions = ctx->datasync.extensions;
+		}
+#else
+		WL_WARN("libwebsockets was built without extension support, websocket compression disabled");
+#endif
+	}
 	lws_ctx_creation_nfo.gid = -1;
 	lws_ctx_creation_nfo.uid = -1;
 
@@ -290,24 +868,71 @@ wc_datasync_context_t *wc_datasync_init(wc_context_t *ctx) {
 			+ sizeof(WEBCOM_PROTOCOL_VERSION) - 1
 			+ 4
 			+ strlen(ctx->app_name)
+			+ sizeof(WEBCOM_BINARY_FRAMING_ARG) - 1
 			+ 1 );
 	ctx->datasync.lws_cci.path = malloc(ws_path_l);
 	if (ctx->datasync.lws_cci.path == NULL) {
 		return NULL;
 	}
-	snprintf((char*)ctx->datasync.lws_cci.path, ws_path_l, "%s?v=%s&ns=%s", WEBCOM_WS_PATH, WEBCOM_PROTOCOL_VERSION, ctx->app_name);
+	snprintf((char*)ctx->datasync.lws_cci.path, ws_path_l, "%s?v=%s&ns=%s%s", WEBCOM_WS_PATH, WEBCOM_PROTOCOL_VERSION, ctx->app_name,
+			ctx->binary_framing ? WEBCOM_BINARY_FRAMING_ARG : "");
 	ctx->datasync.lws_cci.protocol = protocols[0].name;
 	ctx->datasync.lws_cci.ietf_version_or_minus_one = -1;
 	ctx->datasync.lws_cci.userdata = (void *)ctx;
 
 	ctx->datasync.state = WC_CNX_STATE_DISCONNECTED;
 
+	ctx->datasync.webcom = ctx;
 	ctx->datasync_init = 1;
 	ctx->datasync.stamp = 0;
 
+	wc_timer_init(&ctx->datasync.reconnect_timer, _wc_datasync_reconnect_cb, NULL);
+	/* seeded differently by each client of a fleet */
+	wc_backoff_init(&ctx->datasync.reconnect_backoff, ctx->reconnect_initial_ms, ctx->reconnect_multiplier,
+			ctx->reconnect_max_ms, ctx->reconnect_jitter,
+			(uint64_t)wc_datasync_now() ^ ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)ctx);
+	ctx->datasync.connected_at = 0;
+	wc_timer_init(&ctx->datasync.keepalive_timer, _wc_datasync_keepalive_cb, NULL);
+	tx_queue_init(&ctx->datasync.txq, ctx->tx_high_watermark ? ctx->tx_high_watermark : WEBCOM_TX_DEFAULT_HIGH_WATERMARK);
+	tx_queue_init(&ctx->datasync.offline_q, ctx->offline_max_bytes);
+	ctx->datasync.offline_q.max_frames = ctx->offline_max_count;
+
 	ctx->datasync.cache = data_cache_new();
+	cache_overlays_init(&ctx->datasync.overlays);
+	journal_init(&ctx->datasync.journal);
+	if (ctx->journal_path != NULL
+			&& journal_open(&ctx->datasync.journal, ctx->journal_path, ctx->journal_sync, ctx->journal_commit_interval_ms) != 0)
+	{
+		WL_ERR("could not open the journal %s, the writes will not be journaled", ctx->journal_path);
+	}
 	ctx->datasync.on_reg = on_registry_new();
 	ctx->datasync.listen_reg = listen_registry_new();
+	ctx->datasync.submitq = NULL;
+	if (ctx->submit_queue_size) {
+		wc_datasync_submit_open(ctx, ctx->submit_queue_size);
+	}
+	ctx->datasync.rxo = NULL;
+	ctx->datasync.rxs = NULL;
+	cbor_buf_init(&ctx->datasync.rx_bin);
+	ctx->datasync.binary_active = 0;
+	if (ctx->parse_threads) {
+		wc_datasync_rx_offload_open(ctx, ctx->parse_threads, ctx->parse_offload_bytes);
+	} else if (ctx->rx_streaming) {
+		ctx->datasync.rxs = malloc(sizeof(*ctx->datasync.rxs));
+		if (ctx->datasync.rxs != NULL) {
+			rx_stream_init(ctx->datasync.rxs);
+		}
+	}
+
+	wc_timer_init(&ctx->datasync.snapshot_timer, _wc_datasync_snapshot_cb, NULL);
+	if (ctx->cache_snapshot_path != NULL) {
+		if (access(ctx->cache_snapshot_path, F_OK) == 0) {
+			cache_snapshot_load(ctx->datasync.cache, ctx->cache_snapshot_path);
+		}
+		if (ctx->cache_snapshot_interval_ms) {
+			wc_timer_arm(ctx, &ctx->datasync.snapshot_timer, ctx->cache_snapshot_interval_ms);
+		}
+	}
 
 	return &ctx->datasync;
 }
@@ -315,6 +940,9 @@ wc_datasync_context_t *wc_datasync_init(wc_context_t *ctx) {
 void _wc_datasync_connect(wc_context_t *ctx) {
 	if (ctx->datasync.state == WC_CNX_STATE_DISCONNECTED) {
 		ctx->datasync.state = WC_CNX_STATE_CONNECTING;
+		ctx->datasync.deflate_active = 0;
+		ctx->datasync.binary_active = 0;
+		ctx->datasync.rx_bin.len = 0;
 		ctx->datasync.lws_conn = lws_client_connect_via_info(&ctx->datasync.lws_cci);
 		lws_service(ctx->datasync.lws_cci.context, 0);
 	} else {
@@ -326,32 +954,79 @@ void wc_datasync_connect(wc_context_t *ctx) {
 	if (ctx->datasync_init == 0) {
 		wc_datasync_init(ctx);
 	}
-	_wc_datasync_schedule_reconnect(ctx);
+	/* the first connection is not delayed */
+	wc_backoff_reset(&ctx->datasync.reconnect_backoff);
+	ctx->datasync.connected_at = 0;
+	wc_timer_arm(ctx, &ctx->datasync.reconnect_timer, 0);
 }
 
 void wc_datasync_context_cleanup(struct wc_datasync_context *ds_ctx) {
+	wc_datasync_submit_close(ds_ctx->webcom);
+	wc_datasync_rx_offload_close(ds_ctx->webcom);
+
 	if (ds_ctx->lws_cci.path != NULL) free((char*)ds_ctx->lws_cci.path);
 
 	if (ds_ctx->lws_cci.context != NULL) lws_context_destroy(ds_ctx->lws_cci.context);
+	free(ds_ctx->deflate_offer);
 	if (ds_ctx->parser != NULL) wc_datasync_parser_free(ds_ctx->parser);
+	if (ds_ctx->rxs != NULL) {
+		rx_stream_cleanup(ds_ctx->rxs);
+		free(ds_ctx->rxs);
+	}
+	cbor_buf_cleanup(&ds_ctx->rx_bin);
 
-	wc_datasync_free_pending_trans(ds_ctx->pending_req_table);
+	wc_datasync_req_table_cleanup(ds_ctx->webcom);
+	journal_close(ds_ctx->webcom, &ds_ctx->journal);
 
+	wc_timer_cancel(ds_ctx->webcom, &ds_ctx->snapshot_timer);
+	if (ds_ctx->webcom->cache_snapshot_path != NULL) {
+		/* only the data confirmed by the server is saved */
+		cache_overlay_rollback_all(&ds_ctx->overlays, ds_ctx->cache, NULL);
+		cache_snapshot_save(ds_ctx->cache, ds_ctx->webcom->cache_snapshot_path);
+	}
+	tx_queue_clear(&ds_ctx->txq);
+	tx_queue_clear(&ds_ctx->offline_q);
+
+	cache_overlays_clear(&ds_ctx->overlays);
 	data_cache_destroy(ds_ctx->cache);
 	on_registry_destroy(ds_ctx->on_reg);
 	listen_registry_destroy(ds_ctx->listen_reg);
 }
 
+int wc_datasync_cache_save(wc_context_t *ctx, const char *path) {
+	if (!ctx->datasync_init) {
+		return -1;
+	}
+	if (ctx->datasync.overlays.count > 0) {
+		/* the cache holds optimistic writes the server did not confirm */
+		WL_DBG("cache snapshot not saved, %u writes are not confirmed yet", ctx->datasync.overlays.count);
+		return -1;
+	}
+	return cache_snapshot_save(ctx->datasync.cache, path);
+}
+
+int wc_datasync_cache_load(wc_context_t *ctx, const char *path) {
+	if (!ctx->datasync_init || cache_snapshot_load(ctx->datasync.cache, path) != 0) {
+		return -1;
+	}
+	cache_overlay_reconcile(&ctx->datasync.overlays, ctx->datasync.cache, ctx->datasync.on_reg, "/");
+	on_registry_dispatch_on_event(ctx->datasync.on_reg, ctx->datasync.cache, "/");
+	return 0;
+}
+
 int wc_datasync_keepalive(wc_context_t *ctx) {
-	int sent = 0;
-	unsigned char keepalive_msg[LWS_SEND_BUFFER_PRE_PADDING + 1 + LWS_SEND_BUFFER_POST_PADDING];
+	int sent;
+
+	if (ctx->datasync.state != WC_CNX_STATE_CONNECTED) {
+		return -1;
+	}
 
-	keepalive_msg[LWS_SEND_BUFFER_PRE_PADDING] = '0';
-	sent = lws_write(ctx->datasync.lws_conn, &(keepalive_msg[LWS_SEND_BUFFER_PRE_PADDING]), 1, LWS_WRITE_TEXT);
-	if (sent) {
-		WL_DBG("keepalive frame sent");
+	/* keepalive frames are not subject to the high watermark */
+	sent = _wc_datasync_tx_enqueue(ctx, "0", 1, 1, 0, 0);
+	if (sent > 0) {
+		WL_DBG("keepalive frame queued");
 	} else {
-		WL_ERR("error sending keepalive frame");
+		WL_ERR("error queuing keepalive frame");
 	}
 
 	return sent;
@@ -33,7 +33,15 @@
 
 
 #include "webcom-c/webcom.h"
+#include "../timer.h"
+#include "../backoff.h"
+#include "tx_queue.h"
+#include "journal.h"
+#include "submit.h"
+#include "rx_offload.h"
+#include "cbor.h"
 #include "cache/treenode_cache.h"
+#include "cache/overlay.h"
 #include "on/on_registry.h"
 
 typedef enum {
@@ -53,11 +61,21 @@ struct pushid_state {
 
 
 #define WC_RX_BUF_LEN	(1 << 12)
+#define WC_RX_BIN_KEEP	(1 << 16) /* larger binary message buffers are freed after use */
 #define PENDING_ACTION_HASH_FACTOR 8
 #define DATA_ROUTES_HASH_FACTOR 8
 typedef struct wc_action_trans wc_action_trans_t;
 typedef struct wc_datasync_data_route wc_datasync_data_route_t;
 
+/* pending requests, indexed by request id (see request.c) */
+struct wc_req_table {
+	wc_action_trans_t **slots;
+	unsigned mask;                 /* number of slots - 1 */
+	unsigned count;
+	struct wc_trans_chunk *chunks; /* pool of transactions */
+	wc_action_trans_t *free;
+};
+
 struct wc_datasync_context {
 	struct wc_context *webcom;
 	struct lws_client_connect_info lws_cci;
@@ -68,12 +86,33 @@ struct wc_datasync_context {
 	struct pushid_state pids;
 	int64_t time_offset;
 	int64_t last_req;
-	wc_action_trans_t *pending_req_table[1 << PENDING_ACTION_HASH_FACTOR];
+	struct wc_req_table pending;
 	wc_datasync_data_route_t *data_routes[1 << DATA_ROUTES_HASH_FACTOR];
-	unsigned ws_next_reconnect_timer;
+	struct wc_backoff reconnect_backoff;
+	int64_t connected_at; /* time of the last handshake, 0 if none since the last reconnection attempt */
+	struct wc_timer reconnect_timer;
+	struct lws_protocols protocols[2];
+	struct lws_extension extensions[2];
+	char *deflate_offer;
+	int deflate_active;
+	uint64_t rx_bytes;
+	uint64_t wire_tx_bytes; /* of the previous TCP connections */
+	uint64_t wire_rx_bytes;
+	struct wc_timer keepalive_timer;
+	struct wc_timer snapshot_timer;
+	struct tx_queue txq;
+	struct tx_queue offline_q;
+	struct wc_datasync_batch_stats batch_stats;
+	struct wc_journal journal;
 	struct on_registry *on_reg;
 	data_cache_t *cache;
+	struct cache_overlays overlays;
 	struct listen_registry *listen_reg;
+	struct submit_queue *submitq; /* NULL if the cross-thread submission queue is disabled */
+	struct rx_offload *rxo; /* NULL if the messages are parsed by the event loop thread only */
+	struct rx_stream *rxs; /* NULL if the messages are not parsed as they are received */
+	struct cbor_buf rx_bin; /* fragments of the binary message being received */
+	int binary_active; /* the server accepted the binary framing */
 	unsigned stamp;
 };
 
@@ -92,7 +131,16 @@ static inline int64_t wc_datasync_next_reqnum(struct wc_datasync_context *dsctx)
 }
 
 wc_action_trans_t *wc_datasync_req_get_pending(wc_context_t *dsctx, int64_t id);
-void wc_datasync_free_pending_trans(wc_action_trans_t **table);
+void wc_datasync_req_free_trans(wc_context_t *cnx, wc_action_trans_t *trans);
+void wc_datasync_req_hold(wc_context_t *cnx, int64_t id);
+void wc_datasync_req_fail_all(wc_context_t *cnx, char *reason);
+void wc_datasync_req_table_cleanup(wc_context_t *cnx);
+void wc_datasync_req_supersede(wc_context_t *cnx, int64_t old_id, int64_t new_id);
+void wc_datasync_overlay_apply(wc_context_t *ctx, int64_t id, int merge, char *path, char *data);
+void wc_datasync_overlay_ack(wc_context_t *ctx, int64_t id, int accepted);
+int wc_datasync_journal_action(wc_context_t *ctx, int64_t id, wc_action_type_t type, char *path, char *data);
+void wc_datasync_journal_done(wc_context_t *ctx, int64_t id);
+void wc_datasync_offline_drop(wc_context_t *ctx, int64_t id);
 void wc_datasync_req_response_dispatch(wc_context_t *dsctx, wc_response_t *response);
 
 void wc_datasync_push_id(struct pushid_state *s, int64_t time, char* buf) ;
@@ -101,6 +149,16 @@ void wc_datasync_cleanup_data_routes(wc_datasync_data_route_t **table);
 void wc_auth_service(wc_context_t *ctx, int fd);
 void _wc_datasync_connect(wc_context_t *ctx);
 void wc_datasync_service_socket(wc_context_t *ctx, struct wc_pollargs *pa);
+void wc_datasync_service_pending(wc_context_t *ctx);
+int wc_datasync_submit_open(wc_context_t *ctx, unsigned size);
+void wc_datasync_submit_close(wc_context_t *ctx);
+void wc_datasync_submit_service(wc_context_t *ctx);
+int wc_datasync_rx_offload_open(wc_context_t *ctx, unsigned nthreads, size_t threshold);
+void wc_datasync_rx_offload_close(wc_context_t *ctx);
+void wc_datasync_rx_offload_data(wc_context_t *ctx, char *buf, size_t len);
+void wc_datasync_rx_offload_service(wc_context_t *ctx);
+void wc_datasync_rx_offload_reset(wc_context_t *ctx);
+void wc_datasync_process_message(wc_context_t *ctx, wc_msg_t *msg, struct rx_tree *trees, unsigned ntrees);
 
 /**
  * de-initializes the datasync service for a Webcom context
@@ -110,12 +168,14 @@ void wc_datasync_service_socket(wc_context_t *ctx, struct wc_pollargs *pa);
 void wc_datasync_context_cleanup(struct wc_datasync_context *ds_ctx);
 
 /**
- * Sends a datasync message to the webcom server.
+ * Queues a datasync message to be sent to the webcom server as soon as the
+ * socket is writable. If the connection is down and the offline writes are
+ * enabled, write requests are queued until the connection is established.
  *
  * @param ctx the context
  * @param msg the webcom message to send
- * @return the number of bytes written, otherwise < 0 is returned in case of
- * failure.
+ * @return the number of bytes queued, otherwise < 0 is returned in case of
+ * failure, or if the outbound queue is full.
  */
 int wc_datasync_send_msg(wc_context_t *ctx, wc_msg_t *msg);
 
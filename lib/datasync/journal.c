@@ -0,0 +1,452 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "../hash.h"
+#include "webcom-c/webcom-log.h"
+
+struct journal_record {
+	uint8_t kind;
+	uint8_t type;
+	uint16_t path_len;
+	uint32_t session;
+	int64_t id;
+	uint32_t data_len;
+	const char *payload;
+};
+
+struct journal_loaded {
+	struct journal_record rec;
+	int resolved;
+};
+
+static void journal_commit_timer_cb(wc_context_t *ctx, struct wc_timer *t);
+
+void journal_init(struct wc_journal *j) {
+	memset(j, 0, sizeof(*j));
+	j->fd = -1;
+	wc_timer_init(&j->commit_timer, journal_commit_timer_cb, j);
+}
+
+void journal_entry_free(struct journal_entry *e) {
+	free(e->path);
+	free(e->data);
+	free(e);
+}
+
+static int journal_write_all(int fd, const void *buf, size_t len) {
+	const unsigned char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+static size_t journal_record_len(const struct journal_record *r) {
+	return JOURNAL_HEADER_LEN + r->path_len + r->data_len + sizeof(uint32_t);
+}
+
+static void journal_encode(unsigned char *out, const struct journal_record *r, const char *path, const char *data) {
+	uint32_t sum;
+
+	out[0] = r->kind;
+	out[1] = r->type;
+	memcpy(out + 2, &r->path_len, 2);
+	memcpy(out + 4, &r->session, 4);
+	memcpy(out + 8, &r->id, 8);
+	memcpy(out + 16, &r->data_len, 4);
+	memcpy(out + JOURNAL_HEADER_LEN, path, r->path_len);
+	memcpy(out + JOURNAL_HEADER_LEN + r->path_len, data, r->data_len);
+	sum = wc_fnv1a_32_update(out, JOURNAL_HEADER_LEN + r->path_len + r->data_len, WC_FNV1A_32_INIT);
+	memcpy(out + JOURNAL_HEADER_LEN + r->path_len + r->data_len, &sum, 4);
+}
+
+/*
+ * decodes the record at the beginning of buf, returns its length, or 0 if it
+ * is truncated or corrupted
+ */
+static size_t journal_decode(const unsigned char *buf, size_t len, struct journal_record *r) {
+	size_t body;
+	uint32_t sum;
+
+	if (len < JOURNAL_HEADER_LEN + sizeof(uint32_t)) {
+		return 0;
+	}
+	r->kind = buf[0];
+	r->type = buf[1];
+	memcpy(&r->path_len, buf + 2, 2);
+	memcpy(&r->session, buf + 4, 4);
+	memcpy(&r->id, buf + 8, 8);
+	memcpy(&r->data_len, buf + 16, 4);
+
+	if ((size_t)r->path_len + r->data_len > len - JOURNAL_HEADER_LEN - sizeof(uint32_t)) {
+		return 0;
+	}
+	body = JOURNAL_HEADER_LEN + r->path_len + r->data_len;
+	memcpy(&sum, buf + body, 4);
+	if (sum != wc_fnv1a_32_update(buf, body, WC_FNV1A_32_INIT)) {
+		return 0;
+	}
+	if (r->kind != JOURNAL_ACTION && r->kind != JOURNAL_DONE) {
+		return 0;
+	}
+	r->payload = (const char *)buf + JOURNAL_HEADER_LEN;
+	return body + sizeof(uint32_t);
+}
+
+static int journal_read_file(const char *path, unsigned char **buf, size_t *len) {
+	int fd;
+	size_t cap = 0;
+	ssize_t n;
+	unsigned char *tmp;
+
+	*buf = NULL;
+	*len = 0;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return errno == ENOENT ? 0 : -1;
+	}
+	for (;;) {
+		if (*len == cap) {
+			cap = cap ? 2 * cap : 1 << 16;
+			tmp = realloc(*buf, cap);
+			if (tmp == NULL) {
+				goto error;
+			}
+			*buf = tmp;
+		}
+		n = read(fd, *buf + *len, cap - *len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			goto error;
+		} else if (n == 0) {
+			break;
+		}
+		*len += (size_t)n;
+	}
+	close(fd);
+	return 0;
+error:
+	close(fd);
+	free(*buf);
+	*buf = NULL;
+	return -1;
+}
+
+/*
+ * looks for an action record by (session, id) among the n first loaded ones,
+ * they are sorted by session then id since both only grow
+ */
+static int journal_find_loaded(struct journal_loaded *loaded, size_t n, uint32_t session, int64_t id) {
+	size_t lo = 0, hi = n, mid;
+	const struct journal_record *r;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		r = &loaded[mid].rec;
+		if (r->session < session || (r->session == session && r->id < id)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo < n && loaded[lo].rec.session == session && loaded[lo].rec.id == id) {
+		return (int)lo;
+	}
+	return -1;
+}
+
+static struct journal_entry *journal_entry_new(const struct journal_record *r) {
+	struct journal_entry *e = calloc(1, sizeof(*e));
+
+	if (e == NULL) {
+		return NULL;
+	}
+	e->session = r->session;
+	e->id = r->id;
+	e->type = r->type;
+	e->path = strndup(r->payload, r->path_len);
+	e->data = strndup(r->payload + r->path_len, r->data_len);
+	if (e->path == NULL || e->data == NULL) {
+		journal_entry_free(e);
+		return NULL;
+	}
+	return e;
+}
+
+int journal_open(struct wc_journal *j, const char *path, enum wc_journal_sync sync, unsigned interval_ms) {
+	unsigned char *buf, *out = NULL;
+	struct journal_loaded *loaded = NULL, *tmp;
+	size_t len, off, n, count = 0, cap = 0, out_len = 0, rlen, nreplay = 0;
+	struct journal_record r;
+	struct journal_entry **tail = &j->replay, *e;
+	char *tmp_path = NULL;
+	uint32_t session = 0;
+	int fd = -1, i;
+	size_t k;
+
+	j->sync = sync;
+	j->interval_ms = interval_ms ? interval_ms : JOURNAL_DEFAULT_INTERVAL_MS;
+
+	if (journal_read_file(path, &buf, &len) == -1) {
+		WL_ERR("could not read the journal %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	if (len >= sizeof(JOURNAL_MAGIC) - 1 && memcmp(buf, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1) == 0) {
+		for (off = sizeof(JOURNAL_MAGIC) - 1 ; off < len ; off += n) {
+			n = journal_decode(buf + off, len - off, &r);
+			if (n == 0) {
+				WL_WARN("journal %s: dropping %zu bytes of truncated or corrupted records", path, len - off);
+				break;
+			}
+			if (r.session > session) {
+				session = r.session;
+			}
+			if (r.kind == JOURNAL_DONE) {
+				i = journal_find_loaded(loaded, count, r.session, r.id);
+				if (i != -1) {
+					loaded[i].resolved = 1;
+				}
+				continue;
+			}
+			if (count == cap) {
+				cap = cap ? 2 * cap : 64;
+				tmp = realloc(loaded, cap * sizeof(*loaded));
+				if (tmp == NULL) {
+					goto error;
+				}
+				loaded = tmp;
+			}
+			loaded[count].resolved = 0;
+			loaded[count].rec = r;
+			count++;
+		}
+	} else if (len > 0) {
+		WL_WARN("journal %s: bad magic, discarding it", path);
+	}
+
+	/* compaction: only keep the unresolved actions */
+	out_len = sizeof(JOURNAL_MAGIC) - 1;
+	for (k = 0 ; k < count ; k++) {
+		if (!loaded[k].resolved) {
+			out_len += journal_record_len(&loaded[k].rec);
+		}
+	}
+	out = malloc(out_len);
+	if (out == NULL) {
+		goto error;
+	}
+	memcpy(out, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1);
+	off = sizeof(JOURNAL_MAGIC) - 1;
+	for (k = 0 ; k < count ; k++) {
+		if (loaded[k].resolved) {
+			continue;
+		}
+		rlen = journal_record_len(&loaded[k].rec);
+		memcpy(out + off, loaded[k].rec.payload - JOURNAL_HEADER_LEN, rlen);
+		off += rlen;
+		e = journal_entry_new(&loaded[k].rec);
+		if (e == NULL) {
+			goto error;
+		}
+		*tail = e;
+		tail = &e->next;
+		nreplay++;
+	}
+
+	tmp_path = malloc(strlen(path) + sizeof(".tmp"));
+	if (tmp_path == NULL) {
+		goto error;
+	}
+	sprintf(tmp_path, "%s.tmp", path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1 || journal_write_all(fd, out, out_len) == -1 || fsync(fd) == -1) {
+		WL_ERR("could not write the journal %s: %s", tmp_path, strerror(errno));
+		goto error;
+	}
+	close(fd);
+	fd = -1;
+	if (rename(tmp_path, path) == -1) {
+		WL_ERR("could not rename the journal %s: %s", tmp_path, strerror(errno));
+		goto error;
+	}
+
+	j->fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+	if (j->fd == -1) {
+		WL_ERR("could not open the journal %s: %s", path, strerror(errno));
+		goto error;
+	}
+	j->session = session + 1;
+
+	WL_INFO("journal %s opened, session %"PRIu32", %zu write(s) to replay", path, j->session, nreplay);
+
+	free(tmp_path);
+	free(out);
+	free(buf);
+	free(loaded);
+	return 0;
+
+error:
+	if (fd != -1) {
+		close(fd);
+	}
+	if (tmp_path != NULL) {
+		unlink(tmp_path);
+	}
+	while ((e = j->replay) != NULL) {
+		j->replay = e->next;
+		journal_entry_free(e);
+	}
+	free(tmp_path);
+	free(out);
+	free(buf);
+	free(loaded);
+	return -1;
+}
+
+int journal_commit(struct wc_journal *j) {
+	int ret = 0;
+
+	if (j->fd == -1 || j->len == 0) {
+		return 0;
+	}
+	if (journal_write_all(j->fd, j->buf, j->len) == -1) {
+		WL_ERR("could not write to the journal: %s", strerror(errno));
+		ret = -1;
+	} else if (j->sync != WC_JOURNAL_SYNC_NONE && fdatasync(j->fd) == -1) {
+		WL_ERR("could not sync the journal: %s", strerror(errno));
+		ret = -1;
+	}
+	j->len = 0;
+	j->commits++;
+	return ret;
+}
+
+static void journal_commit_timer_cb(wc_context_t *ctx, struct wc_timer *t) {
+	(void)ctx;
+	journal_commit(t->data);
+}
+
+static int journal_append(wc_context_t *ctx, struct wc_journal *j, const struct journal_record *r, const char *path, const char *data) {
+	size_t rlen = journal_record_len(r), cap;
+	unsigned char *tmp;
+
+	if (j->len + rlen > j->cap) {
+		for (cap = j->cap ? j->cap : 4096 ; cap < j->len + rlen ; cap *= 2);
+		tmp = realloc(j->buf, cap);
+		if (tmp == NULL) {
+			return -1;
+		}
+		j->buf = tmp;
+		j->cap = cap;
+	}
+	journal_encode(j->buf + j->len, r, path, data);
+	j->len += rlen;
+	j->records++;
+
+	if (j->sync == WC_JOURNAL_SYNC_ALWAYS || j->len >= JOURNAL_COMMIT_THRESHOLD) {
+		if (wc_timer_is_armed(&j->commit_timer)) {
+			wc_timer_cancel(ctx, &j->commit_timer);
+		}
+		return journal_commit(j);
+	}
+	if (!wc_timer_is_armed(&j->commit_timer)) {
+		wc_timer_arm(ctx, &j->commit_timer, j->interval_ms);
+	}
+	return 0;
+}
+
+int journal_log_action(wc_context_t *ctx, struct wc_journal *j, int64_t id, wc_action_type_t type, const char *path, const char *data) {
+	struct journal_record r;
+	size_t path_len = strlen(path), data_len = strlen(data);
+
+	if (j->fd == -1) {
+		return -1;
+	}
+	if (path_len > UINT16_MAX || data_len > UINT32_MAX - JOURNAL_HEADER_LEN - UINT16_MAX - sizeof(uint32_t)) {
+		WL_WARN("request %"PRId64" is too large to be journaled", id);
+		return -1;
+	}
+	r.kind = JOURNAL_ACTION;
+	r.type = (uint8_t)type;
+	r.path_len = (uint16_t)path_len;
+	r.session = j->session;
+	r.id = id;
+	r.data_len = (uint32_t)data_len;
+	return journal_append(ctx, j, &r, path, data);
+}
+
+int journal_log_done(wc_context_t *ctx, struct wc_journal *j, uint32_t session, int64_t id) {
+	struct journal_record r;
+
+	if (j->fd == -1) {
+		return -1;
+	}
+	r.kind = JOURNAL_DONE;
+	r.type = 0;
+	r.path_len = 0;
+	r.session = session;
+	r.id = id;
+	r.data_len = 0;
+	return journal_append(ctx, j, &r, "", "");
+}
+
+void journal_close(wc_context_t *ctx, struct wc_journal *j) {
+	struct journal_entry *e;
+
+	if (wc_timer_is_armed(&j->commit_timer)) {
+		wc_timer_cancel(ctx, &j->commit_timer);
+	}
+	journal_commit(j);
+	if (j->fd != -1) {
+		close(j->fd);
+		j->fd = -1;
+	}
+	while ((e = j->replay) != NULL) {
+		j->replay = e->next;
+		journal_entry_free(e);
+	}
+	free(j->buf);
+	j->buf = NULL;
+	j->len = j->cap = 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_JOURNAL_H_
+#define LIB_DATASYNC_JOURNAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "webcom-c/webcom.h"
+#include "../timer.h"
+
+/*
+ * Write-ahead journal of the write requests (put and merge).
+ *
+ * Each request is recorded when it is issued, and marked done once its
+ * result is known. When the journal is opened, the requests that were never
+ * marked done (because the process stopped before they were answered) are
+ * loaded to be issued again once connected, and the journal is compacted to
+ * keep only them.
+ *
+ * The records are appended to an in-memory buffer, which is written and
+ * synced to the file by groups (group commit), after a short interval or when
+ * it grows large, unless every record must be synced right away.
+ *
+ * File format, in host byte order: the "WCJ1" magic, followed by records made
+ * of a 20 bytes header, a payload and a 32 bits FNV-1a checksum of both:
+ *
+ *     uint8_t  kind        JOURNAL_ACTION or JOURNAL_DONE
+ *     uint8_t  type        the wc_action_type_t of an action
+ *     uint16_t path_len
+ *     uint32_t session     incremented each time the journal is opened
+ *     int64_t  id          request id, unique within a session
+ *     uint32_t data_len
+ *     char     path[path_len], data[data_len]
+ *     uint32_t checksum
+ *
+ * A truncated or corrupted record ends the journal, it is dropped at the
+ * next compaction.
+ */
+
+#define JOURNAL_MAGIC "WCJ1"
+#define JOURNAL_HEADER_LEN 20
+#define JOURNAL_COMMIT_THRESHOLD (1 << 16)
+#define JOURNAL_DEFAULT_INTERVAL_MS 10
+
+enum journal_record_kind {
+	JOURNAL_ACTION = 1,
+	JOURNAL_DONE = 2,
+};
+
+struct journal_entry {
+	struct journal_entry *next;
+	uint32_t session;
+	int64_t id;
+	wc_action_type_t type;
+	char *path;
+	char *data;
+};
+
+struct wc_journal {
+	int fd;                       /* -1 if there is no journal */
+	enum wc_journal_sync sync;
+	unsigned interval_ms;
+	uint32_t session;
+	unsigned char *buf;           /* records not written yet */
+	size_t len;
+	size_t cap;
+	struct wc_timer commit_timer;
+	struct journal_entry *replay; /* writes of the previous sessions never marked done */
+	uint64_t records;
+	uint64_t commits;
+};
+
+void journal_init(struct wc_journal *j);
+int journal_open(struct wc_journal *j, const char *path, enum wc_journal_sync sync, unsigned interval_ms);
+int journal_log_action(wc_context_t *ctx, struct wc_journal *j, int64_t id, wc_action_type_t type, const char *path, const char *data);
+int journal_log_done(wc_context_t *ctx, struct wc_journal *j, uint32_t session, int64_t id);
+int journal_commit(struct wc_journal *j);
+void journal_close(wc_context_t *ctx, struct wc_journal *j);
+void journal_entry_free(struct journal_entry *e);
+
+#endif /* LIB_DATASYNC_JOURNAL_H_ */
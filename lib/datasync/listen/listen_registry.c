@@ -34,6 +34,213 @@ static void mask_listen_request(wc_context_t *ctx, wc_ds_path_t *parsed_path);
 static void unmask_listen_request(wc_context_t *ctx, wc_ds_path_t *parsed_path);
 static void on_listen_result(wc_context_t *ctx, int64_t id, wc_action_type_t type, wc_req_pending_result_t status, char *reason, char *data, void *user);
 
+/*
+ * sends the listen request of a listen item, with the hash of the data of its
+ * path if it is in the cache (e.g. known from a previous connection), so that
+ * the server does not send it again if it did not change
+ */
+static void send_listen_request(wc_context_t *ctx, struct listen_item *li) {
+	char hash[sizeof(treenode_hash_t) + 1];
+	treenode_hash_t *h = NULL;
+	struct treenode *n;
+	int64_t id;
+
+	li->status = LISTEN_PENDING;
+
+	n = data_cache_get_parsed(ctx->datasync.cache, &li->path);
+	if (n != NULL) {
+		h = treenode_hash_get(n);
+	}
+
+	if (h != NULL) {
+		memcpy(hash, h->bytes, sizeof(h->bytes));
+		hash[sizeof(h->bytes)] = '\0';
+		id = wc_datasync_listen_hash(ctx, wc_datasync_path_to_str(&li->path), hash, on_listen_result, li);
+	} else {
+		id = wc_datasync_listen(ctx, wc_datasync_path_to_str(&li->path), on_listen_result, li);
+	}
+
+	if (id < 0) {
+		/* no result will come, sent again once reconnected */
+		li->status = LISTEN_REQUIRED;
+	}
+}
+
+/*
+ * sends a request that could not be queued right away, regardless of the
+ * current burst
+ */
+static void send_op_now(wc_context_t *ctx, struct listen_item *li, char *path, int unlisten, int resume) {
+	struct listen_registry *lr = ctx->datasync.listen_reg;
+
+	if (ctx->datasync.state != WC_CNX_STATE_CONNECTED) {
+		/* the listens are sent once connected, and the server forgot the
+		 * ones to remove */
+		if (!unlisten) {
+			li->status = LISTEN_REQUIRED;
+		}
+	} else if (unlisten) {
+		wc_datasync_unlisten(ctx, path, NULL, NULL);
+		lr->stats.unlistens_sent++;
+	} else {
+		send_listen_request(ctx, li);
+		lr->stats.listens_sent++;
+		if (resume) {
+			lr->stats.resume_sent++;
+		}
+	}
+}
+
+/* queues a request, it is sent by wc_listen_queue_drain() */
+static void queue_op(wc_context_t *ctx, struct listen_item *li, char *path, int unlisten, int resume) {
+	struct listen_registry *lr = ctx->datasync.listen_reg;
+	struct listen_op *op;
+	size_t len = strlen(path);
+
+	op = malloc(sizeof(*op) + len + 1);
+	if (op == NULL) {
+		WL_WARN("could not queue the %s request of %s, sending it now", unlisten ? "unlisten" : "listen", path);
+		send_op_now(ctx, li, path, unlisten, resume);
+		return;
+	}
+	op->next = NULL;
+	op->li = li;
+	op->unlisten = !!unlisten;
+	op->cancelled = 0;
+	op->resume = !!resume;
+	memcpy(op->path, path, len + 1);
+
+	*lr->queue_tail = op;
+	lr->queue_tail = &op->next;
+	lr->stats.queued++;
+	if (li != NULL) {
+		li->op = op;
+	}
+}
+
+/* the cancelled requests are freed when they reach the head of the queue */
+static void cancel_op(struct listen_registry *lr, struct listen_op *op) {
+	if (op->li != NULL) {
+		op->li->op = NULL;
+		op->li = NULL;
+	}
+	op->cancelled = 1;
+	lr->stats.queued--;
+}
+
+static void queue_listen_request(wc_context_t *ctx, struct listen_item *li, int resume) {
+	struct listen_registry *lr = ctx->datasync.listen_reg;
+
+	if (li->op != NULL && li->op->unlisten) {
+		/* the server still has this listen */
+		cancel_op(lr, li->op);
+		lr->stats.deduplicated += 2;
+		li->status = LISTEN_ACTIVE;
+	} else if (li->op == NULL) {
+		li->status = LISTEN_PENDING;
+		queue_op(ctx, li, wc_datasync_path_to_str(&li->path), 0, resume);
+		if (resume) {
+			lr->stats.resume_total++;
+		}
+	}
+}
+
+static void queue_unlisten_request(wc_context_t *ctx, struct listen_item *li) {
+	struct listen_registry *lr = ctx->datasync.listen_reg;
+
+	if (li->op != NULL && !li->op->unlisten) {
+		/* the listen request was never sent */
+		cancel_op(lr, li->op);
+		lr->stats.deduplicated += 2;
+	} else if (li->op == NULL) {
+		queue_op(ctx, li, wc_datasync_path_to_str(&li->path), 1, 0);
+	}
+}
+
+/*
+ * detaches the queued request of an item removed from the registry, returns 0
+ * if there was none, 1 if it was a listen request (which is cancelled), 2 if
+ * it was an unlisten request (which is kept)
+ */
+static int release_op(struct listen_registry *lr, struct listen_item *li) {
+	int ret = 0;
+
+	if (li->op != NULL) {
+		if (li->op->unlisten) {
+			li->op->li = NULL;
+			li->op = NULL;
+			ret = 2;
+		} else {
+			cancel_op(lr, li->op);
+			ret = 1;
+		}
+	}
+	return ret;
+}
+
+static void clear_queue(struct listen_registry *lr) {
+	struct listen_op *op;
+
+	while ((op = lr->queue) != NULL) {
+		lr->queue = op->next;
+		if (op->li != NULL) {
+			op->li->op = NULL;
+		}
+		free(op);
+	}
+	lr->queue_tail = &lr->queue;
+	lr->stats.queued = 0;
+}
+
+/* sends the queued requests allowed by the current burst */
+void wc_listen_queue_drain(wc_context_t *ctx) {
+	struct listen_registry *lr = ctx->datasync.listen_reg;
+	struct listen_op *op;
+
+	if (ctx->datasync.state != WC_CNX_STATE_CONNECTED) {
+		return;
+	}
+
+	while (lr->burst_left > 0 && (op = lr->queue) != NULL) {
+		lr->queue = op->next;
+		if (lr->queue == NULL) {
+			lr->queue_tail = &lr->queue;
+		}
+		if (!op->cancelled) {
+			lr->stats.queued--;
+			if (op->unlisten) {
+				wc_datasync_unlisten(ctx, op->path, NULL, NULL);
+				lr->stats.unlistens_sent++;
+			} else {
+				op->li->op = NULL;
+				send_listen_request(ctx, op->li);
+				lr->stats.listens_sent++;
+				if (op->resume && ++lr->stats.resume_sent == lr->stats.resume_total) {
+					WL_INFO("%u listen requests resumed", lr->stats.resume_total);
+				}
+			}
+			if (op->li != NULL) {
+				op->li->op = NULL;
+			}
+			lr->burst_left--;
+		}
+		free(op);
+	}
+}
+
+void wc_listen_queue_next_burst(wc_context_t *ctx) {
+	ctx->datasync.listen_reg->burst_left = ctx->listen_burst ? ctx->listen_burst : LISTEN_DEFAULT_BURST;
+	wc_listen_queue_drain(ctx);
+}
+
+void wc_datasync_get_listen_stats(wc_context_t *ctx, struct wc_datasync_listen_stats *stats) {
+	if (ctx->datasync_init) {
+		*stats = ctx->datasync.listen_reg->stats;
+	} else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
 static int compare_listen_item_data(void *a, void *b) {
 	wc_ds_path_t *pa = &(((struct listen_item *)a)->path);
 	wc_ds_path_t *pb = &(((struct listen_item *)b)->path);
@@ -64,7 +271,8 @@ static inline struct listen_item *listen_item_from_path(wc_ds_path_t *parsed_pat
 
 struct listen_registry* listen_registry_new() {
 	struct listen_registry* ret;
-	ret = malloc(sizeof *ret);
+	ret = calloc(1, sizeof *ret);
+	ret->queue_tail = &ret->queue;
 	ret->list = avl_new(
 			(avl_key_cmp_f) compare_listen_item_data,
 			(avl_data_copy_f) copy_listen_item_data,
@@ -75,6 +283,7 @@ struct listen_registry* listen_registry_new() {
 }
 
 void listen_registry_destroy(struct listen_registry* lr) {
+	clear_queue(lr);
 	avl_destroy(lr->list);
 	free(lr);
 }
@@ -110,6 +319,9 @@ void wc_listen_suspend_all(wc_context_t *ctx) {
 	struct avl_it it;
 	struct listen_registry* lr = ctx->datasync.listen_reg;
 
+	/* the server forgets the listens of a closed connection */
+	clear_queue(lr);
+
 	avl_it_start(&it, lr->list);
 
 	while ((li = avl_it_next(&it)) != NULL) {
@@ -124,14 +336,18 @@ void wc_listen_resume_all(wc_context_t *ctx) {
 	struct avl_it it;
 	struct listen_registry* lr = ctx->datasync.listen_reg;
 
+	lr->stats.resume_total = 0;
+	lr->stats.resume_sent = 0;
+
 	avl_it_start(&it, lr->list);
 
 	while ((li = avl_it_next(&it)) != NULL) {
 		if (li->status == LISTEN_REQUIRED || li->status == LISTEN_PENDING) {
-			li->status = LISTEN_PENDING;
-			wc_datasync_listen(ctx, wc_datasync_path_to_str(&li->path), on_listen_result, li);
+			queue_listen_request(ctx, li, 1);
 		}
 	}
+
+	wc_listen_queue_next_burst(ctx);
 }
 
 struct listen_item *listen_registry_add(struct listen_registry* lr, char *path) {
@@ -151,6 +367,7 @@ struct listen_item *listen_registry_add_ex(struct listen_registry* lr, wc_ds_pat
 		li = alloca(LISTEN_ITEM_STRUCT_MAX_SIZE);
 		li->ref = 1;
 		li->stamp = 0;
+		li->op = NULL;
 		li->status = is_masked(lr, parsed_path) ? LISTEN_MASKED : LISTEN_REQUIRED;
 		wc_datasync_path_copy(parsed_path, &li->path);
 		li = avl_insert(lr->list, li);
@@ -173,18 +390,22 @@ int listen_registry_unref(struct listen_registry* lr, wc_ds_path_t *parsed_path,
 		if (li->ref > 0) {
 			ret = 0;
 		} else {
+			ret = 1 + release_op(lr, li);
 			avl_remove(lr->list, k);
-			ret = 1;
 		}
 	}
 	return ret;
 }
 
 static void on_listen_result(wc_context_t *ctx, int64_t id, wc_action_type_t type, wc_req_pending_result_t status, char *reason, char *data, void *user) {
-	(void)ctx,(void)id,(void)type,(void)reason,(void)data;
+	(void)id,(void)type,(void)reason,(void)data;
 	struct listen_item *li = user;
 	if (status == WC_REQ_OK) {
 		li->status = LISTEN_ACTIVE;
+		li->stamp = ctx->datasync.stamp;
+	} else if (reason != NULL && strcmp(reason, WC_REQ_REASON_DISCONNECTED) == 0) {
+		/* sent again once reconnected */
+		li->status = LISTEN_REQUIRED;
 	} else {
 		li->status = LISTEN_FAILED;
 	}
@@ -199,12 +420,12 @@ void wc_datasync_watch(wc_context_t *ctx, char *path) {
 	if (li->status == LISTEN_REQUIRED || li->status == LISTEN_FAILED)
 	{
 		if (ctx->datasync.state == WC_CNX_STATE_CONNECTED) {
-			li->status = LISTEN_PENDING;
-			wc_datasync_listen(ctx, wc_datasync_path_to_str(parsed_path), on_listen_result, li);
+			queue_listen_request(ctx, li, 0);
 		} else {
 			li->status = LISTEN_REQUIRED;
 		}
 		mask_listen_request(ctx, parsed_path);
+		wc_listen_queue_drain(ctx);
 	}
 	wc_datasync_path_destroy(parsed_path);
 }
@@ -227,8 +448,7 @@ static void unmask_listen_request(wc_context_t *ctx, wc_ds_path_t *parsed_path)
 			if (li->status == LISTEN_MASKED) {
 				top_path = &li->path;
 				if (ctx->datasync.state == WC_CNX_STATE_CONNECTED) {
-					li->status = LISTEN_PENDING;
-					wc_datasync_listen(ctx, wc_datasync_path_to_str(&li->path), on_listen_result, li);
+					queue_listen_request(ctx, li, 0);
 				} else {
 					li->status = LISTEN_REQUIRED;
 				}
@@ -250,17 +470,29 @@ static void mask_listen_request(wc_context_t *ctx, wc_ds_path_t *parsed_path) {
 	{
 		if (li->status == LISTEN_ACTIVE) {
 			li->status = LISTEN_MASKED;
-			wc_datasync_unlisten(ctx, wc_datasync_path_to_str(&li->path), NULL, NULL);
+			queue_unlisten_request(ctx, li);
 		} else if (li->status == LISTEN_PENDING || li->status == LISTEN_REQUIRED) {
 			li->status = LISTEN_MASKED;
+			if (li->op != NULL && !li->op->unlisten) {
+				cancel_op(ctx->datasync.listen_reg, li->op);
+				ctx->datasync.listen_reg->stats.deduplicated++;
+			}
 		}
 	}
 }
 
 void wc_datasync_unwatch_ex(wc_context_t *ctx, wc_ds_path_t *parsed_path, int ref_dec) {
-	if (listen_registry_unref(ctx->datasync.listen_reg, parsed_path, ref_dec)) {
-		wc_datasync_unlisten(ctx, wc_datasync_path_to_str(parsed_path), NULL, NULL);
+	int removed = listen_registry_unref(ctx->datasync.listen_reg, parsed_path, ref_dec);
+
+	if (removed) {
+		if (removed == 1) {
+			queue_op(ctx, NULL, wc_datasync_path_to_str(parsed_path), 1, 0);
+		} else if (removed == 2) {
+			/* the listen request was never sent */
+			ctx->datasync.listen_reg->stats.deduplicated += 2;
+		}
 		unmask_listen_request(ctx, parsed_path);
+		wc_listen_queue_drain(ctx);
 	}
 }
 
@@ -272,9 +504,12 @@ void wc_datasync_unwatch_all(wc_context_t *ctx) {
 
 
 	while ((li = avl_it_next(&it)) != NULL) {
-		wc_datasync_unlisten(ctx, wc_datasync_path_to_str(&li->path), NULL, NULL);
+		if (release_op(ctx->datasync.listen_reg, li) == 0) {
+			queue_op(ctx, NULL, wc_datasync_path_to_str(&li->path), 1, 0);
+		}
 	}
 	avl_remove_all(ctx->datasync.listen_reg->list);
+	wc_listen_queue_drain(ctx);
 }
 
 static char *listen_status_to_str(enum listen_status status) {
@@ -39,17 +39,41 @@ enum listen_status {
 	LISTEN_MASKED,
 };
 
+struct listen_op;
+
 struct listen_item {
 	enum listen_status status;
-	unsigned stamp;
+	unsigned stamp; /**< stamp of the connection on which the server last accepted the listen request */
 	unsigned ref;
+	struct listen_op *op; /**< queued listen or unlisten request of this item, NULL if none */
 	wc_ds_path_t path;
 };
 
 #define LISTEN_ITEM_STRUCT_MAX_SIZE (sizeof(struct listen_item) + PATH_STRUCT_MAX_FLEXIBLE_SIZE)
 
+/*
+ * listen and unlisten requests are not sent right away but queued, and sent
+ * by bursts of at most `listen_burst` requests, a new burst being allowed
+ * each time the outbound queue is empty; a queued request cancels a queued opposite request for the same
+ * path instead of being queued itself
+ */
+struct listen_op {
+	struct listen_op *next;
+	struct listen_item *li; /**< NULL for the unlisten request of a removed item */
+	unsigned unlisten:1;
+	unsigned cancelled:1;
+	unsigned resume:1;      /**< queued by wc_listen_resume_all() */
+	char path[];
+};
+
+#define LISTEN_DEFAULT_BURST 32
+
 struct listen_registry {
 	avl_t *list;
+	struct listen_op *queue;
+	struct listen_op **queue_tail;
+	unsigned burst_left; /**< number of requests that can still be sent before the outbound queue is empty */
+	struct wc_datasync_listen_stats stats;
 };
 
 struct listen_registry* listen_registry_new();
@@ -66,6 +90,8 @@ void wc_datasync_watch_ex(wc_context_t *ctx, wc_ds_path_t *parsed_path);
 void wc_datasync_unwatch_ex(wc_context_t *ctx, wc_ds_path_t *parsed_path, int ref_dec);
 void wc_listen_suspend_all(wc_context_t *ctx);
 void wc_listen_resume_all(wc_context_t *ctx);
+void wc_listen_queue_drain(wc_context_t *ctx);
+void wc_listen_queue_next_burst(wc_context_t *ctx);
 void dump_listen_registry(struct listen_registry* lr, FILE *f) ;
 
 int wc_is_listening(wc_context_t *ctx, wc_ds_path_t *parsed_path);
@@ -26,6 +26,8 @@
 
 #include "webcom-c/webcom-msg.h"
 
+#include "cbor.h"
+
 #define IF_NOT_NULL_DO(_func, _p) do {if ((_p) != NULL) _func((_p));} while (0)
 
 static inline void _wc_free_action(wc_action_t *msg) {
@@ -35,6 +37,7 @@ static inline void _wc_free_action(wc_action_t *msg) {
 		break;
 	case WC_ACTION_LISTEN:
 		IF_NOT_NULL_DO(free, msg->u.listen.path);
+		IF_NOT_NULL_DO(free, msg->u.listen.hash);
 		break;
 	case WC_ACTION_MERGE:
 		IF_NOT_NULL_DO(free, msg->u.merge.path);
@@ -148,6 +151,9 @@ static inline json_object* _wc_listen_msg_to_json(wc_action_listen_t *listen) {
 
 	jroot = json_object_new_object();
 	json_object_object_add(jroot, "p", json_object_new_string(listen->path));
+	if (listen->hash) {
+		json_object_object_add(jroot, "h", json_object_new_string(listen->hash));
+	}
 
 	return jroot;
 }
@@ -209,6 +215,51 @@ static inline json_object* _wc_odc_msg_to_json(wc_action_on_disc_cancel_t *odc)
 	return jroot;
 }
 
+static inline json_object* _wc_path_data_to_json(char *path, char *data) {
+	json_object *jroot;
+
+	jroot = json_object_new_object();
+	json_object_object_add(jroot, "p", json_object_new_string(path));
+	json_object_object_add(jroot, "d", data != NULL ? json_tokener_parse(data) : NULL);
+
+	return jroot;
+}
+
+static inline json_object* _wc_push_msg_to_json(wc_push_t *push) {
+	json_object *jbody;
+
+	switch (push->type) {
+	case WC_PUSH_AUTH_REVOKED:
+		jbody = json_object_new_object();
+		json_object_object_add(jbody, "s", json_object_new_string(push->u.auth_revoked.status));
+		json_object_object_add(jbody, "d", json_object_new_string(push->u.auth_revoked.reason));
+		return jbody;
+	case WC_PUSH_LISTEN_REVOKED:
+		jbody = json_object_new_object();
+		json_object_object_add(jbody, "p", json_object_new_string(push->u.listen_revoked.path));
+		return jbody;
+	case WC_PUSH_DATA_UPDATE_PUT:
+		return _wc_path_data_to_json(push->u.update_put.path, push->u.update_put.data);
+	case WC_PUSH_DATA_UPDATE_MERGE:
+		return _wc_path_data_to_json(push->u.update_merge.path, push->u.update_merge.data);
+	}
+
+	return NULL;
+}
+
+static inline json_object* _wc_response_msg_to_json(wc_response_t *response) {
+	json_object *jbody;
+
+	jbody = json_object_new_object();
+	json_object_object_add(jbody, "s", json_object_new_string(response->status));
+	/* the server always sends a data field, if only an empty string */
+	json_object_object_add(jbody, "d", response->data != NULL
+			? json_tokener_parse(response->data)
+			: json_object_new_string(""));
+
+	return jbody;
+}
+
 static inline json_object* _wc_data_msg_to_json(wc_data_msg_t *data) {
 	json_object *jroot;
 
@@ -257,8 +308,48 @@ static inline json_object* _wc_data_msg_to_json(wc_data_msg_t *data) {
 		}
 		break;
 	case WC_DATA_MSG_PUSH:
+		switch (data->u.push.type) {
+		case WC_PUSH_AUTH_REVOKED:
+			json_object_object_add(jroot, "a", json_object_new_string("ac"));
+			break;
+		case WC_PUSH_LISTEN_REVOKED:
+			json_object_object_add(jroot, "a", json_object_new_string("c"));
+			break;
+		case WC_PUSH_DATA_UPDATE_PUT:
+			json_object_object_add(jroot, "a", json_object_new_string("d"));
+			break;
+		case WC_PUSH_DATA_UPDATE_MERGE:
+			json_object_object_add(jroot, "a", json_object_new_string("m"));
+			break;
+		}
+		json_object_object_add(jroot, "b", _wc_push_msg_to_json(&data->u.push));
 		break;
 	case WC_DATA_MSG_RESPONSE:
+		json_object_object_add(jroot, "r", json_object_new_int64(data->u.response.r));
+		json_object_object_add(jroot, "b", _wc_response_msg_to_json(&data->u.response));
+		break;
+	}
+
+	return jroot;
+}
+
+static inline json_object* _wc_ctrl_msg_to_json(wc_ctrl_msg_t *ctrl) {
+	json_object *jroot, *jdata;
+
+	jroot = json_object_new_object();
+
+	switch (ctrl->type) {
+	case WC_CTRL_MSG_HANDSHAKE:
+		jdata = json_object_new_object();
+		json_object_object_add(jdata, "ts", json_object_new_int64(ctrl->u.handshake.ts));
+		json_object_object_add(jdata, "h", json_object_new_string(ctrl->u.handshake.server));
+		json_object_object_add(jdata, "v", json_object_new_string(ctrl->u.handshake.version));
+		json_object_object_add(jroot, "t", json_object_new_string("h"));
+		json_object_object_add(jroot, "d", jdata);
+		break;
+	case WC_CTRL_MSG_CONNECTION_SHUTDOWN:
+		json_object_object_add(jroot, "t", json_object_new_string("s"));
+		json_object_object_add(jroot, "d", json_object_new_string(ctrl->u.shutdown_reason));
 		break;
 	}
 
@@ -277,7 +368,7 @@ static json_object* _wc_msg_to_json(wc_msg_t *msg) {
 		break;
 	case WC_MSG_CTRL:
 		json_object_object_add(jroot, "t", json_object_new_string("c"));
-		//json_object_object_add(jroot, "d", _wc_ctrl_msg_to_json(&msg->u.ctrl));
+		json_object_object_add(jroot, "d", _wc_ctrl_msg_to_json(&msg->u.ctrl));
 		break;
 	}
 
@@ -296,3 +387,20 @@ char *wc_datasync_msg_to_json_str(wc_msg_t *msg) {
 
 	return res;
 }
+
+unsigned char *wc_datasync_msg_to_cbor(wc_msg_t *msg, size_t *len) {
+	json_object *jroot;
+	struct cbor_buf b;
+
+	jroot = _wc_msg_to_json(msg);
+
+	cbor_buf_init(&b);
+	if (cbor_encode(jroot, &b) != 0) {
+		cbor_buf_cleanup(&b);
+	}
+
+	json_object_put(jroot);
+
+	*len = b.len;
+	return b.data;
+}
@@ -21,8 +21,10 @@
  */
 
 
+#include <string.h>
 #include <json-c/json.h>
 
+#include "../../webcom_base_priv.h"
 #include "webcom-c/webcom.h"
 #include "../path.h"
 #include "../cache/treenode_cache.h"
@@ -31,7 +33,29 @@
 
 
 on_handle_t wc_datasync_on_value(wc_context_t *ctx, char *path, on_callback_f callback) {
-	on_handle_t ret = on_registry_add(ctx, ON_VALUE, path, callback);
+	return wc_datasync_on_value_ex(ctx, path, callback, NULL);
+}
+
+on_handle_t wc_datasync_on_value_ex(wc_context_t *ctx, char *path, on_callback_f callback, struct wc_on_options *options) {
+	on_handle_t ret = on_registry_add(ctx, ON_VALUE, path, callback, options, NULL);
+	wc_datasync_watch(ctx, path);
+	return ret;
+}
+
+on_handle_t wc_datasync_on_query(wc_context_t *ctx, char *path, struct wc_query *query, on_callback_f callback, struct wc_on_options *options) {
+	struct cache_query *q;
+	on_handle_t ret;
+
+	if ((q = cache_query_new(query)) == NULL) {
+		return NULL;
+	}
+
+	ret = on_registry_add(ctx, ON_VALUE, path, callback, options, q);
+	if (ret == NULL) {
+		/* the query is owned by the subscription once it is added */
+		cache_query_destroy(q);
+		return NULL;
+	}
 	wc_datasync_watch(ctx, path);
 	return ret;
 }
@@ -48,23 +72,51 @@ wc_context_t *wc_datasync_on_handle_get_ctx(on_handle_t h) {
 
 
 on_handle_t wc_datasync_on_child_added(wc_context_t *ctx, char *path, on_callback_f callback) {
-	on_handle_t ret = on_registry_add(ctx, ON_CHILD_ADDED, path, callback);
+	return wc_datasync_on_child_added_ex(ctx, path, callback, NULL);
+}
+
+on_handle_t wc_datasync_on_child_added_ex(wc_context_t *ctx, char *path, on_callback_f callback, struct wc_on_options *options) {
+	on_handle_t ret = on_registry_add(ctx, ON_CHILD_ADDED, path, callback, options, NULL);
 	wc_datasync_watch(ctx, path);
 	return ret;
 }
 
 on_handle_t wc_datasync_on_child_changed(wc_context_t *ctx, char *path, on_callback_f callback) {
-	on_handle_t ret = on_registry_add(ctx, ON_CHILD_CHANGED, path, callback);
+	return wc_datasync_on_child_changed_ex(ctx, path, callback, NULL);
+}
+
+on_handle_t wc_datasync_on_child_changed_ex(wc_context_t *ctx, char *path, on_callback_f callback, struct wc_on_options *options) {
+	on_handle_t ret = on_registry_add(ctx, ON_CHILD_CHANGED, path, callback, options, NULL);
 	wc_datasync_watch(ctx, path);
 	return ret;
 }
 
 on_handle_t wc_datasync_on_child_removed(wc_context_t *ctx, char *path, on_callback_f callback) {
-	on_handle_t ret = on_registry_add(ctx, ON_CHILD_REMOVED, path, callback);
+	return wc_datasync_on_child_removed_ex(ctx, path, callback, NULL);
+}
+
+on_handle_t wc_datasync_on_child_removed_ex(wc_context_t *ctx, char *path, on_callback_f callback, struct wc_on_options *options) {
+	on_handle_t ret = on_registry_add(ctx, ON_CHILD_REMOVED, path, callback, options, NULL);
 	wc_datasync_watch(ctx, path);
 	return ret;
 }
 
+void wc_datasync_on_set_priority(on_handle_t h, enum wc_on_priority priority) {
+	struct on_cb_list *p_cb = h;
+
+	if (priority >= 0 && priority < _WC_ON_PRIORITY_COUNT) {
+		p_cb->priority = priority;
+	}
+}
+
+void wc_datasync_on_get_dispatch_stats(wc_context_t *ctx, struct wc_on_dispatch_stats *stats) {
+	if (ctx->datasync_init) {
+		on_registry_get_dispatch_stats(ctx->datasync.on_reg, stats);
+	} else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
 static void wc_datasync_off_w(wc_context_t *ctx, char *path, int event_mask, struct on_cb_list *cb) {
 	int removed;
 	wc_ds_path_t *parsed_path = wc_datasync_path_new(path);
@@ -0,0 +1,257 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../webcom_base_priv.h"
+#include "on_dispatch.h"
+#include "on_registry.h"
+
+#define ON_DISPATCH_DEFAULT_BACKLOG (1 << 12)
+
+struct on_data *on_data_new(size_t json_len) {
+	struct on_data *ret;
+
+	ret = malloc(sizeof(*ret) + json_len + 1);
+	ret->ref = 1;
+
+	return ret;
+}
+
+void on_data_unref(struct on_data *data) {
+	if (data != NULL && --data->ref == 0) {
+		free(data);
+	}
+}
+
+void on_dispatch_init(struct on_dispatch *d, wc_timer_cb_f resume_cb, void *data) {
+	int i;
+
+	memset(d, 0, sizeof(*d));
+
+	for (i = 0 ; i < _WC_ON_PRIORITY_COUNT ; i++) {
+		d->tail[i] = &d->head[i];
+	}
+
+	wc_timer_init(&d->resume_timer, resume_cb, data);
+}
+
+static void on_delivery_free(struct on_delivery *dl) {
+	on_data_unref(dl->data);
+	free(dl);
+}
+
+void on_dispatch_cleanup(struct on_dispatch *d) {
+	struct on_delivery *dl, *next;
+	int i;
+
+	for (i = 0 ; i < _WC_ON_PRIORITY_COUNT ; i++) {
+		for (dl = d->head[i] ; dl != NULL ; dl = next) {
+			next = dl->next;
+			on_delivery_free(dl);
+		}
+	}
+
+	if (d->ctx != NULL) {
+		wc_timer_cancel(d->ctx, &d->resume_timer);
+	}
+}
+
+static struct on_delivery *on_dispatch_pop(struct on_dispatch *d) {
+	struct on_delivery *ret = NULL;
+	int i;
+
+	for (i = 0 ; i < _WC_ON_PRIORITY_COUNT ; i++) {
+		if (d->head[i] != NULL) {
+			ret = d->head[i];
+			d->head[i] = ret->next;
+			if (d->head[i] == NULL) {
+				d->tail[i] = &d->head[i];
+			}
+			d->depth--;
+			d->stats.depth[i]--;
+			break;
+		}
+	}
+
+	return ret;
+}
+
+static void on_dispatch_deliver(struct on_dispatch *d, struct on_delivery *dl, int64_t now) {
+	struct on_cb_list *p_cb = dl->cb;
+	uint64_t latency;
+
+	p_cb->queued--;
+	if (p_cb->pending_value == dl) {
+		p_cb->pending_value = NULL;
+	}
+
+	if (!p_cb->cancelled) {
+		latency = (uint64_t)(now - dl->queued_at);
+		d->latency_sum_us += latency;
+		d->stats.delivered++;
+		d->stats.latency_avg_us = d->latency_sum_us / d->stats.delivered;
+		if (latency > d->stats.latency_max_us) {
+			d->stats.latency_max_us = latency;
+		}
+
+		if (!p_cb->cb(p_cb->sub->ctx, p_cb, dl->data == NULL ? "null" : dl->data->json, dl->cur_key, dl->prev_key)) {
+			on_registry_mark_cb_for_deletion(p_cb);
+		}
+	}
+
+	on_delivery_free(dl);
+}
+
+void on_dispatch_push(struct on_dispatch *d, struct on_cb_list *p_cb, enum on_event_type type, struct on_data *data, char *cur_key, char *prev_key) {
+	struct on_delivery *dl;
+	size_t cur_len, prev_len;
+	unsigned backlog_max;
+
+	if (p_cb->cancelled) {
+		return;
+	}
+
+	if (type == ON_VALUE && p_cb->pending_value != NULL) {
+		/* only the latest value matters, refresh the queued delivery */
+		on_data_unref(p_cb->pending_value->data);
+		if (data != NULL) data->ref++;
+		p_cb->pending_value->data = data;
+		d->stats.coalesced++;
+		return;
+	}
+
+	backlog_max = d->ctx->dispatch_backlog_max ? d->ctx->dispatch_backlog_max : ON_DISPATCH_DEFAULT_BACKLOG;
+	if (d->depth >= backlog_max && !d->running) {
+		/* the backlog is full: run the oldest deliveries ahead of the budget */
+		d->running = 1;
+		while (d->depth >= backlog_max && (dl = on_dispatch_pop(d)) != NULL) {
+			d->stats.overflows++;
+			on_dispatch_deliver(d, dl, wc_timer_now_us());
+		}
+		d->running = 0;
+	}
+
+	cur_len = cur_key != NULL ? strlen(cur_key) + 1 : 0;
+	prev_len = prev_key != NULL ? strlen(prev_key) + 1 : 0;
+
+	dl = malloc(sizeof(*dl) + cur_len + prev_len);
+	dl->cb = p_cb;
+	dl->data = data;
+	if (data != NULL) data->ref++;
+	dl->cur_key = cur_key != NULL ? memcpy((char *)(dl + 1), cur_key, cur_len) : NULL;
+	dl->prev_key = prev_key != NULL ? memcpy((char *)(dl + 1) + cur_len, prev_key, prev_len) : NULL;
+	dl->queued_at = wc_timer_now_us();
+	dl->next = NULL;
+
+	*d->tail[p_cb->priority] = dl;
+	d->tail[p_cb->priority] = &dl->next;
+	d->depth++;
+	d->stats.depth[p_cb->priority]++;
+	if (d->depth > d->stats.max_depth) {
+		d->stats.max_depth = d->depth;
+	}
+
+	p_cb->queued++;
+	if (type == ON_VALUE) {
+		p_cb->pending_value = dl;
+	}
+}
+
+void on_dispatch_cancel(struct on_dispatch *d, struct on_cb_list *p_cb) {
+	struct on_delivery **prev, *dl;
+	int i;
+
+	for (i = 0 ; i < _WC_ON_PRIORITY_COUNT && p_cb->queued > 0 ; i++) {
+		prev = &d->head[i];
+		while ((dl = *prev) != NULL) {
+			if (dl->cb == p_cb) {
+				*prev = dl->next;
+				d->depth--;
+				d->stats.depth[i]--;
+				p_cb->queued--;
+				on_delivery_free(dl);
+			} else {
+				prev = &dl->next;
+			}
+		}
+		d->tail[i] = prev;
+	}
+	p_cb->pending_value = NULL;
+}
+
+static inline int on_dispatch_budget_left(struct on_dispatch *d, unsigned spent_cb, int64_t spent_us) {
+	return (d->ctx->dispatch_budget_callbacks == 0 || spent_cb < d->ctx->dispatch_budget_callbacks)
+			&& (d->ctx->dispatch_budget_us == 0 || spent_us < (int64_t)d->ctx->dispatch_budget_us);
+}
+
+void on_dispatch_run(struct on_dispatch *d) {
+	struct on_delivery *dl;
+	unsigned n = 0;
+	int64_t start, now;
+
+	if (d->running || d->ctx == NULL) {
+		return;
+	}
+
+	d->running = 1;
+
+	/* the budget is shared by all the runs of an event loop iteration, e.g.
+	 * one for each message read in this iteration */
+	start = now = wc_timer_now_us();
+	while (on_dispatch_budget_left(d, d->spent_cb + n, d->spent_us + now - start) && (dl = on_dispatch_pop(d)) != NULL) {
+		on_dispatch_deliver(d, dl, now);
+		n++;
+		now = wc_timer_now_us();
+	}
+	if (d->ctx->dispatch_budget_callbacks != 0 || d->ctx->dispatch_budget_us != 0) {
+		d->spent_cb += n;
+		d->spent_us += now - start;
+	}
+
+	if (d->depth > 0 && n > 0) {
+		/* budget exhausted: let the event loop breathe, resume right after */
+		d->stats.yields++;
+	}
+	if ((d->depth > 0 || d->spent_cb > 0) && !wc_timer_is_armed(&d->resume_timer)) {
+		/* the resume timer also marks the start of the next iteration, where
+		 * the budget is refilled */
+		wc_timer_arm(d->ctx, &d->resume_timer, 0);
+	}
+
+	d->running = 0;
+}
+
+/* called by the resume timer, on a new event loop iteration */
+void on_dispatch_refill(struct on_dispatch *d) {
+	d->spent_cb = 0;
+	d->spent_us = 0;
+}
+
+/* delivers the queued events on the next event loop iteration, for the events
+ * queued outside of the event processing (e.g. when a callback is added) */
+void on_dispatch_defer(struct on_dispatch *d) {
+	if (d->depth > 0 && !d->running && !wc_timer_is_armed(&d->resume_timer)) {
+		wc_timer_arm(d->ctx, &d->resume_timer, 0);
+	}
+}
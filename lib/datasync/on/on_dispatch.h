@@ -0,0 +1,83 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_ON_ON_DISPATCH_H_
+#define LIB_DATASYNC_ON_ON_DISPATCH_H_
+
+#include <stdint.h>
+
+#include "webcom-c/webcom.h"
+
+#include "../../timer.h"
+#include "on_subscription.h"
+
+/*
+ * The dispatcher sits between the on_registry triggers and the user
+ * callbacks: every data event is queued in a per-priority FIFO, then the
+ * queues are drained in priority order within the per-iteration budget
+ * configured in the context options. When the budget is exhausted, the
+ * dispatcher yields to the event loop and resumes on the next iteration.
+ * The budget is spent across all the runs of an iteration: the resume timer,
+ * armed once something was delivered under a budget, refills it.
+ */
+
+/* reference counted JSON snapshot, shared by all the deliveries of a given
+ * event */
+struct on_data {
+	unsigned ref;
+	char json[];
+};
+
+struct on_delivery {
+	struct on_cb_list *cb;
+	struct on_data *data; /* NULL stands for "null" */
+	char *cur_key;
+	char *prev_key;
+	int64_t queued_at;
+	struct on_delivery *next;
+};
+
+struct on_dispatch {
+	wc_context_t *ctx;
+	struct on_delivery *head[_WC_ON_PRIORITY_COUNT];
+	struct on_delivery **tail[_WC_ON_PRIORITY_COUNT];
+	unsigned depth;
+	unsigned running:1;
+	struct wc_timer resume_timer;
+	unsigned spent_cb; /* budget spent in the current event loop iteration */
+	int64_t spent_us;
+	uint64_t latency_sum_us;
+	struct wc_on_dispatch_stats stats;
+};
+
+struct on_data *on_data_new(size_t json_len);
+void on_data_unref(struct on_data *data);
+
+void on_dispatch_init(struct on_dispatch *d, wc_timer_cb_f resume_cb, void *data);
+void on_dispatch_cleanup(struct on_dispatch *d);
+void on_dispatch_push(struct on_dispatch *d, struct on_cb_list *p_cb, enum on_event_type type, struct on_data *data, char *cur_key, char *prev_key);
+void on_dispatch_cancel(struct on_dispatch *d, struct on_cb_list *p_cb);
+void on_dispatch_run(struct on_dispatch *d);
+void on_dispatch_refill(struct on_dispatch *d);
+void on_dispatch_defer(struct on_dispatch *d);
+
+#endif /* LIB_DATASYNC_ON_ON_DISPATCH_H_ */
@@ -30,10 +30,18 @@
 #include "../json.h"
 #include "../../collection/avl.h"
 #include "../listen/listen_registry.h"
+#include "on_dispatch.h"
 
 
+struct deleted_cb {
+	on_handle_t cb;
+	struct deleted_cb *next;
+};
+
 struct on_registry {
 	avl_t *sub_list;
+	struct on_dispatch dispatch;
+	struct deleted_cb *deleted_cb_list; /* callbacks to remove once the dispatch is over */
 };
 
 struct internal_hash {
@@ -42,14 +50,20 @@ struct internal_hash {
 };
 
 
-struct deleted_cb {
-	on_handle_t cb;
-	struct deleted_cb *next;
+/* delivery rate state of a rate limited subscription */
+struct on_rate {
+	struct wc_on_options opts; /* the least restrictive options of the sub's callbacks */
+	int64_t last_delivery;
+	int64_t last_event;
+	int64_t burst_start;
+	struct wc_timer timer;
+	unsigned dirty:1;
 };
-static struct deleted_cb *deleted_cb_list = NULL;
 
-static void on_val_trig(struct on_sub *sub, data_cache_t *cache);
-static void on_child_trig(struct on_sub *sub, data_cache_t *cache);
+
+static void on_val_trig(struct on_registry *reg, struct on_sub *sub, data_cache_t *cache);
+static void on_child_trig(struct on_registry *reg, struct on_sub *sub, data_cache_t *cache);
+static void trig_now(struct on_registry *reg, struct on_sub *sub, data_cache_t *cache);
 
 
 
@@ -86,10 +100,16 @@ static void clean_on_sub_data(void *data) {
 	avl_destroy(node->children_hashes);
 	wc_datasync_path_cleanup(&node->path);
 
+	if (node->rate != NULL) {
+		wc_timer_cancel(node->ctx, &node->rate->timer);
+		free(node->rate);
+	}
+
 	for (i = 0 ; i < ON_EVENT_TYPE_COUNT ; i++) {
 		p_cb = node->cb_list[i];
 		while (p_cb != NULL) {
 			tmp = p_cb->next;
+			cache_query_destroy(p_cb->query);
 			free(p_cb);
 			p_cb = tmp;
 		}
@@ -115,6 +135,13 @@ static inline struct on_sub *on_child_sub_from_path(wc_ds_path_t *parsed_path) {
 	return ((void *)parsed_path) - offsetof(struct on_sub, path);
 }
 
+static void on_registry_resume_cb(UNUSED_PARAM(wc_context_t *ctx), struct wc_timer *timer) {
+	struct on_registry *reg = timer->data;
+
+	on_dispatch_refill(&reg->dispatch);
+	on_registry_run_callbacks(reg);
+}
+
 struct on_registry *on_registry_new() {
 	struct on_registry *ret = NULL;
 
@@ -126,6 +153,9 @@ struct on_registry *on_registry_new() {
 					(avl_data_size_f) on_sub_data_size,
 					(avl_data_cleanup_f) clean_on_sub_data);
 
+	on_dispatch_init(&ret->dispatch, on_registry_resume_cb, ret);
+	ret->deleted_cb_list = NULL;
+
 	return ret;
 }
 
@@ -150,13 +180,129 @@ static void refresh_on_child_sub_hashes(struct on_sub *sub, struct treenode *cac
 	}
 }
 
-on_handle_t on_registry_add(wc_context_t *ctx, enum on_event_type type, char *path, on_callback_f cb) {
+static void on_rate_timer_cb(wc_context_t *ctx, struct wc_timer *timer) {
+	struct on_sub *sub = timer->data;
+	struct on_rate *rate = sub->rate;
+
+	if (rate->dirty) {
+		rate->dirty = 0;
+		rate->last_delivery = wc_timer_now();
+		trig_now(ctx->datasync.on_reg, sub, ctx->datasync.cache);
+		on_registry_run_callbacks(ctx->datasync.on_reg);
+	}
+}
+
+/* recomputes the delivery rate of a subscription from its callbacks' options:
+ * a single callback without limits disables rate limiting for the whole
+ * subscription */
+static void on_rate_refresh(struct on_sub *sub) {
+	struct wc_on_options opts = {0, 0, 0};
+	struct on_cb_list *p_cb;
+	int i, first = 1, limited = 1;
+
+	for (i = 0 ; i < ON_EVENT_TYPE_COUNT && limited ; i++) {
+		for (p_cb = sub->cb_list[i] ; p_cb != NULL ; p_cb = p_cb->next) {
+			if (!p_cb->rate_limited) {
+				limited = 0;
+				break;
+			} else if (first) {
+				opts = p_cb->rate;
+				first = 0;
+			} else {
+				opts.min_interval_ms = p_cb->rate.min_interval_ms < opts.min_interval_ms ? p_cb->rate.min_interval_ms : opts.min_interval_ms;
+				opts.debounce_ms = p_cb->rate.debounce_ms < opts.debounce_ms ? p_cb->rate.debounce_ms : opts.debounce_ms;
+				opts.trailing |= p_cb->rate.trailing;
+			}
+		}
+	}
+
+	if (limited && !first && (opts.min_interval_ms != 0 || opts.debounce_ms != 0)) {
+		if (sub->rate == NULL) {
+			sub->rate = calloc(1, sizeof(*sub->rate));
+			wc_timer_init(&sub->rate->timer, on_rate_timer_cb, sub);
+		}
+		sub->rate->opts = opts;
+	} else if (sub->rate != NULL) {
+		wc_timer_cancel(sub->ctx, &sub->rate->timer);
+		free(sub->rate);
+		sub->rate = NULL;
+	}
+}
+
+/* decides whether a change must be delivered right away (returns 1), or
+ * suppressed (returns 0), in which case the trailing edge timer is armed if
+ * needed */
+static int on_rate_admit(struct on_sub *sub) {
+	struct on_rate *rate = sub->rate;
+	int64_t now = wc_timer_now(), deadline;
+
+	if (rate->opts.debounce_ms != 0) {
+		if (!rate->opts.trailing) {
+			/* leading edge: deliver the first change of a burst only */
+			deadline = rate->last_event + rate->opts.debounce_ms;
+			rate->last_event = now;
+			if (now >= deadline) {
+				rate->last_delivery = now;
+				return 1;
+			}
+			return 0;
+		}
+
+		if (!rate->dirty) {
+			rate->dirty = 1;
+			rate->burst_start = now;
+		}
+		deadline = now + rate->opts.debounce_ms;
+		if (rate->opts.min_interval_ms != 0 && rate->burst_start + rate->opts.min_interval_ms < deadline) {
+			deadline = rate->burst_start + rate->opts.min_interval_ms;
+		}
+		wc_timer_arm(sub->ctx, &rate->timer, (long)(deadline - now));
+		return 0;
+	}
+
+	if (!wc_timer_is_armed(&rate->timer) && now - rate->last_delivery >= rate->opts.min_interval_ms) {
+		rate->last_delivery = now;
+		return 1;
+	}
+
+	if (rate->opts.trailing) {
+		rate->dirty = 1;
+		if (!wc_timer_is_armed(&rate->timer)) {
+			wc_timer_arm(sub->ctx, &rate->timer, (long)(rate->last_delivery + rate->opts.min_interval_ms - now));
+		}
+	}
+
+	return 0;
+}
+
+static struct on_data *on_data_from_treenode(struct treenode *snapshot) {
+	struct on_data *ret;
+
+	ret = on_data_new(treenode_to_json_len(snapshot));
+	treenode_to_json(snapshot, ret->json);
+
+	return ret;
+}
+
+/* an initial callback is queued if it must not overtake the queued events, or
+ * wait for the budget of the dispatcher, and called right away otherwise */
+static void on_registry_initial_cb(wc_context_t *ctx, struct on_cb_list *p_cb, int defer, enum on_event_type type, struct on_data *data, char *cur_key, char *prev_key) {
+	if (defer) {
+		on_dispatch_push(&ctx->datasync.on_reg->dispatch, p_cb, type, data, cur_key, prev_key);
+	} else {
+		p_cb->cb(ctx, p_cb, data == NULL ? "null" : data->json, cur_key, prev_key);
+	}
+}
+
+on_handle_t on_registry_add(wc_context_t *ctx, enum on_event_type type, char *path, on_callback_f cb, struct wc_on_options *options, struct cache_query *query) {
 	struct on_sub *sub, *tmp;
 	struct on_cb_list *p_cb;
 	struct treenode *snapshot;
+	struct on_data *data;
 	char *json_snapshot;
-	int json_len;
+	size_t json_len;
 	treenode_hash_t *hash;
+	int defer;
 
 	sub = alloca(ON_SUB_STRUCT_MAX_SIZE);
 
@@ -165,7 +311,22 @@ on_handle_t on_registry_add(wc_context_t *ctx, enum on_event_type type, char *pa
 	wc_datasync_path_parse(path, &sub->path);
 
 	p_cb = malloc(sizeof(struct on_cb_list));
+	if (p_cb == NULL) {
+		wc_datasync_path_cleanup(&sub->path);
+		return NULL;
+	}
 	p_cb->cb = cb;
+	p_cb->priority = WC_ON_PRIORITY_NORMAL;
+	p_cb->queued = 0;
+	p_cb->pending_value = NULL;
+	p_cb->cancelled = 0;
+	p_cb->query = query;
+	p_cb->rate_limited = options != NULL && (options->min_interval_ms != 0 || options->debounce_ms != 0);
+	if (p_cb->rate_limited) {
+		p_cb->rate = *options;
+	}
+
+	ctx->datasync.on_reg->dispatch.ctx = ctx;
 
 	tmp = avl_get(ctx->datasync.on_reg->sub_list, sub);
 
@@ -187,18 +348,29 @@ on_handle_t on_registry_add(wc_context_t *ctx, enum on_event_type type, char *pa
 		tmp->cb_list[type] = p_cb;
 	}
 
+	on_rate_refresh(p_cb->sub);
+
 	/* test whether the callbacks should be initially called */
+	defer = ctx->dispatch_budget_callbacks != 0 || ctx->dispatch_budget_us != 0
+			|| ctx->datasync.on_reg->dispatch.depth > 0;
 	if ((snapshot = data_cache_get_parsed(ctx->datasync.cache, &p_cb->sub->path)) != NULL
 			|| wc_is_listening(ctx, &p_cb->sub->path)
 			|| ctx->datasync.state == WC_CNX_STATE_DISCONNECTED)
 	{
-		if (type == ON_VALUE) {
-			json_len = treenode_to_json_len(snapshot);
-			json_snapshot = malloc(json_len + 1);
-			treenode_to_json(snapshot, json_snapshot);
-			cb(ctx, p_cb, json_snapshot, NULL, NULL);
+		if (type == ON_VALUE && query != NULL) {
+			json_snapshot = cache_query_run(ctx->datasync.cache, &p_cb->sub->path, query);
+			cache_query_result_changed(query, json_snapshot);
+			json_len = strlen(json_snapshot);
+			data = on_data_new(json_len);
+			memcpy(data->json, json_snapshot, json_len + 1);
+			on_registry_initial_cb(ctx, p_cb, defer, ON_VALUE, data, NULL, NULL);
+			on_data_unref(data);
 
 			free(json_snapshot);
+		} else if (type == ON_VALUE) {
+			data = snapshot != NULL ? on_data_from_treenode(snapshot) : NULL;
+			on_registry_initial_cb(ctx, p_cb, defer, ON_VALUE, data, NULL, NULL);
+			on_data_unref(data);
 
 			hash = treenode_hash_get(snapshot);
 			if (hash != NULL) {
@@ -215,17 +387,18 @@ on_handle_t on_registry_add(wc_context_t *ctx, enum on_event_type type, char *pa
 				avl_it_start(&it, snapshot->uval.children);
 				while (avl_it_has_next(&it)) {
 					cur = avl_it_next(&it);
-					json_len = treenode_to_json_len(&cur->node);
-					json_snapshot = malloc(json_len + 1);
-					treenode_to_json(&cur->node, json_snapshot);
-					cb(ctx, p_cb, json_snapshot, cur->key, prev);
-					free(json_snapshot);
+					data = on_data_from_treenode(&cur->node);
+					on_registry_initial_cb(ctx, p_cb, defer, ON_CHILD_ADDED, data, cur->key, prev);
+					on_data_unref(data);
 					prev = cur->key;
 				}
 				refresh_on_child_sub_hashes(p_cb->sub, snapshot);
 			}
 
 		}
+		if (defer) {
+			on_dispatch_defer(&ctx->datasync.on_reg->dispatch);
+		}
 	}
 
 	wc_datasync_path_cleanup(&sub->path);
@@ -245,53 +418,50 @@ static int datasync_key_cmp_null(struct internal_node_element *a, struct interna
 	}
 }
 
-static void mark_cb_for_deletion(on_handle_t p_cb) {
+void on_registry_mark_cb_for_deletion(on_handle_t p_cb) {
+	struct on_registry *reg = ((struct on_cb_list *)p_cb)->sub->ctx->datasync.on_reg;
 	struct deleted_cb *tmp;
+	((struct on_cb_list *)p_cb)->cancelled = 1;
 	tmp = malloc(sizeof *tmp);
 	tmp->cb = p_cb;
-	tmp->next = deleted_cb_list;
-	deleted_cb_list = tmp;
+	tmp->next = reg->deleted_cb_list;
+	reg->deleted_cb_list = tmp;
 }
 
-static void deleted_cb_gc() {
+static void deleted_cb_gc(struct on_registry *reg) {
 	struct deleted_cb *next;
 	struct on_cb_list *p_cb;
 	wc_context_t *ctx;
 	struct on_sub *sub;
 
-	while (deleted_cb_list) {
-		p_cb = deleted_cb_list->cb;
-		next = deleted_cb_list->next;
+	while (reg->deleted_cb_list) {
+		p_cb = reg->deleted_cb_list->cb;
+		next = reg->deleted_cb_list->next;
 		sub = p_cb->sub;
 		ctx = sub->ctx;
 		wc_datasync_unwatch_ex(ctx, &sub->path, 1);
 		on_registry_remove(ctx, &sub->path, -1, p_cb);
-		free(deleted_cb_list);
-		deleted_cb_list = next;
+		free(reg->deleted_cb_list);
+		reg->deleted_cb_list = next;
 	}
 }
 
-static void trigger_on_child_cb_list(wc_context_t *ctx, struct on_sub *sub, enum on_event_type type, struct treenode *snapshot, char *cur_key, char *prev_key) {
+static void trigger_on_child_cb_list(struct on_registry *reg, struct on_sub *sub, enum on_event_type type, struct treenode *snapshot, char *cur_key, char *prev_key) {
 	struct on_cb_list *p_cb;
-	char *data_snapshot = NULL;
-	int data_len;
+	struct on_data *data_snapshot = NULL;
 
 	for (p_cb = sub->cb_list[type] ; p_cb != NULL ; p_cb = p_cb->next) {
 		if (snapshot != NULL && data_snapshot == NULL) {
-			data_len = treenode_to_json_len(snapshot);
-			data_snapshot = malloc(data_len + 1);
-			treenode_to_json(snapshot, data_snapshot);
+			data_snapshot = on_data_from_treenode(snapshot);
 		}
 
-		if(!p_cb->cb(ctx, p_cb, snapshot == NULL ? "null" : data_snapshot, cur_key, prev_key)) {
-			mark_cb_for_deletion(p_cb);
-		}
+		on_dispatch_push(&reg->dispatch, p_cb, type, data_snapshot, cur_key, prev_key);
 	}
 
-	if (data_snapshot != NULL) free(data_snapshot);
+	on_data_unref(data_snapshot);
 }
 
-static void on_child_trig(struct on_sub *sub, data_cache_t *cache) {
+static void on_child_trig(struct on_registry *reg, struct on_sub *sub, data_cache_t *cache) {
 	struct treenode *cached_value;
 	struct internal_node_element *p_cache;
 	struct internal_hash *p_sub;
@@ -306,7 +476,7 @@ static void on_child_trig(struct on_sub *sub, data_cache_t *cache) {
 		/* then every child has been removed */
 		avl_it_start(&it_sub, sub->children_hashes);
 		while ((p_sub = avl_it_next(&it_sub)) != NULL) {
-			trigger_on_child_cb_list(sub->ctx, sub, ON_CHILD_REMOVED, NULL, p_sub->key, NULL);
+			trigger_on_child_cb_list(reg, sub, ON_CHILD_REMOVED, NULL, p_sub->key, NULL);
 		}
 		avl_remove_all(sub->children_hashes);
 	} else {
@@ -324,13 +494,13 @@ static void on_child_trig(struct on_sub *sub, data_cache_t *cache) {
 
 			if (cmp < 0) {
 				refresh = 1;
-				trigger_on_child_cb_list(sub->ctx, sub, ON_CHILD_ADDED, &p_cache->node, p_cache->key, prev_cached_key);
+				trigger_on_child_cb_list(reg, sub, ON_CHILD_ADDED, &p_cache->node, p_cache->key, prev_cached_key);
 				prev_cached_key = p_cache->key;
 				p_cache = avl_it_next(&it_cache);
 			} else if (cmp == 0) {
 				hash = treenode_hash_get(&p_cache->node);
 				if (!treenode_hash_eq(hash, &p_sub->hash)) {
-					trigger_on_child_cb_list(sub->ctx, sub, ON_CHILD_CHANGED, &p_cache->node, p_cache->key, prev_cached_key);
+					trigger_on_child_cb_list(reg, sub, ON_CHILD_CHANGED, &p_cache->node, p_cache->key, prev_cached_key);
 					refresh = 1;
 				}
 				prev_cached_key = p_cache->key;
@@ -338,7 +508,7 @@ static void on_child_trig(struct on_sub *sub, data_cache_t *cache) {
 				p_sub = avl_it_next(&it_sub);
 			} else {
 				refresh = 1;
-				trigger_on_child_cb_list(sub->ctx, sub, ON_CHILD_REMOVED, NULL, p_sub->key, prev_cached_key);
+				trigger_on_child_cb_list(reg, sub, ON_CHILD_REMOVED, NULL, p_sub->key, prev_cached_key);
 				p_sub = avl_it_next(&it_sub);
 			}
 		}
@@ -371,6 +541,10 @@ int on_registry_remove(wc_context_t *ctx, wc_ds_path_t *path, int type_mask, on_
 					tmp = p_cb;
 					p_cb = p_cb->next;
 
+					if (tmp->queued > 0) {
+						on_dispatch_cancel(&ctx->datasync.on_reg->dispatch, tmp);
+					}
+					cache_query_destroy(tmp->query);
 					free(tmp);
 					removed++;
 				} else {
@@ -383,6 +557,8 @@ int on_registry_remove(wc_context_t *ctx, wc_ds_path_t *path, int type_mask, on_
 		if (!(sub->cb_list[ON_VALUE] || sub->cb_list[ON_CHILD_ADDED]
 				|| sub->cb_list[ON_CHILD_REMOVED] || sub->cb_list[ON_CHILD_CHANGED])) {
 			avl_remove(ctx->datasync.on_reg->sub_list, sub);
+		} else if (removed > 0) {
+			on_rate_refresh(sub);
 		}
 	}
 
@@ -390,12 +566,31 @@ int on_registry_remove(wc_context_t *ctx, wc_ds_path_t *path, int type_mask, on_
 	return removed;
 }
 
-static void on_val_trig(struct on_sub *sub, data_cache_t *cache) {
+/* query subscriptions are only notified when the result of their query
+ * changes, not for every change of the data under their path */
+static void on_query_trig(struct on_registry *reg, struct on_cb_list *p_cb, data_cache_t *cache) {
+	struct on_data *result;
+	char *json;
+	size_t len;
+
+	json = cache_query_run(cache, &p_cb->sub->path, p_cb->query);
+
+	if (cache_query_result_changed(p_cb->query, json)) {
+		len = strlen(json);
+		result = on_data_new(len);
+		memcpy(result->json, json, len + 1);
+		on_dispatch_push(&reg->dispatch, p_cb, ON_VALUE, result, NULL, NULL);
+		on_data_unref(result);
+	}
+
+	free(json);
+}
+
+static void on_val_trig(struct on_registry *reg, struct on_sub *sub, data_cache_t *cache) {
 	treenode_hash_t *cached_hash;
 	struct treenode *cached_data;
 	struct on_cb_list *p_cb;
-	char *data_snapshot;
-	int data_len;
+	struct on_data *data_snapshot = NULL;
 
 	if (sub->cb_list[ON_VALUE] != NULL) {
 
@@ -403,36 +598,44 @@ static void on_val_trig(struct on_sub *sub, data_cache_t *cache) {
 		cached_hash = treenode_hash_get(cached_data);
 
 		if (!treenode_hash_eq(cached_hash, &sub->hash)) {
-			data_len = treenode_to_json_len(cached_data);
-			data_snapshot = malloc(data_len + 1);
-			treenode_to_json(cached_data, data_snapshot);
-			p_cb = sub->cb_list[ON_VALUE];
-			do {
-				if (!p_cb->cb(sub->ctx, p_cb, data_snapshot, NULL, NULL)) {
-					mark_cb_for_deletion(p_cb);
+			for (p_cb = sub->cb_list[ON_VALUE] ; p_cb != NULL ; p_cb = p_cb->next) {
+				if (p_cb->query != NULL) {
+					on_query_trig(reg, p_cb, cache);
+					continue;
+				}
+				if (data_snapshot == NULL) {
+					data_snapshot = on_data_from_treenode(cached_data);
 				}
-				p_cb = p_cb->next;
-			} while (p_cb != NULL);
+				on_dispatch_push(&reg->dispatch, p_cb, ON_VALUE, data_snapshot, NULL, NULL);
+			}
 			if (cached_hash != NULL) {
 				sub->hash = *cached_hash;
 			} else {
 				sub->hash = (treenode_hash_t ) { .bytes = { 0 } };
 			}
-			free(data_snapshot);
+			on_data_unref(data_snapshot);
 		}
 	}
 }
 
-static void trig(struct on_sub *sub, data_cache_t *cache) {
+static void trig_now(struct on_registry *reg, struct on_sub *sub, data_cache_t *cache) {
 	if (sub->cb_list[ON_CHILD_ADDED]
 				|| sub->cb_list[ON_CHILD_CHANGED]
 				|| sub->cb_list[ON_CHILD_REMOVED])
 	{
-		on_child_trig(sub, cache);
+		on_child_trig(reg, sub, cache);
 	}
 
 	if (sub->cb_list[ON_VALUE]) {
-		on_val_trig(sub, cache);
+		on_val_trig(reg, sub, cache);
+	}
+}
+
+static void trig(struct on_registry *reg, struct on_sub *sub, data_cache_t *cache) {
+	/* rate limited subscriptions skip the suppressed states before any
+	 * hashing or serialization takes place */
+	if (sub->rate == NULL || on_rate_admit(sub)) {
+		trig_now(reg, sub, cache);
 	}
 }
 
@@ -457,7 +660,7 @@ void on_registry_dispatch_on_event_ex(struct on_registry* reg, data_cache_t *cac
 		key->path.nparts = u;
 		sub = avl_get(reg->sub_list, key);
 		if (sub != NULL) {
-			trig(sub, cache);
+			trig(reg, sub, cache);
 		}
 	}
 
@@ -481,10 +684,19 @@ void on_registry_dispatch_on_event_ex(struct on_registry* reg, data_cache_t *cac
 	avl_it_start_at(&it, reg->sub_list, key);
 
 	while ((sub = avl_it_next(&it)) != NULL && wc_datasync_path_starts_with(&sub->path, &key->path)) {
-		trig(sub, cache);
+		trig(reg, sub, cache);
 	}
 
-	deleted_cb_gc();
+	on_registry_run_callbacks(reg);
+}
+
+void on_registry_run_callbacks(struct on_registry *reg) {
+	on_dispatch_run(&reg->dispatch);
+	deleted_cb_gc(reg);
+}
+
+void on_registry_get_dispatch_stats(struct on_registry *reg, struct wc_on_dispatch_stats *stats) {
+	*stats = reg->dispatch.stats;
 }
 
 void on_registry_dispatch_on_event(struct on_registry* reg, data_cache_t *cache, char *path) {
@@ -500,6 +712,14 @@ void on_registry_dispatch_on_event(struct on_registry* reg, data_cache_t *cache,
 
 
 void on_registry_destroy(struct on_registry *reg) {
+	struct deleted_cb *next;
+
+	while (reg->deleted_cb_list) {
+		next = reg->deleted_cb_list->next;
+		free(reg->deleted_cb_list);
+		reg->deleted_cb_list = next;
+	}
+	on_dispatch_cleanup(&reg->dispatch);
 	avl_destroy(reg->sub_list);
 	free(reg);
 }
@@ -30,17 +30,23 @@
 #include "on_subscription.h"
 
 #include "../cache/treenode_cache.h"
+#include "../cache/query.h"
 #include "../path.h"
 
 struct on_registry;
 
 struct on_registry *on_registry_new();
-on_handle_t on_registry_add(wc_context_t *ctx, enum on_event_type type, char *path, on_callback_f cb);
+on_handle_t on_registry_add(wc_context_t *ctx, enum on_event_type type, char *path, on_callback_f cb, struct wc_on_options *options, struct cache_query *query);
 int on_registry_remove(wc_context_t *ctx, wc_ds_path_t *path, int type_mask, on_handle_t handle);
 
 void on_registry_destroy(struct on_registry *);
 
 void on_registry_dispatch_on_event(struct on_registry* reg, data_cache_t *cache, char *path);
+void on_registry_dispatch_on_event_ex(struct on_registry* reg, data_cache_t *cache, wc_ds_path_t *parsed_path);
+
+void on_registry_mark_cb_for_deletion(on_handle_t p_cb);
+void on_registry_run_callbacks(struct on_registry *reg);
+void on_registry_get_dispatch_stats(struct on_registry *reg, struct wc_on_dispatch_stats *stats);
 
 void dump_on_registry(struct on_registry* reg, FILE *f);
 
@@ -36,6 +36,13 @@ struct on_cb_list {
 	on_callback_f cb;
 	struct on_cb_list *next;
 	struct on_sub *sub;
+	enum wc_on_priority priority;
+	unsigned queued;                    /* deliveries waiting in the dispatcher */
+	struct on_delivery *pending_value;  /* queued ON_VALUE delivery, if any */
+	struct wc_on_options rate;
+	struct cache_query *query;          /* ON_VALUE only: deliver the result of this query */
+	unsigned rate_limited:1;
+	unsigned cancelled:1;
 };
 
 struct on_sub {
@@ -43,6 +50,7 @@ struct on_sub {
 	struct on_cb_list *cb_list[ON_EVENT_TYPE_COUNT];
 	avl_t *children_hashes;
 	treenode_hash_t hash;
+	struct on_rate *rate; /* NULL if the subscription is not rate limited */
 	struct wc_ds_path path;
 };
 
@@ -30,7 +30,9 @@
 #include "webcom-c/webcom-msg.h"
 #include "webcom-c/webcom-parser.h"
 
+#include "cbor.h"
 #include "path.h"
+#include "rx_stream.h"
 
 #define WCPM_CALL_CHILD_PARSER(key, child_parser_name, child_res) \
 	do { \
@@ -190,6 +192,10 @@ static int wc_parse_action_merge(json_object *jroot, wc_action_merge_t *res) {
 
 static int wc_parse_action_listen(json_object *jroot, wc_action_listen_t *res) {
 	res->query_ids = NULL;
+	if (!_wc_hlp_get_string(jroot, "h", &res->hash))
+	{
+		res->hash = NULL;
+	}
 	return _wc_hlp_get_string(jroot, "p", &res->path);
 }
 
@@ -233,7 +239,7 @@ static int wc_parse_action(json_object *jroot, wc_action_t *res) {
 				return wc_parse_action_merge(jroot, &res->u.merge);
 			} else if (strcmp("l", s) == 0) {
 				res->type = WC_ACTION_LISTEN;
-				return wc_parse_action_listen(jroot, &res->u.listen);
+				WCPM_CALL_BODY_CHILD_PARSER(wc_parse_action_listen, &res->u.listen);
 			} else if (strcmp("u", s) == 0) {
 				res->type = WC_ACTION_UNLISTEN;
 				return wc_parse_action_unlisten(jroot, &res->u.unlisten);
@@ -350,6 +356,26 @@ static int wc_parse_msg_json(json_object *jroot, wc_msg_t *res) {
 	return 0;
 }
 
+/* for the messages whose JSON document was built by rx_stream.c */
+int wc_datasync_msg_from_json(json_object *jroot, wc_msg_t *res) {
+	memset(res, 0, sizeof(wc_msg_t));
+	return wc_parse_msg_json(jroot, res);
+}
+
+int wc_datasync_parse_msg_cbor(const void *buf, size_t len, wc_msg_t *res) {
+	json_object *jroot;
+	int ret;
+
+	if (cbor_decode(buf, len, &jroot) != 0) {
+		return 0;
+	}
+	memset(res, 0, sizeof(wc_msg_t));
+	ret = wc_parse_msg_json(jroot, res);
+	json_object_put(jroot);
+
+	return ret;
+}
+
 const char *wc_datasync_parser_get_error(wc_parser_t *parser) {
 	return parser ? parser->error : wc_parse_err_parser_null;
 }
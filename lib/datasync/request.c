@@ -32,95 +32,396 @@ typedef struct wc_action_trans {
 	int64_t id;
 	wc_action_type_t type;
 	wc_on_req_result_t callback;
-	struct wc_action_trans *next;
+	struct wc_action_trans *next;       /* free list of the pool */
+	struct wc_action_trans *superseded; /* requests collapsed into this one */
 	void *user;
+	struct wc_timer deadline;
+	int held:1;                         /* kept across a disconnection */
+	int journaled:1;                    /* recorded in the write-ahead journal */
 } wc_action_trans_t;
 
-inline static size_t pending_req_hash(int64_t id) {
-	return ((uint64_t)id) % (1 << PENDING_ACTION_HASH_FACTOR);
+#define PENDING_TRANS_CHUNK 64
+
+struct wc_trans_chunk {
+	struct wc_trans_chunk *next;
+	wc_action_trans_t trans[PENDING_TRANS_CHUNK];
+};
+
+/*
+ * The pending requests are stored in an open addressing hash table with
+ * linear probing, indexed by the request id. As the ids are sequential, the
+ * table behaves like a ring: consecutive requests use consecutive slots, and
+ * the probe sequences stay short. The table doubles whenever it is half full.
+ *
+ * The transactions are allocated from a pool of chunks, which are only freed
+ * with the context: the transactions never move, so they can embed their
+ * deadline timer.
+ */
+
+static wc_action_trans_t *wc_req_trans_alloc(struct wc_req_table *t) {
+	struct wc_trans_chunk *chunk;
+	wc_action_trans_t *trans;
+	unsigned i;
+
+	if (t->free == NULL) {
+		chunk = malloc(sizeof(*chunk));
+		if (chunk == NULL) {
+			return NULL;
+		}
+		chunk->next = t->chunks;
+		t->chunks = chunk;
+		for (i = 0 ; i < PENDING_TRANS_CHUNK ; i++) {
+			chunk->trans[i].next = t->free;
+			t->free = &chunk->trans[i];
+		}
+	}
+
+	trans = t->free;
+	t->free = trans->next;
+
+	return trans;
+}
+
+static void wc_req_trans_release(wc_context_t *cnx, wc_action_trans_t *trans) {
+	wc_timer_cancel(cnx, &trans->deadline);
+	trans->next = cnx->datasync.pending.free;
+	cnx->datasync.pending.free = trans;
+}
+
+inline static unsigned pending_req_hash(struct wc_req_table *t, int64_t id) {
+	return (unsigned)((uint64_t)id & t->mask);
+}
+
+static void wc_req_table_insert(struct wc_req_table *t, wc_action_trans_t *trans) {
+	unsigned i;
+
+	for (i = pending_req_hash(t, trans->id) ; t->slots[i] != NULL ; i = (i + 1) & t->mask);
+	t->slots[i] = trans;
+	t->count++;
+}
+
+static int wc_req_table_grow(struct wc_req_table *t) {
+	struct wc_req_table old = *t;
+	unsigned i;
+
+	t->mask = t->slots == NULL ? (1u << PENDING_ACTION_HASH_FACTOR) - 1 : (t->mask << 1) | 1;
+	t->slots = calloc((size_t)t->mask + 1, sizeof(*t->slots));
+	if (t->slots == NULL) {
+		*t = old;
+		return -1;
+	}
+	t->count = 0;
+
+	if (old.slots != NULL) {
+		for (i = 0 ; i <= old.mask ; i++) {
+			if (old.slots[i] != NULL) {
+				wc_req_table_insert(t, old.slots[i]);
+			}
+		}
+		free(old.slots);
+	}
+
+	return 0;
 }
 
-static void wc_req_store_pending(
+static int wc_req_table_lookup(struct wc_req_table *t, int64_t id) {
+	unsigned i;
+
+	if (t->slots == NULL) {
+		return -1;
+	}
+
+	for (i = pending_req_hash(t, id) ; t->slots[i] != NULL ; i = (i + 1) & t->mask) {
+		if (t->slots[i]->id == id) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+/* removes the entry in slot i, shifting back the following entries of the
+ * cluster so that no probe sequence is broken */
+static void wc_req_table_remove_at(struct wc_req_table *t, unsigned i) {
+	unsigned j, home;
+
+	j = i;
+	for (;;) {
+		j = (j + 1) & t->mask;
+		if (t->slots[j] == NULL) {
+			break;
+		}
+		home = pending_req_hash(t, t->slots[j]->id);
+		/* the entry in j can fill the hole in i if its home slot is not
+		 * cyclically within ]i, j] */
+		if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			t->slots[i] = t->slots[j];
+			i = j;
+		}
+	}
+	t->slots[i] = NULL;
+	t->count--;
+}
+
+static void wc_req_deadline_cb(wc_context_t *cnx, struct wc_timer *timer);
+
+/*
+ * returns 0 if the request is tracked, -1 if it could not be (allocation
+ * failure), in which case it must not be sent
+ */
+static int wc_req_store_pending(
 		wc_context_t *cnx,
 		int64_t id,
 		wc_action_type_t type,
 		wc_on_req_result_t callback,
 		void *user)
 {
+	struct wc_req_table *t = &cnx->datasync.pending;
 	wc_action_trans_t *trans;
-	size_t slot;
 
-	trans = malloc(sizeof(wc_action_trans_t));
+	if ((t->slots == NULL || 2 * (t->count + 1) > t->mask + 1) && wc_req_table_grow(t) != 0) {
+		return -1;
+	}
+
+	trans = wc_req_trans_alloc(t);
 
 	if (trans == NULL) {
-		return;
+		return -1;
 	}
 
 	trans->id = id;
 	trans->type = type;
 	trans->callback = callback;
 	trans->user = user;
+	trans->superseded = NULL;
+	trans->held = 0;
+	trans->journaled = 0;
+	wc_timer_init(&trans->deadline, wc_req_deadline_cb, trans);
 
-	slot = pending_req_hash(id);
+	if (cnx->request_timeout_ms) {
+		wc_timer_arm(cnx, &trans->deadline, cnx->request_timeout_ms);
+	}
+
+	wc_req_table_insert(t, trans);
+
+	return 0;
+}
 
-	trans->next = cnx->datasync.pending_req_table[slot];
-	cnx->datasync.pending_req_table[slot] = trans;
+static wc_action_trans_t *wc_req_find_pending(wc_context_t *cnx, int64_t id) {
+	int i = wc_req_table_lookup(&cnx->datasync.pending, id);
+
+	return i < 0 ? NULL : cnx->datasync.pending.slots[i];
+}
+
+static void wc_req_journal(wc_context_t *cnx, int64_t id, wc_action_type_t type, char *path, char *data) {
+	wc_action_trans_t *trans;
+
+	if (wc_datasync_journal_action(cnx, id, type, path, data) == 0
+			&& (trans = wc_req_find_pending(cnx, id)) != NULL)
+	{
+		trans->journaled = 1;
+	}
 }
 
 wc_action_trans_t *wc_datasync_req_get_pending(wc_context_t *cnx, int64_t id) {
-	wc_action_trans_t *cur, **prev;
+	wc_action_trans_t *ret;
+	int i;
 
-	prev = &cnx->datasync.pending_req_table[pending_req_hash(id)];
-	cur = *prev;
+	if ((i = wc_req_table_lookup(&cnx->datasync.pending, id)) < 0) {
+		return NULL;
+	}
 
-	while (cur != NULL) {
-		if (cur->id == id) {
-			*prev = cur->next;
-			break;
+	ret = cnx->datasync.pending.slots[i];
+	wc_req_table_remove_at(&cnx->datasync.pending, (unsigned)i);
+
+	return ret;
+}
+
+void wc_datasync_req_free_trans(wc_context_t *cnx, wc_action_trans_t *trans) {
+	wc_action_trans_t *next;
+
+	while (trans != NULL) {
+		next = trans->superseded;
+		wc_req_trans_release(cnx, trans);
+		trans = next;
+	}
+}
+
+/*
+ * the request old_id was dropped in favor of the request new_id: the callback
+ * of old_id will be called with the result of new_id
+ */
+void wc_datasync_req_supersede(wc_context_t *cnx, int64_t old_id, int64_t new_id) {
+	wc_action_trans_t *old, *new, **p;
+
+	old = wc_datasync_req_get_pending(cnx, old_id);
+	if (old == NULL) {
+		return;
+	}
+
+	new = wc_req_find_pending(cnx, new_id);
+
+	if (new == NULL) {
+		wc_datasync_req_free_trans(cnx, old);
+		return;
+	}
+
+	wc_timer_cancel(cnx, &old->deadline);
+	for (p = &new->superseded ; *p != NULL ; p = &(*p)->superseded);
+	*p = old;
+}
+
+/* calls the callbacks of a request removed from the table (and of the
+ * requests it superseded), and frees it. The request has reached its final
+ * state, whatever the outcome: its journal record is released, so that a
+ * write reported as failed is not issued again by the next session. Only the
+ * writes still queued (held in the offline queue) keep their record */
+static void wc_req_complete(wc_context_t *cnx, wc_action_trans_t *trans, wc_req_pending_result_t status, char *reason, char *data) {
+	wc_action_trans_t *cur;
+
+	wc_timer_cancel(cnx, &trans->deadline);
+
+	for (cur = trans ; cur != NULL ; cur = cur->superseded) {
+		wc_datasync_overlay_ack(cnx, cur->id, status == WC_REQ_OK);
+		if (cur->journaled) {
+			wc_datasync_journal_done(cnx, cur->id);
+		}
+		if (cur->callback != NULL) {
+			cur->callback(
+					cnx,
+					cur->id,
+					cur->type,
+					status,
+					reason,
+					data,
+					cur->user);
 		}
-		prev = &(cur->next);
-		cur = cur->next;
 	}
-	return cur;
+	wc_datasync_req_free_trans(cnx, trans);
 }
 
 void wc_datasync_req_response_dispatch(wc_context_t *cnx, wc_response_t *response) {
 	wc_action_trans_t *trans;
 
 	if ((trans = wc_datasync_req_get_pending(cnx, response->r)) != NULL) {
-		if (trans->callback != NULL) {
-			trans->callback(
-					cnx,
-					trans->id,
-					trans->type,
-					strcmp(response->status, "ok") == 0 ? WC_REQ_OK : WC_REQ_ERROR,
-					response->status,
-					response->data,
-					trans->user);
+		wc_req_complete(
+				cnx,
+				trans,
+				strcmp(response->status, "ok") == 0 ? WC_REQ_OK : WC_REQ_ERROR,
+				response->status,
+				response->data);
+	}
+}
+
+static void wc_req_deadline_cb(wc_context_t *cnx, struct wc_timer *timer) {
+	wc_action_trans_t *trans = timer->data;
+
+	if (wc_datasync_req_get_pending(cnx, trans->id) == trans) {
+		wc_datasync_offline_drop(cnx, trans->id);
+		wc_req_complete(cnx, trans, WC_REQ_ERROR, WC_REQ_REASON_TIMEOUT, NULL);
+	}
+}
+
+int wc_datasync_req_set_timeout(wc_context_t *cnx, int64_t id, unsigned ms) {
+	wc_action_trans_t *trans;
+
+	if (!cnx->datasync_init || (trans = wc_req_find_pending(cnx, id)) == NULL) {
+		return -1;
+	}
+
+	if (ms == 0) {
+		wc_timer_cancel(cnx, &trans->deadline);
+	} else {
+		wc_timer_arm(cnx, &trans->deadline, ms);
+	}
+
+	return 0;
+}
+
+void wc_datasync_req_hold(wc_context_t *cnx, int64_t id) {
+	wc_action_trans_t *trans = wc_req_find_pending(cnx, id);
+
+	if (trans != NULL) {
+		trans->held = 1;
+	}
+}
+
+/*
+ * fails all the pending requests but the held ones, whose hold is released
+ */
+void wc_datasync_req_fail_all(wc_context_t *cnx, char *reason) {
+	struct wc_req_table *t = &cnx->datasync.pending;
+	wc_action_trans_t **slots = t->slots, *trans;
+	unsigned mask = t->mask, i;
+
+	if (slots == NULL || t->count == 0) {
+		return;
+	}
+
+	/* the callbacks can issue new requests, start over with an empty table */
+	t->slots = NULL;
+	t->count = 0;
+	if (wc_req_table_grow(t) != 0) {
+		t->slots = slots;
+		t->count = 0;
+		for (i = 0 ; i <= mask ; i++) {
+			t->count += slots[i] != NULL;
 		}
-		free(trans);
+		return;
 	}
+
+	for (i = 0 ; i <= mask ; i++) {
+		trans = slots[i];
+		if (trans != NULL && trans->held) {
+			trans->held = 0;
+			if (2 * (t->count + 1) > t->mask + 1) {
+				wc_req_table_grow(t);
+			}
+			wc_req_table_insert(t, trans);
+			slots[i] = NULL;
+		}
+	}
+
+	for (i = 0 ; i <= mask ; i++) {
+		if (slots[i] != NULL) {
+			wc_req_complete(cnx, slots[i], WC_REQ_ERROR, reason, NULL);
+		}
+	}
+
+	free(slots);
 }
 
-void wc_datasync_free_pending_trans(wc_action_trans_t **table) {
-	wc_action_trans_t *p, *q;
-	size_t i;
+void wc_datasync_req_table_cleanup(wc_context_t *cnx) {
+	struct wc_req_table *t = &cnx->datasync.pending;
+	struct wc_trans_chunk *chunk, *next;
+	unsigned i;
 
-	for (i = 0 ; i < (1 << PENDING_ACTION_HASH_FACTOR) ; i++) {
-		p = table[i];
-		while(p) {
-			q = p->next;
-			free(p);
-			p = q;
+	if (t->slots != NULL) {
+		for (i = 0 ; i <= t->mask ; i++) {
+			if (t->slots[i] != NULL) {
+				wc_datasync_req_free_trans(cnx, t->slots[i]);
+			}
 		}
+		free(t->slots);
 	}
+
+	for (chunk = t->chunks ; chunk != NULL ; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	memset(t, 0, sizeof(*t));
 }
 
 #define DEFINE_REQ_FUNC(__name, __type, ... /* args */)						\
+	DEFINE_REQ_FUNC_EX(__name, __name, __type, ## __VA_ARGS__)
+
+/* for the functions named differently from the action they send */
+#define DEFINE_REQ_FUNC_EX(__name, __action, __type, ... /* args */)		\
 	int64_t wc_datasync_ ## __name(wc_context_t *ctx, ## __VA_ARGS__,		\
 			wc_on_req_result_t callback, void *user) {						\
 		wc_msg_t msg;														\
-		wc_action_ ## __name ## _t *req;									\
+		wc_action_ ## __action ## _t *req;									\
+		wc_action_trans_t *trans;											\
 		int ret;															\
 																			\
 		int64_t reqnum = wc_datasync_next_reqnum(wc_get_datasync(ctx));		\
@@ -128,12 +429,23 @@ void wc_datasync_free_pending_trans(wc_action_trans_t **table) {
 		msg.type = WC_MSG_DATA;												\
 		msg.u.data.type = WC_DATA_MSG_ACTION;								\
 		msg.u.data.u.action.r = reqnum;										\
-		req = &msg.u.data.u.action.u.__name;								\
+		req = &msg.u.data.u.action.u.__action;								\
 		msg.u.data.u.action.type = (__type);								\
-		wc_req_store_pending(ctx, reqnum, (__type), callback, user);
+		if (wc_req_store_pending(ctx, reqnum, (__type), callback, user) != 0) {	\
+			return -1l;														\
+		}
 #define END_DEFINE_REQ_FUNC													\
 		ret = wc_datasync_send_msg(ctx, &msg);								\
-		return ret > 0 ? reqnum : -1l;										\
+		if (ret <= 0) {														\
+			wc_datasync_overlay_ack(ctx, reqnum, 0);						\
+			trans = wc_datasync_req_get_pending(ctx, reqnum);				\
+			if (trans != NULL && trans->journaled) {						\
+				wc_datasync_journal_done(ctx, reqnum);						\
+			}																\
+			wc_datasync_req_free_trans(ctx, trans);							\
+			return -1l;														\
+		}																	\
+		return reqnum;														\
 	}
 
 DEFINE_REQ_FUNC (auth, WC_ACTION_AUTHENTICATE, char *cred)
@@ -148,6 +460,12 @@ DEFINE_REQ_FUNC (listen, WC_ACTION_LISTEN, char *path)
 	req->path = path;
 END_DEFINE_REQ_FUNC
 
+/* a listen request, with the hash of the data of the path */
+DEFINE_REQ_FUNC_EX (listen_hash, listen, WC_ACTION_LISTEN, char *path, char *hash)
+	req->path = path;
+	req->hash = hash;
+END_DEFINE_REQ_FUNC
+
 DEFINE_REQ_FUNC (unlisten, WC_ACTION_UNLISTEN, char *path)
 	req->path = path;
 END_DEFINE_REQ_FUNC
@@ -155,11 +473,15 @@ END_DEFINE_REQ_FUNC
 DEFINE_REQ_FUNC (put, WC_ACTION_PUT, char *path, char *json)
 	req->path = path;
 	req->data = json;
+	wc_datasync_overlay_apply(ctx, reqnum, 0, path, json);
+	wc_req_journal(ctx, reqnum, WC_ACTION_PUT, path, json);
 END_DEFINE_REQ_FUNC
 
 DEFINE_REQ_FUNC (merge, WC_ACTION_MERGE, char *path, char *json)
 	req->path = path;
 	req->data = json;
+	wc_datasync_overlay_apply(ctx, reqnum, 1, path, json);
+	wc_req_journal(ctx, reqnum, WC_ACTION_MERGE, path, json);
 END_DEFINE_REQ_FUNC
 
 DEFINE_REQ_FUNC (on_disc_put, WC_ACTION_ON_DISCONNECT_PUT, char *path, char *json)
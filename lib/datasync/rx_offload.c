@@ -0,0 +1,432 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../webcom_base_priv.h"
+#include "rx_offload.h"
+#include "cache/treenode_cache.h"
+#include "webcom-c/webcom-log.h"
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#define WC_PARSE_OFFLOAD_DEFAULT_BYTES (64 * 1024)
+
+size_t rx_scan(struct rx_scanner *s, const char *buf, size_t len) {
+	size_t i;
+
+	for (i = 0 ; i < len ; i++) {
+		if (s->in_str) {
+			if (s->esc) {
+				s->esc = 0;
+			} else if (buf[i] == '\\') {
+				s->esc = 1;
+			} else if (buf[i] == '"') {
+				s->in_str = 0;
+			}
+		} else if (buf[i] == '"') {
+			s->in_str = 1;
+		} else if (buf[i] == '{' || buf[i] == '[') {
+			s->depth++;
+		} else if ((buf[i] == '}' || buf[i] == ']') && s->depth > 0) {
+			if (--s->depth == 0) {
+				return i + 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void rx_chunks_free(struct rx_chunk *c) {
+	struct rx_chunk *next;
+
+	for ( ; c != NULL ; c = next) {
+		next = c->next;
+		free(c);
+	}
+}
+
+/* thread safe */
+int rx_job_parse(struct rx_job *job) {
+	wc_parser_result_t res = WC_PARSER_CONTINUE;
+	struct rx_stream stream;
+	struct rx_chunk *c;
+	size_t used;
+	unsigned i;
+
+	/* the chunks are released as they are parsed */
+	rx_stream_init(&stream);
+	while ((c = job->chunks) != NULL) {
+		if (res == WC_PARSER_CONTINUE) {
+			res = rx_stream_feed(&stream, c->data, c->len, &used);
+		}
+		job->chunks = c->next;
+		free(c);
+	}
+	job->parsed = res == WC_PARSER_OK && rx_stream_finish(&stream, &job->msg, &job->trees, &job->ntrees);
+	rx_stream_cleanup(&stream);
+
+	/* the hashes are computed here rather than by the first query */
+	for (i = 0 ; i < job->ntrees ; i++) {
+		treenode_hash_get(job->trees[i].tree);
+	}
+
+	return job->parsed;
+}
+
+void rx_job_free(struct rx_job *job) {
+	rx_trees_free(job->trees, job->ntrees);
+	if (job->parsed) {
+		wc_datasync_msg_free(&job->msg);
+	}
+	rx_chunks_free(job->chunks);
+	free(job);
+}
+
+static void rx_wake(struct rx_offload *rx) {
+	uint64_t one = 1;
+
+	if (!__atomic_exchange_n(&rx->wake_pending, 1, __ATOMIC_SEQ_CST)) {
+		while (write(rx->wfd, &one, rx->wfd == rx->rfd ? sizeof(one) : 1) == -1 && errno == EINTR);
+	}
+}
+
+/* worker thread */
+static void rx_job_run(struct worker_job *work) {
+	struct rx_job *job = (struct rx_job *)work;
+	struct rx_offload *rx = job->rx;
+
+	rx_job_parse(job);
+
+	/* the job belongs to the event loop thread from now on */
+	__atomic_store_n(&job->done, 1, __ATOMIC_SEQ_CST);
+	rx_wake(rx);
+}
+
+static int rx_wake_fds(struct rx_offload *rx) {
+#ifdef HAVE_SYS_EVENTFD_H
+	rx->rfd = rx->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return rx->rfd == -1 ? -1 : 0;
+#else
+	int fds[2], i;
+
+	if (pipe(fds) == -1) {
+		return -1;
+	}
+	for (i = 0 ; i < 2 ; i++) {
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	rx->rfd = fds[0];
+	rx->wfd = fds[1];
+	return 0;
+#endif
+}
+
+int wc_datasync_rx_offload_open(wc_context_t *ctx, unsigned nthreads, size_t threshold) {
+	struct rx_offload *rx;
+	struct wc_pollargs pa;
+
+	rx = calloc(1, sizeof(*rx));
+	if (rx == NULL) {
+		return -1;
+	}
+	rx->threshold = threshold ? threshold : WC_PARSE_OFFLOAD_DEFAULT_BYTES;
+	rx->tail = &rx->head;
+	rx->chunks_tail = &rx->chunks;
+	if (rx_wake_fds(rx) == -1) {
+		free(rx);
+		goto error;
+	}
+	rx->pool = worker_pool_new(nthreads);
+	if (rx->pool == NULL) {
+		close(rx->rfd);
+		if (rx->wfd != rx->rfd) {
+			close(rx->wfd);
+		}
+		free(rx);
+		goto error;
+	}
+	ctx->datasync.rxo = rx;
+
+	pa.fd = rx->rfd;
+	pa.events = WC_POLLIN;
+	pa.src = WC_POLL_WORKERS;
+	ctx->callback(WC_EVENT_ADD_FD, ctx, &pa, 0);
+
+	return 0;
+
+error:
+	WL_ERR("could not create the parser threads of context %p, the messages will be parsed by the event loop thread", ctx);
+	return -1;
+}
+
+void wc_datasync_rx_offload_close(wc_context_t *ctx) {
+	struct rx_offload *rx = ctx->datasync.rxo;
+	struct wc_pollargs pa;
+	struct rx_job *job;
+
+	if (rx == NULL) {
+		return;
+	}
+
+	pa.fd = rx->rfd;
+	pa.events = WC_POLLIN;
+	pa.src = WC_POLL_WORKERS;
+	ctx->callback(WC_EVENT_DEL_FD, ctx, &pa, 0);
+
+	/* waits for the messages being parsed, they are dropped with the others */
+	worker_pool_destroy(rx->pool);
+	while ((job = rx->head) != NULL) {
+		rx->head = job->next;
+		rx_job_free(job);
+	}
+
+	close(rx->rfd);
+	if (rx->wfd != rx->rfd) {
+		close(rx->wfd);
+	}
+	rx_chunks_free(rx->chunks);
+	free(rx);
+	ctx->datasync.rxo = NULL;
+}
+
+static void rx_enqueue(struct rx_offload *rx, struct rx_job *job) {
+	*rx->tail = job;
+	rx->tail = &job->next;
+	if (++rx->pending > rx->max_pending) {
+		rx->max_pending = rx->pending;
+	}
+}
+
+static int rx_chunk_append(struct rx_offload *rx, const char *data, size_t len) {
+	struct rx_chunk *c;
+
+	c = malloc(sizeof(*c) + len);
+	if (c == NULL) {
+		return -1;
+	}
+	c->next = NULL;
+	c->len = len;
+	memcpy(c->data, data, len);
+
+	*rx->chunks_tail = c;
+	rx->chunks_tail = &c->next;
+	rx->len += len;
+
+	return 0;
+}
+
+/* takes the chunks of the current message */
+static struct rx_chunk *rx_chunks_take(struct rx_offload *rx) {
+	struct rx_chunk *ret = rx->chunks;
+
+	rx->chunks = NULL;
+	rx->chunks_tail = &rx->chunks;
+	rx->len = 0;
+
+	return ret;
+}
+
+/* parses a small message with json-c, data being NULL if it is in chunks */
+static int rx_parse_now(struct rx_offload *rx, const char *data, size_t len, wc_msg_t *msg) {
+	wc_parser_result_t res = WC_PARSER_CONTINUE;
+	struct rx_chunk *chunks, *c;
+	wc_parser_t *parser;
+
+	parser = wc_datasync_parser_new();
+	if (data != NULL) {
+		res = wc_datasync_parse_msg_ex(parser, (char *)data, len, msg);
+	} else {
+		chunks = rx_chunks_take(rx);
+		for (c = chunks ; c != NULL && res == WC_PARSER_CONTINUE ; c = c->next) {
+			res = wc_datasync_parse_msg_ex(parser, c->data, c->len, msg);
+		}
+		rx_chunks_free(chunks);
+	}
+	wc_datasync_parser_free(parser);
+
+	return res == WC_PARSER_OK;
+}
+
+/* a whole message was received, in data if not NULL, in rx->chunks otherwise */
+static void rx_message(wc_context_t *ctx, const char *data, size_t len) {
+	struct rx_offload *rx = ctx->datasync.rxo;
+	struct rx_job *job;
+	wc_msg_t msg;
+
+	if (data == NULL) {
+		len = rx->len;
+	}
+
+	if (len < rx->threshold && rx->head == NULL) {
+		/* nothing to wait for, the usual way */
+		if (rx_parse_now(rx, data, len, &msg)) {
+			wc_datasync_process_message(ctx, &msg, NULL, 0);
+			wc_datasync_msg_free(&msg);
+		}
+		return;
+	}
+
+	job = calloc(1, sizeof(*job));
+	if (job == NULL || (data != NULL && len >= rx->threshold && rx_chunk_append(rx, data, len) != 0)) {
+		WL_ERR("could not allocate a parser job, dropping a message of %zu bytes", len);
+		free(job);
+		rx_chunks_free(rx_chunks_take(rx));
+		return;
+	}
+	job->rx = rx;
+
+	if (len < rx->threshold) {
+		/* parsed right away, but applied after the previous ones */
+		job->parsed = rx_parse_now(rx, data, len, &job->msg);
+		job->done = 1;
+		rx->deferred++;
+		rx_enqueue(rx, job);
+		return;
+	}
+
+	job->chunks = rx_chunks_take(rx);
+	job->work.run = rx_job_run;
+	rx->offloaded++;
+	rx->offloaded_bytes += len;
+	rx_enqueue(rx, job);
+	worker_pool_submit(rx->pool, &job->work);
+}
+
+void wc_datasync_rx_offload_data(wc_context_t *ctx, char *buf, size_t len) {
+	struct rx_offload *rx = ctx->datasync.rxo;
+	char *start;
+	size_t n;
+
+	while (len > 0) {
+		if (rx->scan.depth == 0) {
+			/* like the regular parser, ignore what is not a JSON object */
+			start = memchr(buf, '{', len);
+			if (start == NULL) {
+				break;
+			}
+			len -= (size_t)(start - buf);
+			buf = start;
+		}
+
+		n = rx_scan(&rx->scan, buf, len);
+		if (n == 0) {
+			if (rx_chunk_append(rx, buf, len) != 0) {
+				WL_ERR("could not allocate a reception buffer, dropping a message");
+				memset(&rx->scan, 0, sizeof(rx->scan));
+				rx_chunks_free(rx_chunks_take(rx));
+			}
+			break;
+		}
+
+		if (rx->chunks == NULL) {
+			rx_message(ctx, buf, n);
+		} else if (rx_chunk_append(rx, buf, n) == 0) {
+			rx_message(ctx, NULL, 0);
+		} else {
+			WL_ERR("could not allocate a reception buffer, dropping a message");
+			rx_chunks_free(rx_chunks_take(rx));
+		}
+
+		buf += n;
+		len -= n;
+	}
+}
+
+void wc_datasync_rx_offload_service(wc_context_t *ctx) {
+	struct rx_offload *rx = ctx->datasync.rxo;
+	struct rx_job *job;
+	char buf[64];
+
+	if (rx == NULL) {
+		return;
+	}
+
+	/* an eventfd is reset by a single read, a pipe is emptied */
+	while (read(rx->rfd, buf, sizeof(buf)) == sizeof(buf));
+	/* the workers finishing from now on will wake the loop again */
+	__atomic_store_n(&rx->wake_pending, 0, __ATOMIC_SEQ_CST);
+
+	/* a message still being parsed holds back the ones received after it */
+	while ((job = rx->head) != NULL && __atomic_load_n(&job->done, __ATOMIC_SEQ_CST)) {
+		rx->head = job->next;
+		if (rx->head == NULL) {
+			rx->tail = &rx->head;
+		}
+		rx->pending--;
+
+		if (job->parsed && !job->stale) {
+			wc_datasync_process_message(ctx, &job->msg, job->trees, job->ntrees);
+		}
+		rx_job_free(job);
+	}
+}
+
+/*
+ * drops what was received on a closed connection: the beginning of a message
+ * cut off by the disconnection, and the messages not applied yet (the ones
+ * still being parsed are dropped once their worker is done with them)
+ */
+void wc_datasync_rx_offload_reset(wc_context_t *ctx) {
+	struct rx_offload *rx = ctx->datasync.rxo;
+	struct rx_job *job, **p;
+
+	if (rx == NULL) {
+		return;
+	}
+
+	memset(&rx->scan, 0, sizeof(rx->scan));
+	rx_chunks_free(rx_chunks_take(rx));
+
+	for (p = &rx->head ; (job = *p) != NULL ; ) {
+		if (__atomic_load_n(&job->done, __ATOMIC_SEQ_CST)) {
+			*p = job->next;
+			rx->pending--;
+			rx_job_free(job);
+		} else {
+			job->stale = 1;
+			p = &job->next;
+		}
+	}
+	rx->tail = p;
+}
+
+void wc_datasync_get_parse_stats(wc_context_t *ctx, struct wc_datasync_parse_stats *stats) {
+	struct rx_offload *rx = ctx->datasync_init ? ctx->datasync.rxo : NULL;
+
+	memset(stats, 0, sizeof(*stats));
+	if (rx != NULL) {
+		stats->offloaded = rx->offloaded;
+		stats->offloaded_bytes = rx->offloaded_bytes;
+		stats->deferred = rx->deferred;
+		stats->pending = rx->pending;
+		stats->max_pending = rx->max_pending;
+	}
+}
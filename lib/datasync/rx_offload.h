@@ -0,0 +1,104 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_RX_OFFLOAD_H_
+#define LIB_DATASYNC_RX_OFFLOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "webcom-c/webcom-msg.h"
+#include "../worker_pool.h"
+#include "rx_stream.h"
+
+/*
+ * Parsing of the large received messages by worker threads.
+ *
+ * The received bytes are only scanned on the event loop thread, to find where
+ * each message ends, and kept as a list of chunks (no reallocation of a
+ * contiguous buffer). The messages of at least `parse_offload_bytes` are
+ * handed to the worker pool of the context, which parses them with the
+ * streaming parser (see rx_stream.h), building the cache trees of their data
+ * detached from the cache. The event loop thread, woken by a descriptor
+ * (WC_POLL_WORKERS source), then moves these trees into the cache in
+ * O(depth).
+ *
+ * The messages are applied in the order they were received: while a message
+ * is being parsed by a worker, the following ones (parsed right away if they
+ * are small) wait behind it.
+ */
+
+struct rx_offload;
+
+/* a received fragment of a message */
+struct rx_chunk {
+	struct rx_chunk *next;
+	size_t len;
+	char data[];
+};
+
+struct rx_job {
+	struct worker_job work;
+	struct rx_offload *rx;
+	struct rx_job *next;
+	struct rx_chunk *chunks;/* the message, until parsed */
+	int parsed;             /* msg is a valid message */
+	int done;               /* set by the worker once it is parsed */
+	int stale;              /* received on a closed connection, dropped once done */
+	wc_msg_t msg;
+	unsigned ntrees;
+	struct rx_tree *trees;  /* the trees of a data update push, if any */
+};
+
+/* finds the end of JSON objects in a byte stream */
+struct rx_scanner {
+	unsigned depth;
+	int in_str;
+	int esc;
+};
+
+struct rx_offload {
+	struct worker_pool *pool;
+	size_t threshold;
+	int rfd;                  /* read end of the wake up descriptor */
+	int wfd;                  /* write end, the same descriptor for an eventfd */
+	int wake_pending;         /* the descriptor was written and not drained yet */
+	struct rx_scanner scan;
+	struct rx_chunk *chunks;  /* beginning of a message received in several chunks */
+	struct rx_chunk **chunks_tail;
+	size_t len;
+	struct rx_job *head;      /* messages waiting to be applied, in order */
+	struct rx_job **tail;
+	unsigned pending;
+	unsigned max_pending;
+	uint64_t offloaded;
+	uint64_t offloaded_bytes;
+	uint64_t deferred;
+};
+
+/* returns the number of bytes of buf up to the end of the current message,
+ * or 0 if it does not end in buf */
+size_t rx_scan(struct rx_scanner *s, const char *buf, size_t len);
+int rx_job_parse(struct rx_job *job);
+void rx_job_free(struct rx_job *job);
+
+#endif /* LIB_DATASYNC_RX_OFFLOAD_H_ */
@@ -0,0 +1,676 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rx_stream.h"
+#include "../collection/avl.h"
+
+enum rx_stream_state {
+	RXS_START,       /* before the message, anything but '{' is skipped */
+	RXS_VALUE,
+	RXS_FIRST_VALUE, /* after '[' */
+	RXS_FIRST_KEY,   /* after '{' */
+	RXS_KEY,         /* after ',' in an object */
+	RXS_COLON,
+	RXS_NEXT,        /* after a value */
+	RXS_STRING,
+	RXS_NUMBER,
+	RXS_LITERAL,
+};
+
+enum rx_value_type {
+	RXV_STRING,
+	RXV_NUMBER,
+	RXV_LITERAL,
+};
+
+#define RXS_IS_WS(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+#define RXS_IS_NUM(c) (((c) >= '0' && (c) <= '9') || (c) == '-' || (c) == '+' || (c) == '.' || (c) == 'e' || (c) == 'E')
+#define RXS_IS_ALPHA(c) ((c) >= 'a' && (c) <= 'z')
+
+static const char *rx_err_syntax = "unexpected character";
+static const char *rx_err_depth = "too many nested levels";
+static const char *rx_err_value = "invalid value";
+static const char *rx_err_mem = "out of memory";
+
+void rx_stream_init(struct rx_stream *s) {
+	memset(s, 0, sizeof(*s));
+}
+
+void rx_stream_reset(struct rx_stream *s) {
+	unsigned i;
+
+	for (i = 0 ; i < s->depth ; i++) {
+		free(s->stack[i].key);
+	}
+	json_object_put(s->root);
+	treenode_destroy(s->data);
+
+	s->state = RXS_START;
+	s->in_key = 0;
+	s->esc = 0;
+	s->ucode = 0;
+	s->surrogate = 0;
+	s->tok_len = 0;
+	s->depth = 0;
+	s->root = NULL;
+	s->body = NULL;
+	s->data_depth = 0;
+	s->has_data = 0;
+	s->data = NULL;
+	s->data_nulls = 0;
+}
+
+void rx_stream_cleanup(struct rx_stream *s) {
+	rx_stream_reset(s);
+	free(s->tok);
+	s->tok = NULL;
+	s->tok_size = 0;
+}
+
+static int rx_fail(struct rx_stream *s, const char *error) {
+	s->error = error;
+	return -1;
+}
+
+static int rx_tok_put(struct rx_stream *s, const char *p, size_t n) {
+	size_t size;
+	char *tmp;
+
+	if (s->tok_len + n + 1 > s->tok_size) {
+		for (size = s->tok_size ? s->tok_size : 64 ; size < s->tok_len + n + 1 ; size *= 2);
+		tmp = realloc(s->tok, size);
+		if (tmp == NULL) {
+			return rx_fail(s, rx_err_mem);
+		}
+		s->tok = tmp;
+		s->tok_size = size;
+	}
+	memcpy(s->tok + s->tok_len, p, n);
+	s->tok_len += n;
+	s->tok[s->tok_len] = '\0';
+
+	return 0;
+}
+
+static int rx_utf8_put(struct rx_stream *s, unsigned c) {
+	char b[4];
+	size_t n;
+
+	if (c < 0x80) {
+		b[0] = (char)c;
+		n = 1;
+	} else if (c < 0x800) {
+		b[0] = (char)(0xc0 | (c >> 6));
+		b[1] = (char)(0x80 | (c & 0x3f));
+		n = 2;
+	} else if (c < 0x10000) {
+		b[0] = (char)(0xe0 | (c >> 12));
+		b[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+		b[2] = (char)(0x80 | (c & 0x3f));
+		n = 3;
+	} else {
+		b[0] = (char)(0xf0 | (c >> 18));
+		b[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+		b[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+		b[3] = (char)(0x80 | (c & 0x3f));
+		n = 4;
+	}
+	return rx_tok_put(s, b, n);
+}
+
+/* a lone high surrogate is kept as is */
+static int rx_surrogate_flush(struct rx_stream *s) {
+	unsigned c = s->surrogate;
+
+	s->surrogate = 0;
+	return c ? rx_utf8_put(s, c) : 0;
+}
+
+static int rx_ucode_put(struct rx_stream *s, unsigned c) {
+	if (c >= 0xdc00 && c <= 0xdfff && s->surrogate) {
+		c = 0x10000 + ((s->surrogate - 0xd800) << 10) + (c - 0xdc00);
+		s->surrogate = 0;
+		return rx_utf8_put(s, c);
+	}
+	if (rx_surrogate_flush(s) != 0) {
+		return -1;
+	}
+	if (c >= 0xd800 && c <= 0xdbff) {
+		s->surrogate = c;
+		return 0;
+	}
+	return rx_utf8_put(s, c);
+}
+
+/* the data of a push: "d" in the "b" object in the "d" object of the message */
+static int rx_is_data(struct rx_stream *s) {
+	return s->depth == 3
+			&& !s->has_data
+			&& !s->stack[0].is_array && !s->stack[1].is_array && !s->stack[2].is_array
+			&& strcmp(s->stack[0].key, "d") == 0
+			&& strcmp(s->stack[1].key, "b") == 0
+			&& strcmp(s->stack[2].key, "d") == 0;
+}
+
+static void rx_data_begin(struct rx_stream *s) {
+	s->has_data = 1;
+	s->body = s->stack[2].jobj;
+	/* placeholder, for the regular parser */
+	json_object_object_add(s->body, "d", NULL);
+}
+
+/* key of the next value of a container of the data */
+static char *rx_key(struct rx_stream_frame *f, char *idx, size_t idx_size) {
+	if (f->is_array) {
+		snprintf(idx, idx_size, "%u", f->idx);
+		return idx;
+	}
+	return f->key;
+}
+
+static void rx_json_add(struct rx_stream_frame *f, json_object *j) {
+	if (f->is_array) {
+		json_object_array_add(f->jobj, j);
+	} else {
+		json_object_object_add(f->jobj, f->key, j);
+	}
+}
+
+/* the current value of a container is complete */
+static void rx_next(struct rx_stream_frame *f) {
+	free(f->key);
+	f->key = NULL;
+	f->idx++;
+}
+
+static int rx_open(struct rx_stream *s, int is_array) {
+	struct rx_stream_frame *parent = s->depth ? &s->stack[s->depth - 1] : NULL;
+	struct rx_stream_frame *f;
+	char idx[16], *key;
+
+	if (s->depth == RX_STREAM_MAX_DEPTH) {
+		return rx_fail(s, rx_err_depth);
+	}
+	f = &s->stack[s->depth];
+	memset(f, 0, sizeof(*f));
+	f->is_array = is_array;
+
+	if (parent == NULL) {
+		f->jobj = s->root = json_object_new_object();
+	} else if (rx_is_data(s)) {
+		rx_data_begin(s);
+		f->node = s->data = treenode_new_internal();
+		s->data_depth = s->depth + 1;
+	} else if (s->data_depth) {
+		key = rx_key(parent, idx, sizeof(idx));
+		if (!parent->is_array) {
+			/* the last one wins, as with json-c */
+			internal_remove(parent->node, key);
+		}
+		f->node = internal_add_new_internal(parent->node, key);
+	} else {
+		f->jobj = is_array ? json_object_new_array() : json_object_new_object();
+		rx_json_add(parent, f->jobj);
+	}
+	s->depth++;
+
+	return 0;
+}
+
+static int rx_close(struct rx_stream *s, int is_array) {
+	struct rx_stream_frame *f = &s->stack[s->depth - 1];
+
+	if (f->is_array != is_array) {
+		return rx_fail(s, rx_err_syntax);
+	}
+	free(f->key);
+	f->key = NULL;
+	s->depth--;
+
+	if (s->depth < s->data_depth) {
+		s->data_depth = 0;
+	}
+	if (s->depth > 0) {
+		rx_next(&s->stack[s->depth - 1]);
+	}
+
+	return 0;
+}
+
+static int rx_number(struct rx_stream *s, double *d, int64_t *i, int *is_double) {
+	char *end;
+
+	*is_double = strpbrk(s->tok, ".eE") != NULL;
+	if (*is_double) {
+		*d = strtod(s->tok, &end);
+	} else {
+		*i = strtoll(s->tok, &end, 10);
+		*d = (double)*i;
+	}
+	return end == s->tok + s->tok_len ? 0 : rx_fail(s, rx_err_value);
+}
+
+static int rx_literal(struct rx_stream *s, int *is_null, int *b) {
+	*is_null = 0;
+	if (strcmp(s->tok, "true") == 0) {
+		*b = 1;
+	} else if (strcmp(s->tok, "false") == 0) {
+		*b = 0;
+	} else if (strcmp(s->tok, "null") == 0) {
+		*is_null = 1;
+	} else {
+		return rx_fail(s, rx_err_value);
+	}
+	return 0;
+}
+
+static int rx_scalar(struct rx_stream *s, enum rx_value_type type) {
+	struct rx_stream_frame *f = &s->stack[s->depth - 1];
+	int is_null = 0, is_double = 0, b = 0;
+	json_object *j = NULL;
+	char idx[16], *key;
+	int64_t i = 0;
+	double d = 0;
+
+	if ((type == RXV_NUMBER && rx_number(s, &d, &i, &is_double) != 0)
+			|| (type == RXV_LITERAL && rx_literal(s, &is_null, &b) != 0))
+	{
+		return -1;
+	}
+
+	if (rx_is_data(s)) {
+		rx_data_begin(s);
+		if (type == RXV_STRING) {
+			s->data = treenode_new_string(s->tok);
+		} else if (type == RXV_NUMBER) {
+			s->data = treenode_new_number(d);
+		} else if (!is_null) {
+			s->data = treenode_new_bool(b ? TN_TRUE : TN_FALSE);
+		}
+	} else if (s->data_depth) {
+		key = rx_key(f, idx, sizeof(idx));
+		if (!f->is_array) {
+			internal_remove(f->node, key);
+		}
+		if (type == RXV_STRING) {
+			internal_add_new_string(f->node, key, s->tok);
+		} else if (type == RXV_NUMBER) {
+			internal_add_new_number(f->node, key, d);
+		} else if (!is_null) {
+			internal_add_new_bool(f->node, key, b ? TN_TRUE : TN_FALSE);
+		} else if (s->depth == s->data_depth && !f->is_array) {
+			/* a merge removes the children set to null */
+			internal_add_new_null(f->node, key);
+			s->data_nulls++;
+		}
+	} else {
+		if (type == RXV_STRING) {
+			j = json_object_new_string_len(s->tok, (int)s->tok_len);
+		} else if (type == RXV_NUMBER) {
+			j = is_double ? json_object_new_double(d) : json_object_new_int64(i);
+		} else if (!is_null) {
+			j = json_object_new_boolean(b);
+		}
+		rx_json_add(f, j);
+	}
+	rx_next(f);
+
+	return 0;
+}
+
+static int rx_string_end(struct rx_stream *s) {
+	struct rx_stream_frame *f = &s->stack[s->depth - 1];
+
+	if (rx_surrogate_flush(s) != 0) {
+		return -1;
+	}
+	if (s->in_key) {
+		free(f->key);
+		f->key = strdup(s->tok);
+		s->state = RXS_COLON;
+		return f->key != NULL ? 0 : rx_fail(s, rx_err_mem);
+	}
+	s->state = RXS_NEXT;
+	return rx_scalar(s, RXV_STRING);
+}
+
+static int rx_string_escape(struct rx_stream *s, char c) {
+	static const char from[] = "\"\\/bfnrt";
+	static const char to[] = "\"\\/\b\f\n\r\t";
+	const char *p;
+
+	if (s->esc == 1) {
+		if (c == 'u') {
+			s->esc = 2;
+			s->ucode = 0;
+			return 0;
+		}
+		s->esc = 0;
+		p = c ? strchr(from, c) : NULL;
+		if (p == NULL) {
+			return rx_fail(s, rx_err_syntax);
+		}
+		return rx_surrogate_flush(s) == 0 ? rx_tok_put(s, &to[p - from], 1) : -1;
+	}
+
+	if (c >= '0' && c <= '9') {
+		s->ucode = s->ucode * 16 + (unsigned)(c - '0');
+	} else if (c >= 'a' && c <= 'f') {
+		s->ucode = s->ucode * 16 + (unsigned)(c - 'a' + 10);
+	} else if (c >= 'A' && c <= 'F') {
+		s->ucode = s->ucode * 16 + (unsigned)(c - 'A' + 10);
+	} else {
+		return rx_fail(s, rx_err_syntax);
+	}
+	if (++s->esc == 6) {
+		s->esc = 0;
+		return rx_ucode_put(s, s->ucode);
+	}
+	return 0;
+}
+
+static int rx_token_start(struct rx_stream *s, enum rx_stream_state state) {
+	s->state = state;
+	s->tok_len = 0;
+	return rx_tok_put(s, "", 0);
+}
+
+/* a value, or the end of an empty array */
+static int rx_value(struct rx_stream *s, char c) {
+	if (c == '{') {
+		s->state = RXS_FIRST_KEY;
+		return rx_open(s, 0);
+	} else if (c == '[') {
+		s->state = RXS_FIRST_VALUE;
+		return rx_open(s, 1);
+	} else if (c == ']' && s->state == RXS_FIRST_VALUE) {
+		s->state = RXS_NEXT;
+		return rx_close(s, 1);
+	} else if (c == '"') {
+		s->in_key = 0;
+		return rx_token_start(s, RXS_STRING);
+	}
+	return rx_fail(s, rx_err_syntax);
+}
+
+wc_parser_result_t rx_stream_feed(struct rx_stream *s, const char *buf, size_t len, size_t *used) {
+	size_t i = 0, n;
+	char c;
+	int ret = 0;
+
+	while (i < len && ret == 0) {
+		c = buf[i];
+
+		switch (s->state) {
+		case RXS_START:
+			if (c == '{') {
+				ret = rx_open(s, 0);
+				s->state = RXS_FIRST_KEY;
+			}
+			i++;
+			break;
+		case RXS_STRING:
+			if (s->esc) {
+				ret = rx_string_escape(s, c);
+				i++;
+				break;
+			}
+			for (n = i ; n < len && buf[n] != '"' && buf[n] != '\\' ; n++);
+			if (n > i) {
+				ret = rx_surrogate_flush(s) == 0 ? rx_tok_put(s, buf + i, n - i) : -1;
+				i = n;
+			} else if (c == '"') {
+				ret = rx_string_end(s);
+				i++;
+			} else {
+				s->esc = 1;
+				i++;
+			}
+			break;
+		case RXS_NUMBER:
+		case RXS_LITERAL:
+			for (n = i ; n < len && (s->state == RXS_NUMBER ? RXS_IS_NUM(buf[n]) : RXS_IS_ALPHA(buf[n])) ; n++);
+			if (n > i) {
+				ret = rx_tok_put(s, buf + i, n - i);
+				i = n;
+			} else {
+				/* the character that ends the token is not consumed */
+				ret = rx_scalar(s, s->state == RXS_NUMBER ? RXV_NUMBER : RXV_LITERAL);
+				s->state = RXS_NEXT;
+			}
+			break;
+		default:
+			if (RXS_IS_WS(c)) {
+				i++;
+				break;
+			}
+			switch (s->state) {
+			case RXS_VALUE:
+			case RXS_FIRST_VALUE:
+				if (c == '-' || (c >= '0' && c <= '9')) {
+					ret = rx_token_start(s, RXS_NUMBER);
+				} else if (RXS_IS_ALPHA(c)) {
+					ret = rx_token_start(s, RXS_LITERAL);
+				} else {
+					ret = rx_value(s, c);
+					i++;
+				}
+				break;
+			case RXS_FIRST_KEY:
+			case RXS_KEY:
+				if (c == '"') {
+					s->in_key = 1;
+					ret = rx_token_start(s, RXS_STRING);
+				} else if (c == '}' && s->state == RXS_FIRST_KEY) {
+					s->state = RXS_NEXT;
+					ret = rx_close(s, 0);
+				} else {
+					ret = rx_fail(s, rx_err_syntax);
+				}
+				i++;
+				break;
+			case RXS_COLON:
+				s->state = RXS_VALUE;
+				ret = c == ':' ? 0 : rx_fail(s, rx_err_syntax);
+				i++;
+				break;
+			case RXS_NEXT:
+				if (c == ',') {
+					s->state = s->stack[s->depth - 1].is_array ? RXS_VALUE : RXS_KEY;
+				} else if (c == '}' || c == ']') {
+					ret = rx_close(s, c == ']');
+				} else {
+					ret = rx_fail(s, rx_err_syntax);
+				}
+				i++;
+				break;
+			default:
+				break;
+			}
+		}
+
+		if (ret == 0 && s->depth == 0 && s->state == RXS_NEXT) {
+			/* end of the message */
+			s->state = RXS_START;
+			*used = i;
+			return WC_PARSER_OK;
+		}
+	}
+
+	*used = i;
+	if (ret != 0) {
+		rx_stream_reset(s);
+		return WC_PARSER_ERROR;
+	}
+	return WC_PARSER_CONTINUE;
+}
+
+void rx_trees_free(struct rx_tree *trees, unsigned n) {
+	unsigned i;
+
+	for (i = 0 ; i < n ; i++) {
+		treenode_destroy(trees[i].tree);
+		wc_datasync_path_destroy(trees[i].path);
+	}
+	free(trees);
+}
+
+/* the null children were only kept for the merges */
+static void rx_strip_nulls(struct rx_stream *s) {
+	struct internal_node_element *e;
+	struct avl_it it;
+	char **keys;
+	unsigned i, n = 0;
+
+	if (s->data_nulls == 0) {
+		return;
+	}
+	keys = malloc(s->data_nulls * sizeof(*keys));
+	if (keys != NULL) {
+		avl_it_start(&it, s->data->uval.children);
+		while ((e = avl_it_next(&it)) != NULL) {
+			if (e->node.type == TREENODE_TYPE_LEAF_NULL) {
+				keys[n++] = e->key;
+			}
+		}
+		/* the keys belong to their own element, they outlive the other removals */
+		for (i = 0 ; i < n ; i++) {
+			avl_remove(s->data->uval.children, &keys[i]);
+		}
+		free(keys);
+	}
+	s->data_nulls = 0;
+}
+
+static int rx_put_trees(struct rx_stream *s, wc_push_data_update_put_t *put, struct rx_tree **trees, unsigned *ntrees) {
+	struct rx_tree *t;
+
+	t = calloc(1, sizeof(*t));
+	if (t == NULL || (t->path = wc_datasync_path_new(put->path)) == NULL) {
+		free(t);
+		return -1;
+	}
+	rx_strip_nulls(s);
+	t->tree = s->data;
+	s->data = NULL;
+
+	*trees = t;
+	*ntrees = 1;
+	return 0;
+}
+
+/* one tree per child, as data_cache_merge() does */
+static int rx_merge_trees(struct rx_stream *s, wc_push_data_update_merge_t *merge, struct rx_tree **trees, unsigned *ntrees) {
+	struct internal_node_element *e;
+	struct avl_it it;
+	struct rx_tree *t;
+	unsigned i, n = 0;
+	char *path;
+
+	if (s->data != NULL && s->data->type == TREENODE_TYPE_INTERNAL) {
+		n = avl_count(s->data->uval.children);
+	}
+	/* not NULL even if there is nothing to merge */
+	t = calloc(n ? n : 1, sizeof(*t));
+	if (t == NULL) {
+		return -1;
+	}
+
+	/* the paths first, the tree is left as is if one of them is not valid */
+	avl_it_start(&it, n ? s->data->uval.children : NULL);
+	for (i = 0 ; i < n && (e = avl_it_next(&it)) != NULL ; i++) {
+		path = malloc(strlen(merge->path) + strlen(e->key) + 2);
+		if (path != NULL) {
+			sprintf(path, "%s/%s", merge->path, e->key);
+			t[i].path = wc_datasync_path_new(path);
+			free(path);
+		}
+		if (t[i].path == NULL) {
+			rx_trees_free(t, i);
+			return -1;
+		}
+	}
+
+	avl_it_start(&it, n ? s->data->uval.children : NULL);
+	for (i = 0 ; i < n && (e = avl_it_next(&it)) != NULL ; i++) {
+		if (e->node.type != TREENODE_TYPE_LEAF_NULL) {
+			t[i].tree = internal_steal(e);
+		}
+	}
+
+	*trees = t;
+	*ntrees = n;
+	return 0;
+}
+
+int rx_stream_finish(struct rx_stream *s, wc_msg_t *msg, struct rx_tree **trees, unsigned *ntrees) {
+	wc_push_t *push = &msg->u.data.u.push;
+	json_object *jdata = NULL;
+	int ok, is_update, len;
+	char *json;
+
+	*trees = NULL;
+	*ntrees = 0;
+
+	ok = wc_datasync_msg_from_json(s->root, msg);
+
+	if (s->has_data) {
+		is_update = ok
+				&& msg->type == WC_MSG_DATA
+				&& msg->u.data.type == WC_DATA_MSG_PUSH
+				&& (push->type == WC_PUSH_DATA_UPDATE_PUT || push->type == WC_PUSH_DATA_UPDATE_MERGE);
+
+		if (is_update && (push->type == WC_PUSH_DATA_UPDATE_PUT
+				? rx_put_trees(s, &push->u.update_put, trees, ntrees)
+				: rx_merge_trees(s, &push->u.update_merge, trees, ntrees)) == 0)
+		{
+			/* the placeholder */
+			free(push->u.update_put.data);
+			push->u.update_put.data = NULL;
+		} else {
+			/* not a data update after all, the data goes back to the document
+			 * (the first attempt may have partially filled the message) */
+			wc_datasync_msg_free(msg);
+			rx_strip_nulls(s);
+			if (s->data != NULL) {
+				len = treenode_to_json_len(s->data);
+				json = malloc((size_t)len + 1);
+				if (json != NULL) {
+					treenode_to_json(s->data, json);
+					json[len] = '\0';
+					jdata = json_tokener_parse(json);
+					free(json);
+				}
+			}
+			json_object_object_add(s->body, "d", jdata);
+			ok = wc_datasync_msg_from_json(s->root, msg);
+		}
+	}
+
+	rx_stream_reset(s);
+
+	return ok;
+}
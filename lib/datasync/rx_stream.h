@@ -0,0 +1,99 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_RX_STREAM_H_
+#define LIB_DATASYNC_RX_STREAM_H_
+
+#include <stddef.h>
+
+#include <json-c/json.h>
+
+#include "webcom-c/webcom-msg.h"
+#include "webcom-c/webcom-parser.h"
+#include "cache/treenode.h"
+#include "path.h"
+
+/*
+ * Streaming parser of the received messages.
+ *
+ * The fragments of a message are parsed as they are received, without being
+ * reassembled. The envelope of the message is built as a json-c document and
+ * handed to the regular parser once complete, but the data of the pushes,
+ * which can be arbitrarily large, is built straight into a cache tree detached
+ * from the cache: it never exists as a json-c document nor as a string, the
+ * peak memory usage is about the size of the resulting tree.
+ *
+ * The data update pushes parsed this way come with the trees to move into the
+ * cache (see data_cache_set_tree()), and their `data` field is NULL.
+ */
+
+#define RX_STREAM_MAX_DEPTH 32 /* as json-c's default */
+
+/* a detached tree, and where it goes in the cache (NULL tree: removal) */
+struct rx_tree {
+	wc_ds_path_t *path;
+	struct treenode *tree;
+};
+
+struct rx_stream_frame {
+	json_object *jobj;      /* container of the envelope */
+	struct treenode *node;  /* container of the data */
+	char *key;              /* key of the next value, for the objects */
+	unsigned idx;           /* index of the next value, for the arrays */
+	int is_array;
+};
+
+struct rx_stream {
+	int state;
+	int in_key;             /* the string being read is a key */
+	int esc;                /* 1 after a backslash, 2 to 5 in a \uXXXX sequence */
+	unsigned ucode;
+	unsigned surrogate;     /* high surrogate waiting for the low one */
+	char *tok;              /* string, number or literal being read */
+	size_t tok_len;
+	size_t tok_size;
+	struct rx_stream_frame stack[RX_STREAM_MAX_DEPTH];
+	unsigned depth;
+	json_object *root;      /* the envelope */
+	json_object *body;      /* its "b" object holding the data */
+	unsigned data_depth;    /* depth of the data root container, 0 if not in it */
+	int has_data;
+	struct treenode *data;
+	unsigned data_nulls;    /* null children of the data root, kept for the merges */
+	const char *error;
+};
+
+void rx_stream_init(struct rx_stream *s);
+void rx_stream_cleanup(struct rx_stream *s);
+/* drops the message being read, and the partial tree of its data */
+void rx_stream_reset(struct rx_stream *s);
+/* returns WC_PARSER_OK once a whole message was read, *used being the number
+ * of bytes of buf it took, then rx_stream_finish() must be called */
+wc_parser_result_t rx_stream_feed(struct rx_stream *s, const char *buf, size_t len, size_t *used);
+/* builds the message, and the trees if it is a data update push (NULL
+ * otherwise), the stream is ready for the next message */
+int rx_stream_finish(struct rx_stream *s, wc_msg_t *msg, struct rx_tree **trees, unsigned *ntrees);
+void rx_trees_free(struct rx_tree *trees, unsigned n);
+
+int wc_datasync_msg_from_json(json_object *jroot, wc_msg_t *res);
+
+#endif /* LIB_DATASYNC_RX_STREAM_H_ */
@@ -0,0 +1,245 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../webcom_base_priv.h"
+#include "submit.h"
+#include "webcom-c/webcom-log.h"
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#define WC_SUBMIT_DEFAULT_SIZE 1024
+
+enum submit_cmd_type {
+	SUBMIT_PUT,
+	SUBMIT_MERGE,
+	SUBMIT_PUSH,
+};
+
+struct submit_cmd {
+	enum submit_cmd_type type;
+	wc_on_req_result_t callback;
+	void *user;
+	char *json;
+	char path[]; /* followed by the JSON data */
+};
+
+static int submit_wake_fds(struct submit_queue *q) {
+#ifdef HAVE_SYS_EVENTFD_H
+	q->rfd = q->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return q->rfd == -1 ? -1 : 0;
+#else
+	int fds[2], i;
+
+	if (pipe(fds) == -1) {
+		return -1;
+	}
+	for (i = 0 ; i < 2 ; i++) {
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	q->rfd = fds[0];
+	q->wfd = fds[1];
+	return 0;
+#endif
+}
+
+int wc_datasync_submit_open(wc_context_t *ctx, unsigned size) {
+	struct submit_queue *q;
+	struct wc_pollargs pa;
+
+	q = calloc(1, sizeof(*q));
+	if (q == NULL) {
+		return -1;
+	}
+	q->ring = mpsc_ring_new(size ? size : WC_SUBMIT_DEFAULT_SIZE);
+	if (q->ring == NULL || submit_wake_fds(q) == -1) {
+		WL_ERR("could not create the submission queue of context %p", ctx);
+		mpsc_ring_destroy(q->ring);
+		free(q);
+		return -1;
+	}
+	ctx->datasync.submitq = q;
+
+	pa.fd = q->rfd;
+	pa.events = WC_POLLIN;
+	pa.src = WC_POLL_SUBMIT;
+	ctx->callback(WC_EVENT_ADD_FD, ctx, &pa, 0);
+
+	return 0;
+}
+
+void wc_datasync_submit_close(wc_context_t *ctx) {
+	struct submit_queue *q = ctx->datasync.submitq;
+	struct wc_pollargs pa;
+	void *cmd;
+
+	if (q == NULL) {
+		return;
+	}
+
+	pa.fd = q->rfd;
+	pa.events = WC_POLLIN;
+	pa.src = WC_POLL_SUBMIT;
+	ctx->callback(WC_EVENT_DEL_FD, ctx, &pa, 0);
+
+	/* like the pending requests, the commands not executed yet are dropped */
+	while ((cmd = mpsc_ring_pop(q->ring)) != NULL) {
+		free(cmd);
+	}
+	mpsc_ring_destroy(q->ring);
+	close(q->rfd);
+	if (q->wfd != q->rfd) {
+		close(q->wfd);
+	}
+	free(q);
+	ctx->datasync.submitq = NULL;
+}
+
+static void submit_wake(struct submit_queue *q) {
+	uint64_t one = 1;
+
+	if (!__atomic_exchange_n(&q->wake_pending, 1, __ATOMIC_ACQ_REL)) {
+		while (write(q->wfd, &one, q->wfd == q->rfd ? sizeof(one) : 1) == -1 && errno == EINTR);
+	}
+}
+
+static int submit_cmd(wc_context_t *ctx, enum submit_cmd_type type, const char *path, const char *json, wc_on_req_result_t callback, void *user) {
+	struct submit_queue *q = ctx->datasync.submitq;
+	struct submit_cmd *cmd;
+	size_t path_len, json_len;
+
+	if (q == NULL) {
+		return -1;
+	}
+
+	path_len = strlen(path) + 1;
+	json_len = strlen(json) + 1;
+	cmd = malloc(sizeof(*cmd) + path_len + json_len);
+	if (cmd == NULL) {
+		return -1;
+	}
+	cmd->type = type;
+	cmd->callback = callback;
+	cmd->user = user;
+	cmd->json = cmd->path + path_len;
+	memcpy(cmd->path, path, path_len);
+	memcpy(cmd->json, json, json_len);
+
+	if (mpsc_ring_push(q->ring, cmd) != 0) {
+		__atomic_fetch_add(&q->rejected, 1, __ATOMIC_RELAXED);
+		free(cmd);
+		return -1;
+	}
+	__atomic_fetch_add(&q->submitted, 1, __ATOMIC_RELAXED);
+	submit_wake(q);
+
+	return 0;
+}
+
+int wc_datasync_submit_put(wc_context_t *ctx, const char *path, const char *json, wc_on_req_result_t callback, void *user) {
+	return submit_cmd(ctx, SUBMIT_PUT, path, json, callback, user);
+}
+
+int wc_datasync_submit_merge(wc_context_t *ctx, const char *path, const char *json, wc_on_req_result_t callback, void *user) {
+	return submit_cmd(ctx, SUBMIT_MERGE, path, json, callback, user);
+}
+
+int wc_datasync_submit_push(wc_context_t *ctx, const char *path, const char *json, wc_on_req_result_t callback, void *user) {
+	return submit_cmd(ctx, SUBMIT_PUSH, path, json, callback, user);
+}
+
+void wc_datasync_submit_service(wc_context_t *ctx) {
+	struct submit_queue *q = ctx->datasync.submitq;
+	struct submit_cmd *cmd;
+	wc_action_type_t type;
+	int64_t id = -1;
+	unsigned n = 0, budget;
+	char buf[64];
+
+	if (q == NULL) {
+		return;
+	}
+
+	/* an eventfd is reset by a single read, a pipe is emptied */
+	while (read(q->rfd, buf, sizeof(buf)) == sizeof(buf));
+	/* the commands submitted from now on will wake the loop again */
+	__atomic_store_n(&q->wake_pending, 0, __ATOMIC_SEQ_CST);
+
+	/* at most one ring's worth, so that busy producers cannot starve the loop */
+	for (budget = (unsigned)q->ring->mask + 1 ; budget > 0 ; budget--) {
+		cmd = mpsc_ring_pop(q->ring);
+		if (cmd == NULL) {
+			break;
+		}
+		type = cmd->type == SUBMIT_MERGE ? WC_ACTION_MERGE : WC_ACTION_PUT;
+		switch (cmd->type) {
+		case SUBMIT_PUT:
+			id = wc_datasync_put(ctx, cmd->path, cmd->json, cmd->callback, cmd->user);
+			break;
+		case SUBMIT_MERGE:
+			id = wc_datasync_merge(ctx, cmd->path, cmd->json, cmd->callback, cmd->user);
+			break;
+		case SUBMIT_PUSH:
+			id = wc_datasync_push(ctx, cmd->path, cmd->json, cmd->callback, cmd->user);
+			break;
+		}
+		/* the submitter has no return value to look at, the callback is the
+		 * only way to learn that the request never left */
+		if (id == -1 && cmd->callback != NULL) {
+			cmd->callback(ctx, -1, type, WC_REQ_ERROR, WC_REQ_REASON_NOT_SENT, NULL, cmd->user);
+		}
+		free(cmd);
+		n++;
+	}
+
+	if (budget == 0) {
+		submit_wake(q);
+	}
+	if (n > 0) {
+		q->executed += n;
+		q->batches++;
+		if (n > q->max_batch) {
+			q->max_batch = n;
+		}
+	}
+}
+
+void wc_datasync_submit_get_stats(wc_context_t *ctx, struct wc_datasync_submit_stats *stats) {
+	struct submit_queue *q = ctx->datasync_init ? ctx->datasync.submitq : NULL;
+
+	memset(stats, 0, sizeof(*stats));
+	if (q != NULL) {
+		stats->submitted = __atomic_load_n(&q->submitted, __ATOMIC_RELAXED);
+		stats->rejected = __atomic_load_n(&q->rejected, __ATOMIC_RELAXED);
+		stats->executed = q->executed;
+		stats->batches = q->batches;
+		stats->max_batch = q->max_batch;
+	}
+}
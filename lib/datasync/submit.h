@@ -0,0 +1,53 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_SUBMIT_H_
+#define LIB_DATASYNC_SUBMIT_H_
+
+#include <stdint.h>
+
+#include "../collection/mpsc.h"
+
+/*
+ * Cross-thread submission queue of a context.
+ *
+ * The write commands are built by the submitting threads (path and data are
+ * copied in a single allocation), and handed to the event loop thread through
+ * a bounded lock-free MPSC ring. The loop thread is woken by a descriptor
+ * registered like the sockets of the context (WC_POLL_SUBMIT source), which is
+ * only written once until the loop thread drains the ring: a burst of
+ * submissions costs one wake up, and is then executed as a batch.
+ */
+
+struct submit_queue {
+	struct mpsc_ring *ring;
+	int rfd;                  /* read end of the wake up descriptor */
+	int wfd;                  /* write end, the same descriptor for an eventfd */
+	int wake_pending;         /* the descriptor was written and not drained yet */
+	uint64_t submitted;       /* updated by the submitting threads */
+	uint64_t rejected;        /* updated by the submitting threads */
+	uint64_t executed;
+	uint64_t batches;
+	unsigned max_batch;
+};
+
+#endif /* LIB_DATASYNC_SUBMIT_H_ */
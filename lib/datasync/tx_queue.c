@@ -0,0 +1,228 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libwebsockets.h>
+
+#include "tx_queue.h"
+
+void tx_queue_init(struct tx_queue *q, size_t high_watermark) {
+	memset(q, 0, sizeof(*q));
+	q->tail = &q->head;
+	q->high_watermark = high_watermark;
+}
+
+unsigned char *tx_frame_payload(struct tx_frame *f) {
+	return f->buf + LWS_SEND_BUFFER_PRE_PADDING;
+}
+
+static struct tx_frame *tx_frame_new(const char *data, size_t len, int64_t id, const char *key) {
+	struct tx_frame *f;
+	size_t key_len = key != NULL ? strlen(key) + 1 : 0;
+
+	f = malloc(sizeof(*f) + LWS_SEND_BUFFER_PRE_PADDING + len + LWS_SEND_BUFFER_POST_PADDING + key_len);
+	if (f == NULL) {
+		return NULL;
+	}
+
+	f->next = NULL;
+	f->len = len;
+	f->id = id;
+	f->binary = 0;
+	memcpy(tx_frame_payload(f), data, len);
+	if (key != NULL) {
+		f->key = (char *)tx_frame_payload(f) + len + LWS_SEND_BUFFER_POST_PADDING;
+		memcpy(f->key, key, key_len);
+	} else {
+		f->key = NULL;
+	}
+
+	return f;
+}
+
+static int tx_queue_full(struct tx_queue *q, size_t bytes, unsigned depth) {
+	return (q->high_watermark && bytes > q->high_watermark)
+			|| (q->max_frames && depth > q->max_frames);
+}
+
+static void tx_queue_update_max(struct tx_queue *q) {
+	if (q->depth > q->max_depth) q->max_depth = q->depth;
+	if (q->bytes > q->max_bytes) q->max_bytes = q->bytes;
+}
+
+void tx_queue_append(struct tx_queue *q, struct tx_frame *f) {
+	f->next = NULL;
+	q->last = q->tail;
+	*q->tail = f;
+	q->tail = &f->next;
+
+	q->depth++;
+	q->bytes += f->len;
+	tx_queue_update_max(q);
+}
+
+int tx_queue_push(struct tx_queue *q, const char *data, size_t len, int force) {
+	return tx_queue_push_ex(q, data, len, force, 0, NULL);
+}
+
+/*
+ * returns 0 if the frame was queued, 1 if it was refused because of the high
+ * watermark, -1 in case of allocation failure
+ */
+int tx_queue_push_ex(struct tx_queue *q, const char *data, size_t len, int force, int64_t id, const char *key) {
+	struct tx_frame *f;
+
+	if (!force && tx_queue_full(q, q->bytes + len, q->depth + 1)) {
+		q->rejected++;
+		q->congested = 1;
+		return 1;
+	}
+
+	f = tx_frame_new(data, len, id, key);
+	if (f == NULL) {
+		return -1;
+	}
+
+	tx_queue_append(q, f);
+
+	return 0;
+}
+
+/*
+ * substitutes the last frame of the queue with a new one, provided it has the
+ * given key. Returns 0 on success (the id of the substituted frame is stored
+ * in *replaced), 1 if the new frame does not fit in the queue, 2 if the last
+ * frame does not have the given key, -1 in case of allocation failure
+ */
+int tx_queue_replace_last(struct tx_queue *q, const char *data, size_t len, int64_t id, const char *key, int64_t *replaced) {
+	struct tx_frame *old, *f;
+
+	old = tx_queue_last(q);
+	if (old == NULL || old->key == NULL || key == NULL || strcmp(old->key, key) != 0) {
+		return 2;
+	}
+
+	if (tx_queue_full(q, q->bytes - old->len + len, q->depth)) {
+		q->rejected++;
+		q->congested = 1;
+		return 1;
+	}
+
+	f = tx_frame_new(data, len, id, key);
+	if (f == NULL) {
+		return -1;
+	}
+
+	*q->last = f;
+	q->tail = &f->next;
+	q->bytes = q->bytes - old->len + len;
+	q->collapsed++;
+	tx_queue_update_max(q);
+
+	*replaced = old->id;
+	free(old);
+
+	return 0;
+}
+
+struct tx_frame *tx_queue_pop(struct tx_queue *q) {
+	struct tx_frame *f = q->head;
+
+	if (f != NULL) {
+		q->head = f->next;
+		if (q->head == NULL) {
+			q->tail = &q->head;
+			q->last = NULL;
+		} else if (q->last == &f->next) {
+			q->last = &q->head;
+		}
+		q->depth--;
+		q->bytes -= f->len;
+		f->next = NULL;
+	}
+	return f;
+}
+
+/*
+ * removes and frees the frame carrying the request of the given id, returns 1
+ * if such a frame was found, 0 otherwise
+ */
+int tx_queue_remove(struct tx_queue *q, int64_t id) {
+	struct tx_frame **link, **prev = NULL, *f;
+
+	if (id == 0) {
+		return 0;
+	}
+
+	for (link = &q->head ; (f = *link) != NULL ; prev = link, link = &f->next) {
+		if (f->id != id) {
+			continue;
+		}
+
+		*link = f->next;
+		if (f->next == NULL) {
+			q->tail = link;
+			q->last = prev;
+		} else if (q->last == &f->next) {
+			q->last = link;
+		}
+		q->depth--;
+		q->bytes -= f->len;
+		free(f);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * moves all the frames of src at the end of dst, regardless of the limits of
+ * dst
+ */
+void tx_queue_splice(struct tx_queue *dst, struct tx_queue *src) {
+	if (src->head == NULL) {
+		return;
+	}
+
+	*dst->tail = src->head;
+	dst->last = src->last == &src->head ? dst->tail : src->last;
+	dst->tail = src->tail;
+	dst->depth += src->depth;
+	dst->bytes += src->bytes;
+	tx_queue_update_max(dst);
+
+	src->head = NULL;
+	src->tail = &src->head;
+	src->last = NULL;
+	src->depth = 0;
+	src->bytes = 0;
+}
+
+void tx_queue_clear(struct tx_queue *q) {
+	struct tx_frame *f;
+
+	while ((f = tx_queue_pop(q)) != NULL) {
+		free(f);
+	}
+	q->congested = 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_DATASYNC_TX_QUEUE_H_
+#define LIB_DATASYNC_TX_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Outbound queue of a datasync connection.
+ *
+ * The frames are allocated with the padding libwebsockets needs in front of
+ * and after the payload, so that they can be handed to lws_write() as is when
+ * the socket becomes writable. The queue is bounded in bytes by a high
+ * watermark, and optionally in number of frames, above which tx_queue_push()
+ * refuses new frames unless they are forced (e.g. keepalive frames).
+ *
+ * A frame can be tagged with the id of the request it carries, and with a key:
+ * tx_queue_replace_last() substitutes the last frame of the queue if it has
+ * the same key, this is how consecutive writes to the same path are collapsed
+ * while the connection is down.
+ */
+
+struct tx_frame {
+	struct tx_frame *next;
+	size_t len;
+	int64_t id;          /* request id, 0 if none */
+	char *key;           /* collapsing key, stored after the payload, or NULL */
+	int binary;          /* CBOR payload, written in a binary frame */
+	unsigned char buf[]; /* pre padding + payload + post padding */
+};
+
+struct tx_queue {
+	struct tx_frame *head;
+	struct tx_frame **tail;
+	struct tx_frame **last;  /* link to the last frame, NULL if the queue is empty */
+	unsigned depth;          /* number of queued frames */
+	size_t bytes;            /* payload bytes of the queued frames */
+	size_t high_watermark;   /* max payload bytes, 0 for no limit */
+	unsigned max_frames;     /* max number of frames, 0 for no limit */
+	unsigned max_depth;      /* highest depth observed */
+	size_t max_bytes;        /* highest bytes observed */
+	uint64_t frames_sent;
+	uint64_t bytes_sent;
+	uint64_t partial_writes;
+	uint64_t rejected;
+	uint64_t collapsed;
+	int congested:1;         /* the high watermark was hit and the queue was not drained since */
+};
+
+void tx_queue_init(struct tx_queue *q, size_t high_watermark);
+int tx_queue_push(struct tx_queue *q, const char *data, size_t len, int force);
+int tx_queue_push_ex(struct tx_queue *q, const char *data, size_t len, int force, int64_t id, const char *key);
+int tx_queue_replace_last(struct tx_queue *q, const char *data, size_t len, int64_t id, const char *key, int64_t *replaced);
+struct tx_frame *tx_queue_pop(struct tx_queue *q);
+int tx_queue_remove(struct tx_queue *q, int64_t id);
+void tx_queue_append(struct tx_queue *q, struct tx_frame *f);
+void tx_queue_splice(struct tx_queue *dst, struct tx_queue *src);
+void tx_queue_clear(struct tx_queue *q);
+unsigned char *tx_frame_payload(struct tx_frame *f);
+
+static inline struct tx_frame *tx_queue_peek(struct tx_queue *q) {
+	return q->head;
+}
+
+static inline struct tx_frame *tx_queue_last(struct tx_queue *q) {
+	return q->last != NULL ? *q->last : NULL;
+}
+
+static inline int tx_queue_empty(struct tx_queue *q) {
+	return q->head == NULL;
+}
+
+#endif /* LIB_DATASYNC_TX_QUEUE_H_ */
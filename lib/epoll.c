@@ -0,0 +1,532 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/ioctl.h>
+
+#include "webcom_base_priv.h"
+#include "webcom-c/webcom-epoll.h"
+#include "webcom-c/webcom-utils.h"
+#include "webcom-c/webcom-log.h"
+
+#include "event_libs_priv.h"
+
+#define WC_LOOP_MAX_EVENTS 64
+/* max number of consecutive services of an edge-triggered socket that still
+ * has data to read, before the other ready sockets get their turn */
+#define WC_LOOP_SOCKET_BUDGET 8
+
+enum wc_epoll_source_type {
+	WC_EPOLL_SOCKET,
+	WC_EPOLL_TIMER,
+	WC_EPOLL_USER,
+};
+
+struct wc_epoll_source {
+	enum wc_epoll_source_type type;
+	int fd;                       /* -1 if not watched */
+	int idx;                      /* wc_pollsrc or wc_timersrc value */
+	uint32_t revents;             /* events not serviced yet */
+	struct wc_epoll_source *next; /* in the ready list, or in the list of application descriptors */
+	unsigned ready:1;
+	unsigned armed:1;
+	unsigned repeat:1;
+	wc_context_t *ctx;
+	wc_loop_fd_cb_t cb;
+	void *data;
+};
+
+struct wc_epoll_integration_data {
+	wc_loop_t *loop;
+	struct wc_eli_callbacks callbacks;
+	struct wc_epoll_source fds[_WC_POLL_MAX];
+	struct wc_epoll_source timers[_WC_TIMER_MAX];
+	struct wc_epoll_integration_data *next_dead;
+	unsigned next_try;
+};
+
+/*
+ * The sources removed while dispatching the events of an iteration may still
+ * be referenced by the remaining events of this iteration, so they are freed
+ * at the end of it.
+ */
+struct wc_loop {
+	int epfd;
+	int stop;
+	int dispatching;
+	unsigned nwatched; /* number of watched descriptors and armed timers */
+	struct wc_epoll_source *ready;
+	struct wc_epoll_source **ready_tail;
+	struct wc_epoll_source *user;
+	struct wc_epoll_source *user_garbage;
+	struct wc_epoll_integration_data *dead;
+};
+
+static inline uint32_t _wc_epoll_events(short events) {
+	return ((events & WC_POLLIN) ? EPOLLIN | EPOLLRDHUP : 0)
+			| ((events & WC_POLLOUT) ? EPOLLOUT : 0);
+}
+
+static inline short _wc_poll_events(uint32_t events) {
+	return ((events & (EPOLLIN | EPOLLRDHUP)) ? POLLIN : 0)
+			| ((events & EPOLLOUT) ? POLLOUT : 0)
+			| ((events & EPOLLHUP) ? POLLHUP : 0)
+			| ((events & EPOLLERR) ? POLLERR : 0);
+}
+
+static void _wc_loop_ready_add(wc_loop_t *loop, struct wc_epoll_source *src) {
+	if (!src->ready) {
+		src->ready = 1;
+		src->next = NULL;
+		*loop->ready_tail = src;
+		loop->ready_tail = &src->next;
+	}
+}
+
+static void _wc_loop_ready_remove(wc_loop_t *loop, struct wc_epoll_source *src) {
+	struct wc_epoll_source **p;
+
+	if (!src->ready) {
+		return;
+	}
+	for (p = &loop->ready ; *p != NULL ; p = &(*p)->next) {
+		if (*p == src) {
+			*p = src->next;
+			if (loop->ready_tail == &src->next) {
+				loop->ready_tail = p;
+			}
+			break;
+		}
+	}
+	src->ready = 0;
+}
+
+static void _wc_loop_gc(wc_loop_t *loop) {
+	struct wc_epoll_integration_data *lid;
+	struct wc_epoll_source *src;
+
+	while ((lid = loop->dead) != NULL) {
+		loop->dead = lid->next_dead;
+		free(lid);
+	}
+	while ((src = loop->user_garbage) != NULL) {
+		loop->user_garbage = src->next;
+		free(src);
+	}
+}
+
+/*
+ * The datasync socket is watched in edge-triggered mode: it is serviced until
+ * it has nothing left to read, or its budget is exhausted (it is then put
+ * back in the ready list, so that the other sockets are not starved).
+ */
+static void _wc_loop_service_socket(wc_loop_t *loop, struct wc_epoll_source *src) {
+	struct wc_pollargs pa;
+	int pending, i;
+
+	pa.fd = src->fd;
+	pa.src = (enum wc_pollsrc)src->idx;
+	pa.events = _wc_poll_events(src->revents);
+	src->revents = 0;
+
+	for (i = 1 ; ; i++) {
+		wc_dispatch_fd_event(src->ctx, &pa);
+		if (src->fd != pa.fd || src->idx != WC_POLL_DATASYNC || !(pa.events & POLLIN)) {
+			break;
+		}
+		if (ioctl(pa.fd, FIONREAD, &pending) != 0 || pending <= 0) {
+			break;
+		}
+		if (i == WC_LOOP_SOCKET_BUDGET) {
+			src->revents |= EPOLLIN;
+			_wc_loop_ready_add(loop, src);
+			break;
+		}
+		pa.events = POLLIN;
+	}
+
+	if (src->fd != -1 && src->idx == WC_POLL_DATASYNC) {
+		/* the data libwebsockets has already read, e.g. decrypted TLS records */
+		wc_datasync_service_pending(src->ctx);
+	}
+}
+
+static void _wc_loop_service_timer(wc_loop_t *loop, struct wc_epoll_source *src) {
+	uint64_t expirations;
+
+	if (read(src->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+		/* spurious wakeup, e.g. the timer was re-armed in the meantime */
+		return;
+	}
+	if (!src->repeat) {
+		src->armed = 0;
+		loop->nwatched--;
+	}
+	wc_dispatch_timer_event(src->ctx, (enum wc_timersrc)src->idx);
+}
+
+int wc_loop_run_once(wc_loop_t *loop, int timeout_ms) {
+	struct epoll_event events[WC_LOOP_MAX_EVENTS];
+	struct wc_epoll_source *src, *ready;
+	int n, i, ret = 0;
+
+	n = epoll_wait(loop->epfd, events, WC_LOOP_MAX_EVENTS, loop->ready != NULL ? 0 : timeout_ms);
+	if (n < 0) {
+		return errno == EINTR ? 0 : -1;
+	}
+
+	loop->dispatching = 1;
+
+	for (i = 0 ; i < n ; i++) {
+		src = events[i].data.ptr;
+		if (src->fd == -1) {
+			continue;
+		}
+		switch (src->type) {
+		case WC_EPOLL_SOCKET:
+			/* serviced below, once all the events are known */
+			src->revents |= events[i].events;
+			_wc_loop_ready_add(loop, src);
+			break;
+		case WC_EPOLL_TIMER:
+			_wc_loop_service_timer(loop, src);
+			ret++;
+			break;
+		case WC_EPOLL_USER:
+			src->cb(loop, src->fd, _wc_poll_events(events[i].events), src->data);
+			ret++;
+			break;
+		}
+	}
+
+	ready = loop->ready;
+	loop->ready = NULL;
+	loop->ready_tail = &loop->ready;
+	while ((src = ready) != NULL) {
+		ready = src->next;
+		src->ready = 0;
+		if (src->fd != -1) {
+			_wc_loop_service_socket(loop, src);
+			ret++;
+		}
+	}
+
+	loop->dispatching = 0;
+	_wc_loop_gc(loop);
+
+	return ret;
+}
+
+int wc_loop_run(wc_loop_t *loop) {
+	loop->stop = 0;
+	while (!loop->stop && loop->nwatched > 0) {
+		if (wc_loop_run_once(loop, -1) < 0) {
+			WL_ERR("epoll_wait failed: %s", strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void wc_loop_break(wc_loop_t *loop) {
+	loop->stop = 1;
+}
+
+wc_loop_t *wc_loop_new(void) {
+	wc_loop_t *loop;
+
+	loop = calloc(1, sizeof(*loop));
+	if (loop == NULL) {
+		return NULL;
+	}
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd == -1) {
+		free(loop);
+		return NULL;
+	}
+	loop->ready_tail = &loop->ready;
+	return loop;
+}
+
+void wc_loop_destroy(wc_loop_t *loop) {
+	struct wc_epoll_source *src;
+
+	while ((src = loop->user) != NULL) {
+		loop->user = src->next;
+		free(src);
+	}
+	_wc_loop_gc(loop);
+	close(loop->epfd);
+	free(loop);
+}
+
+int wc_loop_add_fd(wc_loop_t *loop, int fd, short events, wc_loop_fd_cb_t cb, void *data) {
+	struct wc_epoll_source *src;
+	struct epoll_event ev;
+
+	src = calloc(1, sizeof(*src));
+	if (src == NULL) {
+		return -1;
+	}
+	src->type = WC_EPOLL_USER;
+	src->fd = fd;
+	src->cb = cb;
+	src->data = data;
+
+	ev.events = _wc_epoll_events(events);
+	ev.data.ptr = src;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		free(src);
+		return -1;
+	}
+	src->next = loop->user;
+	loop->user = src;
+	loop->nwatched++;
+	return 0;
+}
+
+int wc_loop_del_fd(wc_loop_t *loop, int fd) {
+	struct wc_epoll_source **p, *src;
+
+	for (p = &loop->user ; *p != NULL ; p = &(*p)->next) {
+		if ((*p)->fd == fd) {
+			src = *p;
+			*p = src->next;
+			epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+			loop->nwatched--;
+			src->fd = -1;
+			if (loop->dispatching) {
+				src->next = loop->user_garbage;
+				loop->user_garbage = src;
+			} else {
+				free(src);
+			}
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void _wc_epoll_watch(wc_context_t *ctx, struct wc_epoll_integration_data *lid, struct wc_pollargs *pa) {
+	struct wc_epoll_source *src = &lid->fds[pa->src];
+	struct epoll_event ev;
+	int op;
+
+	ev.events = _wc_epoll_events(pa->events) | (pa->src == WC_POLL_DATASYNC ? EPOLLET : 0);
+	ev.data.ptr = src;
+
+	if (src->fd != -1 && src->fd != pa->fd) {
+		/* the previous descriptor is not watched any more */
+		epoll_ctl(lid->loop->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+		src->fd = -1;
+		lid->loop->nwatched--;
+	}
+	op = src->fd == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+	if (epoll_ctl(lid->loop->epfd, op, pa->fd, &ev) == -1) {
+		op = op == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		if (epoll_ctl(lid->loop->epfd, op, pa->fd, &ev) == -1) {
+			WL_ERR("could not watch fd %d of context %p: %s", pa->fd, ctx, strerror(errno));
+			return;
+		}
+	}
+	if (src->fd == -1) {
+		src->fd = pa->fd;
+		lid->loop->nwatched++;
+	}
+}
+
+static void _wc_epoll_unwatch(struct wc_epoll_integration_data *lid, struct wc_epoll_source *src) {
+	if (src->fd != -1) {
+		epoll_ctl(lid->loop->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+		_wc_loop_ready_remove(lid->loop, src);
+		src->fd = -1;
+		src->revents = 0;
+		lid->loop->nwatched--;
+	}
+}
+
+static void _wc_epoll_set_timer(wc_context_t *ctx, struct wc_epoll_integration_data *lid, struct wc_timerargs *ta) {
+	struct wc_epoll_source *src = &lid->timers[ta->timer];
+	struct itimerspec its;
+	struct epoll_event ev;
+
+	if (src->fd == -1) {
+		src->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (src->fd == -1) {
+			WL_ERR("could not create a timer for context %p: %s", ctx, strerror(errno));
+			return;
+		}
+		ev.events = EPOLLIN;
+		ev.data.ptr = src;
+		epoll_ctl(lid->loop->epfd, EPOLL_CTL_ADD, src->fd, &ev);
+	}
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = ta->ms / 1000;
+	its.it_value.tv_nsec = (ta->ms % 1000) * 1000000;
+	if (ta->ms <= 0) {
+		/* a zero it_value would disarm the timer */
+		its.it_value.tv_sec = 0;
+		its.it_value.tv_nsec = 1;
+	}
+	if (ta->repeat) {
+		its.it_interval = its.it_value;
+	}
+	timerfd_settime(src->fd, 0, &its, NULL);
+
+	src->repeat = !!ta->repeat;
+	if (!src->armed) {
+		src->armed = 1;
+		lid->loop->nwatched++;
+	}
+}
+
+static void _wc_epoll_del_timer(struct wc_epoll_integration_data *lid, struct wc_epoll_source *src) {
+	struct itimerspec its;
+
+	if (src->armed) {
+		memset(&its, 0, sizeof(its));
+		timerfd_settime(src->fd, 0, &its, NULL);
+		src->armed = 0;
+		lid->loop->nwatched--;
+	}
+}
+
+static void _wc_epoll_cleanup(wc_context_t *ctx) {
+	struct wc_epoll_integration_data *lid = wc_context_get_user_data(ctx);
+	int i;
+
+	for (i = 0 ; i < _WC_POLL_MAX ; i++) {
+		_wc_epoll_unwatch(lid, &lid->fds[i]);
+	}
+	for (i = 0 ; i < _WC_TIMER_MAX ; i++) {
+		_wc_epoll_del_timer(lid, &lid->timers[i]);
+		if (lid->timers[i].fd != -1) {
+			close(lid->timers[i].fd);
+			lid->timers[i].fd = -1;
+		}
+	}
+
+	if (lid->loop->dispatching) {
+		lid->next_dead = lid->loop->dead;
+		lid->loop->dead = lid;
+	} else {
+		free(lid);
+	}
+}
+
+static int _wc_epoll_cb(wc_event_t event, wc_context_t *ctx, void *data, size_t len) {
+	struct wc_epoll_integration_data *lid = wc_context_get_user_data(ctx);
+	struct wc_pollargs *pollargs;
+	struct wc_auth_info* ai;
+	int ret = 0;
+
+	switch(event) {
+	case WC_EVENT_ADD_FD:
+	case WC_EVENT_MODIFY_FD:
+		pollargs = data;
+		_wc_epoll_watch(ctx, lid, pollargs);
+		break;
+	case WC_EVENT_DEL_FD:
+		pollargs = data;
+		_wc_epoll_unwatch(lid, &lid->fds[pollargs->src]);
+		break;
+	case WC_EVENT_ON_SERVER_HANDSHAKE:
+		CALLBACK_SAFE_VOID(lid->callbacks.on_connected, ctx);
+		break;
+	case WC_EVENT_ON_CNX_CLOSED:
+		ret = CALLBACK_SAFE_INT(lid->callbacks.on_disconnected, ctx);
+		break;
+	case WC_EVENT_ON_CNX_ERROR:
+		ret = CALLBACK_SAFE_INT(lid->callbacks.on_error, ctx, lid->next_try, data, len);
+		break;
+	case WC_EVENT_SET_TIMER:
+		_wc_epoll_set_timer(ctx, lid, data);
+		break;
+	case WC_EVENT_DEL_TIMER:
+		_wc_epoll_del_timer(lid, &lid->timers[*((enum wc_timersrc *)data)]);
+		break;
+	case WC_AUTH_ON_AUTH_REPLY:
+		ai = data;
+		if (ai->error) {
+			CALLBACK_SAFE_VOID(lid->callbacks.on_auth_error, ctx, ai->error);
+		} else {
+			CALLBACK_SAFE_VOID(lid->callbacks.on_auth_success, ctx, ai);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return ret;
+}
+
+wc_context_t *wc_context_create_with_epoll(struct wc_context_options *options, wc_loop_t *loop, struct wc_eli_callbacks *callbacks) {
+	struct wc_epoll_integration_data *integration_data;
+	wc_context_t *ret = NULL;
+	struct wc_context_options epoll_options;
+	int i;
+
+	integration_data = calloc(1, sizeof *integration_data);
+	if (integration_data == NULL) {
+		return NULL;
+	}
+
+	integration_data->callbacks = *callbacks;
+	integration_data->loop = loop;
+	for (i = 0 ; i < _WC_POLL_MAX ; i++) {
+		integration_data->fds[i].type = WC_EPOLL_SOCKET;
+		integration_data->fds[i].fd = -1;
+		integration_data->fds[i].idx = i;
+	}
+	for (i = 0 ; i < _WC_TIMER_MAX ; i++) {
+		integration_data->timers[i].type = WC_EPOLL_TIMER;
+		integration_data->timers[i].fd = -1;
+		integration_data->timers[i].idx = i;
+	}
+
+	epoll_options = *options;
+	epoll_options.callback = _wc_epoll_cb;
+	epoll_options.user_data = integration_data;
+
+	ret = wc_context_create(&epoll_options);
+
+	if (ret == NULL) {
+		free(integration_data);
+	} else {
+		for (i = 0 ; i < _WC_POLL_MAX ; i++) {
+			integration_data->fds[i].ctx = ret;
+		}
+		for (i = 0 ; i < _WC_TIMER_MAX ; i++) {
+			integration_data->timers[i].ctx = ret;
+		}
+		ret->eli_cleanup = _wc_epoll_cleanup;
+	}
+
+	return ret;
+}
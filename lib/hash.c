@@ -83,3 +83,15 @@ wc_hash_t wc_str_path_hash(char *path) {
 	}
 	return hash;
 }
+
+/* 32 bits FNV-1a hash of a binary buffer, start with WC_FNV1A_32_INIT */
+uint32_t wc_fnv1a_32_update(const void *buf, size_t len, uint32_t hash) {
+	const unsigned char *p = buf;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x01000193u;
+	}
+
+	return hash;
+}
@@ -23,6 +23,9 @@
 #ifndef LIB_HASH_H_
 #define LIB_HASH_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef unsigned long wc_hash_t;
 
 
@@ -33,4 +36,7 @@ wc_hash_t wc_ap_hash(char* str);
 wc_hash_t wc_str_path_hash_update(unsigned char **str, wc_hash_t hash);
 wc_hash_t wc_str_path_hash(char *path);
 
+#define WC_FNV1A_32_INIT 0x811c9dc5u
+uint32_t wc_fnv1a_32_update(const void *buf, size_t len, uint32_t hash);
+
 #endif /* LIB_HASH_H_ */
@@ -128,6 +128,9 @@ int _wc_libev_cb (wc_event_t event, wc_context_t *ctx, void *data, size_t len) {
 	case WC_EVENT_SET_TIMER:
 		timerargs = data;
 		timer = &lid->timer_events[timerargs->timer];
+		if (ev_is_active(timer)) {
+			ev_timer_stop(lid->loop, timer);
+		}
 		in = ((ev_tstamp)timerargs->ms) / 1000.;
 		repeat = timerargs->repeat ? in : 0.;
 #pragma GCC diagnostic push
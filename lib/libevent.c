@@ -20,141 +20,158 @@
  *
  */
 #include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <webcom-c/webcom-datasync.h>
 
 #include "webcom-c/webcom-libevent.h"
 #include "webcom-c/webcom-utils.h"
 #include "webcom-c/webcom-log.h"
 
+#include "event_libs_priv.h"
+
+struct wc_libevent_watcher {
+	struct event ev;
+	wc_context_t *ctx;
+	int idx;
+	unsigned added:1;
+};
+
 struct wc_libevent_integration_data {
 	struct event_base *loop;
 	struct wc_eli_callbacks callbacks;
-	struct event con_watcher;
-	struct event ka_timer;
-	struct event recon_timer;
+	struct wc_libevent_watcher fd_watcher[_WC_POLL_MAX];
+	struct wc_libevent_watcher timer_events[_WC_TIMER_MAX];
 	unsigned next_try;
 };
 
-static inline void _wc_on_fd_event_libevent_cb (
-		UNUSED_PARAM(evutil_socket_t fd),
-		UNUSED_PARAM(short revents),
+static void _wc_on_fd_event_libevent_cb (
+		evutil_socket_t fd,
+		short revents,
 		void *data)
 {
-
-	wc_context_t *ctx = data;
-	wc_dispatch_fd_event(ctx, fd,
-			((revents&EV_READ) ? POLLIN : 0)
-					| ((revents&EV_WRITE) ? POLLOUT : 0)
-					);
+	struct wc_libevent_watcher *watcher = data;
+	struct wc_pollargs pa;
+
+	pa.fd = fd;
+	pa.events = ((revents&EV_READ) ? POLLIN : 0)
+			| ((revents&EV_WRITE) ? POLLOUT : 0);
+	pa.src = watcher->idx;
+	wc_dispatch_fd_event(watcher->ctx, &pa);
 }
 
-static inline void _wc_on_ka_timer_libevent_cb (
+static void _wc_on_timer_libevent_cb (
 		UNUSED_PARAM(evutil_socket_t fd),
 		UNUSED_PARAM(short revents),
 		void *data)
 {
-	wc_context_t *ctx = data;
-	wc_datasync_keepalive(ctx);
+	struct wc_libevent_watcher *watcher = data;
+
+	watcher->added = 0;
+	wc_dispatch_timer_event(watcher->ctx, watcher->idx);
 }
 
-static inline void _wc_on_recon_timer_libevent_cb (
-		UNUSED_PARAM(evutil_socket_t fd),
-		UNUSED_PARAM(short revents),
-		void *data)
-{
-	wc_context_t *ctx = data;
+static void _wc_libevent_watcher_del(struct wc_libevent_watcher *watcher) {
+	if (watcher->added) {
+		event_del(&watcher->ev);
+		watcher->added = 0;
+	}
+}
 
-	W_DBG(WC_LOG_CONNECTION, "reconnect callback triggered for context %p", ctx);
-	wc_datasync_connect(ctx);
+static void _wc_libevent_fd_watch(wc_context_t *ctx, struct wc_libevent_integration_data *lid, struct wc_pollargs *pollargs) {
+	struct wc_libevent_watcher *watcher = &lid->fd_watcher[pollargs->src];
+
+	_wc_libevent_watcher_del(watcher);
+	watcher->ctx = ctx;
+	watcher->idx = pollargs->src;
+	event_assign(&watcher->ev, lid->loop, pollargs->fd,
+			((pollargs->events & (WC_POLLIN | WC_POLLHUP)) ? EV_READ : 0)
+				| ((pollargs->events & WC_POLLOUT) ? EV_WRITE : 0)
+				| EV_PERSIST,
+			_wc_on_fd_event_libevent_cb, watcher);
+	event_add(&watcher->ev, NULL);
+	watcher->added = 1;
 }
 
-static void _wc_libevent_cb (wc_event_t event, wc_context_t *ctx, void *data, UNUSED_PARAM(size_t len)) {
+static int _wc_libevent_cb (wc_event_t event, wc_context_t *ctx, void *data, size_t len) {
 	struct wc_libevent_integration_data *lid = wc_context_get_user_data(ctx);
 	struct wc_pollargs *pollargs;
+	struct wc_timerargs *timerargs;
+	struct wc_libevent_watcher *timer;
 	struct timeval tv;
-	int reconnect = 0;
+	struct wc_auth_info* ai;
+	int ret = 0;
 
 	switch(event) {
 	case WC_EVENT_ADD_FD:
-		pollargs = data;
-		event_assign(&lid->con_watcher, lid->loop, pollargs->fd,
-				((pollargs->events & (WC_POLLIN | WC_POLLHUP)) ? EV_READ : 0)
-					| ((pollargs->events & WC_POLLOUT) ? EV_WRITE : 0)
-					| EV_PERSIST,
-				_wc_on_fd_event_libevent_cb, ctx);
-		event_add(&lid->con_watcher, NULL);
+	case WC_EVENT_MODIFY_FD:
+		_wc_libevent_fd_watch(ctx, lid, data);
 		break;
 
 	case WC_EVENT_DEL_FD:
-		event_del(&lid->con_watcher);
-		break;
-
-	case WC_EVENT_MODIFY_FD:
 		pollargs = data;
-		event_del(&lid->con_watcher);
-		event_assign(&lid->con_watcher, lid->loop, pollargs->fd,
-				((pollargs->events & (WC_POLLIN | WC_POLLHUP)) ? EV_READ : 0)
-					| ((pollargs->events & WC_POLLOUT) ? EV_WRITE : 0)
-					| EV_PERSIST,
-				_wc_on_fd_event_libevent_cb, ctx);
-		event_add(&lid->con_watcher, NULL);
+		_wc_libevent_watcher_del(&lid->fd_watcher[pollargs->src]);
 		break;
 
 	case WC_EVENT_ON_SERVER_HANDSHAKE:
-		tv.tv_sec = 50;
-		tv.tv_usec = 0;
-		event_assign(&lid->ka_timer, lid->loop, -1, EV_PERSIST, _wc_on_ka_timer_libevent_cb, ctx);
-		event_add(&lid->ka_timer, &tv);
-		if (lid->next_try) {
-			event_del(&lid->recon_timer);
-			lid->next_try = 0;
-		}
-		lid->callbacks.on_connected(ctx);
+		CALLBACK_SAFE_VOID(lid->callbacks.on_connected, ctx);
 		break;
 	case WC_EVENT_ON_CNX_CLOSED:
-		event_del(&lid->ka_timer);
-		reconnect = lid->callbacks.on_disconnected(ctx);
+		ret = CALLBACK_SAFE_INT(lid->callbacks.on_disconnected, ctx);
 		break;
 	case WC_EVENT_ON_CNX_ERROR:
-		reconnect = lid->callbacks.on_error(ctx, lid->next_try, data, len);
+		ret = CALLBACK_SAFE_INT(lid->callbacks.on_error, ctx, lid->next_try, data, len);
+		break;
+	case WC_EVENT_SET_TIMER:
+		timerargs = data;
+		timer = &lid->timer_events[timerargs->timer];
+		_wc_libevent_watcher_del(timer);
+		timer->ctx = ctx;
+		timer->idx = timerargs->timer;
+		tv.tv_sec = timerargs->ms / 1000;
+		tv.tv_usec = (timerargs->ms % 1000) * 1000;
+		event_assign(&timer->ev, lid->loop, -1, timerargs->repeat ? EV_PERSIST : 0,
+				_wc_on_timer_libevent_cb, timer);
+		event_add(&timer->ev, &tv);
+		timer->added = 1;
+		break;
+	case WC_EVENT_DEL_TIMER:
+		_wc_libevent_watcher_del(&lid->timer_events[*((enum wc_timersrc *)data)]);
+		break;
+	case WC_AUTH_ON_AUTH_REPLY:
+		ai = data;
+		if (ai->error) {
+			CALLBACK_SAFE_VOID(lid->callbacks.on_auth_error, ctx, ai->error);
+		} else {
+			CALLBACK_SAFE_VOID(lid->callbacks.on_auth_success, ctx, ai);
+		}
 		break;
 	default:
 		break;
 	}
 
-	if (reconnect) {
-		tv.tv_sec = lid->next_try;
-		tv.tv_usec = 0;
-
-		if (lid->next_try == 0) {
-			lid->next_try = 1;
-		} else if (lid->next_try < 128) {
-			lid->next_try <<= 1;
-		}
-
-		event_assign(&lid->recon_timer, lid->loop, -1, 0 , _wc_on_recon_timer_libevent_cb, ctx);
-		event_add(&lid->recon_timer, &tv);
-		W_DBG(WC_LOG_CONNECTION, "automatic reconnection attempt in %ld sec", (long)tv.tv_sec);
-	} else {
-		if (lid->next_try != 0) {
-			lid->next_try = 0;
-		}
-	}
+	return ret;
 }
 
-wc_context_t *wc_context_new_with_libevent(char *host, uint16_t port, char *application, struct event_base *loop, struct wc_eli_callbacks *callbacks) {
+wc_context_t *wc_context_create_with_libevent(struct wc_context_options *options, struct event_base *loop, struct wc_eli_callbacks *callbacks) {
 	struct wc_libevent_integration_data *integration_data;
 	wc_context_t *ret = NULL;
 
-	integration_data = malloc(sizeof *integration_data);
+	struct wc_context_options ev_options;
+
+	integration_data = calloc(1, sizeof *integration_data);
 	if (integration_data == NULL) {
 		return NULL;
 	}
 
 	integration_data->callbacks = *callbacks;
 	integration_data->loop = loop;
-	integration_data->next_try = 0;
 
-	ret = wc_datasync_init(host, port, application, _wc_libevent_cb, integration_data);
+	ev_options = *options;
+	ev_options.callback = _wc_libevent_cb;
+	ev_options.user_data = integration_data;
+
+	ret = wc_context_create(&ev_options);
 
 	if (ret == NULL) {
 		free(integration_data);
@@ -162,3 +179,14 @@ wc_context_t *wc_context_new_with_libevent(char *host, uint16_t port, char *appl
 
 	return ret;
 }
+
+wc_context_t *wc_context_new_with_libevent(char *host, uint16_t port, char *application, struct event_base *loop, struct wc_eli_callbacks *callbacks) {
+	struct wc_context_options options;
+
+	memset(&options, 0, sizeof(options));
+	options.host = host;
+	options.port = port;
+	options.app_name = application;
+
+	return wc_context_create_with_libevent(&options, loop, callbacks);
+}
@@ -22,11 +22,16 @@
 
 
 #include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <webcom-c/webcom-datasync.h>
 
 #include "webcom-c/webcom-libuv.h"
 #include "webcom-c/webcom-utils.h"
 #include "webcom-c/webcom-log.h"
 
+#include "event_libs_priv.h"
+
 #if UV_VERSION_HEX < 0x010900
 /* UV_DISCONNECT was introduced in libuv 1.9.0, fallback to UV_READABLE */
 # define UV_DISCONNECT UV_READABLE
@@ -35,127 +40,136 @@
 struct wc_libuv_integration_data {
 	uv_loop_t *loop;
 	struct wc_eli_callbacks callbacks;
-	uv_poll_t con_watcher;
-	uv_timer_t ka_timer;
-	uv_timer_t recon_timer;
+	uv_poll_t fd_watcher[_WC_POLL_MAX];
+	uv_timer_t timer_events[_WC_TIMER_MAX];
+	unsigned timers_init:1;
 	unsigned next_try;
 };
 
-static inline void _wc_on_fd_event_libuv_cb (
+static void _wc_on_fd_event_libuv_cb (
 		uv_poll_t* handle,
 		UNUSED_PARAM(int status),
 		int events)
 {
 	wc_context_t *ctx = handle->data;
-	int fd;
+	struct wc_libuv_integration_data *lid = wc_context_get_user_data(ctx);
+	struct wc_pollargs pa;
 
-	if (uv_fileno((uv_handle_t*)handle, &fd) == 0) {
-		wc_dispatch_fd_event(ctx, fd,
-				((events&UV_READABLE) ? POLLIN : 0)
+	if (uv_fileno((uv_handle_t*)handle, &pa.fd) == 0) {
+		pa.events = ((events&UV_READABLE) ? POLLIN : 0)
 				| ((events&UV_WRITABLE) ? POLLOUT : 0)
-				| ((events&UV_DISCONNECT) ? POLLIN : 0)
-		);
+				| ((events&UV_DISCONNECT) ? POLLIN : 0);
+		pa.src = handle - lid->fd_watcher;
+		wc_dispatch_fd_event(ctx, &pa);
 	}
 }
 
-static inline void _wc_on_ka_timer_libuv_cb (uv_timer_t *handle) {
+static void _wc_on_timer_libuv_cb (uv_timer_t *handle) {
 	wc_context_t *ctx = handle->data;
-	wc_datasync_keepalive(ctx);
+	struct wc_libuv_integration_data *lid = wc_context_get_user_data(ctx);
+	enum wc_timersrc timer = handle - lid->timer_events;
+
+	wc_dispatch_timer_event(ctx, timer);
 }
 
-static inline void _wc_on_recon_timer_libuv_cb (uv_timer_t *handle) {
-	wc_context_t *ctx = handle->data;
-	W_DBG(WC_LOG_CONNECTION, "reconnect callback triggered for context %p", ctx);
-	uv_timer_stop(handle);
-	wc_datasync_connect(ctx);
+static inline int _wc_libuv_events(int events) {
+	return ((events & WC_POLLIN) ? UV_READABLE : 0)
+			| ((events & WC_POLLOUT) ? UV_WRITABLE : 0)
+			| ((events & WC_POLLHUP) ? UV_DISCONNECT : 0);
 }
 
-static void _wc_libuv_cb (wc_event_t event, wc_context_t *ctx, void *data, UNUSED_PARAM(size_t len)) {
+static int _wc_libuv_cb (wc_event_t event, wc_context_t *ctx, void *data, size_t len) {
 	struct wc_libuv_integration_data *lid = wc_context_get_user_data(ctx);
 	struct wc_pollargs *pollargs;
-	int reconnect = 0;
+	struct wc_timerargs *timerargs;
+	uv_poll_t *watcher;
+	uv_timer_t *timer;
+	int i;
+	struct wc_auth_info* ai;
+	int ret = 0;
 
 	switch(event) {
 	case WC_EVENT_ADD_FD:
 		pollargs = data;
-		uv_poll_init(lid->loop, &lid->con_watcher, pollargs->fd);
-		lid->con_watcher.data = ctx;
-		uv_poll_start(&lid->con_watcher,
-				((pollargs->events & WC_POLLIN) ? UV_READABLE : 0)
-					| ((pollargs->events & WC_POLLOUT) ? UV_WRITABLE : 0)
-					| ((pollargs->events & WC_POLLHUP) ? UV_DISCONNECT : 0),
-				_wc_on_fd_event_libuv_cb);
+		watcher = &lid->fd_watcher[pollargs->src];
+		uv_poll_init(lid->loop, watcher, pollargs->fd);
+		watcher->data = ctx;
+		uv_poll_start(watcher, _wc_libuv_events(pollargs->events), _wc_on_fd_event_libuv_cb);
 		break;
 
 	case WC_EVENT_DEL_FD:
-		uv_poll_stop(&lid->con_watcher);
+		pollargs = data;
+		uv_poll_stop(&lid->fd_watcher[pollargs->src]);
 		break;
 
 	case WC_EVENT_MODIFY_FD:
 		pollargs = data;
-		uv_poll_start(&lid->con_watcher,
-				((pollargs->events & WC_POLLIN) ? UV_READABLE : 0)
-					| ((pollargs->events & WC_POLLOUT) ? UV_WRITABLE : 0)
-					| ((pollargs->events & WC_POLLHUP) ? UV_DISCONNECT : 0),
-				_wc_on_fd_event_libuv_cb);
+		watcher = &lid->fd_watcher[pollargs->src];
+		uv_poll_start(watcher, _wc_libuv_events(pollargs->events), _wc_on_fd_event_libuv_cb);
 		break;
 
 	case WC_EVENT_ON_SERVER_HANDSHAKE:
-		uv_timer_init(lid->loop, &lid->ka_timer);
-		lid->ka_timer.data = ctx;
-		uv_timer_start(&lid->ka_timer, _wc_on_ka_timer_libuv_cb, 50000, 50000);
-		if (lid->next_try) {
-			uv_timer_stop(&lid->recon_timer);
-			lid->next_try = 0;
-		}
-		lid->callbacks.on_connected(ctx);
+		CALLBACK_SAFE_VOID(lid->callbacks.on_connected, ctx);
 		break;
 
 	case WC_EVENT_ON_CNX_CLOSED:
-		uv_timer_stop(&lid->ka_timer);
-		reconnect = lid->callbacks.on_disconnected(ctx);
+		ret = CALLBACK_SAFE_INT(lid->callbacks.on_disconnected, ctx);
 		break;
 	case WC_EVENT_ON_CNX_ERROR:
-		reconnect = lid->callbacks.on_error(ctx, lid->next_try, data, len);
+		ret = CALLBACK_SAFE_INT(lid->callbacks.on_error, ctx, lid->next_try, data, len);
 		break;
-	default:
+	case WC_EVENT_SET_TIMER:
+		timerargs = data;
+		if (!lid->timers_init) {
+			for (i = 0 ; i < _WC_TIMER_MAX ; i++) {
+				uv_timer_init(lid->loop, &lid->timer_events[i]);
+				lid->timer_events[i].data = ctx;
+			}
+			lid->timers_init = 1;
+		}
+		timer = &lid->timer_events[timerargs->timer];
+		/* uv_timer_start() re-arms an active timer */
+		uv_timer_start(timer, _wc_on_timer_libuv_cb, timerargs->ms, timerargs->repeat ? timerargs->ms : 0);
 		break;
-	}
-
-	if (reconnect) {
-		uint64_t in = 1000 * lid->next_try;
-
-		if (lid->next_try == 0) {
-			lid->next_try = 1;
-		} else if (lid->next_try < 128) {
-			lid->next_try <<= 1;
+	case WC_EVENT_DEL_TIMER:
+		if (lid->timers_init) {
+			uv_timer_stop(&lid->timer_events[*((enum wc_timersrc *)data)]);
 		}
-
-		uv_timer_init(lid->loop, &lid->recon_timer);
-		lid->recon_timer.data = ctx;
-		uv_timer_start(&lid->recon_timer, _wc_on_recon_timer_libuv_cb, in, 0);
-		W_DBG(WC_LOG_CONNECTION, "automatic reconnection attempt in %lu millisec", (unsigned long)in);
-	} else {
-		if (lid->next_try != 0) {
-			lid->next_try = 0;
+		break;
+	case WC_AUTH_ON_AUTH_REPLY:
+		ai = data;
+		if (ai->error) {
+			CALLBACK_SAFE_VOID(lid->callbacks.on_auth_error, ctx, ai->error);
+		} else {
+			CALLBACK_SAFE_VOID(lid->callbacks.on_auth_success, ctx, ai);
 		}
+		break;
+	default:
+		break;
 	}
+
+	return ret;
 }
 
-wc_context_t *wc_context_new_with_libuv(char *host, uint16_t port, char *application, uv_loop_t *loop, struct wc_eli_callbacks *callbacks) {
+wc_context_t *wc_context_create_with_libuv(struct wc_context_options *options, uv_loop_t *loop, struct wc_eli_callbacks *callbacks) {
 	struct wc_libuv_integration_data *integration_data;
 	wc_context_t *ret = NULL;
 
-	integration_data = malloc(sizeof *integration_data);
+	struct wc_context_options uv_options;
+
+	integration_data = calloc(1, sizeof *integration_data);
 	if (integration_data == NULL) {
 		return NULL;
 	}
 
 	integration_data->callbacks = *callbacks;
 	integration_data->loop = loop;
-	integration_data->next_try = 0;
 
-	ret = wc_datasync_init(host, port, application, _wc_libuv_cb, integration_data);
+	uv_options = *options;
+	uv_options.callback = _wc_libuv_cb;
+	uv_options.user_data = integration_data;
+
+	ret = wc_context_create(&uv_options);
 
 	if (ret == NULL) {
 		free(integration_data);
@@ -163,3 +177,14 @@ wc_context_t *wc_context_new_with_libuv(char *host, uint16_t port, char *applica
 
 	return ret;
 }
+
+wc_context_t *wc_context_new_with_libuv(char *host, uint16_t port, char *application, uv_loop_t *loop, struct wc_eli_callbacks *callbacks) {
+	struct wc_context_options options;
+
+	memset(&options, 0, sizeof(options));
+	options.host = host;
+	options.port = port;
+	options.app_name = application;
+
+	return wc_context_create_with_libuv(&options, loop, callbacks);
+}
@@ -0,0 +1,452 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#define _GNU_SOURCE /* pthread_setaffinity_np() */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+
+#include "webcom_base_priv.h"
+#include "webcom-c/webcom-runtime.h"
+#include "webcom-c/webcom-datasync.h"
+#include "webcom-c/webcom-log.h"
+#include "webcom-c/webcom-utils.h"
+
+#include "collection/mpsc.h"
+
+/* max number of jobs executed per wake up of a shard, before it gets back to
+ * its other events */
+#define WC_RUNTIME_JOB_BUDGET 256
+
+enum wc_rt_job_type {
+	WC_RT_JOB_CREATE,
+	WC_RT_JOB_DESTROY,
+	WC_RT_JOB_CALL,
+	WC_RT_JOB_PUT,
+	WC_RT_JOB_MERGE,
+	WC_RT_JOB_ON,
+	WC_RT_JOB_STOP,
+};
+
+struct wc_rt_create {
+	struct wc_context_options *options;
+	struct wc_eli_callbacks *callbacks;
+	wc_context_t *ret;
+	sem_t done;
+};
+
+struct wc_rt_job {
+	struct mpsc_node node; /* keep first */
+	enum wc_rt_job_type type;
+	wc_context_t *ctx;
+	union {
+		struct wc_rt_create *create;
+		struct {
+			wc_runtime_call_f fn;
+			void *data;
+		} call;
+		struct {
+			wc_on_req_result_t cb;
+			void *user;
+			char *json;
+		} req;
+		struct {
+			enum on_event_type type;
+			on_callback_f cb;
+		} on;
+	} u;
+	char path[]; /* followed by the JSON data, for put and merge */
+};
+
+struct wc_shard {
+	struct wc_runtime *rt;
+	unsigned idx;
+	pthread_t thread;
+	wc_loop_t *loop;
+	int efd;
+	int wake_pending;          /* the eventfd was written and not read yet */
+	struct mpsc_queue jobs;
+	wc_context_t **ctx;        /* the contexts of this shard */
+	unsigned nctx;
+	unsigned ctx_size;
+};
+
+struct wc_runtime {
+	unsigned nshards;
+	unsigned next_shard;       /* round robin assignment of the new contexts */
+	struct wc_shard shards[];
+};
+
+static __thread struct wc_shard *wc_current_shard = NULL;
+
+static void _wc_shard_wake(struct wc_shard *shard) {
+	uint64_t one = 1;
+
+	/* only one write is needed until the shard reads the eventfd */
+	if (!__atomic_exchange_n(&shard->wake_pending, 1, __ATOMIC_ACQ_REL)) {
+		while (write(shard->efd, &one, sizeof(one)) == -1 && errno == EINTR);
+	}
+}
+
+static void _wc_shard_submit(struct wc_shard *shard, struct wc_rt_job *job) {
+	mpsc_push(&shard->jobs, &job->node);
+	_wc_shard_wake(shard);
+}
+
+static struct wc_rt_job *_wc_rt_job_new(enum wc_rt_job_type type, wc_context_t *ctx, const char *path, const char *json) {
+	struct wc_rt_job *job;
+	size_t path_len = path != NULL ? strlen(path) + 1 : 0;
+	size_t json_len = json != NULL ? strlen(json) + 1 : 0;
+
+	job = malloc(sizeof(*job) + path_len + json_len);
+	if (job == NULL) {
+		return NULL;
+	}
+	job->type = type;
+	job->ctx = ctx;
+	if (path != NULL) {
+		memcpy(job->path, path, path_len);
+	}
+	if (json != NULL) {
+		job->u.req.json = job->path + path_len;
+		memcpy(job->u.req.json, json, json_len);
+	}
+	return job;
+}
+
+static void _wc_shard_attach(struct wc_shard *shard, wc_context_t *ctx) {
+	wc_context_t **tmp;
+
+	if (shard->nctx == shard->ctx_size) {
+		tmp = realloc(shard->ctx, (shard->ctx_size ? 2 * shard->ctx_size : 16) * sizeof(*tmp));
+		if (tmp == NULL) {
+			WL_ERR("shard %u: could not keep track of context %p", shard->idx, ctx);
+			return;
+		}
+		shard->ctx = tmp;
+		shard->ctx_size = shard->ctx_size ? 2 * shard->ctx_size : 16;
+	}
+	shard->ctx[shard->nctx++] = ctx;
+}
+
+static void _wc_shard_detach(struct wc_shard *shard, wc_context_t *ctx) {
+	unsigned i;
+
+	for (i = 0 ; i < shard->nctx ; i++) {
+		if (shard->ctx[i] == ctx) {
+			shard->ctx[i] = shard->ctx[--shard->nctx];
+			break;
+		}
+	}
+}
+
+static int _wc_shard_run_job(struct wc_shard *shard, struct wc_rt_job *job) {
+	wc_context_t *ctx = job->ctx;
+
+	switch (job->type) {
+	case WC_RT_JOB_CREATE:
+		ctx = wc_context_create_with_epoll(job->u.create->options, shard->loop, job->u.create->callbacks);
+		if (ctx != NULL) {
+			ctx->shard = shard;
+			_wc_shard_attach(shard, ctx);
+		}
+		job->u.create->ret = ctx;
+		sem_post(&job->u.create->done);
+		break;
+	case WC_RT_JOB_DESTROY:
+		_wc_shard_detach(shard, ctx);
+		wc_context_destroy(ctx);
+		break;
+	case WC_RT_JOB_CALL:
+		job->u.call.fn(ctx, job->u.call.data);
+		break;
+	case WC_RT_JOB_PUT:
+		if (wc_datasync_put(ctx, job->path, job->u.req.json, job->u.req.cb, job->u.req.user) == -1
+				&& job->u.req.cb != NULL) {
+			job->u.req.cb(ctx, -1, WC_ACTION_PUT, WC_REQ_ERROR, WC_REQ_REASON_NOT_SENT, NULL, job->u.req.user);
+		}
+		break;
+	case WC_RT_JOB_MERGE:
+		if (wc_datasync_merge(ctx, job->path, job->u.req.json, job->u.req.cb, job->u.req.user) == -1
+				&& job->u.req.cb != NULL) {
+			job->u.req.cb(ctx, -1, WC_ACTION_MERGE, WC_REQ_ERROR, WC_REQ_REASON_NOT_SENT, NULL, job->u.req.user);
+		}
+		break;
+	case WC_RT_JOB_ON:
+		switch (job->u.on.type) {
+		case ON_VALUE:
+			wc_datasync_on_value(ctx, job->path, job->u.on.cb);
+			break;
+		case ON_CHILD_ADDED:
+			wc_datasync_on_child_added(ctx, job->path, job->u.on.cb);
+			break;
+		case ON_CHILD_CHANGED:
+			wc_datasync_on_child_changed(ctx, job->path, job->u.on.cb);
+			break;
+		case ON_CHILD_REMOVED:
+			wc_datasync_on_child_removed(ctx, job->path, job->u.on.cb);
+			break;
+		}
+		break;
+	case WC_RT_JOB_STOP:
+		while (shard->nctx > 0) {
+			wc_context_destroy(shard->ctx[--shard->nctx]);
+		}
+		wc_loop_del_fd(shard->loop, shard->efd);
+		wc_loop_break(shard->loop);
+		return 1;
+	}
+	return 0;
+}
+
+static void _wc_shard_on_wake(UNUSED_PARAM(wc_loop_t *loop), int fd, UNUSED_PARAM(short events), void *data) {
+	struct wc_shard *shard = data;
+	struct mpsc_node *n;
+	uint64_t val;
+	unsigned budget = WC_RUNTIME_JOB_BUDGET;
+	int stop = 0;
+
+	while (read(fd, &val, sizeof(val)) == -1 && errno == EINTR);
+	/* the jobs pushed from now on will wake the shard again */
+	__atomic_store_n(&shard->wake_pending, 0, __ATOMIC_SEQ_CST);
+
+	while (!stop && budget > 0 && (n = mpsc_pop(&shard->jobs)) != NULL) {
+		stop = _wc_shard_run_job(shard, (struct wc_rt_job *)n);
+		free(n);
+		budget--;
+	}
+
+	if (!stop && budget == 0) {
+		/* more jobs may be waiting: get back to them on the next iteration */
+		_wc_shard_wake(shard);
+	}
+}
+
+static void _wc_shard_pin(struct wc_shard *shard) {
+	cpu_set_t allowed, cpu;
+	unsigned i, n = 0;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+		return;
+	}
+	/* shard #i runs on the i-th core the process is allowed to use */
+	for (i = 0 ; i < CPU_SETSIZE ; i++) {
+		if (CPU_ISSET(i, &allowed) && n++ == shard->idx % CPU_COUNT(&allowed)) {
+			CPU_ZERO(&cpu);
+			CPU_SET(i, &cpu);
+			if (pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu) != 0) {
+				WL_WARN("could not pin shard %u to CPU %u", shard->idx, i);
+			}
+			return;
+		}
+	}
+}
+
+static void *_wc_shard_main(void *data) {
+	struct wc_shard *shard = data;
+
+	wc_current_shard = shard;
+	_wc_shard_pin(shard);
+
+	wc_loop_run(shard->loop);
+
+	return NULL;
+}
+
+static void _wc_shard_cleanup(struct wc_shard *shard) {
+	struct mpsc_node *n;
+
+	while ((n = mpsc_pop(&shard->jobs)) != NULL) {
+		free(n);
+	}
+	free(shard->ctx);
+	if (shard->loop != NULL) {
+		wc_loop_destroy(shard->loop);
+	}
+	if (shard->efd != -1) {
+		close(shard->efd);
+	}
+}
+
+wc_runtime_t *wc_runtime_new(unsigned nshards) {
+	wc_runtime_t *rt;
+	struct wc_shard *shard;
+	unsigned i;
+	long ncpus;
+
+	if (nshards == 0) {
+		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nshards = ncpus > 0 ? (unsigned)ncpus : 1;
+	}
+
+	rt = calloc(1, sizeof(*rt) + nshards * sizeof(*rt->shards));
+	if (rt == NULL) {
+		return NULL;
+	}
+	rt->nshards = nshards;
+
+	for (i = 0 ; i < nshards ; i++) {
+		shard = &rt->shards[i];
+		shard->rt = rt;
+		shard->idx = i;
+		mpsc_init(&shard->jobs);
+		shard->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		shard->loop = wc_loop_new();
+		if (shard->efd == -1 || shard->loop == NULL
+				|| wc_loop_add_fd(shard->loop, shard->efd, WC_POLLIN, _wc_shard_on_wake, shard) == -1
+				|| pthread_create(&shard->thread, NULL, _wc_shard_main, shard) != 0) {
+			WL_ERR("could not start shard %u of the runtime", i);
+			_wc_shard_cleanup(shard);
+			rt->nshards = i;
+			wc_runtime_destroy(rt);
+			return NULL;
+		}
+	}
+
+	return rt;
+}
+
+void wc_runtime_destroy(wc_runtime_t *rt) {
+	struct wc_rt_job *job;
+	unsigned i;
+
+	for (i = 0 ; i < rt->nshards ; i++) {
+		job = _wc_rt_job_new(WC_RT_JOB_STOP, NULL, NULL, NULL);
+		if (job != NULL) {
+			_wc_shard_submit(&rt->shards[i], job);
+		}
+	}
+	for (i = 0 ; i < rt->nshards ; i++) {
+		pthread_join(rt->shards[i].thread, NULL);
+		_wc_shard_cleanup(&rt->shards[i]);
+	}
+	free(rt);
+}
+
+unsigned wc_runtime_shard_count(wc_runtime_t *rt) {
+	return rt->nshards;
+}
+
+wc_context_t *wc_runtime_context_create(wc_runtime_t *rt, struct wc_context_options *options, struct wc_eli_callbacks *callbacks) {
+	struct wc_shard *shard;
+	struct wc_rt_create create;
+	struct wc_rt_job *job;
+	unsigned idx;
+
+	idx = __atomic_fetch_add(&rt->next_shard, 1, __ATOMIC_RELAXED) % rt->nshards;
+	shard = &rt->shards[idx];
+
+	create.options = options;
+	create.callbacks = callbacks;
+	create.ret = NULL;
+
+	if (sem_init(&create.done, 0, 0) == -1) {
+		return NULL;
+	}
+
+	job = _wc_rt_job_new(WC_RT_JOB_CREATE, NULL, NULL, NULL);
+	if (job == NULL) {
+		sem_destroy(&create.done);
+		return NULL;
+	}
+	job->u.create = &create;
+
+	if (shard == wc_current_shard) {
+		/* called from the target shard itself: waiting would deadlock */
+		_wc_shard_run_job(shard, job);
+		free(job);
+	} else {
+		_wc_shard_submit(shard, job);
+		while (sem_wait(&create.done) == -1 && errno == EINTR);
+	}
+
+	sem_destroy(&create.done);
+
+	return create.ret;
+}
+
+void wc_runtime_context_destroy(wc_context_t *ctx) {
+	struct wc_rt_job *job;
+
+	job = _wc_rt_job_new(WC_RT_JOB_DESTROY, ctx, NULL, NULL);
+	if (job == NULL) {
+		WL_ERR("could not destroy context %p: out of memory", ctx);
+		return;
+	}
+	_wc_shard_submit(ctx->shard, job);
+}
+
+int wc_runtime_call(wc_context_t *ctx, wc_runtime_call_f fn, void *data) {
+	struct wc_rt_job *job;
+
+	job = _wc_rt_job_new(WC_RT_JOB_CALL, ctx, NULL, NULL);
+	if (job == NULL) {
+		return -1;
+	}
+	job->u.call.fn = fn;
+	job->u.call.data = data;
+	_wc_shard_submit(ctx->shard, job);
+
+	return 0;
+}
+
+static int _wc_runtime_req(enum wc_rt_job_type type, wc_context_t *ctx, const char *path, const char *json, wc_on_req_result_t callback, void *user) {
+	struct wc_rt_job *job;
+
+	job = _wc_rt_job_new(type, ctx, path, json);
+	if (job == NULL) {
+		return -1;
+	}
+	job->u.req.cb = callback;
+	job->u.req.user = user;
+	_wc_shard_submit(ctx->shard, job);
+
+	return 0;
+}
+
+int wc_runtime_put(wc_context_t *ctx, const char *path, const char *json, wc_on_req_result_t callback, void *user) {
+	return _wc_runtime_req(WC_RT_JOB_PUT, ctx, path, json, callback, user);
+}
+
+int wc_runtime_merge(wc_context_t *ctx, const char *path, const char *json, wc_on_req_result_t callback, void *user) {
+	return _wc_runtime_req(WC_RT_JOB_MERGE, ctx, path, json, callback, user);
+}
+
+int wc_runtime_on(wc_context_t *ctx, enum on_event_type type, const char *path, on_callback_f callback) {
+	struct wc_rt_job *job;
+
+	job = _wc_rt_job_new(WC_RT_JOB_ON, ctx, path, NULL);
+	if (job == NULL) {
+		return -1;
+	}
+	job->u.on.type = type;
+	job->u.on.cb = callback;
+	_wc_shard_submit(ctx->shard, job);
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stddef.h>
+
+#include "webcom_base_priv.h"
+#include "timer.h"
+
+#define WC_TIMER_WHEEL_MASK (WC_TIMER_WHEEL_SIZE - 1)
+#define LEVEL_SHIFT(l) (WC_TIMER_WHEEL_BITS * (l))
+#define LEVEL_SPAN(l) ((int64_t)1 << LEVEL_SHIFT(l))
+#define WHEEL_SPAN LEVEL_SPAN(WC_TIMER_WHEEL_LEVELS)
+
+/* level value of the timers that are not stored in the wheel's slots */
+#define LEVEL_NONE WC_TIMER_WHEEL_LEVELS
+
+/* offset (in [0, WC_TIMER_WHEEL_SIZE)) of the first non-empty slot at or
+ * after `start`, wrapping around, or -1 if all the slots are empty */
+static inline int first_occupied(uint64_t bitmap, unsigned start) {
+	uint64_t rotated;
+
+	if (bitmap == 0) {
+		return -1;
+	}
+
+	rotated = start == 0 ? bitmap : (bitmap >> start) | (bitmap << (WC_TIMER_WHEEL_SIZE - start));
+
+	return __builtin_ctzll(rotated);
+}
+
+static void wc_timer_link(struct wc_timer **where, struct wc_timer *t) {
+	t->next = *where;
+	t->pprev = where;
+	if (*where != NULL) {
+		(*where)->pprev = &t->next;
+	}
+	*where = t;
+}
+
+static void wc_timer_unlink(struct wc_timers *w, struct wc_timer *t) {
+	*t->pprev = t->next;
+	if (t->next != NULL) {
+		t->next->pprev = t->pprev;
+	}
+	if (t->level != LEVEL_NONE) {
+		w->count--;
+		if (w->slots[t->level][t->slot] == NULL) {
+			w->occupied[t->level] &= ~((uint64_t)1 << t->slot);
+		}
+	}
+	t->next = NULL;
+	t->pprev = NULL;
+}
+
+static void wc_timer_insert(struct wc_timers *w, struct wc_timer *t) {
+	int64_t expires, delta;
+	unsigned level;
+
+	expires = t->expires < w->now ? w->now : t->expires;
+	delta = expires - w->now;
+
+	if (delta >= WHEEL_SPAN) {
+		/* beyond the wheel's span: park it in the last level, it will be
+		 * cascaded (and re-inserted) in time */
+		level = WC_TIMER_WHEEL_LEVELS - 1;
+		expires = w->now + WHEEL_SPAN - 1;
+	} else {
+		for (level = 0 ; delta >= LEVEL_SPAN(level + 1) ; level++);
+	}
+
+	t->level = level;
+	t->slot = (expires >> LEVEL_SHIFT(level)) & WC_TIMER_WHEEL_MASK;
+
+	wc_timer_link(&w->slots[level][t->slot], t);
+	w->occupied[level] |= (uint64_t)1 << t->slot;
+	w->count++;
+}
+
+/* date of the next tick at which something has to be done (a timer expires,
+ * or a slot must be cascaded to the lower levels), assumes the wheel is not
+ * empty */
+static int64_t wc_timers_next_tick(struct wc_timers *w) {
+	int64_t ret = INT64_MAX, tick, base;
+	unsigned level;
+	int off;
+
+	off = first_occupied(w->occupied[0], w->now & WC_TIMER_WHEEL_MASK);
+	if (off >= 0) {
+		ret = w->now + off;
+	}
+
+	for (level = 1 ; level < WC_TIMER_WHEEL_LEVELS ; level++) {
+		/* next boundary of this level, at or after now */
+		base = (w->now + LEVEL_SPAN(level) - 1) >> LEVEL_SHIFT(level);
+		off = first_occupied(w->occupied[level], base & WC_TIMER_WHEEL_MASK);
+		if (off >= 0) {
+			tick = (base + off) << LEVEL_SHIFT(level);
+			if (tick < ret) {
+				ret = tick;
+			}
+		}
+	}
+
+	return ret;
+}
+
+static void wc_timers_program(wc_context_t *ctx, int force) {
+	struct wc_timers *w = &ctx->timers;
+	struct wc_timerargs ta;
+	enum wc_timersrc src = WC_TIMER_MUX;
+	int64_t next, now;
+
+	if (w->count == 0) {
+		if (w->programmed != 0) {
+			w->programmed = 0;
+			ctx->callback(WC_EVENT_DEL_TIMER, ctx, &src, 0);
+		}
+		return;
+	}
+
+	next = wc_timers_next_tick(w);
+
+	/* firing too early is harmless, so the event loop timer is only
+	 * re-programmed when it must fire sooner */
+	if (force || w->programmed == 0 || next < w->programmed) {
+		now = wc_timer_now();
+		w->programmed = next;
+		ta.ms = next > now ? (long)(next - now) : 0;
+		ta.repeat = 0;
+		ta.timer = WC_TIMER_MUX;
+		ctx->callback(WC_EVENT_SET_TIMER, ctx, &ta, 0);
+	}
+}
+
+void wc_timer_init(struct wc_timer *t, wc_timer_cb_f cb, void *data) {
+	t->expires = 0;
+	t->cb = cb;
+	t->data = data;
+	t->next = NULL;
+	t->pprev = NULL;
+	t->level = LEVEL_NONE;
+	t->slot = 0;
+}
+
+void wc_timer_arm(wc_context_t *ctx, struct wc_timer *t, long ms) {
+	struct wc_timers *w = &ctx->timers;
+	int64_t now = wc_timer_now();
+
+	if (wc_timer_is_armed(t)) {
+		wc_timer_unlink(w, t);
+	}
+
+	if (w->count == 0 && w->now < now) {
+		/* the wheel is idle, fast-forward it */
+		w->now = now;
+	}
+
+	t->expires = now + (ms > 0 ? ms : 0);
+	wc_timer_insert(w, t);
+
+	wc_timers_program(ctx, 0);
+}
+
+void wc_timer_cancel(wc_context_t *ctx, struct wc_timer *t) {
+	if (wc_timer_is_armed(t)) {
+		wc_timer_unlink(&ctx->timers, t);
+		if (ctx->timers.count == 0) {
+			wc_timers_program(ctx, 0);
+		}
+	}
+}
+
+static void wc_timers_cascade(struct wc_timers *w, unsigned level, unsigned slot) {
+	struct wc_timer *t;
+
+	while ((t = w->slots[level][slot]) != NULL) {
+		wc_timer_unlink(w, t);
+		wc_timer_insert(w, t);
+	}
+}
+
+/* processes the wheel's ticks up to `target` (included), and runs the
+ * callbacks of the expired timers */
+static void wc_timers_advance(wc_context_t *ctx, int64_t target) {
+	struct wc_timers *w = &ctx->timers;
+	struct wc_timer *expired = NULL, **expired_tail = &expired, *t;
+	int64_t tick, next;
+	unsigned level, slot;
+
+	while (w->count > 0 && w->now <= target) {
+		tick = w->now;
+
+		/* cascade the upper levels reaching one of their boundaries */
+		for (level = 1 ; level < WC_TIMER_WHEEL_LEVELS && (tick & (LEVEL_SPAN(level) - 1)) == 0 ; level++);
+		while (--level > 0) {
+			wc_timers_cascade(w, level, (tick >> LEVEL_SHIFT(level)) & WC_TIMER_WHEEL_MASK);
+		}
+
+		/* move the expired timers to a private list, so that the ones
+		 * (re-)armed from the callbacks are only considered on the next run */
+		slot = tick & WC_TIMER_WHEEL_MASK;
+		if ((t = w->slots[0][slot]) != NULL) {
+			w->slots[0][slot] = NULL;
+			w->occupied[0] &= ~((uint64_t)1 << slot);
+			*expired_tail = t;
+			t->pprev = expired_tail;
+			for (; t != NULL ; t = t->next) {
+				t->level = LEVEL_NONE;
+				w->count--;
+				expired_tail = &t->next;
+			}
+		}
+
+		w->now = tick + 1;
+
+		if ((w->occupied[0] >> (w->now & WC_TIMER_WHEEL_MASK)) == 0) {
+			/* nothing left in this turn of the first level, jump to its next
+			 * boundary */
+			next = (w->now + WC_TIMER_WHEEL_MASK) & ~(int64_t)WC_TIMER_WHEEL_MASK;
+			w->now = next <= target ? next : target + 1;
+		}
+	}
+
+	if (w->count == 0 && w->now <= target) {
+		w->now = target + 1;
+	}
+
+	while ((t = expired) != NULL) {
+		wc_timer_unlink(w, t);
+		t->cb(ctx, t);
+	}
+}
+
+void wc_timers_service(wc_context_t *ctx) {
+	/* the event loop timer has fired */
+	ctx->timers.programmed = 0;
+
+	wc_timers_advance(ctx, wc_timer_now());
+
+	wc_timers_program(ctx, 1);
+}
+
+void wc_timers_cleanup(wc_context_t *ctx) {
+	struct wc_timers *w = &ctx->timers;
+	unsigned level, slot;
+
+	for (level = 0 ; level < WC_TIMER_WHEEL_LEVELS ; level++) {
+		for (slot = 0 ; slot < WC_TIMER_WHEEL_SIZE ; slot++) {
+			while (w->slots[level][slot] != NULL) {
+				wc_timer_unlink(w, w->slots[level][slot]);
+			}
+		}
+	}
+	w->programmed = 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_TIMER_H_
+#define LIB_TIMER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "webcom-c/webcom-base.h"
+
+/*
+ * Internal timers: any number of logical timers, multiplexed onto the
+ * single WC_TIMER_MUX event loop timer of a context.
+ *
+ * The timers are stored in a hierarchical timing wheel with a 1 ms
+ * resolution: WC_TIMER_WHEEL_LEVELS levels of WC_TIMER_WHEEL_SIZE slots,
+ * each level covering WC_TIMER_WHEEL_SIZE times the span of the previous
+ * one (about 4.6 hours for the whole wheel, longer timers are cascaded
+ * again from the last level). Arming and cancelling a timer are O(1).
+ *
+ * The wc_timer structures are meant to be embedded in the objects they
+ * relate to, arming or cancelling them never allocates memory.
+ */
+
+#define WC_TIMER_WHEEL_BITS 6
+#define WC_TIMER_WHEEL_SIZE (1 << WC_TIMER_WHEEL_BITS)
+#define WC_TIMER_WHEEL_LEVELS 4
+
+struct wc_timer;
+
+typedef void (*wc_timer_cb_f)(wc_context_t *ctx, struct wc_timer *timer);
+
+struct wc_timer {
+	int64_t expires;         /* monotonic date, in milliseconds */
+	wc_timer_cb_f cb;
+	void *data;
+	struct wc_timer *next;
+	struct wc_timer **pprev; /* NULL if the timer is not armed */
+	unsigned char level;
+	unsigned char slot;
+};
+
+struct wc_timers {
+	struct wc_timer *slots[WC_TIMER_WHEEL_LEVELS][WC_TIMER_WHEEL_SIZE];
+	uint64_t occupied[WC_TIMER_WHEEL_LEVELS]; /* bitmaps of the non-empty slots */
+	int64_t now;            /* next tick to process, every earlier tick has been processed */
+	unsigned count;         /* number of timers in the wheel */
+	int64_t programmed;     /* expiry date of the event loop timer, 0 if unset */
+};
+
+static inline int64_t wc_timer_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* same clock as wc_timer_now(), in microseconds, for latency measurements */
+static inline int64_t wc_timer_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline int wc_timer_is_armed(struct wc_timer *t) {
+	return t->pprev != NULL;
+}
+
+void wc_timer_init(struct wc_timer *t, wc_timer_cb_f cb, void *data);
+void wc_timer_arm(wc_context_t *ctx, struct wc_timer *t, long ms);
+void wc_timer_cancel(wc_context_t *ctx, struct wc_timer *t);
+
+void wc_timers_service(wc_context_t *ctx);
+void wc_timers_cleanup(wc_context_t *ctx);
+
+#endif /* LIB_TIMER_H_ */
@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <curl/curl.h>
 
@@ -29,21 +30,19 @@
 
 #include "webcom_base_priv.h"
 
-wc_context_t *wc_context_create(struct wc_context_options *options) {
-	static int curl_initialized = 0;
-	static int log_initialized = 0;
+/* contexts may be created concurrently from several threads (e.g. by the
+ * shards of a runtime), the process wide initializations must be run once */
+static pthread_once_t wc_global_init_once = PTHREAD_ONCE_INIT;
 
-	wc_context_t *ret = NULL;
+static void wc_global_init(void) {
+	wc_init_log();
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+}
 
-	if (log_initialized == 0) {
-		wc_init_log();
-		log_initialized = 1;
-	}
+wc_context_t *wc_context_create(struct wc_context_options *options) {
+	wc_context_t *ret = NULL;
 
-	if (curl_initialized == 0) {
-		curl_global_init(CURL_GLOBAL_DEFAULT);
-		curl_initialized = 1;
-	}
+	pthread_once(&wc_global_init_once, wc_global_init);
 
 	ret = calloc(1, sizeof (*ret));
 
@@ -54,6 +53,35 @@ wc_context_t *wc_context_create(struct wc_context_options *options) {
 		ret->user = options->user_data;
 		ret->callback = options->callback;
 		ret->no_tls = !!options->no_tls;
+		ret->dispatch_budget_callbacks = options->dispatch_budget_callbacks;
+		ret->dispatch_budget_us = options->dispatch_budget_us;
+		ret->dispatch_backlog_max = options->dispatch_backlog_max;
+		ret->tx_high_watermark = options->tx_high_watermark;
+		ret->offline_writes = !!options->offline_writes;
+		ret->offline_max_bytes = options->offline_max_bytes;
+		ret->offline_max_count = options->offline_max_count;
+		ret->optimistic_writes = !!options->optimistic_writes;
+		ret->request_timeout_ms = options->request_timeout_ms;
+		ret->journal_path = options->journal_path ? strdup(options->journal_path) : NULL;
+		ret->journal_sync = options->journal_sync;
+		ret->journal_commit_interval_ms = options->journal_commit_interval_ms;
+		ret->cache_snapshot_path = options->cache_snapshot_path ? strdup(options->cache_snapshot_path) : NULL;
+		ret->cache_snapshot_interval_ms = options->cache_snapshot_interval_ms;
+		ret->listen_burst = options->listen_burst;
+		ret->reconnect_initial_ms = options->reconnect_initial_ms;
+		ret->reconnect_multiplier = options->reconnect_multiplier;
+		ret->reconnect_max_ms = options->reconnect_max_ms;
+		ret->reconnect_jitter = options->reconnect_jitter;
+		ret->reconnect_stable_ms = options->reconnect_stable_ms;
+		ret->ws_deflate = !!options->ws_deflate;
+		ret->ws_deflate_window_bits = options->ws_deflate_window_bits;
+		ret->ws_deflate_level = options->ws_deflate_level;
+		ret->submit_queue_size = options->submit_queue_size;
+		ret->parse_threads = options->parse_threads;
+		ret->parse_offload_bytes = options->parse_offload_bytes;
+		ret->rx_buffer_size = options->rx_buffer_size;
+		ret->rx_streaming = !!options->rx_streaming;
+		ret->binary_framing = !!options->binary_framing;
 	}
 
 	return ret;
@@ -64,19 +92,17 @@ void wc_dispatch_fd_event(wc_context_t *ctx, struct wc_pollargs *pa) {
 		wc_datasync_service_socket(ctx, pa);
 	} else if (pa->src == WC_POLL_AUTH) {
 		wc_auth_service(ctx, pa->fd);
+	} else if (pa->src == WC_POLL_SUBMIT) {
+		wc_datasync_submit_service(ctx);
+	} else if (pa->src == WC_POLL_WORKERS) {
+		wc_datasync_rx_offload_service(ctx);
 	}
 }
 
 void wc_dispatch_timer_event(wc_context_t *ctx, enum wc_timersrc timer) {
 	switch (timer) {
-	case WC_TIMER_DATASYNC_KEEPALIVE:
-		wc_datasync_keepalive(ctx);
-		break;
-	case WC_TIMER_DATASYNC_RECONNECT:
-		_wc_datasync_connect(ctx);
-		break;
-	case WC_TIMER_AUTH:
-		wc_auth_service(ctx, -1);
+	case WC_TIMER_MUX:
+		wc_timers_service(ctx);
 		break;
 	default:
 		break;
@@ -109,8 +135,16 @@ void wc_context_destroy(wc_context_t * ctx) {
 		// TODO call destructor
 	}
 
+	wc_timers_cleanup(ctx);
+
+	if (ctx->eli_cleanup != NULL) {
+		ctx->eli_cleanup(ctx);
+	}
+
 	free(ctx->app_name);
 	free(ctx->host);
+	free(ctx->journal_path);
+	free(ctx->cache_snapshot_path);
 
 	free(ctx);
 }
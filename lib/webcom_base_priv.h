@@ -31,6 +31,7 @@
 
 #include "auth/auth_priv.h"
 #include "datasync/datasync_priv.h"
+#include "timer.h"
 
 
 wc_datasync_context_t *wc_get_datasync(wc_context_t *);
@@ -39,14 +40,46 @@ wc_auth_context_t *wc_get_auth(wc_context_t *);
 struct wc_context {
 	wc_on_event_cb_t callback;
 	void *user;
+	void (*eli_cleanup)(wc_context_t *ctx); /* releases the data of the built-in event loop integration, if any */
+	struct wc_shard *shard; /* the runtime shard the context belongs to, if any */
 	char *app_name;
 	char *host;
 	uint16_t port;
+	unsigned dispatch_budget_callbacks;
+	unsigned dispatch_budget_us;
+	unsigned dispatch_backlog_max;
+	size_t tx_high_watermark;
+	size_t offline_max_bytes;
+	unsigned offline_max_count;
+	unsigned request_timeout_ms;
+	char *journal_path;
+	enum wc_journal_sync journal_sync;
+	unsigned journal_commit_interval_ms;
+	char *cache_snapshot_path;
+	unsigned cache_snapshot_interval_ms;
+	unsigned listen_burst;
+	unsigned reconnect_initial_ms;
+	double reconnect_multiplier;
+	unsigned reconnect_max_ms;
+	enum wc_backoff_jitter reconnect_jitter;
+	unsigned reconnect_stable_ms;
+	int ws_deflate;
+	unsigned ws_deflate_window_bits;
+	int ws_deflate_level;
+	unsigned submit_queue_size;
+	unsigned parse_threads;
+	size_t parse_offload_bytes;
+	size_t rx_buffer_size;
+	struct wc_timers timers;
 	struct wc_datasync_context datasync;
 	struct wc_auth_context auth;
 	int no_tls:1;
 	int datasync_init:1;
 	int auth_init:1;
+	int offline_writes:1;
+	int optimistic_writes:1;
+	int rx_streaming:1;
+	int binary_framing:1;
 };
 
 __attribute__ ((visibility ("hidden")))
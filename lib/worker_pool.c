@@ -0,0 +1,111 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+
+#include "worker_pool.h"
+
+static void *worker_main(void *arg) {
+	struct worker_pool *pool = arg;
+	struct worker_job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->head == NULL && !pool->stop) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+		job = pool->head;
+		if (job == NULL) {
+			break;
+		}
+		pool->head = job->next;
+		if (pool->head == NULL) {
+			pool->tail = &pool->head;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		job->run(job);
+
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+struct worker_pool *worker_pool_new(unsigned nthreads) {
+	struct worker_pool *pool;
+	unsigned i;
+
+	pool = calloc(1, sizeof(*pool) + nthreads * sizeof(*pool->threads));
+	if (pool == NULL) {
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->tail = &pool->head;
+
+	for (i = 0 ; i < nthreads ; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+			break;
+		}
+	}
+	pool->nthreads = i;
+
+	if (i == 0) {
+		worker_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void worker_pool_submit(struct worker_pool *pool, struct worker_job *job) {
+	job->next = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	*pool->tail = job;
+	pool->tail = &job->next;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void worker_pool_destroy(struct worker_pool *pool) {
+	unsigned i;
+
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0 ; i < pool->nthreads ; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
@@ -0,0 +1,56 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef LIB_WORKER_POOL_H_
+#define LIB_WORKER_POOL_H_
+
+#include <pthread.h>
+
+/*
+ * fixed-size pool of worker threads running jobs in submission order
+ *
+ * The jobs are meant to be few and heavy (e.g. parsing a multi-megabyte
+ * message), a mutex protected list is all they need. The job structure is
+ * to be embedded in the caller's own structure, it is not freed by the pool.
+ */
+
+struct worker_job {
+	struct worker_job *next;
+	void (*run)(struct worker_job *job);
+};
+
+struct worker_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct worker_job *head;
+	struct worker_job **tail;
+	int stop;
+	unsigned nthreads;
+	pthread_t threads[];
+};
+
+struct worker_pool *worker_pool_new(unsigned nthreads);
+void worker_pool_submit(struct worker_pool *pool, struct worker_job *job);
+/* runs the jobs still queued, then stops and joins the threads */
+void worker_pool_destroy(struct worker_pool *pool);
+
+#endif /* LIB_WORKER_POOL_H_ */
@@ -0,0 +1,507 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <libwebsockets.h>
+
+#include "webcom-c/webcom.h"
+#include "../../lib/datasync/cbor.h"
+#include "../../lib/datasync/path.h"
+#include "../../lib/datasync/tx_queue.h"
+#include "../../lib/datasync/cache/treenode_cache.h"
+
+#include "mock_server.h"
+
+#define MOCK_RX_BUF_LEN (1 << 12)
+
+struct mock_listen {
+	struct mock_listen *next;
+	wc_ds_path_t *path;
+};
+
+struct mock_session {
+	struct mock_session *next;
+	struct mock_server *server;
+	struct lws *wsi;
+	int binary;                  /* the client asked for the binary framing */
+	int authenticated;
+	int closing;                 /* to be closed at the next writable callback */
+	unsigned received;           /* messages */
+	struct cbor_buf rx;          /* fragments of the message being received */
+	struct tx_queue txq;         /* the id of the frames is their due time */
+	struct mock_listen *listens;
+};
+
+struct mock_server {
+	struct mock_server_options options;
+	struct lws_context *lws;
+	struct lws_protocols protocols[2];
+	data_cache_t *cache;
+	struct mock_session *sessions;
+	struct mock_server_stats stats;
+	unsigned seed;
+};
+
+static int64_t mock_now(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/* the websocket path is /_wss/.ws?v=5&ns=<app>[&enc=cbor] */
+static int mock_wants_binary(struct lws *wsi) {
+	char arg[64];
+	int i;
+
+	for (i = 0 ; lws_hdr_copy_fragment(wsi, arg, sizeof(arg), WSI_TOKEN_HTTP_URI_ARGS, i) > 0 ; i++) {
+		if (strcmp(arg, "enc=cbor") == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int mock_lost(struct mock_server *ms) {
+	return ms->options.loss > 0 && (double)rand_r(&ms->seed) / RAND_MAX < ms->options.loss;
+}
+
+static void mock_send(struct mock_session *s, wc_msg_t *msg) {
+	struct mock_server *ms = s->server;
+	unsigned char *cbor;
+	char *json;
+	size_t len;
+	int ret = -1;
+
+	if (msg->type == WC_MSG_DATA && mock_lost(ms)) {
+		ms->stats.dropped++;
+		return;
+	}
+
+	if (s->binary) {
+		cbor = wc_datasync_msg_to_cbor(msg, &len);
+		if (cbor != NULL && (ret = tx_queue_push(&s->txq, (char *)cbor, len, 1)) == 0) {
+			tx_queue_last(&s->txq)->binary = 1;
+		}
+		free(cbor);
+	} else {
+		json = wc_datasync_msg_to_json_str(msg);
+		if (json != NULL) {
+			ret = tx_queue_push(&s->txq, json, strlen(json), 1);
+		}
+		free(json);
+	}
+	if (ret != 0) {
+		return;
+	}
+
+	tx_queue_last(&s->txq)->id = mock_now() + ms->options.latency_ms;
+	if (ms->options.latency_ms == 0) {
+		lws_callback_on_writable(s->wsi);
+	}
+}
+
+static void mock_send_response(struct mock_session *s, int64_t r, char *status) {
+	wc_msg_t msg;
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_RESPONSE;
+	msg.u.data.u.response.r = r;
+	msg.u.data.u.response.status = status;
+	mock_send(s, &msg);
+}
+
+static void mock_send_update(struct mock_session *s, wc_push_type_t type, char *path, char *data) {
+	wc_msg_t msg;
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_PUSH;
+	msg.u.data.u.push.type = type;
+	/* same layout for put and merge */
+	msg.u.data.u.push.u.update_put.path = path;
+	msg.u.data.u.push.u.update_put.data = data;
+	mock_send(s, &msg);
+}
+
+static void mock_send_handshake(struct mock_session *s) {
+	wc_msg_t msg;
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_CTRL;
+	msg.u.ctrl.type = WC_CTRL_MSG_HANDSHAKE;
+	msg.u.ctrl.u.handshake.ts = mock_now();
+	msg.u.ctrl.u.handshake.server = "webcom-mock";
+	msg.u.ctrl.u.handshake.version = "5";
+	mock_send(s, &msg);
+}
+
+static void mock_send_value(struct mock_session *s, char *path) {
+	struct treenode *n;
+	char *json;
+	int len;
+
+	n = data_cache_get(s->server->cache, path);
+	len = treenode_to_json_len(n);
+	json = malloc((size_t)len + 1);
+	if (json != NULL) {
+		treenode_to_json(n, json);
+		json[len] = '\0';
+		mock_send_update(s, WC_PUSH_DATA_UPDATE_PUT, path, json);
+		free(json);
+	}
+}
+
+/* sends a write to the sessions listening to a path above or below it */
+static void mock_fan_out(struct mock_server *ms, wc_push_type_t type, char *path, char *data) {
+	struct mock_session *s;
+	struct mock_listen *l;
+	wc_ds_path_t *parsed;
+
+	parsed = wc_datasync_path_new(path);
+	if (parsed == NULL) {
+		return;
+	}
+	for (s = ms->sessions ; s != NULL ; s = s->next) {
+		for (l = s->listens ; l != NULL ; l = l->next) {
+			if (wc_datasync_path_starts_with(parsed, l->path) || wc_datasync_path_starts_with(l->path, parsed)) {
+				mock_send_update(s, type, path, data);
+				break;
+			}
+		}
+	}
+	wc_datasync_path_destroy(parsed);
+}
+
+static void mock_listen(struct mock_session *s, char *path) {
+	struct mock_listen *l;
+
+	l = malloc(sizeof(*l));
+	if (l == NULL || (l->path = wc_datasync_path_new(path)) == NULL) {
+		free(l);
+		return;
+	}
+	l->next = s->listens;
+	s->listens = l;
+	s->server->stats.listens++;
+}
+
+static void mock_unlisten(struct mock_session *s, char *path) {
+	struct mock_listen *l, **p;
+	wc_ds_path_t *parsed;
+
+	parsed = wc_datasync_path_new(path);
+	if (parsed == NULL) {
+		return;
+	}
+	for (p = &s->listens ; (l = *p) != NULL ; ) {
+		if (wc_datasync_path_cmp(l->path, parsed) == 0) {
+			*p = l->next;
+			wc_datasync_path_destroy(l->path);
+			free(l);
+			s->server->stats.listens--;
+		} else {
+			p = &l->next;
+		}
+	}
+	wc_datasync_path_destroy(parsed);
+}
+
+static void mock_handle_action(struct mock_session *s, wc_action_t *action) {
+	struct mock_server *ms = s->server;
+	const char *token = ms->options.auth_token;
+
+	switch (action->type) {
+	case WC_ACTION_AUTHENTICATE:
+		s->authenticated = token == NULL || strcmp(action->u.auth.cred, token) == 0;
+		mock_send_response(s, action->r, s->authenticated ? "ok" : "invalid_token");
+		return;
+	case WC_ACTION_UNAUTHENTICATE:
+		s->authenticated = 0;
+		mock_send_response(s, action->r, "ok");
+		return;
+	default:
+		if (token != NULL && !s->authenticated) {
+			mock_send_response(s, action->r, "permission_denied");
+			return;
+		}
+		break;
+	}
+
+	switch (action->type) {
+	case WC_ACTION_PUT:
+		data_cache_set(ms->cache, action->u.put.path, action->u.put.data);
+		mock_send_response(s, action->r, "ok");
+		mock_fan_out(ms, WC_PUSH_DATA_UPDATE_PUT, action->u.put.path, action->u.put.data);
+		break;
+	case WC_ACTION_MERGE:
+		data_cache_merge(ms->cache, action->u.merge.path, action->u.merge.data);
+		mock_send_response(s, action->r, "ok");
+		mock_fan_out(ms, WC_PUSH_DATA_UPDATE_MERGE, action->u.merge.path, action->u.merge.data);
+		break;
+	case WC_ACTION_LISTEN:
+		mock_listen(s, action->u.listen.path);
+		mock_send_value(s, action->u.listen.path);
+		mock_send_response(s, action->r, "ok");
+		break;
+	case WC_ACTION_UNLISTEN:
+		mock_unlisten(s, action->u.unlisten.path);
+		mock_send_response(s, action->r, "ok");
+		break;
+	default:
+		/* accepted, and otherwise ignored */
+		mock_send_response(s, action->r, "ok");
+		break;
+	}
+}
+
+static void mock_handle_message(struct mock_session *s, int binary) {
+	struct mock_server *ms = s->server;
+	wc_msg_t msg;
+	int ok;
+
+	ms->stats.rx_messages++;
+	ms->stats.rx_bytes += s->rx.len;
+
+	if (binary) {
+		ok = wc_datasync_parse_msg_cbor(s->rx.data, s->rx.len, &msg);
+	} else {
+		/* the keepalive frames ("0") are not messages */
+		if (s->rx.len == 1 && s->rx.data[0] == '0') {
+			return;
+		}
+		ok = cbor_buf_append(&s->rx, "", 1) == 0 && wc_datasync_parse_msg((char *)s->rx.data, &msg);
+	}
+	if (!ok) {
+		lwsl_warn("mock: dropping an invalid message of %zu bytes\n", s->rx.len);
+		return;
+	}
+	if (msg.type == WC_MSG_DATA && msg.u.data.type == WC_DATA_MSG_ACTION) {
+		mock_handle_action(s, &msg.u.data.u.action);
+	}
+	wc_datasync_msg_free(&msg);
+
+	if (ms->options.disconnect_after && ++s->received >= ms->options.disconnect_after) {
+		s->closing = 1;
+		lws_callback_on_writable(s->wsi);
+	}
+}
+
+static int mock_write_next(struct mock_session *s) {
+	struct mock_server *ms = s->server;
+	struct tx_frame *f;
+	int sent;
+
+	if (s->closing) {
+		ms->stats.disconnects++;
+		return -1;
+	}
+	f = tx_queue_peek(&s->txq);
+	if (f == NULL || f->id > mock_now()) {
+		/* mock_server_service() asks again when it is due */
+		return 0;
+	}
+	f = tx_queue_pop(&s->txq);
+	sent = lws_write(s->wsi, tx_frame_payload(f), f->len, f->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
+	ms->stats.tx_messages++;
+	ms->stats.tx_bytes += f->len;
+	free(f);
+	if (sent < 0) {
+		return -1;
+	}
+	if (!tx_queue_empty(&s->txq)) {
+		lws_callback_on_writable(s->wsi);
+	}
+	return 0;
+}
+
+static void mock_session_open(struct mock_server *ms, struct mock_session *s, struct lws *wsi) {
+	memset(s, 0, sizeof(*s));
+	s->server = ms;
+	s->wsi = wsi;
+	s->binary = mock_wants_binary(wsi);
+	cbor_buf_init(&s->rx);
+	tx_queue_init(&s->txq, 0);
+	s->next = ms->sessions;
+	ms->sessions = s;
+
+	ms->stats.connections++;
+	ms->stats.sessions++;
+	if (s->binary) {
+		ms->stats.binary_sessions++;
+	}
+}
+
+static void mock_session_close(struct mock_session *s) {
+	struct mock_server *ms = s->server;
+	struct mock_session **p;
+	struct mock_listen *l;
+
+	for (p = &ms->sessions ; *p != NULL ; p = &(*p)->next) {
+		if (*p == s) {
+			*p = s->next;
+			break;
+		}
+	}
+	while ((l = s->listens) != NULL) {
+		s->listens = l->next;
+		wc_datasync_path_destroy(l->path);
+		free(l);
+		ms->stats.listens--;
+	}
+	cbor_buf_cleanup(&s->rx);
+	tx_queue_clear(&s->txq);
+
+	ms->stats.sessions--;
+	if (s->binary) {
+		ms->stats.binary_sessions--;
+	}
+}
+
+static int mock_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
+	struct mock_server *ms = lws_context_user(lws_get_context(wsi));
+	struct mock_session *s = user;
+
+	switch (reason) {
+	case LWS_CALLBACK_ESTABLISHED:
+		mock_session_open(ms, s, wsi);
+		mock_send_handshake(s);
+		break;
+	case LWS_CALLBACK_RECEIVE:
+		if (cbor_buf_append(&s->rx, in, len) != 0) {
+			return -1;
+		}
+		if (lws_is_final_fragment(wsi) && lws_remaining_packet_payload(wsi) == 0) {
+			mock_handle_message(s, lws_frame_is_binary(wsi));
+			s->rx.len = 0;
+		}
+		break;
+	case LWS_CALLBACK_SERVER_WRITEABLE:
+		return mock_write_next(s);
+	case LWS_CALLBACK_CLOSED:
+		mock_session_close(s);
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+struct mock_server *mock_server_new(const struct mock_server_options *options) {
+	struct lws_context_creation_info info;
+	struct mock_server *ms;
+
+	ms = calloc(1, sizeof(*ms));
+	if (ms == NULL) {
+		return NULL;
+	}
+	ms->options = *options;
+	ms->seed = options->seed;
+
+	/* the protocol name the SDK asks for */
+	ms->protocols[0].name = "webcom-protocol";
+	ms->protocols[0].callback = mock_callback;
+	ms->protocols[0].per_session_data_size = sizeof(struct mock_session);
+	ms->protocols[0].rx_buffer_size = MOCK_RX_BUF_LEN;
+
+	memset(&info, 0, sizeof(info));
+	info.port = options->port;
+	info.protocols = ms->protocols;
+	info.gid = -1;
+	info.uid = -1;
+	info.user = ms;
+
+	ms->cache = data_cache_new();
+	ms->lws = lws_create_context(&info);
+	if (ms->lws == NULL) {
+		data_cache_destroy(ms->cache);
+		free(ms);
+		return NULL;
+	}
+
+	return ms;
+}
+
+/*
+ * services the websockets for at most timeout_ms, or until the next delayed
+ * message is due
+ */
+int mock_server_service(struct mock_server *ms, int timeout_ms) {
+	struct mock_session *s;
+	struct tx_frame *f;
+	int64_t now = mock_now();
+
+	for (s = ms->sessions ; s != NULL ; s = s->next) {
+		if ((f = tx_queue_peek(&s->txq)) == NULL) {
+			continue;
+		}
+		if (f->id <= now) {
+			lws_callback_on_writable(s->wsi);
+		} else if (f->id - now < timeout_ms) {
+			timeout_ms = (int)(f->id - now);
+		}
+	}
+
+	return lws_service(ms->lws, timeout_ms);
+}
+
+void mock_server_disconnect_all(struct mock_server *ms) {
+	struct mock_session *s;
+
+	for (s = ms->sessions ; s != NULL ; s = s->next) {
+		s->closing = 1;
+		lws_callback_on_writable(s->wsi);
+	}
+}
+
+/* the authentication of the clients expires */
+void mock_server_revoke_auth(struct mock_server *ms, const char *reason) {
+	struct mock_session *s;
+	wc_msg_t msg;
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_PUSH;
+	msg.u.data.u.push.type = WC_PUSH_AUTH_REVOKED;
+	msg.u.data.u.push.u.auth_revoked.status = "expired";
+	msg.u.data.u.push.u.auth_revoked.reason = (char *)reason;
+
+	for (s = ms->sessions ; s != NULL ; s = s->next) {
+		if (s->authenticated) {
+			s->authenticated = 0;
+			mock_send(s, &msg);
+		}
+	}
+}
+
+void mock_server_get_stats(struct mock_server *ms, struct mock_server_stats *stats) {
+	*stats = ms->stats;
+}
+
+void mock_server_destroy(struct mock_server *ms) {
+	/* closes the sessions */
+	lws_context_destroy(ms->lws);
+	data_cache_destroy(ms->cache);
+	free(ms);
+}
@@ -0,0 +1,80 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef TEST_MOCK_MOCK_SERVER_H_
+#define TEST_MOCK_MOCK_SERVER_H_
+
+/*
+ * Local mock of the Webcom datasync server, for the end-to-end tests and
+ * benchmarks.
+ *
+ * It speaks the datasync protocol over plain (non TLS) websockets, in JSON
+ * text frames, or in CBOR binary frames if the client asks for it with the
+ * "enc=cbor" argument of the websocket path (see the `binary_framing` context
+ * option). It answers the handshake, keeps the data written by the clients in
+ * a cache, and pushes the writes to the clients listening to the paths they
+ * touch.
+ *
+ * The network conditions are simulated on the server side: every message sent
+ * to the clients can be delayed, and the responses and pushes can be dropped,
+ * the drops being drawn from a seeded generator so that the runs are
+ * reproducible. The connections can be closed after a number of messages, or
+ * on demand.
+ *
+ * The server is serviced by mock_server_service(), typically interleaved with
+ * the iterations of the client event loop in the same thread.
+ */
+
+#include <stdint.h>
+
+struct mock_server;
+
+struct mock_server_options {
+	int port;                  /* TCP port to listen on */
+	unsigned latency_ms;       /* delay of every message sent to the clients */
+	double loss;               /* probability to drop a response or a push */
+	unsigned seed;             /* seed of the drops */
+	unsigned disconnect_after; /* closes the connections after this number of received messages, 0 for never */
+	const char *auth_token;    /* if not NULL, the only credential accepted, the listens and writes of the clients that are not authenticated are denied */
+};
+
+struct mock_server_stats {
+	uint64_t connections;      /* accepted since the creation */
+	unsigned sessions;         /* open connections */
+	unsigned binary_sessions;  /* open connections using the binary framing */
+	unsigned listens;          /* active listens */
+	uint64_t rx_messages;
+	uint64_t rx_bytes;
+	uint64_t tx_messages;
+	uint64_t tx_bytes;
+	uint64_t dropped;          /* messages not sent because of the simulated loss */
+	uint64_t disconnects;      /* connections closed by the server */
+};
+
+struct mock_server *mock_server_new(const struct mock_server_options *options);
+int mock_server_service(struct mock_server *ms, int timeout_ms);
+void mock_server_disconnect_all(struct mock_server *ms);
+void mock_server_revoke_auth(struct mock_server *ms, const char *reason);
+void mock_server_get_stats(struct mock_server *ms, struct mock_server_stats *stats);
+void mock_server_destroy(struct mock_server *ms);
+
+#endif /* TEST_MOCK_MOCK_SERVER_H_ */
@@ -0,0 +1,111 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * wcmock: runs the mock datasync server until interrupted
+ *
+ * usage: wcmock [-p port] [-l latency_ms] [-L loss] [-s seed]
+ *               [-d disconnect_after] [-a auth_token] [-v]
+ *
+ * connect to it with the `no_tls` context option, host "localhost" and the
+ * given port (8081 by default), the statistics of the server are printed when
+ * it stops
+ */
+
+#include <signal.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libwebsockets.h>
+
+#include "webcom-c/webcom-utils.h"
+#include "mock_server.h"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(UNUSED_PARAM(int sig)) {
+	stop = 1;
+}
+
+int main(int argc, char *argv[]) {
+	struct mock_server_options options = {.port = 8081};
+	struct mock_server_stats stats;
+	struct mock_server *ms;
+	int verbose = 0, opt;
+
+	while ((opt = getopt(argc, argv, "p:l:L:s:d:a:v")) != -1) {
+		switch (opt) {
+		case 'p':
+			options.port = atoi(optarg);
+			break;
+		case 'l':
+			options.latency_ms = (unsigned)atoi(optarg);
+			break;
+		case 'L':
+			options.loss = atof(optarg);
+			break;
+		case 's':
+			options.seed = (unsigned)atoi(optarg);
+			break;
+		case 'd':
+			options.disconnect_after = (unsigned)atoi(optarg);
+			break;
+		case 'a':
+			options.auth_token = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p port] [-l latency_ms] [-L loss] [-s seed] "
+					"[-d disconnect_after] [-a auth_token] [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	lws_set_log_level(verbose ? LLL_ERR | LLL_WARN | LLL_NOTICE : LLL_ERR, NULL);
+
+	ms = mock_server_new(&options);
+	if (ms == NULL) {
+		fprintf(stderr, "could not listen on port %d\n", options.port);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	printf("mock datasync server listening on port %d\n", options.port);
+
+	while (!stop) {
+		mock_server_service(ms, 100);
+	}
+
+	mock_server_get_stats(ms, &stats);
+	printf("connections: %" PRIu64 ", disconnects: %" PRIu64 "\n", stats.connections, stats.disconnects);
+	printf("received: %" PRIu64 " messages, %" PRIu64 " bytes\n", stats.rx_messages, stats.rx_bytes);
+	printf("sent: %" PRIu64 " messages, %" PRIu64 " bytes, dropped: %" PRIu64 "\n",
+			stats.tx_messages, stats.tx_bytes, stats.dropped);
+
+	mock_server_destroy(ms);
+
+	return 0;
+}
@@ -81,11 +81,16 @@ size_t data_size(void *data) {
 	return sizeof(*d) + d->value.s;
 }
 
+int word_cmp(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
 int main(void) {
 	avl_t *tree;
 	struct test_data data, *p, *q, *r;
 	char *key = "Foo";
 	unsigned i;
+	int ok;
 
 	tree = avl_new(key_cmp, data_copy, data_size, data_cleanup);
 
@@ -163,8 +168,95 @@ int main(void) {
 	p = avl_it_peek_prev(&it);
 	STFU_INFO("peek 1 element before '%s': got key %s, insertion order: %g", key, p->key, p->value.f);
 
+	/* order statistics */
+	avl_it_start(&it, tree);
+	i = 0;
+	ok = 1;
+	while((p = avl_it_next(&it))) {
+		ok = ok && avl_nth(tree, i) == p && avl_rank(tree, p) == i;
+		i++;
+	}
+	STFU_TRUE("avl_nth() and avl_rank() match the in-order position", ok);
+	STFU_TRUE("avl_nth() out of bounds", avl_nth(tree, 100) == NULL);
+
+	key = "mam";
+	q = avl_nth(tree, avl_rank(tree, &key));
+	STFU_TRUE("The rank of a missing key is the position of the next key", strcmp(q->key, "maudissait") == 0);
+
+	ok = 1;
+	for (i = 0 ; i < 100 ; i += 7) {
+		avl_it_start_nth(&it, tree, i);
+		p = avl_it_next(&it);
+		r = avl_it_peek_prev(&it);
+		ok = ok && p == avl_nth(tree, i)
+				&& r == (i > 0 ? avl_nth(tree, i - 1) : NULL)
+				&& avl_it_peek_next(&it) == avl_nth(tree, i + 1);
+	}
+	STFU_TRUE("Iterating from a position", ok);
+
+	for (i = 0 ; i < 100 ; i += 2) {
+		data.key = words[i];
+		avl_remove(tree, &data);
+	}
+	avl_it_start(&it, tree);
+	i = 0;
+	ok = 1;
+	while((p = avl_it_next(&it))) {
+		ok = ok && avl_nth(tree, i) == p && avl_rank(tree, p) == i;
+		i++;
+	}
+	STFU_TRUE("The positions are maintained by the removals", ok && i == 50);
+
 	avl_destroy(tree);
 
+	{
+		char *sorted_words[100];
+		struct test_data sorted[100];
+
+		memcpy(sorted_words, words, sizeof(sorted_words));
+		qsort(sorted_words, 100, sizeof(*sorted_words), word_cmp);
+		memset(sorted, 0, sizeof(sorted));
+		for (i = 0 ; i < 100 ; i++) {
+			sorted[i].key = strdup(sorted_words[i]);
+			sorted[i].value.f = (float)i;
+		}
+
+		tree = avl_new(key_cmp, data_copy, data_size, data_cleanup);
+		STFU_TRUE("Bulk loading sorted elements", avl_bulk_load(tree, sorted, sizeof(*sorted), 100) == 0);
+		STFU_TRUE("The element count is 100", avl_count(tree) == 100);
+
+		ok = 1;
+		for (i = 0 ; i < 100 ; i++) {
+			data.key = sorted_words[i];
+			p = avl_get(tree, &data);
+			ok = ok && p != NULL && p == avl_nth(tree, i) && avl_rank(tree, p) == i && p->value.f == (float)i;
+		}
+		STFU_TRUE("The bulk loaded elements are found at their positions", ok);
+
+		data.key = "zzz";
+		data.value.s = 0;
+		avl_insert(tree, &data);
+		for (i = 0 ; i < 100 ; i += 3) {
+			data.key = sorted_words[i];
+			avl_remove(tree, &data);
+		}
+		avl_it_start(&it, tree);
+		i = 0;
+		ok = 1;
+		q = NULL;
+		while((p = avl_it_next(&it))) {
+			ok = ok && avl_nth(tree, i) == p && (q == NULL || strcmp(q->key, p->key) < 0);
+			q = p;
+			i++;
+		}
+		STFU_TRUE("A bulk loaded tree can be updated", ok && i == 67 && avl_count(tree) == 67);
+
+		data.key = "again";
+		STFU_TRUE("Only an empty tree can be bulk loaded", avl_bulk_load(tree, &data, sizeof(data), 1) == -1);
+
+		avl_destroy(tree);
+	}
+
 	STFU_SUMMARY();
 
 	return STFU_NUMBER_FAILED;
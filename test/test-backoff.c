@@ -0,0 +1,134 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "../lib/backoff.c"
+
+#include "stfu.h"
+
+/*
+ * thundering herd simulation: NCLIENTS clients lose their connection at the
+ * same time, the server is back after SERVER_DOWN_MS and accepts at most
+ * SERVER_CAPACITY connections per SLOT_MS slot, the other attempts fail
+ */
+#define NCLIENTS 10000
+#define SLOT_MS 100
+#define NSLOTS 12000
+#define SERVER_DOWN_MS 5000
+#define SERVER_CAPACITY 400
+
+static struct wc_backoff herd[NCLIENTS];
+static int64_t next_at[NCLIENTS];
+static unsigned attempts[NSLOTS];
+
+/* returns the max number of attempts in a slot, sets the time at which all the clients are connected */
+static unsigned simulate_herd(enum wc_backoff_jitter jitter, int64_t *all_connected) {
+	unsigned i, slot, max = 0, connected = 0, accepted;
+
+	memset(attempts, 0, sizeof(attempts));
+	for (i = 0 ; i < NCLIENTS ; i++) {
+		wc_backoff_init(&herd[i], 0, 0, 30000, jitter, i + 1);
+		next_at[i] = wc_backoff_next(&herd[i]);
+	}
+
+	*all_connected = -1;
+	for (slot = 0 ; slot < NSLOTS && connected < NCLIENTS ; slot++) {
+		accepted = 0;
+		for (i = 0 ; i < NCLIENTS ; i++) {
+			if (next_at[i] < 0 || next_at[i] >= (int64_t)(slot + 1) * SLOT_MS) {
+				continue;
+			}
+			attempts[slot]++;
+			if (slot * SLOT_MS >= SERVER_DOWN_MS && accepted < SERVER_CAPACITY) {
+				accepted++;
+				next_at[i] = -1;
+			} else {
+				next_at[i] += wc_backoff_next(&herd[i]);
+				/* an attempt takes at least one slot */
+				if (next_at[i] < (int64_t)(slot + 1) * SLOT_MS) {
+					next_at[i] = (int64_t)(slot + 1) * SLOT_MS;
+				}
+			}
+		}
+		connected += accepted;
+		if (attempts[slot] > max) {
+			max = attempts[slot];
+		}
+	}
+	if (connected == NCLIENTS) {
+		*all_connected = (int64_t)slot * SLOT_MS;
+	}
+	return max;
+}
+
+int main(void) {
+	struct wc_backoff b;
+	unsigned i, d, ok;
+	unsigned max_none, max_full, max_decorrelated;
+	int64_t t_none, t_full, t_decorrelated;
+
+	wc_backoff_init(&b, 0, 0, 0, WC_BACKOFF_JITTER_NONE, 0);
+	STFU_TRUE("Default initial delay", b.initial_ms == WC_BACKOFF_DEFAULT_INITIAL_MS);
+	STFU_TRUE("Default max delay", b.max_ms == WC_BACKOFF_DEFAULT_MAX_MS);
+	STFU_TRUE("Default multiplier", b.multiplier == WC_BACKOFF_DEFAULT_MULTIPLIER);
+
+	wc_backoff_init(&b, 100, 3, 1000, WC_BACKOFF_JITTER_NONE, 42);
+	STFU_TRUE("First attempt is immediate", wc_backoff_next(&b) == 0);
+	STFU_TRUE("Second attempt after the initial delay", wc_backoff_next(&b) == 100);
+	STFU_TRUE("Delays are multiplied", wc_backoff_next(&b) == 300 && wc_backoff_next(&b) == 900);
+	STFU_TRUE("Delays are capped", wc_backoff_next(&b) == 1000 && wc_backoff_next(&b) == 1000);
+	wc_backoff_reset(&b);
+	STFU_TRUE("Reset starts over", wc_backoff_next(&b) == 0 && wc_backoff_next(&b) == 100);
+
+	wc_backoff_init(&b, 100, 2, 1000, WC_BACKOFF_JITTER_FULL, 42);
+	ok = wc_backoff_next(&b) <= 100;
+	for (i = 0 ; i < 1000 ; i++) {
+		d = wc_backoff_next(&b);
+		ok = ok && d <= (i < 4 ? 100u << i : 1000u);
+	}
+	STFU_TRUE("Full jitter delays are in [0, exponential delay]", ok);
+
+	wc_backoff_init(&b, 100, 3, 1000, WC_BACKOFF_JITTER_DECORRELATED, 42);
+	ok = wc_backoff_next(&b) <= 100;
+	for (i = 0 ; i < 1000 ; i++) {
+		d = wc_backoff_next(&b);
+		ok = ok && d >= 100 && d <= 1000;
+	}
+	STFU_TRUE("Decorrelated jitter delays are in [initial, max]", ok);
+
+	max_none = simulate_herd(WC_BACKOFF_JITTER_NONE, &t_none);
+	max_full = simulate_herd(WC_BACKOFF_JITTER_FULL, &t_full);
+	max_decorrelated = simulate_herd(WC_BACKOFF_JITTER_DECORRELATED, &t_decorrelated);
+	printf("\tpeak attempts per %d ms: none %u, full %u, decorrelated %u\n", SLOT_MS, max_none, max_full, max_decorrelated);
+	printf("\tall connected after: none %"PRId64" ms, full %"PRId64" ms, decorrelated %"PRId64" ms\n", t_none, t_full, t_decorrelated);
+	STFU_TRUE("Without jitter the whole herd retries at once", max_none == NCLIENTS);
+	STFU_TRUE("Full jitter spreads the herd", max_full < NCLIENTS / 4);
+	STFU_TRUE("Decorrelated jitter spreads the herd", max_decorrelated < NCLIENTS / 4);
+	STFU_TRUE("The herd eventually connects", t_none > 0 && t_full > 0 && t_decorrelated > 0);
+	STFU_TRUE("Jitter connects the herd sooner", t_full < t_none && t_decorrelated < t_none);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
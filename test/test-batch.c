@@ -0,0 +1,160 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/datasync/batch.c"
+
+#include "stfu.h"
+
+/* stubs */
+struct sent_req {
+	int64_t id;
+	int merge;
+	char path[64];
+	char json[256];
+	wc_on_req_result_t callback;
+	void *user;
+} sent[16];
+int nsent = 0;
+
+static int64_t send_req(int merge, char *path, char *json, wc_on_req_result_t callback, void *user) {
+	sent[nsent].id = nsent + 1;
+	sent[nsent].merge = merge;
+	snprintf(sent[nsent].path, sizeof(sent[nsent].path), "%s", path);
+	snprintf(sent[nsent].json, sizeof(sent[nsent].json), "%s", json);
+	sent[nsent].callback = callback;
+	sent[nsent].user = user;
+	return sent[nsent++].id;
+}
+
+int64_t wc_datasync_put(UNUSED_PARAM(wc_context_t *cnx), char *path, char *json, wc_on_req_result_t callback, void *user) {
+	return send_req(0, path, json, callback, user);
+}
+
+int64_t wc_datasync_merge(UNUSED_PARAM(wc_context_t *cnx), char *path, char *json, wc_on_req_result_t callback, void *user) {
+	return send_req(1, path, json, callback, user);
+}
+/* end stubs */
+
+static void reply(wc_context_t *ctx, int i, int ok) {
+	sent[i].callback(ctx, sent[i].id, sent[i].merge ? WC_ACTION_MERGE : WC_ACTION_PUT, ok ? WC_REQ_OK : WC_REQ_ERROR, ok ? "ok" : "permission_denied", NULL, sent[i].user);
+}
+
+static int ncompleted;
+static int64_t completed_id;
+static wc_req_pending_result_t completed_status;
+static char completed_reason[64];
+
+static void on_batch(UNUSED_PARAM(wc_context_t *cnx), int64_t id, UNUSED_PARAM(wc_action_type_t type), wc_req_pending_result_t status, char *reason, UNUSED_PARAM(char *data), UNUSED_PARAM(void *user)) {
+	ncompleted++;
+	completed_id = id;
+	completed_status = status;
+	snprintf(completed_reason, sizeof(completed_reason), "%s", reason);
+}
+
+static wc_context_t ctx;
+
+int main(void)
+{
+	struct wc_datasync_batch_stats stats;
+	wc_batch_t *b;
+	json_object *folded, *val;
+	int64_t id;
+	int ok;
+
+	b = wc_datasync_batch_begin(&ctx);
+	wc_datasync_batch_put(b, "/devices/d1/state", "\"on\"");
+	wc_datasync_batch_put(b, "/devices/d1/level", "42");
+	wc_datasync_batch_merge(b, "/devices/d1", "{\"name\":\"lamp\",\"level\":43}");
+	wc_datasync_batch_put(b, "/devices/d1/room", "null");
+	id = wc_datasync_batch_commit(b, on_batch, NULL);
+	ok = id == 1 && nsent == 1 && sent[0].merge && strcmp(sent[0].path, "/devices/d1") == 0;
+	STFU_TRUE("Operations on the children of a common ancestor are folded in a merge", ok);
+	folded = json_tokener_parse(sent[0].json);
+	ok = json_object_object_length(folded) == 4
+			&& json_object_object_get_ex(folded, "level", &val) && json_object_get_int(val) == 43
+			&& json_object_object_get_ex(folded, "state", &val) && strcmp(json_object_get_string(val), "on") == 0
+			&& json_object_object_get_ex(folded, "name", &val) && strcmp(json_object_get_string(val), "lamp") == 0
+			&& json_object_object_get_ex(folded, "room", &val) && val == NULL;
+	json_object_put(folded);
+	STFU_TRUE("The folded merge applies the operations in order", ok);
+	STFU_TRUE("The callback is not called before the result is known", ncompleted == 0);
+	reply(&ctx, 0, 1);
+	STFU_TRUE("The callback is called with the result of the merge", ncompleted == 1 && completed_id == 1 && completed_status == WC_REQ_OK);
+
+	nsent = 0;
+	b = wc_datasync_batch_begin(&ctx);
+	wc_datasync_batch_put(b, "/a/b", "1");
+	wc_datasync_batch_put(b, "/a/b", "2");
+	wc_datasync_batch_commit(b, on_batch, NULL);
+	ok = nsent == 1 && sent[0].merge && strcmp(sent[0].path, "/a") == 0 && strcmp(sent[0].json, "{\"b\":2}") == 0;
+	STFU_TRUE("Puts to the same path are folded in a merge on the parent", ok);
+	reply(&ctx, 0, 1);
+
+	nsent = 0;
+	b = wc_datasync_batch_begin(&ctx);
+	wc_datasync_batch_put(b, "/a/b/c", "1");
+	wc_datasync_batch_put(b, "/a/d", "2");
+	wc_datasync_batch_merge(b, "/e", "{\"f\":3}");
+	id = wc_datasync_batch_commit(b, on_batch, NULL);
+	ok = nsent == 3 && id == 1 && !sent[0].merge && strcmp(sent[0].path, "/a/b/c") == 0
+			&& strcmp(sent[1].path, "/a/d") == 0 && sent[2].merge && strcmp(sent[2].path, "/e") == 0;
+	STFU_TRUE("Operations that cannot be folded are sent in order", ok);
+	reply(&ctx, 1, 1);
+	reply(&ctx, 0, 0);
+	STFU_TRUE("The callback waits for all the requests", ncompleted == 2);
+	reply(&ctx, 2, 1);
+	ok = ncompleted == 3 && completed_id == 1 && completed_status == WC_REQ_ERROR && strcmp(completed_reason, "permission_denied") == 0;
+	STFU_TRUE("A batch fails with the reason of the first failed request", ok);
+
+	nsent = 0;
+	b = wc_datasync_batch_begin(&ctx);
+	STFU_TRUE("An empty batch is not sent", wc_datasync_batch_commit(b, on_batch, NULL) == -1 && nsent == 0);
+
+	b = wc_datasync_batch_begin(&ctx);
+	wc_datasync_batch_put(b, "/x", "1");
+	wc_datasync_batch_abort(b);
+	STFU_TRUE("An aborted batch is not sent", nsent == 0);
+
+	nsent = 0;
+	b = wc_datasync_batch_begin(&ctx);
+	wc_datasync_batch_put(b, "/g/h", "1");
+	wc_datasync_batch_put(b, "/g/i", "{\"j\":");
+	wc_datasync_batch_commit(b, on_batch, NULL);
+	ok = nsent == 2 && !sent[0].merge && strcmp(sent[0].path, "/g/h") == 0
+			&& !sent[1].merge && strcmp(sent[1].json, "{\"j\":") == 0;
+	STFU_TRUE("A malformed value is not folded as a deletion", ok);
+	reply(&ctx, 0, 1);
+	reply(&ctx, 1, 0);
+
+	wc_datasync_batch_get_stats(&ctx, &stats);
+	ok = stats.committed == 4 && stats.folded == 2 && stats.ops == 11 && stats.requests == 7
+			&& stats.completed == 4 && stats.failed == 2;
+	STFU_TRUE("Batch statistics are maintained", ok);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,175 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <string.h>
+#include <json-c/json.h>
+#include <webcom-c/webcom.h>
+
+#include "../lib/datasync/cbor.c"
+
+#include "stfu.h"
+
+static unsigned char out[64];
+
+/* encodes a JSON document, returns the CBOR as hex */
+static char *enc(const char *json) {
+	static char hex[2 * sizeof(out) + 1];
+	json_object *jobj = json_tokener_parse(json);
+	struct cbor_buf b;
+	size_t i;
+
+	cbor_buf_init(&b);
+	hex[0] = '\0';
+	if (cbor_encode(jobj, &b) == 0 && b.len < sizeof(out)) {
+		for (i = 0 ; i < b.len ; i++) {
+			sprintf(hex + 2 * i, "%02x", b.data[i]);
+		}
+	}
+	cbor_buf_cleanup(&b);
+	json_object_put(jobj);
+	return hex;
+}
+
+/* decodes hex CBOR, returns it as JSON, or "error" */
+static char *dec(const char *hex) {
+	static char json[256];
+	json_object *jobj;
+	size_t len = strlen(hex) / 2, i;
+	unsigned x;
+
+	for (i = 0 ; i < len ; i++) {
+		sscanf(hex + 2 * i, "%2x", &x);
+		out[i] = (unsigned char)x;
+	}
+	if (cbor_decode(out, len, &jobj) != 0) {
+		return "error";
+	}
+	snprintf(json, sizeof(json), "%s", json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PLAIN));
+	json_object_put(jobj);
+	return json;
+}
+
+int main(void) {
+	char deep[2 * (CBOR_MAX_DEPTH + 1) + 3];
+	wc_msg_t msg, parsed;
+	unsigned char *cbor;
+	size_t len;
+	int i;
+
+	/* RFC 7049 appendix A */
+	STFU_STR_EQ("Encode 0", enc("0"), "00");
+	STFU_STR_EQ("Encode 23", enc("23"), "17");
+	STFU_STR_EQ("Encode 24", enc("24"), "1818");
+	STFU_STR_EQ("Encode 1000", enc("1000"), "1903e8");
+	STFU_STR_EQ("Encode 1000000000000", enc("1000000000000"), "1b000000e8d4a51000");
+	STFU_STR_EQ("Encode -1", enc("-1"), "20");
+	STFU_STR_EQ("Encode -1000", enc("-1000"), "3903e7");
+	STFU_STR_EQ("Encode 1.1", enc("1.1"), "fb3ff199999999999a");
+	STFU_STR_EQ("Encode false", enc("false"), "f4");
+	STFU_STR_EQ("Encode null", enc("null"), "f6");
+	STFU_STR_EQ("Encode a string", enc("\"\\u00fc\""), "62c3bc");
+	STFU_STR_EQ("Encode nested arrays", enc("[1,[2,3],[4,5]]"), "8301820203820405");
+	STFU_STR_EQ("Encode an object", enc("{\"a\":1,\"b\":[2,3]}"), "a26161016162820203");
+
+	STFU_STR_EQ("Decode an object", dec("a26161016162820203"), "{\"a\":1,\"b\":[2,3]}");
+	STFU_STR_EQ("Decode a half float", dec("f93e00"), "1.5");
+	STFU_STR_EQ("Decode a single float", dec("fa3e800000"), "0.25");
+	STFU_STR_EQ("Decode a tagged item", dec("c11a514b67b0"), "1363896240");
+	STFU_STR_EQ("Decode a negative integer", dec("3903e7"), "-1000");
+
+	STFU_STR_EQ("Reject a truncated item", dec("a2616101616282"), "error");
+	STFU_STR_EQ("Reject trailing bytes", dec("0000"), "error");
+	STFU_STR_EQ("Reject indefinite lengths", dec("9f01ff"), "error");
+	STFU_STR_EQ("Reject byte strings", dec("4101"), "error");
+	STFU_STR_EQ("Reject non text keys", dec("a10101"), "error");
+	STFU_STR_EQ("Reject huge lengths", dec("9bffffffffffffffff"), "error");
+	for (i = 0 ; i <= CBOR_MAX_DEPTH ; i++) {
+		memcpy(deep + 2 * i, "81", 2);
+	}
+	strcpy(deep + 2 * i, "01");
+	STFU_STR_EQ("Reject deep nesting", dec(deep), "error");
+
+	/* messages */
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_ACTION;
+	msg.u.data.u.action.type = WC_ACTION_PUT;
+	msg.u.data.u.action.r = 42;
+	msg.u.data.u.action.u.put.path = "/foo/bar";
+	msg.u.data.u.action.u.put.data = "{\"x\":[true,null,\"y\"],\"z\":-2.5}";
+	cbor = wc_datasync_msg_to_cbor(&msg, &len);
+	STFU_TRUE("Encode a put request", cbor != NULL && len > 0);
+	STFU_TRUE("Decode a put request", wc_datasync_parse_msg_cbor(cbor, len, &parsed)
+			&& parsed.u.data.type == WC_DATA_MSG_ACTION
+			&& parsed.u.data.u.action.type == WC_ACTION_PUT
+			&& parsed.u.data.u.action.r == 42
+			&& strcmp(parsed.u.data.u.action.u.put.path, "/foo/bar") == 0
+			&& strcmp(parsed.u.data.u.action.u.put.data, "{\"x\":[true,null,\"y\"],\"z\":-2.5}") == 0);
+	wc_datasync_msg_free(&parsed);
+	STFU_TRUE("Reject a truncated message", !wc_datasync_parse_msg_cbor(cbor, len - 1, &parsed));
+	free(cbor);
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_CTRL;
+	msg.u.ctrl.type = WC_CTRL_MSG_HANDSHAKE;
+	msg.u.ctrl.u.handshake.ts = 1492191239182;
+	msg.u.ctrl.u.handshake.server = "mock";
+	msg.u.ctrl.u.handshake.version = "5";
+	cbor = wc_datasync_msg_to_cbor(&msg, &len);
+	STFU_TRUE("Round trip of a handshake", wc_datasync_parse_msg_cbor(cbor, len, &parsed)
+			&& parsed.type == WC_MSG_CTRL
+			&& parsed.u.ctrl.u.handshake.ts == 1492191239182
+			&& strcmp(parsed.u.ctrl.u.handshake.server, "mock") == 0);
+	wc_datasync_msg_free(&parsed);
+	free(cbor);
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_PUSH;
+	msg.u.data.u.push.type = WC_PUSH_DATA_UPDATE_MERGE;
+	msg.u.data.u.push.u.update_merge.path = "/a";
+	msg.u.data.u.push.u.update_merge.data = "{\"b\":null,\"c\":1}";
+	cbor = wc_datasync_msg_to_cbor(&msg, &len);
+	STFU_TRUE("Round trip of a merge push", wc_datasync_parse_msg_cbor(cbor, len, &parsed)
+			&& parsed.u.data.u.push.type == WC_PUSH_DATA_UPDATE_MERGE
+			&& strcmp(parsed.u.data.u.push.u.update_merge.data, "{\"b\":null,\"c\":1}") == 0);
+	wc_datasync_msg_free(&parsed);
+	free(cbor);
+
+	wc_datasync_msg_init(&msg);
+	msg.type = WC_MSG_DATA;
+	msg.u.data.type = WC_DATA_MSG_RESPONSE;
+	msg.u.data.u.response.r = 7;
+	msg.u.data.u.response.status = "ok";
+	msg.u.data.u.response.data = "\"done\"";
+	cbor = wc_datasync_msg_to_cbor(&msg, &len);
+	STFU_TRUE("Round trip of a response", wc_datasync_parse_msg_cbor(cbor, len, &parsed)
+			&& parsed.u.data.type == WC_DATA_MSG_RESPONSE
+			&& parsed.u.data.u.response.r == 7
+			&& strcmp(parsed.u.data.u.response.status, "ok") == 0);
+	wc_datasync_msg_free(&parsed);
+	free(cbor);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
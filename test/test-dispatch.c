@@ -0,0 +1,208 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <unistd.h>
+
+#include "../lib/datasync/on/on_dispatch.c"
+#include "../lib/timer.c"
+
+#include "stfu.h"
+
+/* stubs */
+static int deleted = 0;
+void on_registry_mark_cb_for_deletion(on_handle_t p_cb) {
+	((struct on_cb_list *)p_cb)->cancelled = 1;
+	deleted++;
+}
+
+static int timer_set = 0;
+static int event_cb(wc_event_t event, UNUSED_PARAM(wc_context_t *ctx), void *data, UNUSED_PARAM(size_t len)) {
+	if (event == WC_EVENT_SET_TIMER && ((struct wc_timerargs *)data)->timer == WC_TIMER_MUX) {
+		timer_set++;
+	}
+	return 0;
+}
+
+static void resume_cb(UNUSED_PARAM(wc_context_t *ctx), struct wc_timer *timer) {
+	on_dispatch_refill(timer->data);
+	on_dispatch_run(timer->data);
+}
+/* end stubs */
+
+static char trace[64];
+static int ntrace = 0;
+static char last_value[16];
+
+static int cb_high(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(on_handle_t h), UNUSED_PARAM(char *data), UNUSED_PARAM(char *cur), UNUSED_PARAM(char *prev)) {
+	trace[ntrace++] = 'H';
+	return 1;
+}
+
+static int cb_normal(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(on_handle_t h), char *data, UNUSED_PARAM(char *cur), UNUSED_PARAM(char *prev)) {
+	trace[ntrace++] = 'N';
+	snprintf(last_value, sizeof(last_value), "%s", data);
+	return 1;
+}
+
+static int cb_low(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(on_handle_t h), UNUSED_PARAM(char *data), char *cur, UNUSED_PARAM(char *prev)) {
+	trace[ntrace++] = cur != NULL ? cur[0] : 'L';
+	return 0;
+}
+
+static struct on_data *data_new(const char *json) {
+	struct on_data *ret = on_data_new(strlen(json));
+	strcpy(ret->json, json);
+	return ret;
+}
+
+int main(void)
+{
+	wc_context_t ctx;
+	struct on_dispatch d;
+	struct on_sub sub;
+	struct on_cb_list high, normal, low;
+	struct on_data *data;
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&sub, 0, sizeof(sub));
+	ctx.callback = event_cb;
+	sub.ctx = &ctx;
+
+	memset(&high, 0, sizeof(high));
+	memset(&normal, 0, sizeof(normal));
+	memset(&low, 0, sizeof(low));
+	high.cb = cb_high;
+	high.sub = &sub;
+	high.priority = WC_ON_PRIORITY_HIGH;
+	normal.cb = cb_normal;
+	normal.sub = &sub;
+	normal.priority = WC_ON_PRIORITY_NORMAL;
+	low.cb = cb_low;
+	low.sub = &sub;
+	low.priority = WC_ON_PRIORITY_LOW;
+
+	on_dispatch_init(&d, resume_cb, &d);
+	d.ctx = &ctx;
+
+	/* priority ordering */
+	data = data_new("1");
+	on_dispatch_push(&d, &low, ON_CHILD_ADDED, data, "a", NULL);
+	on_dispatch_push(&d, &normal, ON_VALUE, data, NULL, NULL);
+	on_dispatch_push(&d, &high, ON_VALUE, data, NULL, NULL);
+	on_data_unref(data);
+
+	STFU_TRUE("3 events are queued", d.depth == 3 && d.stats.max_depth == 3);
+
+	on_dispatch_run(&d);
+	STFU_TRUE("Events are delivered by priority", ntrace == 3 && memcmp(trace, "HNa", 3) == 0);
+	STFU_TRUE("Returning 0 cancels the callback", deleted == 1 && low.cancelled);
+	STFU_TRUE("The queue is empty", d.depth == 0 && timer_set == 0 && normal.queued == 0);
+
+	/* cancelled callbacks are not queued anymore */
+	data = data_new("2");
+	on_dispatch_push(&d, &low, ON_CHILD_ADDED, data, "b", NULL);
+	on_data_unref(data);
+	STFU_TRUE("Cancelled callbacks are ignored", d.depth == 0);
+
+	/* coalescing */
+	ntrace = 0;
+	data = data_new("3");
+	on_dispatch_push(&d, &normal, ON_VALUE, data, NULL, NULL);
+	on_data_unref(data);
+	data = data_new("4");
+	on_dispatch_push(&d, &normal, ON_VALUE, data, NULL, NULL);
+	on_data_unref(data);
+	STFU_TRUE("Consecutive values are coalesced", d.depth == 1 && d.stats.coalesced == 1);
+	on_dispatch_run(&d);
+	STFU_TRUE("Only the latest value is delivered", ntrace == 1 && strcmp(last_value, "4") == 0);
+
+	/* budget */
+	ntrace = 0;
+	ctx.dispatch_budget_callbacks = 2;
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "x", NULL);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "y", NULL);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "z", NULL);
+	on_dispatch_run(&d);
+	STFU_TRUE("The budget limits the deliveries", ntrace == 2 && d.depth == 1);
+	STFU_TRUE("The dispatcher yields to the event loop", timer_set == 1 && d.stats.yields == 1);
+	on_dispatch_run(&d);
+	STFU_TRUE("The yield timer is not armed twice", timer_set == 1);
+	usleep(2000);
+	wc_timers_service(&ctx);
+	STFU_TRUE("The remaining events are delivered on resume", ntrace == 3 && d.depth == 0);
+
+	/* the budget is spent per event loop iteration, not per run */
+	usleep(2000);
+	wc_timers_service(&ctx);
+	STFU_TRUE("The budget is refilled on the next iteration", d.spent_cb == 0 && !wc_timer_is_armed(&d.resume_timer));
+	ntrace = 0;
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "x", NULL);
+	on_dispatch_run(&d);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "y", NULL);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "z", NULL);
+	on_dispatch_run(&d);
+	STFU_TRUE("Several runs in an iteration share the budget", ntrace == 2 && d.depth == 1);
+	usleep(2000);
+	wc_timers_service(&ctx);
+	STFU_TRUE("The event left over is delivered on the next iteration", ntrace == 3 && d.depth == 0);
+	usleep(2000);
+	wc_timers_service(&ctx);
+
+	/* events queued outside of the event processing */
+	ntrace = 0;
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "x", NULL);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "y", NULL);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "z", NULL);
+	on_dispatch_defer(&d);
+	STFU_TRUE("Deferred events are not delivered right away", ntrace == 0 && wc_timer_is_armed(&d.resume_timer));
+	usleep(2000);
+	wc_timers_service(&ctx);
+	STFU_TRUE("Deferred events are delivered within the budget", ntrace == 2 && d.depth == 1);
+	usleep(2000);
+	wc_timers_service(&ctx);
+	STFU_TRUE("The remaining deferred events are delivered next", ntrace == 3 && d.depth == 0);
+	usleep(2000);
+	wc_timers_service(&ctx);
+	on_dispatch_defer(&d);
+	STFU_TRUE("Nothing is deferred when the queue is empty", !wc_timer_is_armed(&d.resume_timer));
+
+	/* bounded backlog */
+	ntrace = 0;
+	ctx.dispatch_backlog_max = 2;
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "x", NULL);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "y", NULL);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "z", NULL);
+	STFU_TRUE("A full backlog delivers the oldest events", ntrace == 1 && d.depth == 2 && d.stats.overflows == 1);
+
+	/* cancellation */
+	on_dispatch_cancel(&d, &high);
+	STFU_TRUE("Cancelling a callback purges its queued events", d.depth == 0 && high.queued == 0);
+	on_dispatch_push(&d, &high, ON_CHILD_ADDED, NULL, "x", NULL);
+	STFU_TRUE("The queue is still usable after a purge", d.depth == 1);
+
+	on_dispatch_cleanup(&d);
+	STFU_TRUE("No timer is left armed", ctx.timers.count == 0);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,257 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <string.h>
+
+#include "webcom-c/webcom.h"
+#include "webcom-c/webcom-epoll.h"
+#include "../lib/timer.h"
+#include "mock_server.h"
+
+#include "stfu.h"
+
+#define E2E_PORT 18081
+
+static wc_loop_t *loop;
+static struct mock_server *server;
+
+static int connected = 0;
+static int disconnections = 0;
+
+static void on_connected(UNUSED_PARAM(wc_context_t *ctx)) {
+	connected++;
+}
+
+static int on_disconnected(UNUSED_PARAM(wc_context_t *ctx)) {
+	disconnections++;
+	return 1;
+}
+
+static int nresults;
+static wc_req_pending_result_t last_status;
+static char last_reason[64];
+static int64_t result_at;
+
+static void on_result(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(int64_t id), UNUSED_PARAM(wc_action_type_t type),
+		wc_req_pending_result_t status, char *reason, UNUSED_PARAM(char *data), UNUSED_PARAM(void *user))
+{
+	nresults++;
+	last_status = status;
+	strncpy(last_reason, reason != NULL ? reason : "", sizeof(last_reason) - 1);
+	result_at = wc_timer_now();
+}
+
+static int nvalues;
+static char last_value[256];
+
+static int on_value(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(on_handle_t handle), char *data,
+		UNUSED_PARAM(char *current_key), UNUSED_PARAM(char *previous_key))
+{
+	nvalues++;
+	strncpy(last_value, data != NULL ? data : "", sizeof(last_value) - 1);
+	return 1;
+}
+
+/* runs the server and the client until *counter reaches n, or for timeout_ms */
+static int run_until(int *counter, int n, int timeout_ms) {
+	int64_t deadline = wc_timer_now() + timeout_ms;
+
+	while ((counter == NULL || *counter < n) && wc_timer_now() < deadline) {
+		mock_server_service(server, 0);
+		wc_loop_run_once(loop, 5);
+	}
+	return counter == NULL || *counter >= n;
+}
+
+static wc_context_t *new_client(struct wc_eli_callbacks *callbacks, int binary) {
+	struct wc_context_options options;
+
+	memset(&options, 0, sizeof(options));
+	options.host = "localhost";
+	options.port = E2E_PORT;
+	options.app_name = "e2e";
+	options.no_tls = 1;
+	options.binary_framing = binary;
+	options.reconnect_initial_ms = 10;
+
+	return wc_context_create_with_epoll(&options, loop, callbacks);
+}
+
+static struct mock_server *new_server(struct mock_server_options *options) {
+	options->port = E2E_PORT;
+	return mock_server_new(options);
+}
+
+static void reset(void) {
+	nresults = 0;
+	nvalues = 0;
+	last_reason[0] = '\0';
+	last_value[0] = '\0';
+}
+
+int main(void) {
+	struct wc_eli_callbacks callbacks;
+	struct mock_server_options so;
+	struct mock_server_stats stats;
+	wc_context_t *ctx, *other;
+	int64_t id, start;
+
+	memset(&callbacks, 0, sizeof(callbacks));
+	callbacks.on_connected = on_connected;
+	callbacks.on_disconnected = on_disconnected;
+
+	loop = wc_loop_new();
+
+	/* handshake, writes and pushes */
+	memset(&so, 0, sizeof(so));
+	server = new_server(&so);
+	STFU_TRUE("Start the mock server", server != NULL);
+
+	ctx = new_client(&callbacks, 0);
+	wc_datasync_connect(ctx);
+	STFU_TRUE("The client gets the handshake", run_until(&connected, 1, 2000));
+	mock_server_get_stats(server, &stats);
+	STFU_TRUE("The server has one text session", stats.sessions == 1 && stats.binary_sessions == 0);
+
+	reset();
+	wc_datasync_on_value(ctx, "/foo", on_value);
+	run_until(NULL, 0, 200);
+	mock_server_get_stats(server, &stats);
+	STFU_TRUE("The server has one listen", stats.listens == 1);
+
+	reset();
+	wc_datasync_put(ctx, "/foo/bar", "42", on_result, NULL);
+	STFU_TRUE("The put is answered", run_until(&nresults, 1, 2000) && last_status == WC_REQ_OK);
+	run_until(&nvalues, 1, 2000);
+	STFU_STR_EQ("The put is pushed back", last_value, "{\"bar\":42}");
+
+	reset();
+	wc_datasync_merge(ctx, "/foo", "{\"baz\":true}", on_result, NULL);
+	STFU_TRUE("The merge is answered", run_until(&nresults, 1, 2000) && last_status == WC_REQ_OK);
+	run_until(&nvalues, 1, 2000);
+	STFU_STR_EQ("The merge is pushed back", last_value, "{\"bar\":42,\"baz\":true}");
+
+	/* a second client, using the binary framing, sees the writes of the first one */
+	other = new_client(&callbacks, 1);
+	wc_datasync_connect(other);
+	STFU_TRUE("The binary client gets the handshake", run_until(&connected, 2, 2000));
+	mock_server_get_stats(server, &stats);
+	STFU_TRUE("The server has a binary session", stats.sessions == 2 && stats.binary_sessions == 1);
+
+	reset();
+	wc_datasync_on_value(other, "/foo/bar", on_value);
+	STFU_TRUE("The binary listen gets the current value", run_until(&nvalues, 1, 2000) && strcmp(last_value, "42") == 0);
+	reset();
+	wc_datasync_put(ctx, "/foo/bar", "\"hello\"", NULL, NULL);
+	STFU_TRUE("The write is pushed to both clients", run_until(&nvalues, 2, 2000));
+	STFU_STR_EQ("The binary client gets the new value", last_value, "\"hello\"");
+
+	/* the server closes the connections, the clients reconnect and listen again */
+	mock_server_disconnect_all(server);
+	STFU_TRUE("The clients are disconnected", run_until(&disconnections, 2, 2000));
+	STFU_TRUE("The clients reconnect", run_until(&connected, 4, 5000));
+	run_until(NULL, 0, 100);
+	mock_server_get_stats(server, &stats);
+	STFU_TRUE("The listens are resumed", stats.sessions == 2 && stats.listens == 2 && stats.disconnects == 2);
+
+	wc_context_destroy(other);
+	wc_context_destroy(ctx);
+	mock_server_destroy(server);
+
+	/* authentication */
+	memset(&so, 0, sizeof(so));
+	so.auth_token = "secret";
+	server = new_server(&so);
+	ctx = new_client(&callbacks, 0);
+	connected = 0;
+	wc_datasync_connect(ctx);
+	run_until(&connected, 1, 2000);
+
+	reset();
+	wc_datasync_put(ctx, "/foo", "1", on_result, NULL);
+	run_until(&nresults, 1, 2000);
+	STFU_TRUE("A write without credential is denied", last_status == WC_REQ_ERROR);
+	STFU_STR_EQ("The denial reason is given", last_reason, "permission_denied");
+
+	reset();
+	wc_datasync_auth(ctx, "wrong", on_result, NULL);
+	run_until(&nresults, 1, 2000);
+	STFU_TRUE("An invalid credential is rejected", last_status == WC_REQ_ERROR);
+
+	reset();
+	wc_datasync_auth(ctx, "secret", on_result, NULL);
+	run_until(&nresults, 1, 2000);
+	STFU_TRUE("The valid credential is accepted", last_status == WC_REQ_OK);
+
+	reset();
+	wc_datasync_put(ctx, "/foo", "1", on_result, NULL);
+	run_until(&nresults, 1, 2000);
+	STFU_TRUE("An authenticated write is accepted", last_status == WC_REQ_OK);
+
+	wc_context_destroy(ctx);
+	mock_server_destroy(server);
+
+	/* latency */
+	memset(&so, 0, sizeof(so));
+	so.latency_ms = 50;
+	server = new_server(&so);
+	ctx = new_client(&callbacks, 0);
+	connected = 0;
+	wc_datasync_connect(ctx);
+	run_until(&connected, 1, 2000);
+
+	reset();
+	start = wc_timer_now();
+	wc_datasync_put(ctx, "/foo", "1", on_result, NULL);
+	STFU_TRUE("The delayed put is answered", run_until(&nresults, 1, 2000) && last_status == WC_REQ_OK);
+	STFU_TRUE("The answer is delayed", result_at - start >= 50);
+
+	wc_context_destroy(ctx);
+	mock_server_destroy(server);
+
+	/* loss */
+	memset(&so, 0, sizeof(so));
+	so.loss = 1.;
+	so.seed = 42;
+	server = new_server(&so);
+	ctx = new_client(&callbacks, 0);
+	connected = 0;
+	wc_datasync_connect(ctx);
+	STFU_TRUE("The handshake is never dropped", run_until(&connected, 1, 2000));
+
+	reset();
+	id = wc_datasync_put(ctx, "/foo", "1", on_result, NULL);
+	wc_datasync_req_set_timeout(ctx, id, 50);
+	run_until(&nresults, 1, 2000);
+	STFU_TRUE("The lost answer times out", nresults == 1 && last_status == WC_REQ_ERROR);
+	STFU_STR_EQ("The timeout reason is given", last_reason, WC_REQ_REASON_TIMEOUT);
+	mock_server_get_stats(server, &stats);
+	STFU_TRUE("The server counts the dropped message", stats.dropped == 1);
+
+	wc_context_destroy(ctx);
+	mock_server_destroy(server);
+	wc_loop_destroy(loop);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
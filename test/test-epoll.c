@@ -0,0 +1,132 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <unistd.h>
+#include <string.h>
+
+#include "webcom-c/webcom.h"
+#include "webcom-c/webcom-epoll.h"
+#include "../lib/timer.h"
+
+#include "stfu.h"
+
+static int ncalls = 0;
+static short last_events = 0;
+
+static void on_readable(wc_loop_t *loop, int fd, short events, UNUSED_PARAM(void *data)) {
+	char c;
+
+	ncalls++;
+	last_events = events;
+	if (read(fd, &c, 1) == 1 && c == 'q') {
+		wc_loop_del_fd(loop, fd);
+	}
+}
+
+static int64_t fired_at = 0;
+static wc_loop_t *the_loop;
+
+static void on_timer(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(struct wc_timer *t)) {
+	fired_at = wc_timer_now();
+	wc_loop_break(the_loop);
+}
+
+static wc_context_t *doomed;
+
+static void destroy_context(wc_loop_t *loop, int fd, UNUSED_PARAM(short events), UNUSED_PARAM(void *data)) {
+	char c;
+
+	if (read(fd, &c, 1) == 1) {
+		wc_context_destroy(doomed);
+		doomed = NULL;
+		wc_loop_del_fd(loop, fd);
+	}
+}
+
+int main(void) {
+	struct wc_eli_callbacks callbacks;
+	struct wc_context_options options;
+	struct wc_timer timer, other;
+	wc_context_t *ctx;
+	wc_loop_t *loop;
+	int64_t start;
+	int p[2], q[2];
+
+	memset(&callbacks, 0, sizeof(callbacks));
+	memset(&options, 0, sizeof(options));
+	options.host = "localhost";
+	options.port = 443;
+	options.app_name = "test";
+
+	loop = wc_loop_new();
+	the_loop = loop;
+	STFU_TRUE("Create a loop", loop != NULL);
+
+	/* application descriptors */
+	STFU_TRUE("Run an empty loop", wc_loop_run(loop) == 0);
+	STFU_TRUE("Create a pipe", pipe(p) == 0);
+	STFU_TRUE("Watch an application descriptor", wc_loop_add_fd(loop, p[0], WC_POLLIN, on_readable, NULL) == 0);
+	STFU_TRUE("Nothing happens on an idle descriptor", wc_loop_run_once(loop, 0) == 0 && ncalls == 0);
+	STFU_TRUE("Write to the pipe", write(p[1], "a", 1) == 1);
+	STFU_TRUE("The descriptor callback is called", wc_loop_run_once(loop, 100) == 1 && ncalls == 1 && (last_events & WC_POLLIN));
+	STFU_TRUE("Write to the pipe", write(p[1], "q", 1) == 1);
+	STFU_TRUE("The loop stops once nothing is watched", wc_loop_run(loop) == 0 && ncalls == 2);
+	STFU_TRUE("Removing an unknown descriptor fails", wc_loop_del_fd(loop, p[0]) == -1);
+
+	/* context timers */
+	ctx = wc_context_create_with_epoll(&options, loop, &callbacks);
+	STFU_TRUE("Create a context", ctx != NULL);
+	wc_timer_init(&timer, on_timer, NULL);
+	start = wc_timer_now();
+	wc_timer_arm(ctx, &timer, 20);
+	STFU_TRUE("Run until the timer fires", wc_loop_run(loop) == 0 && fired_at != 0);
+	STFU_TRUE("The timer fires on time", fired_at - start >= 20 && fired_at - start < 200);
+
+	fired_at = 0;
+	wc_timer_arm(ctx, &timer, 10);
+	wc_timer_cancel(ctx, &timer);
+	STFU_TRUE("The loop stops once the timer is cancelled", wc_loop_run(loop) == 0 && fired_at == 0);
+
+	/* a context destroyed while its events are being dispatched */
+	doomed = wc_context_create_with_epoll(&options, loop, &callbacks);
+	wc_timer_init(&other, on_timer, NULL);
+	wc_timer_arm(doomed, &other, 0);
+	STFU_TRUE("Create a pipe", pipe(q) == 0);
+	wc_loop_add_fd(loop, q[0], WC_POLLIN, destroy_context, NULL);
+	STFU_TRUE("Write to the pipe", write(q[1], "x", 1) == 1);
+	usleep(10000);
+	fired_at = 0;
+	wc_loop_run_once(loop, 100);
+	STFU_TRUE("The context is destroyed", doomed == NULL);
+	STFU_TRUE("Nothing is watched any more", wc_loop_run(loop) == 0);
+
+	wc_context_destroy(ctx);
+	wc_loop_destroy(loop);
+	close(p[0]);
+	close(p[1]);
+	close(q[0]);
+	close(q[1]);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,124 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stfu.h"
+
+#include "webcom-c/webcom-utils.h"
+#include "../lib/collection/ht.h"
+
+static wc_hash_t str_hash(ht_key_t *key) {
+	return wc_djb2_hash(key);
+}
+
+/* every key in the same bucket */
+static wc_hash_t collide(UNUSED_PARAM(ht_key_t *key)) {
+	return 42;
+}
+
+static int str_eq(ht_key_t *a, ht_key_t *b) {
+	return strcmp(a, b) == 0;
+}
+
+static char *keys[] = {"alpha", "bravo", "charlie", "delta", "echo"};
+#define NKEYS (sizeof(keys) / sizeof(*keys))
+
+static int all_found_but(ht_t *t, unsigned mask) {
+	unsigned i;
+
+	for (i = 0 ; i < NKEYS ; i++) {
+		if (ht_contains(t, keys[i]) != !(mask & (1u << i))
+				|| (!(mask & (1u << i)) && ht_get(t, keys[i]) != keys[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(void) {
+	ht_val_t *val = keys[0];
+	ht_iter_t it;
+	ht_t *t;
+	char key[16];
+	unsigned i, n;
+
+	t = ht_new(str_hash, str_eq, NULL, NULL);
+	STFU_TRUE("Create a table", t != NULL);
+
+	STFU_TRUE("A missing key is not found", ht_contains(t, "foo") == 0);
+	STFU_TRUE("ht_get_ex() without result pointer on a miss", ht_get_ex(t, "foo", NULL) == 0);
+	STFU_TRUE("ht_get_ex() sets the result to NULL on a miss", ht_get_ex(t, "foo", &val) == 0 && val == NULL);
+	STFU_TRUE("Insert a key", ht_insert(t, "foo", "bar") == 1);
+	STFU_TRUE("Inserting it again fails", ht_insert(t, "foo", "baz") == 0);
+	STFU_TRUE("ht_get_ex() without result pointer on a hit", ht_get_ex(t, "foo", NULL) == 1);
+	STFU_STR_EQ("Get the value", ht_get(t, "foo"), "bar");
+	STFU_TRUE("Remove the key", ht_remove(t, "foo") == 1 && ht_count(t) == 0);
+	STFU_TRUE("Removing it again fails", ht_remove(t, "foo") == 0);
+
+	ht_destroy(t);
+
+	/* enough keys to rehash the table back and forth */
+	t = ht_new(str_hash, str_eq, free, NULL);
+	for (i = 0 ; i < 1000 ; i++) {
+		sprintf(key, "k%u", i);
+		ht_insert(t, strdup(key), NULL);
+	}
+	STFU_TRUE("Insert 1000 keys", ht_count(t) == 1000);
+	n = 0;
+	for (ht_it_init(&it, t) ; ht_it_fetch_next(&it) ; ) {
+		n++;
+	}
+	STFU_TRUE("Iterate over the keys", n == 1000);
+
+	for (i = 0 ; i < 1000 ; i += 2) {
+		sprintf(key, "k%u", i);
+		ht_remove(t, key);
+	}
+	n = 0;
+	for (i = 0 ; i < 1000 ; i++) {
+		sprintf(key, "k%u", i);
+		n += ht_contains(t, key) == (int)(i % 2);
+	}
+	STFU_TRUE("Remove every other key", ht_count(t) == 500 && n == 1000);
+	ht_destroy(t);
+
+	/* collided chain: the keys are linked in reverse insertion order */
+	t = ht_new(collide, str_eq, NULL, NULL);
+	for (i = 0 ; i < NKEYS ; i++) {
+		ht_insert(t, keys[i], keys[i]);
+	}
+	STFU_TRUE("All the colliding keys are found", all_found_but(t, 0));
+	STFU_TRUE("Remove a key in the middle of the chain", ht_remove(t, "charlie") == 1);
+	STFU_TRUE("The other keys are still found", all_found_but(t, 1u << 2));
+	STFU_TRUE("Remove the key at the tail of the chain", ht_remove(t, "alpha") == 1);
+	STFU_TRUE("The other keys are still found", all_found_but(t, 1u << 2 | 1u << 0));
+	STFU_TRUE("Remove the key at the head of the chain", ht_remove(t, "echo") == 1);
+	STFU_TRUE("The other keys are still found", all_found_but(t, 1u << 2 | 1u << 0 | 1u << 4));
+	STFU_TRUE("The count is right", ht_count(t) == 2);
+	ht_destroy(t);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,162 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stfu.h"
+
+#include "../lib/datasync/journal.h"
+#include "../lib/webcom_base_priv.h"
+
+static int event_cb(UNUSED_PARAM(wc_event_t event), UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(void *data), UNUSED_PARAM(size_t len)) {
+	return 0;
+}
+
+static off_t file_size(const char *path) {
+	struct stat st;
+
+	return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+static void file_append(const char *path, const void *buf, size_t len) {
+	int fd = open(path, O_WRONLY | O_APPEND);
+
+	if (fd != -1) {
+		if (write(fd, buf, len) != (ssize_t)len) {
+			perror("write");
+		}
+		close(fd);
+	}
+}
+
+int main(void)
+{
+	wc_context_t ctx;
+	struct wc_journal j;
+	struct journal_entry *e;
+	char path[64], *big;
+	size_t one_record;
+	int fd, ok;
+	unsigned char c;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.callback = event_cb;
+	snprintf(path, sizeof(path), "/tmp/webcom-test-journal-%d", (int)getpid());
+	unlink(path);
+
+	journal_init(&j);
+	STFU_TRUE("A new journal is opened", journal_open(&j, path, WC_JOURNAL_SYNC_BATCHED, 0) == 0);
+	STFU_TRUE("The first session is 1, with nothing to replay", j.session == 1 && j.replay == NULL);
+
+	journal_log_action(&ctx, &j, 1, WC_ACTION_PUT, "/a", "1");
+	journal_log_action(&ctx, &j, 2, WC_ACTION_MERGE, "/b", "{\"x\":2}");
+	journal_log_action(&ctx, &j, 3, WC_ACTION_PUT, "/c", "\"three\"");
+	journal_log_done(&ctx, &j, j.session, 2);
+	STFU_TRUE("The records are buffered", j.len > 0 && j.records == 4 && j.commits == 0);
+	STFU_TRUE("A group commit is scheduled", wc_timer_is_armed(&j.commit_timer));
+	STFU_TRUE("The records are not written yet", file_size(path) == 4);
+
+	STFU_TRUE("The group is committed", journal_commit(&j) == 0 && j.len == 0 && j.commits == 1);
+	STFU_TRUE("The records are written", file_size(path) > 4);
+	journal_close(&ctx, &j);
+	STFU_TRUE("Closing cancels the commit timer", !wc_timer_is_armed(&j.commit_timer) && j.fd == -1);
+
+	journal_init(&j);
+	STFU_TRUE("The journal is reopened", journal_open(&j, path, WC_JOURNAL_SYNC_BATCHED, 0) == 0);
+	STFU_TRUE("The session is incremented", j.session == 2);
+	e = j.replay;
+	ok = e != NULL && e->session == 1 && e->id == 1 && e->type == WC_ACTION_PUT
+			&& strcmp(e->path, "/a") == 0 && strcmp(e->data, "1") == 0;
+	STFU_TRUE("The first unresolved write is loaded", ok);
+	e = e != NULL ? e->next : NULL;
+	ok = e != NULL && e->session == 1 && e->id == 3 && strcmp(e->path, "/c") == 0
+			&& strcmp(e->data, "\"three\"") == 0 && e->next == NULL;
+	STFU_TRUE("The second unresolved write is loaded, the resolved one is not", ok);
+
+	journal_log_done(&ctx, &j, 1, 1);
+	journal_log_done(&ctx, &j, 1, 3);
+	journal_log_action(&ctx, &j, 1, WC_ACTION_MERGE, "/d", "{}");
+	journal_close(&ctx, &j);
+
+	journal_init(&j);
+	journal_open(&j, path, WC_JOURNAL_SYNC_BATCHED, 0);
+	ok = j.session == 3 && j.replay != NULL && j.replay->next == NULL
+			&& j.replay->session == 2 && j.replay->id == 1 && j.replay->type == WC_ACTION_MERGE;
+	STFU_TRUE("The writes of the previous sessions are resolved across sessions", ok);
+	journal_close(&ctx, &j);
+	one_record = JOURNAL_HEADER_LEN + strlen("/d") + strlen("{}") + sizeof(uint32_t);
+	STFU_TRUE("The journal is compacted when opened", file_size(path) == (off_t)(4 + one_record));
+
+	file_append(path, "\x01\x01\x02\x00garbage", 11);
+	journal_init(&j);
+	journal_open(&j, path, WC_JOURNAL_SYNC_BATCHED, 0);
+	ok = j.replay != NULL && j.replay->next == NULL && j.replay->id == 1;
+	STFU_TRUE("A torn record at the end is ignored", ok);
+	journal_close(&ctx, &j);
+	STFU_TRUE("The torn record is dropped by the compaction", file_size(path) == (off_t)(4 + one_record));
+
+	fd = open(path, O_RDWR);
+	ok = fd != -1 && pread(fd, &c, 1, 4 + JOURNAL_HEADER_LEN) == 1;
+	c ^= 0xff;
+	ok = ok && pwrite(fd, &c, 1, 4 + JOURNAL_HEADER_LEN) == 1;
+	close(fd);
+	journal_init(&j);
+	journal_open(&j, path, WC_JOURNAL_SYNC_BATCHED, 0);
+	STFU_TRUE("A record with a bad checksum is dropped", ok && j.replay == NULL);
+	journal_close(&ctx, &j);
+
+	journal_init(&j);
+	journal_open(&j, path, WC_JOURNAL_SYNC_ALWAYS, 0);
+	journal_log_action(&ctx, &j, 1, WC_ACTION_PUT, "/e", "null");
+	ok = j.len == 0 && j.commits == 1 && !wc_timer_is_armed(&j.commit_timer);
+	STFU_TRUE("In the always mode, each record is committed right away", ok);
+	journal_close(&ctx, &j);
+
+	big = malloc(JOURNAL_COMMIT_THRESHOLD + 1);
+	memset(big, 'x', JOURNAL_COMMIT_THRESHOLD);
+	big[JOURNAL_COMMIT_THRESHOLD] = '\0';
+	journal_init(&j);
+	journal_open(&j, path, WC_JOURNAL_SYNC_BATCHED, 0);
+	journal_log_action(&ctx, &j, 1, WC_ACTION_PUT, "/f", "1");
+	STFU_TRUE("In the batched mode, a small record is buffered", j.len > 0 && j.commits == 0);
+	journal_log_action(&ctx, &j, 2, WC_ACTION_PUT, "/g", big);
+	STFU_TRUE("A large group is committed right away", j.len == 0 && j.commits == 1);
+	journal_close(&ctx, &j);
+	free(big);
+
+	journal_init(&j);
+	STFU_TRUE("A journal in a missing directory is not opened", journal_open(&j, "/nonexistent/dir/journal", WC_JOURNAL_SYNC_BATCHED, 0) == -1);
+	STFU_TRUE("Nothing is logged to a journal that is not open", journal_log_action(&ctx, &j, 1, WC_ACTION_PUT, "/", "1") == -1);
+	journal_close(&ctx, &j);
+
+	unlink(path);
+	wc_timers_cleanup(&ctx);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,209 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+static int malloc_fails = 0;
+static void *test_malloc(size_t size);
+#define malloc test_malloc
+
+#include "../lib/datasync/listen/listen_registry.c"
+
+#undef malloc
+static void *test_malloc(size_t size) {
+	return malloc_fails ? NULL : malloc(size);
+}
+
+#include "stfu.h"
+
+/* stubs */
+static char sent[256][64];
+static wc_on_req_result_t sent_cb[256];
+static void *sent_user[256];
+static int nsent = 0;
+static int send_fails = 0;
+
+static int64_t stub_send(char *action, char *path, wc_on_req_result_t callback, void *user) {
+	if (send_fails) {
+		return -1;
+	}
+	snprintf(sent[nsent], sizeof(sent[nsent]), "%s %s", action, path);
+	sent_cb[nsent] = callback;
+	sent_user[nsent] = user;
+	return ++nsent;
+}
+
+int64_t wc_datasync_listen(UNUSED_PARAM(wc_context_t *cnx), char *path, wc_on_req_result_t callback, void *user) {
+	return stub_send("l", path, callback, user);
+}
+
+int64_t wc_datasync_listen_hash(UNUSED_PARAM(wc_context_t *cnx), char *path, UNUSED_PARAM(char *hash), wc_on_req_result_t callback, void *user) {
+	return stub_send("l", path, callback, user);
+}
+
+int64_t wc_datasync_unlisten(UNUSED_PARAM(wc_context_t *cnx), char *path, wc_on_req_result_t callback, void *user) {
+	return stub_send("u", path, callback, user);
+}
+/* end stubs */
+
+static void ack_all(wc_context_t *ctx) {
+	int i;
+
+	for (i = 0 ; i < nsent ; i++) {
+		if (sent_cb[i] != NULL) {
+			sent_cb[i](ctx, i + 1, WC_ACTION_LISTEN, WC_REQ_OK, "ok", NULL, sent_user[i]);
+		}
+	}
+	nsent = 0;
+}
+
+static int was_sent(char *s) {
+	int i;
+
+	for (i = 0 ; i < nsent ; i++) {
+		if (strcmp(sent[i], s) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(void) {
+	struct wc_context ctx;
+	struct wc_datasync_listen_stats stats;
+	wc_ds_path_t *parsed_path;
+	struct listen_item *li;
+	char path[32];
+	int i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.datasync_init = 1;
+	ctx.datasync.cache = data_cache_new();
+	ctx.datasync.listen_reg = listen_registry_new();
+	ctx.datasync.state = WC_CNX_STATE_CONNECTED;
+
+	/* a listen followed by an unlisten before being sent: nothing is sent */
+	ctx.listen_burst = 1;
+	wc_listen_queue_next_burst(&ctx);
+	wc_datasync_watch(&ctx, "/b");
+	wc_datasync_watch(&ctx, "/c");
+	STFU_TRUE("The listen request is sent right away", nsent == 1 && was_sent("l /b"));
+	parsed_path = wc_datasync_path_new("/c");
+	wc_datasync_unwatch_ex(&ctx, parsed_path, 1);
+	wc_datasync_path_destroy(parsed_path);
+	wc_listen_queue_next_burst(&ctx);
+	STFU_TRUE("The cancelled listen request is not sent", nsent == 1);
+	wc_datasync_get_listen_stats(&ctx, &stats);
+	STFU_TRUE("The cancelled requests are counted", stats.deduplicated == 2 && stats.queued == 0 && stats.listens_sent == 1 && stats.unlistens_sent == 0);
+	ack_all(&ctx);
+
+	/* masked paths */
+	wc_datasync_watch(&ctx, "/b/x");
+	STFU_TRUE("A masked path is not listened to", nsent == 0);
+	wc_datasync_watch(&ctx, "/d/x");
+	wc_listen_queue_next_burst(&ctx);
+	ack_all(&ctx);
+	wc_listen_queue_next_burst(&ctx);
+	wc_datasync_watch(&ctx, "/d");
+	STFU_TRUE("The masking listen request is sent", nsent == 1 && was_sent("l /d"));
+	parsed_path = wc_datasync_path_new("/d");
+	wc_datasync_unwatch_ex(&ctx, parsed_path, 1);
+	wc_datasync_path_destroy(parsed_path);
+	wc_listen_queue_next_burst(&ctx);
+	wc_listen_queue_next_burst(&ctx);
+	STFU_TRUE("The unlisten and listen requests of a masked path cancel each other", nsent == 2 && was_sent("u /d"));
+	nsent = 0;
+
+	/* subscription storm */
+	ctx.listen_burst = 4;
+	wc_listen_suspend_all(&ctx);
+	ctx.datasync.state = WC_CNX_STATE_DISCONNECTED;
+	for (i = 0 ; i < 10 ; i++) {
+		snprintf(path, sizeof(path), "/storm/%d", i);
+		wc_datasync_watch(&ctx, path);
+	}
+	STFU_TRUE("Nothing is sent while disconnected", nsent == 0);
+	ctx.datasync.state = WC_CNX_STATE_CONNECTED;
+	wc_listen_resume_all(&ctx);
+	wc_datasync_get_listen_stats(&ctx, &stats);
+	STFU_TRUE("The resumed listen requests are sent by bursts", nsent == 4 && stats.queued == 8 && stats.resume_total == 12 && stats.resume_sent == 4);
+	wc_listen_queue_drain(&ctx);
+	STFU_TRUE("The next burst waits for the outbound queue to be empty", nsent == 4);
+	wc_listen_queue_next_burst(&ctx);
+	wc_listen_queue_next_burst(&ctx);
+	wc_datasync_get_listen_stats(&ctx, &stats);
+	STFU_TRUE("All the listen requests are eventually sent", nsent == 12 && stats.queued == 0 && stats.resume_sent == 12);
+	ack_all(&ctx);
+
+	wc_listen_queue_next_burst(&ctx);
+	wc_datasync_unwatch_all(&ctx);
+	STFU_TRUE("The unlisten requests are sent by bursts too", nsent == 4);
+	wc_listen_suspend_all(&ctx);
+	wc_datasync_get_listen_stats(&ctx, &stats);
+	STFU_TRUE("The queue is cleared on disconnection", stats.queued == 0);
+
+	/* requests that cannot be queued */
+	nsent = 0;
+	ctx.datasync.state = WC_CNX_STATE_CONNECTED;
+	ctx.listen_burst = 1;
+	wc_listen_queue_next_burst(&ctx);
+	wc_datasync_watch(&ctx, "/m1");
+	malloc_fails = 1;
+	wc_datasync_watch(&ctx, "/m2");
+	malloc_fails = 0;
+	parsed_path = wc_datasync_path_new("/m2");
+	li = avl_get(ctx.datasync.listen_reg->list, listen_item_from_path(parsed_path));
+	STFU_TRUE("A listen request that cannot be queued is sent right away", nsent == 2 && was_sent("l /m2") && li->status == LISTEN_PENDING);
+	ack_all(&ctx);
+	malloc_fails = 1;
+	wc_datasync_unwatch_ex(&ctx, parsed_path, 1);
+	malloc_fails = 0;
+	wc_datasync_path_destroy(parsed_path);
+	STFU_TRUE("An unlisten request that cannot be queued is sent right away", nsent == 1 && was_sent("u /m2"));
+	ack_all(&ctx);
+
+	ctx.datasync.state = WC_CNX_STATE_DISCONNECTED;
+	malloc_fails = 1;
+	wc_listen_suspend_all(&ctx);
+	ctx.datasync.state = WC_CNX_STATE_CONNECTED;
+	wc_listen_resume_all(&ctx);
+	malloc_fails = 0;
+	wc_datasync_get_listen_stats(&ctx, &stats);
+	STFU_TRUE("The resumed listens are sent right away when they cannot be queued", nsent == 1 && was_sent("l /m1") && stats.resume_sent == 1);
+	nsent = 0;
+
+	send_fails = 1;
+	wc_datasync_watch(&ctx, "/m3");
+	send_fails = 0;
+	parsed_path = wc_datasync_path_new("/m3");
+	li = avl_get(ctx.datasync.listen_reg->list, listen_item_from_path(parsed_path));
+	STFU_TRUE("A listen that could not be sent is required again", li->status == LISTEN_REQUIRED);
+	wc_datasync_path_destroy(parsed_path);
+
+	listen_registry_destroy(ctx.datasync.listen_reg);
+	data_cache_destroy(ctx.datasync.cache);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
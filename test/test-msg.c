@@ -51,6 +51,25 @@ int main(void) {
 	wc_datasync_msg_free(&msg1);
 	free(res);
 
+	wc_datasync_msg_init(&msg1);
+	msg1.type = WC_MSG_DATA;
+	msg1.u.data.type = WC_DATA_MSG_ACTION;
+	msg1.u.data.u.action.type = WC_ACTION_LISTEN;
+	msg1.u.data.u.action.r = 4;
+	msg1.u.data.u.action.u.listen.path = strdup("/brick");
+	msg1.u.data.u.action.u.listen.hash = strdup("aSSNoqcS4oQwJ2xxH20rvpp3zP0=");
+
+	res = wc_datasync_msg_to_json_str(&msg1);
+	wc_datasync_msg_free(&msg1);
+
+	STFU_TRUE	("Parse a listen action with a hash", res != NULL && wc_datasync_parse_msg(res, &msg1) == 1);
+	STFU_TRUE	("The listen action is parsed", msg1.type == WC_MSG_DATA && msg1.u.data.u.action.type == WC_ACTION_LISTEN);
+	STFU_STR_EQ	("Listen action path", msg1.u.data.u.action.u.listen.path, "/brick");
+	STFU_STR_EQ	("Listen action hash", msg1.u.data.u.action.u.listen.hash, "aSSNoqcS4oQwJ2xxH20rvpp3zP0=");
+
+	wc_datasync_msg_free(&msg1);
+	free(res);
+
 	STFU_SUMMARY();
 
 	return STFU_NUMBER_FAILED;
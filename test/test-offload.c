@@ -0,0 +1,226 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <string.h>
+#include <poll.h>
+
+#include "../lib/datasync/rx_offload.c"
+
+#include "stfu.h"
+
+/* stubs */
+static data_cache_t *cache;
+static char handled[16][64];
+static unsigned nhandled = 0;
+
+void wc_datasync_process_message(UNUSED_PARAM(wc_context_t *ctx), wc_msg_t *msg, struct rx_tree *trees, unsigned ntrees) {
+	unsigned i;
+	char *what = "other";
+
+	if (msg->type == WC_MSG_DATA && msg->u.data.type == WC_DATA_MSG_PUSH) {
+		if (msg->u.data.u.push.type == WC_PUSH_DATA_UPDATE_PUT) {
+			what = "put";
+			if (trees == NULL) {
+				data_cache_set(cache, msg->u.data.u.push.u.update_put.path, msg->u.data.u.push.u.update_put.data);
+			}
+		} else if (msg->u.data.u.push.type == WC_PUSH_DATA_UPDATE_MERGE) {
+			what = "merge";
+			if (trees == NULL) {
+				data_cache_merge(cache, msg->u.data.u.push.u.update_merge.path, msg->u.data.u.push.u.update_merge.data);
+			}
+		}
+		for (i = 0 ; trees != NULL && i < ntrees ; i++) {
+			data_cache_set_tree(cache, trees[i].path, trees[i].tree);
+			trees[i].tree = NULL;
+		}
+		snprintf(handled[nhandled++ % 16], sizeof(handled[0]), "%s %s %s", what, msg->u.data.u.push.u.update_put.path, trees ? "offloaded" : "inline");
+	} else {
+		if (msg->type == WC_MSG_CTRL && msg->u.ctrl.type == WC_CTRL_MSG_HANDSHAKE) {
+			what = "handshake";
+		}
+		snprintf(handled[nhandled++ % 16], sizeof(handled[0]), "%s", what);
+	}
+}
+/* end stubs */
+
+static int watched_fd = -1;
+
+static int on_event(wc_event_t event, UNUSED_PARAM(wc_context_t *ctx), void *data, UNUSED_PARAM(size_t len)) {
+	struct wc_pollargs *pa = data;
+
+	if (pa->src == WC_POLL_WORKERS) {
+		if (event == WC_EVENT_ADD_FD) {
+			watched_fd = pa->fd;
+		} else if (event == WC_EVENT_DEL_FD && pa->fd == watched_fd) {
+			watched_fd = -1;
+		}
+	}
+	return 1;
+}
+
+static wc_context_t ctx;
+
+/* runs the event loop until all the received messages are handled */
+static int drain(void) {
+	struct pollfd pfd;
+	int n = 0;
+
+	while (ctx.datasync.rxo->pending > 0 && n++ < 100) {
+		pfd.fd = watched_fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 1000) == 1) {
+			wc_datasync_rx_offload_service(&ctx);
+		}
+	}
+	return ctx.datasync.rxo->pending == 0;
+}
+
+static void feed(char *msg, size_t chunk) {
+	size_t len = strlen(msg), n;
+
+	while (len > 0) {
+		n = len < chunk ? len : chunk;
+		wc_datasync_rx_offload_data(&ctx, msg, n);
+		msg += n;
+		len -= n;
+	}
+}
+
+static int same_tree(struct treenode *a, struct treenode *b) {
+	return treenode_hash_eq(treenode_hash_get(a), treenode_hash_get(b))
+			&& treenode_to_json_len(a) == treenode_to_json_len(b);
+}
+
+int main(void) {
+	struct wc_datasync_parse_stats stats;
+	struct rx_scanner s = {0};
+	data_cache_t *c1, *c2;
+	wc_ds_path_t *path;
+	json_object *doc;
+	struct treenode *n;
+	char big_put[2048], big_merge[2048], *p;
+	unsigned i;
+
+	/* scanner */
+	STFU_TRUE("Scan an incomplete object", rx_scan(&s, "{\"a\":\"}\\\"{\",", 12) == 0 && s.depth == 1);
+	STFU_TRUE("Scan the end of the object", rx_scan(&s, "\"b\":[1,{}]}{}", 13) == 11 && s.depth == 0);
+	STFU_TRUE("Scan the next object", rx_scan(&s, "{}", 2) == 2);
+
+	/* detached trees */
+	c1 = data_cache_new();
+	c2 = data_cache_new();
+	data_cache_set(c1, "/", "{\"a\":{\"b\":1},\"c\":[true,\"x\"]}");
+	data_cache_set(c2, "/", "{\"a\":{\"b\":1},\"c\":[true,\"x\"]}");
+	data_cache_set(c1, "/a/d/e", "{\"f\":\"g\",\"h\":null,\"i\":[]}");
+	doc = json_tokener_parse("{\"f\":\"g\",\"h\":null,\"i\":[]}");
+	path = wc_datasync_path_new("/a/d/e");
+	data_cache_set_tree(c2, path, data_cache_tree_new(doc));
+	wc_datasync_path_destroy(path);
+	json_object_put(doc);
+	STFU_TRUE("A moved tree is the same as a regular set", same_tree(c1->root, c2->root));
+
+	data_cache_set(c1, "/c", "null");
+	path = wc_datasync_path_new("/c");
+	data_cache_set_tree(c2, path, data_cache_tree_new(NULL));
+	wc_datasync_path_destroy(path);
+	STFU_TRUE("A null tree removes the key", data_cache_get(c2, "/c") == NULL && same_tree(c1->root, c2->root));
+
+	doc = json_tokener_parse("\"root\"");
+	path = wc_datasync_path_new("/");
+	n = data_cache_tree_new(doc);
+	treenode_hash_get(n);
+	data_cache_set_tree(c2, path, n);
+	wc_datasync_path_destroy(path);
+	json_object_put(doc);
+	data_cache_set(c1, "/", "\"root\"");
+	STFU_TRUE("Replace the root with a tree", c2->root->type == TREENODE_TYPE_LEAF_STRING && same_tree(c1->root, c2->root));
+	data_cache_destroy(c1);
+	data_cache_destroy(c2);
+
+	/* offloaded messages */
+	p = big_put + sprintf(big_put, "{\"t\":\"d\",\"d\":{\"a\":\"d\",\"b\":{\"p\":\"/big\",\"d\":{");
+	for (i = 0 ; i < 50 ; i++) {
+		p += sprintf(p, "%s\"k%u\":{\"v\":%u,\"s\":\"} \\\" {\"}", i ? "," : "", i, i);
+	}
+	strcpy(p, "}}}}");
+	p = big_merge + sprintf(big_merge, "{\"t\":\"d\",\"d\":{\"a\":\"m\",\"b\":{\"p\":\"/big\",\"d\":{");
+	for (i = 0 ; i < 20 ; i++) {
+		p += sprintf(p, "%s\"k%u\":%s", i ? "," : "", i * 5, i % 2 ? "null" : "\"merged\"");
+	}
+	strcpy(p, "}}}}");
+
+	cache = data_cache_new();
+	ctx.callback = on_event;
+	ctx.datasync_init = 1;
+	STFU_TRUE("Start the parser threads", wc_datasync_rx_offload_open(&ctx, 2, 256) == 0 && watched_fd != -1);
+
+	feed("{\"t\":\"d\",\"d\":{\"a\":\"d\",\"b\":{\"p\":\"/first\",\"d\":0}}}", 7);
+	STFU_TRUE("A small message is handled right away", nhandled == 1 && strcmp(handled[0], "put /first inline") == 0);
+
+	feed(big_put, 100);
+	feed("  {\"t\":\"d\",\"d\":{\"r\":1,\"b\":{\"s\":\"ok\",\"d\":\"\"}}}{\"t\":\"d\",", 1000);
+	feed("\"d\":{\"a\":\"d\",\"b\":{\"p\":\"/small\",\"d\":1}}}", 1000);
+	feed(big_merge, sizeof(big_merge));
+	STFU_TRUE("The messages wait for the one being parsed", nhandled == 1);
+	STFU_TRUE("Handle the messages", drain());
+	STFU_TRUE("The messages are handled in order", nhandled == 5
+			&& strcmp(handled[1], "put /big offloaded") == 0
+			&& strcmp(handled[2], "other") == 0
+			&& strcmp(handled[3], "put /small inline") == 0
+			&& strcmp(handled[4], "merge /big offloaded") == 0);
+
+	n = data_cache_get(cache, "/big/k1/s");
+	STFU_TRUE("The put tree is in the cache", n != NULL && n->type == TREENODE_TYPE_LEAF_STRING && strcmp(n->uval.str, "} \" {") == 0);
+	n = data_cache_get(cache, "/big/k10");
+	STFU_TRUE("The merge trees are in the cache", n != NULL && n->type == TREENODE_TYPE_LEAF_STRING && strcmp(n->uval.str, "merged") == 0);
+	STFU_TRUE("The merged nulls are removed", data_cache_get(cache, "/big/k5") == NULL && data_cache_get(cache, "/big/k6/v") != NULL);
+	n = data_cache_get(cache, "/small");
+	STFU_TRUE("The small messages are in the cache", n != NULL && n->type == TREENODE_TYPE_LEAF_NUMBER && n->uval.number == 1.);
+
+	wc_datasync_get_parse_stats(&ctx, &stats);
+	STFU_TRUE("Parse statistics", stats.offloaded == 2
+			&& stats.offloaded_bytes == strlen(big_put) + strlen(big_merge)
+			&& stats.deferred == 2
+			&& stats.pending == 0
+			&& stats.max_pending == 4);
+
+	/* disconnection in the middle of a message, with another one being parsed */
+	nhandled = 0;
+	feed(big_put, 100);
+	feed("{\"t\":\"d\",\"d\":{\"a\":\"d\",\"b\":{\"p\":\"/cut\",\"d\":{\"x\":", 1000);
+	wc_datasync_rx_offload_reset(&ctx);
+	STFU_TRUE("The cut off message is forgotten", ctx.datasync.rxo->scan.depth == 0 && ctx.datasync.rxo->chunks == NULL);
+	feed("{\"t\":\"c\",\"d\":{\"t\":\"h\",\"d\":{\"ts\":1,\"v\":\"5\",\"h\":\"host\"}}}", 7);
+	STFU_TRUE("Handle the messages of the new connection", drain());
+	STFU_TRUE("The handshake of the new connection is parsed", nhandled == 1 && strcmp(handled[0], "handshake") == 0);
+	STFU_TRUE("The messages of the closed connection are dropped", data_cache_get(cache, "/cut") == NULL);
+
+	feed(big_put, 10);
+	wc_datasync_rx_offload_close(&ctx);
+	STFU_TRUE("Stop the parser threads with a pending message", watched_fd == -1 && ctx.datasync.rxo == NULL);
+
+	data_cache_destroy(cache);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,147 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stfu.h"
+
+#include "../lib/datasync/cache/treenode_cache.h"
+#include "../lib/datasync/cache/overlay.h"
+#include "../lib/datasync/on/on_registry.h"
+
+static int value_eq(data_cache_t *cache, char *path, char *expected) {
+	struct treenode *n;
+	char *json;
+	int ret;
+
+	n = data_cache_get(cache, path);
+	json = malloc(treenode_to_json_len(n) + 1);
+	treenode_to_json(n, json);
+	ret = strcmp(json, expected) == 0;
+	if (!ret) {
+		STFU_INFO("%s: got %s, expected %s", path, json, expected);
+	}
+	free(json);
+
+	return ret;
+}
+
+int main(void)
+{
+	data_cache_t *cache;
+	struct on_registry *reg;
+	struct cache_overlays ov;
+	char path[32];
+	int ok, i;
+
+	cache = data_cache_new();
+	reg = on_registry_new();
+	cache_overlays_init(&ov);
+
+	data_cache_set(cache, "/a", "{\"x\":1,\"y\":2}");
+
+	cache_overlay_apply(&ov, cache, reg, 1, 0, "/a/x", "10");
+	STFU_TRUE("A put is applied to the cache right away", value_eq(cache, "/a", "{\"x\":10,\"y\":2}"));
+
+	cache_overlay_apply(&ov, cache, reg, 2, 1, "/a", "{\"z\":3}");
+	STFU_TRUE("A merge is applied to the cache right away", value_eq(cache, "/a", "{\"x\":10,\"y\":2,\"z\":3}"));
+	STFU_TRUE("One overlay per write is recorded", ov.count == 2);
+
+	cache_overlay_ack(&ov, cache, reg, 1, 1);
+	STFU_TRUE("An accepted write is dropped once the earlier ones are accepted", ov.count == 1 && ov.head->id == 2);
+
+	cache_overlay_ack(&ov, cache, reg, 2, 0);
+	STFU_TRUE("A rejected merge is rolled back", value_eq(cache, "/a", "{\"x\":10,\"y\":2}") && ov.count == 0);
+
+	cache_overlay_apply(&ov, cache, reg, 3, 0, "/a/y", "20");
+	cache_overlay_apply(&ov, cache, reg, 4, 0, "/a/w", "\"w\"");
+	cache_overlay_apply(&ov, cache, reg, 5, 0, "/a/y", "200");
+	cache_overlay_ack(&ov, cache, reg, 3, 0);
+	STFU_TRUE("Rolling back a write keeps the later writes to the same path", value_eq(cache, "/a", "{\"w\":\"w\",\"x\":10,\"y\":200}"));
+	cache_overlay_ack(&ov, cache, reg, 5, 0);
+	STFU_TRUE("The later write is rolled back to the value preceding the earlier write", value_eq(cache, "/a", "{\"w\":\"w\",\"x\":10,\"y\":2}"));
+	cache_overlay_ack(&ov, cache, reg, 4, 1);
+
+	cache_overlay_apply(&ov, cache, reg, 6, 0, "/a/x", "11");
+	cache_overlay_apply(&ov, cache, reg, 7, 0, "/a", "{\"v\":1}");
+	cache_overlay_apply(&ov, cache, reg, 8, 0, "/a/u", "2");
+	cache_overlay_ack(&ov, cache, reg, 7, 1);
+	cache_overlay_ack(&ov, cache, reg, 6, 0);
+	STFU_TRUE("Rolling back a write keeps the later writes to a parent path", value_eq(cache, "/a", "{\"u\":2,\"v\":1}"));
+	cache_overlay_ack(&ov, cache, reg, 8, 1);
+	STFU_TRUE("All the overlays are dropped once accepted", ov.count == 0);
+
+	cache_overlay_apply(&ov, cache, reg, 9, 0, "/a/v", "42");
+	data_cache_set(cache, "/a", "{\"v\":1,\"t\":0}");
+	cache_overlay_reconcile(&ov, cache, reg, "/a");
+	STFU_TRUE("A pending write is kept on top of the server value", value_eq(cache, "/a", "{\"t\":0,\"v\":42}"));
+	data_cache_set(cache, "/b", "true");
+	cache_overlay_reconcile(&ov, cache, reg, "/b");
+	STFU_TRUE("An unrelated server value does not affect the pending writes", value_eq(cache, "/a/v", "42") && value_eq(cache, "/b", "true"));
+	cache_overlay_ack(&ov, cache, reg, 9, 0);
+	STFU_TRUE("A rejected write is rolled back to the server value", value_eq(cache, "/a", "{\"t\":0,\"v\":1}"));
+
+	cache_overlay_apply(&ov, cache, reg, 10, 0, "/c", "1");
+	cache_overlay_apply(&ov, cache, reg, 11, 0, "/c/d", "2");
+	cache_overlay_apply(&ov, cache, reg, 12, 0, "/e", "3");
+	cache_overlay_rollback_all(&ov, cache, reg);
+	STFU_TRUE("All the pending writes can be rolled back", value_eq(cache, "/c", "null") && value_eq(cache, "/e", "null") && ov.count == 0);
+	STFU_TRUE("Rolling back all the writes preserves the server values", value_eq(cache, "/a", "{\"t\":0,\"v\":1}"));
+
+	cache_overlay_apply(&ov, cache, reg, 13, 0, "/f", "1");
+	cache_overlays_clear(&ov);
+	STFU_TRUE("Clearing the overlays keeps the cache as is", ov.count == 0 && value_eq(cache, "/f", "1"));
+
+	cache_overlay_apply(&ov, cache, reg, 14, 0, "/g", "1");
+	cache_overlay_rollback_all(&ov, cache, NULL);
+	STFU_TRUE("The writes can be rolled back without calling the callbacks", ov.count == 0 && value_eq(cache, "/g", "null"));
+
+	/* a burst of writes, answered out of order */
+	ok = 1;
+	for (i = 0 ; i < 1000 ; i++) {
+		snprintf(path, sizeof(path), "/burst/%d", i);
+		ok &= cache_overlay_apply(&ov, cache, reg, 100 + i, 0, path, "1") == 0;
+	}
+	STFU_TRUE("A burst of writes is applied", ok && ov.count == 1000);
+	cache_overlay_ack(&ov, cache, reg, 100 + 999, 0);
+	cache_overlay_ack(&ov, cache, reg, 100 + 500, 0);
+	cache_overlay_ack(&ov, cache, reg, 100 + 999, 1);
+	ok = value_eq(cache, "/burst/999", "null") && value_eq(cache, "/burst/500", "null") && value_eq(cache, "/burst/998", "1");
+	STFU_TRUE("The writes of a burst are rolled back by id", ok && ov.count == 998);
+	cache_overlay_apply(&ov, cache, reg, 2000, 0, "/burst/999", "2");
+	for (i = 998 ; i >= 0 ; i--) {
+		cache_overlay_ack(&ov, cache, reg, 100 + i, 1);
+	}
+	STFU_TRUE("The confirmed writes of a burst wait for the earlier ones", ov.count == 1 && ov.head->id == 2000);
+	cache_overlay_ack(&ov, cache, reg, 2000, 0);
+	STFU_TRUE("A write appended after a rollback is rolled back too", ov.count == 0 && value_eq(cache, "/burst/999", "null"));
+	cache_overlays_clear(&ov);
+
+	on_registry_destroy(reg);
+	data_cache_destroy(cache);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
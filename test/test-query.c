@@ -0,0 +1,263 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stfu.h"
+
+#include "../lib/datasync/cache/treenode_cache.h"
+#include "../lib/datasync/cache/query.h"
+
+static char *run(data_cache_t *cache, char *path, struct wc_query *query) {
+	struct cache_query *q;
+	wc_ds_path_t *parsed_path;
+	char *ret;
+
+	q = cache_query_new(query);
+	if (q == NULL) {
+		return NULL;
+	}
+
+	parsed_path = wc_datasync_path_new(path);
+	ret = cache_query_run(cache, parsed_path, q);
+	wc_datasync_path_destroy(parsed_path);
+	cache_query_destroy(q);
+
+	return ret;
+}
+
+static int run_eq(data_cache_t *cache, char *path, struct wc_query *query, char *expected) {
+	char *result = run(cache, path, query);
+	int ret;
+
+	ret = result != NULL && strcmp(result, expected) == 0;
+	if (!ret) {
+		STFU_INFO("got %s", result ? result : "(null)");
+		STFU_INFO("expected %s", expected);
+	}
+	free(result);
+
+	return ret;
+}
+
+/* the indexed and the sorted strategies must always agree */
+static int index_check(data_cache_t *cache, char *path, struct wc_query *query) {
+	wc_ds_path_t *parsed_path = wc_datasync_path_new(path);
+	char *indexed, *sorted;
+	int ret;
+
+	indexed = run(cache, path, query);
+	cache_index_remove(cache, parsed_path, query->child);
+	sorted = run(cache, path, query);
+	cache_index_add(cache, parsed_path, query->child);
+
+	ret = strcmp(indexed, sorted) == 0;
+	if (!ret) {
+		STFU_INFO("indexed: %s", indexed);
+		STFU_INFO("sorted:  %s", sorted);
+	}
+
+	free(indexed);
+	free(sorted);
+	wc_datasync_path_destroy(parsed_path);
+
+	return ret;
+}
+
+int main(void) {
+	data_cache_t *cache;
+	struct wc_query q;
+	struct cache_query *cq;
+	wc_ds_path_t *path;
+	union treenode_value uval;
+	char buf[128], key[16];
+	int i, ok;
+
+	cache = data_cache_new();
+
+	data_cache_set(cache, "/devices", "{"
+			"\"a\":{\"lastSeen\":30,\"name\":\"alpha\"},"
+			"\"b\":{\"lastSeen\":10,\"name\":\"bravo\"},"
+			"\"c\":{\"lastSeen\":20,\"name\":\"charlie\"},"
+			"\"d\":{\"name\":\"delta\"},"
+			"\"e\":{\"lastSeen\":\"never\"},"
+			"\"f\":{\"lastSeen\":true},"
+			"\"g\":{\"lastSeen\":20}"
+		"}");
+
+	/* order by key */
+	memset(&q, 0, sizeof(q));
+	q.order_by = WC_QUERY_ORDER_BY_KEY;
+	q.start_at = "b";
+	q.end_at = "c";
+	STFU_TRUE("Order by key with bounds",
+			run_eq(cache, "/devices", &q, "[[\"b\",{\"lastSeen\":10,\"name\":\"bravo\"}],[\"c\",{\"lastSeen\":20,\"name\":\"charlie\"}]]"));
+
+	memset(&q, 0, sizeof(q));
+	q.order_by = WC_QUERY_ORDER_BY_KEY;
+	q.limit_to_last = 2;
+	STFU_TRUE("Order by key, limit to last",
+			run_eq(cache, "/devices", &q, "[[\"f\",{\"lastSeen\":true}],[\"g\",{\"lastSeen\":20}]]"));
+
+	q.limit_to_last = 0;
+	q.limit_to_first = 1;
+	STFU_TRUE("Order by key, limit to first",
+			run_eq(cache, "/devices", &q, "[[\"a\",{\"lastSeen\":30,\"name\":\"alpha\"}]]"));
+
+	STFU_TRUE("A missing node gives an empty result", run_eq(cache, "/nothing/here", &q, "[]"));
+
+	q.limit_to_first = 2;
+	q.offset = 3;
+	STFU_TRUE("Order by key, with an offset",
+			run_eq(cache, "/devices", &q, "[[\"d\",{\"name\":\"delta\"}],[\"e\",{\"lastSeen\":\"never\"}]]"));
+
+	q.limit_to_first = 0;
+	q.limit_to_last = 1;
+	q.offset = 1;
+	q.end_at = "bb";
+	STFU_TRUE("Order by key, offset and limit to last",
+			run_eq(cache, "/devices", &q, "[[\"b\",{\"lastSeen\":10,\"name\":\"bravo\"}]]"));
+
+	q.offset = 2;
+	STFU_TRUE("An offset beyond the range gives an empty result", run_eq(cache, "/devices", &q, "[]"));
+
+	uval.null = NULL;
+	data_cache_set_leaf(cache, "/devices/bb", TREENODE_TYPE_LEAF_NULL, uval);
+	memset(&q, 0, sizeof(q));
+	q.order_by = WC_QUERY_ORDER_BY_KEY;
+	q.start_at = "b";
+	q.offset = 1;
+	q.limit_to_first = 1;
+	STFU_TRUE("Null children are skipped",
+			run_eq(cache, "/devices", &q, "[[\"c\",{\"lastSeen\":20,\"name\":\"charlie\"}]]"));
+	q.offset = 2;
+	STFU_TRUE("The offset does not count a null child",
+			run_eq(cache, "/devices", &q, "[[\"d\",{\"name\":\"delta\"}]]"));
+	data_cache_set(cache, "/devices/bb", "null");
+
+	/* order by child */
+	memset(&q, 0, sizeof(q));
+	q.order_by = WC_QUERY_ORDER_BY_CHILD;
+	q.child = "lastSeen";
+	STFU_TRUE("Order by child: types, then values, then keys",
+			run_eq(cache, "/devices", &q, "[[\"d\",{\"name\":\"delta\"}],[\"f\",{\"lastSeen\":true}],[\"b\",{\"lastSeen\":10,\"name\":\"bravo\"}],[\"c\",{\"lastSeen\":20,\"name\":\"charlie\"}],[\"g\",{\"lastSeen\":20}],[\"a\",{\"lastSeen\":30,\"name\":\"alpha\"}],[\"e\",{\"lastSeen\":\"never\"}]]"));
+
+	q.limit_to_last = 3;
+	STFU_TRUE("Order by child: limit to last",
+			run_eq(cache, "/devices", &q, "[[\"g\",{\"lastSeen\":20}],[\"a\",{\"lastSeen\":30,\"name\":\"alpha\"}],[\"e\",{\"lastSeen\":\"never\"}]]"));
+
+	q.limit_to_last = 0;
+	q.start_at = "15";
+	q.end_at = "30";
+	STFU_TRUE("Order by child with numeric bounds",
+			run_eq(cache, "/devices", &q, "[[\"c\",{\"lastSeen\":20,\"name\":\"charlie\"}],[\"g\",{\"lastSeen\":20}],[\"a\",{\"lastSeen\":30,\"name\":\"alpha\"}]]"));
+
+	q.start_at = q.end_at = NULL;
+	q.equal_to = "null";
+	STFU_TRUE("Children lacking the value equal null",
+			run_eq(cache, "/devices", &q, "[[\"d\",{\"name\":\"delta\"}]]"));
+
+	q.equal_to = "{\"invalid\":1}";
+	STFU_TRUE("Non scalar bounds are rejected", run(cache, "/devices", &q) == NULL);
+	q.equal_to = "nul";
+	STFU_TRUE("Invalid JSON bounds are rejected", run(cache, "/devices", &q) == NULL);
+
+	/* indexes */
+	path = wc_datasync_path_new("/devices");
+	STFU_TRUE("Add an index", cache_index_add(cache, path, "lastSeen") == 0);
+
+	memset(&q, 0, sizeof(q));
+	q.order_by = WC_QUERY_ORDER_BY_CHILD;
+	q.child = "lastSeen";
+	q.start_at = "15";
+	q.limit_to_first = 2;
+	STFU_TRUE("The index gives the same results",
+			run_eq(cache, "/devices", &q, "[[\"c\",{\"lastSeen\":20,\"name\":\"charlie\"}],[\"g\",{\"lastSeen\":20}]]"));
+
+	data_cache_set(cache, "/devices/c/lastSeen", "5");
+	data_cache_merge(cache, "/devices/h", "{\"lastSeen\":16}");
+	data_cache_set(cache, "/devices/g", "null");
+	STFU_TRUE("The index follows the updates",
+			run_eq(cache, "/devices", &q, "[[\"h\",{\"lastSeen\":16}],[\"a\",{\"lastSeen\":30,\"name\":\"alpha\"}]]"));
+
+	srand(42);
+	ok = 1;
+	for (i = 0 ; i < 2000 && ok ; i++) {
+		snprintf(key, sizeof(key), "k%d", rand() % 200);
+		switch (rand() % 5) {
+		case 0:
+			snprintf(buf, sizeof(buf), "/devices/%s", key);
+			data_cache_set(cache, buf, "null");
+			break;
+		case 1:
+			snprintf(buf, sizeof(buf), "{\"%s\":{\"lastSeen\":%d}}", key, rand() % 50);
+			data_cache_merge(cache, "/devices", buf);
+			break;
+		case 2:
+			snprintf(buf, sizeof(buf), "/devices/%s/lastSeen", key);
+			data_cache_set(cache, buf, rand() % 2 ? "\"s\"" : "false");
+			break;
+		default:
+			snprintf(buf, sizeof(buf), "/devices/%s/lastSeen", key);
+			snprintf(key, sizeof(key), "%d", rand() % 50);
+			data_cache_set(cache, buf, key);
+			break;
+		}
+		if (i % 100 == 0) {
+			data_cache_set(cache, "/devices/k0", "{\"lastSeen\":1}");
+		}
+		q.offset = rand() % 3;
+		q.limit_to_first = rand() % 2 ? rand() % 10 : 0;
+		q.limit_to_last = rand() % 2 ? rand() % 10 : 0;
+		q.start_at = rand() % 2 ? "10" : NULL;
+		q.end_at = rand() % 2 ? "\"s\"" : NULL;
+		ok = index_check(cache, "/devices", &q);
+	}
+	STFU_TRUE("The index is consistent after random updates", ok);
+
+	data_cache_set(cache, "/", "{\"devices\":{\"x\":{\"lastSeen\":99}}}");
+	memset(&q, 0, sizeof(q));
+	q.order_by = WC_QUERY_ORDER_BY_CHILD;
+	q.child = "lastSeen";
+	STFU_TRUE("The index is rebuilt when an ancestor is replaced",
+			run_eq(cache, "/devices", &q, "[[\"x\",{\"lastSeen\":99}]]"));
+
+	STFU_TRUE("Remove the index", cache_index_remove(cache, path, "lastSeen") == 0);
+	STFU_TRUE("Remove an unknown index", cache_index_remove(cache, path, "lastSeen") == -1);
+	wc_datasync_path_destroy(path);
+
+	/* result change detection */
+	memset(&q, 0, sizeof(q));
+	cq = cache_query_new(&q);
+	STFU_TRUE("A first result is a change", cache_query_result_changed(cq, "[]"));
+	STFU_TRUE("The same result is not a change", !cache_query_result_changed(cq, "[]"));
+	STFU_TRUE("Another result is a change", cache_query_result_changed(cq, "[[\"a\",1]]"));
+	cache_query_destroy(cq);
+
+	data_cache_destroy(cache);
+
+	STFU_SUMMARY();
+
+	return 0;
+}
@@ -20,7 +20,10 @@
  *
  */
 
+#include <unistd.h>
+
 #include "../lib/datasync/request.c"
+#include "../lib/timer.c"
 
 #include <inttypes.h>
 
@@ -48,6 +51,13 @@ wc_datasync_context_t *wc_get_datasync(wc_context_t *ctx) {
 
 void wc_datasync_push_id(UNUSED_PARAM(struct pushid_state *s), UNUSED_PARAM(int64_t time), UNUSED_PARAM(char* buf)) {}
 void wc_datasync_msg_init(UNUSED_PARAM(wc_msg_t *msg)) {}
+void wc_datasync_overlay_apply(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(int64_t id), UNUSED_PARAM(int merge), UNUSED_PARAM(char *path), UNUSED_PARAM(char *data)) {}
+void wc_datasync_overlay_ack(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(int64_t id), UNUSED_PARAM(int accepted)) {}
+int wc_datasync_journal_action(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(int64_t id), UNUSED_PARAM(wc_action_type_t type), UNUSED_PARAM(char *path), UNUSED_PARAM(char *data)) { return 0; }
+int journal_done;
+void wc_datasync_journal_done(UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(int64_t id)) { journal_done++; }
+int64_t dropped_id;
+void wc_datasync_offline_drop(UNUSED_PARAM(wc_context_t *ctx), int64_t id) { dropped_id = id; }
 /* end stubs */
 
 int listen_response = 0, put_response = 0, auth_response = 0;
@@ -73,46 +83,86 @@ void cb_auth(wc_context_t *cnx, int64_t id, wc_action_type_t type, wc_req_pendin
 	}
 }
 
+int64_t put_ids[8];
+int nput_ids;
+
+wc_req_pending_result_t last_status;
+char last_reason[32];
+
+void cb_put_id(UNUSED_PARAM(wc_context_t *cnx), int64_t id, UNUSED_PARAM(wc_action_type_t type), wc_req_pending_result_t status, char *reason, UNUSED_PARAM(char *data), UNUSED_PARAM(void *user)) {
+	put_ids[nput_ids++] = id;
+	last_status = status;
+	snprintf(last_reason, sizeof(last_reason), "%s", reason);
+}
+
+static int event_cb(UNUSED_PARAM(wc_event_t event), UNUSED_PARAM(wc_context_t *ctx), UNUSED_PARAM(void *data), UNUSED_PARAM(size_t len)) {
+	return 0;
+}
+
 int main(void)
 {
 	wc_context_t cnx;
 	uint64_t id;
-	int c;
+	int c, ok;
 	wc_action_trans_t *p;
+	wc_response_t resp;
 	size_t i;
 
 	memset(&cnx, 0, sizeof(cnx));
 
 	cnx.datasync_init = 1;
 
-	for (i = 0 ; i < 4096 ; i++) {
+	cnx.callback = event_cb;
+
+	for (i = 0 ; i < 50000 ; i++) {
 		wc_req_store_pending(&cnx, wc_datasync_next_reqnum(&cnx.datasync), WC_ACTION_LISTEN, NULL, NULL);
 	}
 	c = 0;
-	for (i = 0 ; i < (1 << PENDING_ACTION_HASH_FACTOR) ; i++) {
-		p = cnx.datasync.pending_req_table[i];
-		while(p) {
-			c++;
-			p = p->next;
-		}
+	for (i = 0 ; i <= cnx.datasync.pending.mask ; i++) {
+		c += cnx.datasync.pending.slots[i] != NULL;
 	}
 
-	STFU_TRUE("Store 4096 pending requests", c == 4096);
+	STFU_TRUE("Store 50000 pending requests", c == 50000 && cnx.datasync.pending.count == 50000);
+	STFU_TRUE("The table grows with the load", cnx.datasync.pending.mask + 1 >= 2 * 50000);
+
+	/* remove every third request, then check that all the others are found */
+	for (id = 3 ; id <= 50000 ; id += 3) {
+		wc_datasync_req_free_trans(&cnx, wc_datasync_req_get_pending(&cnx, id));
+	}
+	c = 0;
+	for (id = 1 ; id <= 50000 ; id++) {
+		p = wc_req_find_pending(&cnx, id);
+		c += (id % 3 == 0) ? p != NULL : p == NULL || p->id != (int64_t)id;
+	}
+	STFU_TRUE("Removing requests keeps the others reachable", c == 0);
 
-	for (id = 1 ; id <= 4096 ; id++) {
-		free(wc_datasync_req_get_pending(&cnx, id));
+	for (id = 50000 ; id >= 1 ; id--) {
+		wc_datasync_req_free_trans(&cnx, wc_datasync_req_get_pending(&cnx, id));
 	}
 
 	c = 0;
-	for (i = 0 ; i < (1 << PENDING_ACTION_HASH_FACTOR) ; i++) {
-		p = cnx.datasync.pending_req_table[i];
-		while(p) {
-			c++;
-			p = p->next;
-		}
+	for (i = 0 ; i <= cnx.datasync.pending.mask ; i++) {
+		c += cnx.datasync.pending.slots[i] != NULL;
 	}
 
-	STFU_TRUE("Requests table is empty after all getting all entries", c == 0);
+	STFU_TRUE("Requests table is empty after all getting all entries", c == 0 && cnx.datasync.pending.count == 0);
+
+	/* a non sequential pattern, in a small table with wrap-around clusters */
+	ok = 1;
+	for (i = 0 ; i < 100 ; i++) {
+		wc_req_store_pending(&cnx, (int64_t)((i * 37) % 101) * 256 + 255, WC_ACTION_PUT, NULL, NULL);
+	}
+	for (i = 0 ; i < 100 ; i += 2) {
+		wc_datasync_req_free_trans(&cnx, wc_datasync_req_get_pending(&cnx, (int64_t)((i * 37) % 101) * 256 + 255));
+	}
+	for (i = 0 ; i < 100 ; i++) {
+		p = wc_req_find_pending(&cnx, (int64_t)((i * 37) % 101) * 256 + 255);
+		ok &= (i % 2 == 0) ? p == NULL : p != NULL;
+	}
+	STFU_TRUE("Colliding request ids are found after removals", ok);
+	for (i = 1 ; i < 100 ; i += 2) {
+		wc_datasync_req_free_trans(&cnx, wc_datasync_req_get_pending(&cnx, (int64_t)((i * 37) % 101) * 256 + 255));
+	}
 
 	wc_datasync_listen(&cnx, "/foo/", cb_listen, NULL);
 	STFU_TRUE("Callback was called for listen request", listen_response);
@@ -123,6 +173,87 @@ int main(void)
 	wc_datasync_auth(&cnx, "S3CRET", cb_auth, NULL);
 	STFU_TRUE("Callback was called for auth request", auth_response);
 
+	nput_ids = 0;
+	wc_req_store_pending(&cnx, 10001, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_req_store_pending(&cnx, 10002, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_req_store_pending(&cnx, 10003, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_datasync_req_supersede(&cnx, 10001, 10002);
+	wc_datasync_req_supersede(&cnx, 10002, 10003);
+	STFU_TRUE("A superseded request leaves the pending table", wc_datasync_req_get_pending(&cnx, 10001) == NULL);
+	resp.r = 10003;
+	resp.status = "ok";
+	resp.data = NULL;
+	wc_datasync_req_response_dispatch(&cnx, &resp);
+	STFU_TRUE("Superseded requests get the result of the request replacing them",
+			nput_ids == 3 && put_ids[0] == 10003 && put_ids[1] == 10002 && put_ids[2] == 10001);
+
+
+	nput_ids = 0;
+	wc_req_store_pending(&cnx, 20001, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_req_store_pending(&cnx, 20002, WC_ACTION_PUT, cb_put_id, NULL);
+	STFU_TRUE("A deadline can be set on a pending request", wc_datasync_req_set_timeout(&cnx, 20001, 5) == 0);
+	STFU_TRUE("No deadline can be set on an unknown request", wc_datasync_req_set_timeout(&cnx, 424242, 5) == -1);
+	usleep(20000);
+	wc_timers_service(&cnx);
+	ok = nput_ids == 1 && put_ids[0] == 20001 && strcmp(last_reason, WC_REQ_REASON_TIMEOUT) == 0 && last_status == WC_REQ_ERROR;
+	STFU_TRUE("A request fails once its deadline has expired", ok);
+	STFU_TRUE("An expired request is not replayed once the connection is back", dropped_id == 20001);
+	STFU_TRUE("An expired request leaves the pending table", wc_req_find_pending(&cnx, 20001) == NULL && wc_req_find_pending(&cnx, 20002) != NULL);
+
+	cnx.request_timeout_ms = 5;
+	wc_req_store_pending(&cnx, 20003, WC_ACTION_PUT, cb_put_id, NULL);
+	resp.r = 20003;
+	resp.status = "ok";
+	resp.data = NULL;
+	wc_datasync_req_response_dispatch(&cnx, &resp);
+	usleep(20000);
+	wc_timers_service(&cnx);
+	STFU_TRUE("The default deadline is cancelled by the response", nput_ids == 2 && last_status == WC_REQ_OK && cnx.timers.count == 0);
+	cnx.request_timeout_ms = 0;
+
+	nput_ids = 0;
+	wc_req_store_pending(&cnx, 20004, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_req_store_pending(&cnx, 20005, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_datasync_req_hold(&cnx, 20004);
+	wc_datasync_req_fail_all(&cnx, WC_REQ_REASON_DISCONNECTED);
+	ok = nput_ids == 2 && strcmp(last_reason, WC_REQ_REASON_DISCONNECTED) == 0 && cnx.datasync.pending.count == 1
+			&& wc_req_find_pending(&cnx, 20004) != NULL;
+	STFU_TRUE("All the pending requests but the held ones fail on disconnection", ok);
+	wc_datasync_req_fail_all(&cnx, WC_REQ_REASON_DISCONNECTED);
+	STFU_TRUE("A request is only held once", cnx.datasync.pending.count == 0 && nput_ids == 3);
+
+	journal_done = 0;
+	wc_req_store_pending(&cnx, 30001, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_req_journal(&cnx, 30001, WC_ACTION_PUT, "/a", "1");
+	wc_req_store_pending(&cnx, 30002, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_req_journal(&cnx, 30002, WC_ACTION_PUT, "/b", "2");
+	wc_req_store_pending(&cnx, 30003, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_req_journal(&cnx, 30003, WC_ACTION_PUT, "/c", "3");
+	wc_datasync_req_set_timeout(&cnx, 30001, 5);
+	usleep(20000);
+	wc_timers_service(&cnx);
+	STFU_TRUE("An expired write leaves the journal", journal_done == 1);
+	resp.r = 30002;
+	resp.status = "permission_denied";
+	resp.data = NULL;
+	wc_datasync_req_response_dispatch(&cnx, &resp);
+	STFU_TRUE("A write refused by the server leaves the journal", journal_done == 2);
+	wc_req_store_pending(&cnx, 30004, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_req_journal(&cnx, 30004, WC_ACTION_PUT, "/d", "4");
+	wc_datasync_req_hold(&cnx, 30004);
+	wc_datasync_req_fail_all(&cnx, WC_REQ_REASON_DISCONNECTED);
+	ok = journal_done == 3 && cnx.datasync.pending.count == 1;
+	STFU_TRUE("A write failed by a disconnection leaves the journal, unless it is queued offline", ok);
+	resp.r = 30004;
+	resp.status = "ok";
+	wc_datasync_req_response_dispatch(&cnx, &resp);
+	STFU_TRUE("A write queued offline leaves the journal once answered", journal_done == 4 && cnx.datasync.pending.count == 0);
+
+	wc_req_store_pending(&cnx, 20006, WC_ACTION_PUT, cb_put_id, NULL);
+	wc_datasync_req_set_timeout(&cnx, 20006, 1000);
+	wc_datasync_req_table_cleanup(&cnx);
+	STFU_TRUE("Cleaning up the table cancels the deadlines", cnx.timers.count == 0);
+
 	STFU_SUMMARY();
 
 	return STFU_NUMBER_FAILED;
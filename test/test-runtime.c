@@ -0,0 +1,203 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "webcom-c/webcom.h"
+#include "webcom-c/webcom-runtime.h"
+#include "../lib/collection/mpsc.h"
+
+#include "stfu.h"
+
+#define NPRODUCERS 4
+#define NITEMS 100000
+
+struct item {
+	struct mpsc_node node;
+	unsigned producer;
+	unsigned seq;
+};
+
+static struct mpsc_queue queue;
+static struct item items[NPRODUCERS][NITEMS];
+
+static void *producer(void *data) {
+	unsigned p = (unsigned)(uintptr_t)data, i;
+
+	for (i = 0 ; i < NITEMS ; i++) {
+		items[p][i].producer = p;
+		items[p][i].seq = i;
+		mpsc_push(&queue, &items[p][i].node);
+	}
+	return NULL;
+}
+
+#define NCTX 6
+#define NCALLS 1000
+
+static struct {
+	pthread_t thread;
+	int thread_set;
+	int wrong_thread;
+	unsigned ncalls;
+	unsigned seq[NPRODUCERS];
+	int out_of_order;
+} calls[NCTX];
+
+static wc_context_t *contexts[NCTX];
+static sem_t done;
+
+struct call {
+	unsigned ctx;
+	unsigned producer;
+	unsigned seq;
+};
+
+static struct call call_args[NPRODUCERS][NCTX][NCALLS];
+
+static void on_call(wc_context_t *ctx, void *data) {
+	struct call *c = data;
+
+	(void)ctx;
+	if (!calls[c->ctx].thread_set) {
+		calls[c->ctx].thread = pthread_self();
+		calls[c->ctx].thread_set = 1;
+	} else if (!pthread_equal(calls[c->ctx].thread, pthread_self())) {
+		calls[c->ctx].wrong_thread = 1;
+	}
+	if (c->seq != calls[c->ctx].seq[c->producer]) {
+		calls[c->ctx].out_of_order = 1;
+	}
+	calls[c->ctx].seq[c->producer] = c->seq + 1;
+	calls[c->ctx].ncalls++;
+}
+
+static void on_last_call(wc_context_t *ctx, void *data) {
+	(void)ctx;
+	(void)data;
+	sem_post(&done);
+}
+
+static void *submitter(void *data) {
+	unsigned p = (unsigned)(uintptr_t)data, i, j;
+
+	for (i = 0 ; i < NCALLS ; i++) {
+		for (j = 0 ; j < NCTX ; j++) {
+			call_args[p][j][i].ctx = j;
+			call_args[p][j][i].producer = p;
+			call_args[p][j][i].seq = i;
+			wc_runtime_call(contexts[j], on_call, &call_args[p][j][i]);
+		}
+	}
+	return NULL;
+}
+
+int main(void) {
+	unsigned seq[NPRODUCERS] = {0}, total = 0, i;
+	struct wc_eli_callbacks callbacks;
+	struct wc_context_options options;
+	pthread_t threads[NPRODUCERS];
+	struct mpsc_node *n;
+	struct item *it;
+	wc_runtime_t *rt;
+	int ordered = 1, all_created = 1, all_calls = 1, same_thread = 1, in_order = 1;
+
+	/* lock-free queue */
+	mpsc_init(&queue);
+	STFU_TRUE("An empty queue pops nothing", mpsc_pop(&queue) == NULL);
+
+	for (i = 0 ; i < NPRODUCERS ; i++) {
+		pthread_create(&threads[i], NULL, producer, (void *)(uintptr_t)i);
+	}
+	while (total < NPRODUCERS * NITEMS) {
+		if ((n = mpsc_pop(&queue)) == NULL) {
+			continue;
+		}
+		it = (struct item *)n;
+		if (it->seq != seq[it->producer]) {
+			ordered = 0;
+		}
+		seq[it->producer] = it->seq + 1;
+		total++;
+	}
+	for (i = 0 ; i < NPRODUCERS ; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	STFU_TRUE("All the elements pushed concurrently are popped", total == NPRODUCERS * NITEMS);
+	STFU_TRUE("The elements of each producer are popped in order", ordered);
+	STFU_TRUE("The queue is empty", mpsc_pop(&queue) == NULL);
+
+	/* runtime */
+	memset(&callbacks, 0, sizeof(callbacks));
+	memset(&options, 0, sizeof(options));
+	options.host = "localhost";
+	options.port = 443;
+	options.app_name = "test";
+
+	rt = wc_runtime_new(3);
+	STFU_TRUE("Start a runtime", rt != NULL);
+	STFU_TRUE("The runtime has 3 shards", wc_runtime_shard_count(rt) == 3);
+
+	for (i = 0 ; i < NCTX ; i++) {
+		contexts[i] = wc_runtime_context_create(rt, &options, &callbacks);
+		all_created = all_created && contexts[i] != NULL;
+	}
+	STFU_TRUE("Create some contexts on the runtime", all_created);
+
+	sem_init(&done, 0, 0);
+	for (i = 0 ; i < NPRODUCERS ; i++) {
+		pthread_create(&threads[i], NULL, submitter, (void *)(uintptr_t)i);
+	}
+	for (i = 0 ; i < NPRODUCERS ; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	for (i = 0 ; i < NCTX ; i++) {
+		wc_runtime_call(contexts[i], on_last_call, NULL);
+	}
+	for (i = 0 ; i < NCTX ; i++) {
+		sem_wait(&done);
+	}
+
+	for (i = 0 ; i < NCTX ; i++) {
+		all_calls = all_calls && calls[i].ncalls == NPRODUCERS * NCALLS;
+		same_thread = same_thread && !calls[i].wrong_thread;
+		in_order = in_order && !calls[i].out_of_order;
+	}
+	STFU_TRUE("All the calls submitted from several threads are run", all_calls);
+	STFU_TRUE("The calls of a context are run on the same thread", same_thread);
+	STFU_TRUE("The calls of a submitter are run in order", in_order);
+	STFU_TRUE("The contexts are spread over the shards",
+			pthread_equal(calls[0].thread, calls[3].thread)
+			&& !pthread_equal(calls[0].thread, calls[1].thread)
+			&& !pthread_equal(calls[1].thread, calls[2].thread)
+			&& !pthread_equal(calls[0].thread, pthread_self()));
+
+	wc_runtime_context_destroy(contexts[0]);
+	wc_runtime_destroy(rt);
+	sem_destroy(&done);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,124 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stfu.h"
+
+#include "../lib/datasync/cache/treenode_cache.h"
+#include "../lib/datasync/cache/snapshot.h"
+
+static char *to_json(struct treenode *n) {
+	char *json;
+
+	json = malloc(treenode_to_json_len(n) + 1);
+	treenode_to_json(n, json);
+
+	return json;
+}
+
+static int same_trees(data_cache_t *a, data_cache_t *b) {
+	char *ja, *jb;
+	int ret;
+
+	ja = to_json(a->root);
+	jb = to_json(b->root);
+	ret = strcmp(ja, jb) == 0;
+	if (!ret) {
+		STFU_INFO("got %s, expected %s", jb, ja);
+	}
+	free(ja);
+	free(jb);
+
+	return ret;
+}
+
+int main(void)
+{
+	data_cache_t *cache, *copy;
+	wc_ds_path_t *list = wc_datasync_path_new("/list");
+	char path[64], key[32], *json;
+	unsigned char c;
+	int fd, ok, i;
+
+	snprintf(path, sizeof(path), "/tmp/webcom-test-snapshot-%d", (int)getpid());
+
+	cache = data_cache_new();
+	data_cache_set(cache, "/", "{\"a\":{\"x\":1.5,\"y\":\"foo\",\"z\":true},\"b\":[false,\"bar\",{\"c\":-3}],\"d\":\"\"}");
+	for (i = 0 ; i < 1000 ; i++) {
+		snprintf(key, sizeof(key), "/list/item%d", i);
+		data_cache_set(cache, key, "{\"n\":42,\"s\":\"baz\"}");
+	}
+	treenode_hash_get(data_cache_get(cache, "/a"));
+
+	STFU_TRUE("The cache is saved", cache_snapshot_save(cache, path) == 0);
+
+	copy = data_cache_new();
+	STFU_TRUE("The snapshot is loaded", cache_snapshot_load(copy, path) == 0);
+	STFU_TRUE("The loaded tree is identical", same_trees(cache, copy));
+	STFU_TRUE("The loaded children can be looked up", data_cache_get(copy, "/list/item537/s") != NULL);
+	STFU_TRUE("The child ranks are preserved", data_cache_child_rank(copy, list, "item500") == data_cache_child_rank(cache, list, "item500"));
+	STFU_TRUE("The saved hashes are restored", data_cache_get(copy, "/a")->hash_cached && !data_cache_get(copy, "/b")->hash_cached);
+	STFU_TRUE("The restored hash is correct", treenode_hash_eq(treenode_hash_get(data_cache_get(copy, "/a")), treenode_hash_get(data_cache_get(cache, "/a"))));
+	STFU_TRUE("The root hashes are equal", treenode_hash_eq(treenode_hash_get(copy->root), treenode_hash_get(cache->root)));
+
+	data_cache_set(copy, "/list/item3/n", "43");
+	data_cache_set(copy, "/list/aaa", "1");
+	STFU_TRUE("The loaded tree can be updated", data_cache_child_count(copy, list) == 1001);
+	data_cache_destroy(copy);
+
+	fd = open(path, O_RDWR);
+	ok = fd != -1 && pread(fd, &c, 1, SNAPSHOT_HEADER_LEN + 100) == 1;
+	c ^= 0x01;
+	ok = ok && pwrite(fd, &c, 1, SNAPSHOT_HEADER_LEN + 100) == 1;
+	close(fd);
+	copy = data_cache_new();
+	data_cache_set(copy, "/", "{\"kept\":1}");
+	STFU_TRUE("A corrupted snapshot is not loaded", ok && cache_snapshot_load(copy, path) == -1);
+	json = to_json(copy->root);
+	STFU_TRUE("The cache is left untouched", strcmp(json, "{\"kept\":1}") == 0);
+	free(json);
+
+	ok = truncate(path, 30) == 0;
+	STFU_TRUE("A truncated snapshot is not loaded", ok && cache_snapshot_load(copy, path) == -1);
+	unlink(path);
+	STFU_TRUE("A missing snapshot is not loaded", cache_snapshot_load(copy, path) == -1);
+
+	data_cache_destroy(copy);
+	data_cache_set(cache, "/", "\"leaf\"");
+	copy = data_cache_new();
+	ok = cache_snapshot_save(cache, path) == 0 && cache_snapshot_load(copy, path) == 0;
+	STFU_TRUE("A leaf root is saved and loaded", ok && same_trees(cache, copy));
+	unlink(path);
+
+	data_cache_destroy(copy);
+	data_cache_destroy(cache);
+	wc_datasync_path_destroy(list);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
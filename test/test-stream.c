@@ -0,0 +1,159 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <string.h>
+
+#include "../lib/datasync/rx_stream.c"
+#include "../lib/datasync/cache/treenode_cache.h"
+
+#include "stfu.h"
+
+static struct rx_stream stream;
+static wc_msg_t msg;
+static struct rx_tree *trees;
+static unsigned ntrees;
+
+/* feeds a message in chunks of the given size, returns 1 if it was parsed */
+static int parse(const char *str, size_t chunk) {
+	size_t len = strlen(str), used, n;
+	wc_parser_result_t res = WC_PARSER_CONTINUE;
+
+	while (len > 0 && res == WC_PARSER_CONTINUE) {
+		n = len < chunk ? len : chunk;
+		res = rx_stream_feed(&stream, str, n, &used);
+		str += used;
+		len -= used;
+	}
+	return res == WC_PARSER_OK && rx_stream_finish(&stream, &msg, &trees, &ntrees);
+}
+
+static void done(void) {
+	wc_datasync_msg_free(&msg);
+	rx_trees_free(trees, ntrees);
+	trees = NULL;
+	ntrees = 0;
+}
+
+/* applies the trees to a cache, and compares it to the regular way */
+static int same_as_put(const char *path, const char *json) {
+	data_cache_t *c1 = data_cache_new(), *c2 = data_cache_new();
+	unsigned i;
+	int ret;
+
+	data_cache_set(c1, (char *)path, (char *)json);
+	for (i = 0 ; i < ntrees ; i++) {
+		data_cache_set_tree(c2, trees[i].path, trees[i].tree);
+		trees[i].tree = NULL;
+	}
+	ret = treenode_hash_eq(treenode_hash_get(c1->root), treenode_hash_get(c2->root));
+	data_cache_destroy(c1);
+	data_cache_destroy(c2);
+
+	return ret;
+}
+
+int main(void) {
+	char *put = "{\"t\":\"d\",\"d\":{\"a\":\"d\",\"b\":{\"p\":\"/a/b\",\"d\":"
+			"{\"s\":\"x\\\"y\\\\z\\n\",\"n\":-1.5e3,\"i\":42,\"t\":true,\"f\":false,\"z\":null,"
+			"\"o\":{\"e\":{},\"x\":{\"y\":[1,null,[\"q\"]]}},\"l\":[ ] ,\"s\":\"last\"}}}}";
+	char *put_data = "{\"s\":\"last\",\"n\":-1.5e3,\"i\":42,\"t\":true,\"f\":false,"
+			"\"o\":{\"e\":{},\"x\":{\"y\":[1,null,[\"q\"]]}},\"l\":[]}";
+	char *two = "{\"t\":\"d\",\"d\":{\"b\":{\"d\":\"\\u00e9\\ud83d\\ude00\",\"p\":\"/u\"},\"a\":\"d\"}} \n"
+			"{\"t\":\"d\",\"d\":{\"a\":\"d\",\"b\":{\"p\":\"/v\",\"d\":null}}}";
+	struct treenode *n;
+	size_t chunk, used;
+	int ok;
+
+	rx_stream_init(&stream);
+
+	/* data update pushes */
+	ok = 1;
+	for (chunk = 1 ; chunk <= strlen(put) ; chunk++) {
+		ok = ok && parse(put, chunk)
+				&& msg.u.data.u.push.type == WC_PUSH_DATA_UPDATE_PUT
+				&& msg.u.data.u.push.u.update_put.data == NULL
+				&& ntrees == 1
+				&& same_as_put("/a/b", put_data);
+		done();
+	}
+	STFU_TRUE("Parse a put in fragments of any size", ok);
+
+	STFU_TRUE("Parse a put with the body first", parse(two, 1000)
+			&& strcmp(msg.u.data.u.push.u.update_put.path, "/u") == 0
+			&& ntrees == 1
+			&& trees[0].tree->type == TREENODE_TYPE_LEAF_STRING
+			&& strcmp(trees[0].tree->uval.str, "\xc3\xa9\xf0\x9f\x98\x80") == 0);
+	done();
+	STFU_TRUE("Parse the next message", parse(strchr(two, '\n') + 1, 1000) && ntrees == 1 && trees[0].tree == NULL);
+	done();
+
+	STFU_TRUE("Parse a merge", parse("{\"t\":\"d\",\"d\":{\"a\":\"m\",\"b\":{\"p\":\"/m\",\"d\":{\"k\":{\"x\":1},\"r\":null,\"a\":[null]}}}}", 7)
+			&& msg.u.data.u.push.type == WC_PUSH_DATA_UPDATE_MERGE
+			&& ntrees == 3
+			&& strcmp(wc_datasync_path_get_part(trees[0].path, 1), "a") == 0
+			&& trees[0].tree->type == TREENODE_TYPE_INTERNAL
+			&& strcmp(wc_datasync_path_get_part(trees[1].path, 1), "k") == 0
+			&& (n = internal_get(trees[1].tree, "x")) != NULL && n->uval.number == 1.
+			&& strcmp(wc_datasync_path_get_part(trees[2].path, 1), "r") == 0
+			&& trees[2].tree == NULL);
+	done();
+
+	/* other messages */
+	STFU_TRUE("Parse a response", parse("{\"t\":\"d\",\"d\":{\"r\":3,\"b\":{\"s\":\"ok\",\"d\":\"done\"}}}", 5)
+			&& msg.u.data.type == WC_DATA_MSG_RESPONSE
+			&& msg.u.data.u.response.r == 3
+			&& strcmp(msg.u.data.u.response.data, "\"done\"") == 0
+			&& trees == NULL);
+	done();
+	STFU_TRUE("Parse an auth revoked push", parse("{\"t\":\"d\",\"d\":{\"a\":\"ac\",\"b\":{\"s\":\"expired\",\"d\":\"bye\"}}}", 3)
+			&& msg.u.data.u.push.type == WC_PUSH_AUTH_REVOKED
+			&& strcmp(msg.u.data.u.push.u.auth_revoked.reason, "bye") == 0);
+	done();
+	STFU_TRUE("Parse a handshake", parse("{\"t\":\"c\",\"d\":{\"t\":\"h\",\"d\":{\"ts\":1234567890123,\"v\":\"5\",\"h\":\"host\"}}}", 4)
+			&& msg.type == WC_MSG_CTRL
+			&& msg.u.ctrl.u.handshake.ts == 1234567890123
+			&& strcmp(msg.u.ctrl.u.handshake.server, "host") == 0);
+	done();
+
+	/* errors */
+	STFU_TRUE("Reject an invalid literal", rx_stream_feed(&stream, "{\"t\":nul}", 9, &used) == WC_PARSER_ERROR);
+	STFU_TRUE("Reject mismatched brackets", rx_stream_feed(&stream, "{\"t\":[}", 7, &used) == WC_PARSER_ERROR);
+	STFU_TRUE("Resynchronize on the next message", parse("} garbage {\"t\":\"d\",\"d\":{\"r\":1,\"b\":{\"s\":\"ok\",\"d\":null}}}", 2)
+			&& msg.u.data.u.response.r == 1);
+	done();
+
+	/* disconnection in the middle of the data of a push */
+	STFU_TRUE("Read the beginning of a push", rx_stream_feed(&stream, put, strlen(put) / 2, &used) == WC_PARSER_CONTINUE
+			&& stream.data != NULL && stream.depth > 0);
+	rx_stream_reset(&stream);
+	STFU_TRUE("The partial tree is freed", stream.data == NULL && stream.root == NULL && stream.depth == 0);
+	STFU_TRUE("Parse the handshake of the next connection", parse("{\"t\":\"c\",\"d\":{\"t\":\"h\",\"d\":{\"ts\":1,\"v\":\"5\",\"h\":\"next\"}}}", 3)
+			&& msg.type == WC_MSG_CTRL
+			&& strcmp(msg.u.ctrl.u.handshake.server, "next") == 0);
+	done();
+
+	rx_stream_cleanup(&stream);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
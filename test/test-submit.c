@@ -0,0 +1,221 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "../lib/datasync/submit.c"
+
+#include "stfu.h"
+
+/* stubs */
+#define MAX_EXECUTED 100000
+
+static struct {
+	char action;
+	char path[32];
+	char json[32];
+	void *user;
+} executed[MAX_EXECUTED];
+static unsigned nexecuted = 0;
+static int exec_fails = 0;
+
+static int64_t stub_exec(char action, char *path, char *json, void *user) {
+	if (exec_fails) {
+		return -1;
+	}
+	if (nexecuted < MAX_EXECUTED) {
+		executed[nexecuted].action = action;
+		snprintf(executed[nexecuted].path, sizeof(executed[nexecuted].path), "%s", path);
+		snprintf(executed[nexecuted].json, sizeof(executed[nexecuted].json), "%s", json);
+		executed[nexecuted].user = user;
+	}
+	return ++nexecuted;
+}
+
+int64_t wc_datasync_put(UNUSED_PARAM(wc_context_t *cnx), char *path, char *json, UNUSED_PARAM(wc_on_req_result_t callback), void *user) {
+	return stub_exec('p', path, json, user);
+}
+
+int64_t wc_datasync_merge(UNUSED_PARAM(wc_context_t *cnx), char *path, char *json, UNUSED_PARAM(wc_on_req_result_t callback), void *user) {
+	return stub_exec('m', path, json, user);
+}
+
+int64_t wc_datasync_push(UNUSED_PARAM(wc_context_t *cnx), char *path, char *json, UNUSED_PARAM(wc_on_req_result_t callback), void *user) {
+	return stub_exec('u', path, json, user);
+}
+/* end stubs */
+
+static int nfailed = 0;
+static wc_action_type_t failed_type;
+static void *failed_user;
+
+static void on_result(UNUSED_PARAM(wc_context_t *cnx), int64_t id, wc_action_type_t type, wc_req_pending_result_t status, char *reason, UNUSED_PARAM(char *data), void *user) {
+	if (id == -1 && status == WC_REQ_ERROR && strcmp(reason, WC_REQ_REASON_NOT_SENT) == 0) {
+		nfailed++;
+		failed_type = type;
+		failed_user = user;
+	}
+}
+
+static int watched_fd = -1;
+
+static int on_event(wc_event_t event, UNUSED_PARAM(wc_context_t *ctx), void *data, UNUSED_PARAM(size_t len)) {
+	struct wc_pollargs *pa = data;
+
+	if (pa->src == WC_POLL_SUBMIT) {
+		if (event == WC_EVENT_ADD_FD) {
+			watched_fd = pa->fd;
+		} else if (event == WC_EVENT_DEL_FD && pa->fd == watched_fd) {
+			watched_fd = -1;
+		}
+	}
+	return 1;
+}
+
+static int readable(int fd, int timeout) {
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+	return poll(&pfd, 1, timeout) == 1;
+}
+
+#define NPRODUCERS 4
+#define NCMDS 5000
+
+static wc_context_t ctx;
+
+static void *producer(void *data) {
+	uintptr_t p = (uintptr_t)data;
+	char path[32];
+	unsigned i;
+
+	for (i = 0 ; i < NCMDS ; i++) {
+		snprintf(path, sizeof(path), "/p%u/%u", (unsigned)p, i);
+		while (wc_datasync_submit_put(&ctx, path, "42", NULL, (void *)p) != 0);
+	}
+	return NULL;
+}
+
+int main(void) {
+	struct wc_datasync_submit_stats stats;
+	unsigned seq[NPRODUCERS] = {0}, i, p, n;
+	pthread_t threads[NPRODUCERS];
+	struct mpsc_ring *r;
+	int in_order = 1, ok;
+
+	/* ring */
+	r = mpsc_ring_new(3);
+	STFU_TRUE("The ring size is rounded up to a power of 2", r != NULL && r->mask == 3);
+	ok = 1;
+	for (i = 0 ; i < 4 ; i++) {
+		ok = ok && mpsc_ring_push(r, (void *)(uintptr_t)(i + 1)) == 0;
+	}
+	STFU_TRUE("Fill the ring", ok);
+	STFU_TRUE("Pushing to a full ring fails", mpsc_ring_push(r, (void *)5) == -1);
+	STFU_TRUE("Pop from the ring", mpsc_ring_pop(r) == (void *)1 && mpsc_ring_pop(r) == (void *)2);
+	STFU_TRUE("Push after some pops", mpsc_ring_push(r, (void *)5) == 0 && mpsc_ring_push(r, (void *)6) == 0);
+	STFU_TRUE("The ring wraps around in order",
+			mpsc_ring_pop(r) == (void *)3 && mpsc_ring_pop(r) == (void *)4
+			&& mpsc_ring_pop(r) == (void *)5 && mpsc_ring_pop(r) == (void *)6);
+	STFU_TRUE("An empty ring pops nothing", mpsc_ring_pop(r) == NULL);
+	mpsc_ring_destroy(r);
+
+	/* submission queue */
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.callback = on_event;
+	ctx.datasync_init = 1;
+
+	STFU_TRUE("Submitting fails if the queue is not enabled", wc_datasync_submit_put(&ctx, "/foo", "1", NULL, NULL) == -1);
+
+	STFU_TRUE("Enable the submission queue", wc_datasync_submit_open(&ctx, 8) == 0);
+	STFU_TRUE("The wake up descriptor is watched", watched_fd != -1);
+	STFU_TRUE("The descriptor is idle", !readable(watched_fd, 0));
+
+	ok = wc_datasync_submit_put(&ctx, "/a", "1", NULL, (void *)1) == 0
+			&& wc_datasync_submit_merge(&ctx, "/b", "{\"x\":2}", NULL, (void *)2) == 0
+			&& wc_datasync_submit_push(&ctx, "/c", "3", NULL, (void *)3) == 0;
+	STFU_TRUE("Submit some commands", ok);
+	STFU_TRUE("Nothing is executed out of the loop thread", nexecuted == 0);
+	STFU_TRUE("The descriptor is readable", readable(watched_fd, 0));
+
+	wc_datasync_submit_service(&ctx);
+	STFU_TRUE("The commands are executed in a batch", nexecuted == 3);
+	STFU_TRUE("The commands are executed in order",
+			executed[0].action == 'p' && strcmp(executed[0].path, "/a") == 0 && strcmp(executed[0].json, "1") == 0
+			&& executed[1].action == 'm' && strcmp(executed[1].path, "/b") == 0 && strcmp(executed[1].json, "{\"x\":2}") == 0
+			&& executed[2].action == 'u' && strcmp(executed[2].path, "/c") == 0 && executed[2].user == (void *)3);
+	STFU_TRUE("The descriptor is idle again", !readable(watched_fd, 0));
+
+	ok = 1;
+	for (i = 0 ; i < 8 ; i++) {
+		ok = ok && wc_datasync_submit_put(&ctx, "/d", "4", NULL, NULL) == 0;
+	}
+	STFU_TRUE("Fill the queue", ok);
+	STFU_TRUE("Submitting to a full queue fails", wc_datasync_submit_put(&ctx, "/d", "5", NULL, NULL) == -1);
+	wc_datasync_submit_service(&ctx);
+
+	wc_datasync_submit_get_stats(&ctx, &stats);
+	STFU_TRUE("The statistics are updated", stats.submitted == 11 && stats.rejected == 1
+			&& stats.executed == 11 && stats.batches == 2 && stats.max_batch == 8);
+
+	exec_fails = 1;
+	ok = wc_datasync_submit_put(&ctx, "/e", "6", on_result, (void *)4) == 0
+			&& wc_datasync_submit_merge(&ctx, "/f", "{\"y\":7}", on_result, (void *)5) == 0;
+	wc_datasync_submit_service(&ctx);
+	exec_fails = 0;
+	ok = ok && nfailed == 2 && failed_type == WC_ACTION_MERGE && failed_user == (void *)5;
+	STFU_TRUE("A command that cannot be sent reports the failure to its callback", ok);
+
+	/* concurrent producers */
+	nexecuted = 0;
+	for (p = 0 ; p < NPRODUCERS ; p++) {
+		pthread_create(&threads[p], NULL, producer, (void *)(uintptr_t)p);
+	}
+	while (nexecuted < NPRODUCERS * NCMDS) {
+		if (readable(watched_fd, 1000)) {
+			wc_datasync_submit_service(&ctx);
+		} else {
+			break;
+		}
+	}
+	for (p = 0 ; p < NPRODUCERS ; p++) {
+		pthread_join(threads[p], NULL);
+	}
+	STFU_TRUE("All the commands submitted concurrently are executed", nexecuted == NPRODUCERS * NCMDS);
+	for (i = 0 ; i < nexecuted ; i++) {
+		p = (unsigned)(uintptr_t)executed[i].user;
+		sscanf(executed[i].path, "/p%*u/%u", &n);
+		if (n != seq[p]++) {
+			in_order = 0;
+		}
+	}
+	STFU_TRUE("The commands of each thread are executed in order", in_order);
+
+	wc_datasync_submit_close(&ctx);
+	STFU_TRUE("The wake up descriptor is not watched any more", watched_fd == -1);
+	STFU_TRUE("The submission queue is disabled", wc_datasync_submit_put(&ctx, "/foo", "1", NULL, NULL) == -1);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,202 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <unistd.h>
+
+#include "../lib/timer.c"
+
+#include "stfu.h"
+
+static long last_set = -1;
+static int nset = 0, ndel = 0;
+
+static int event_cb(wc_event_t event, UNUSED_PARAM(wc_context_t *ctx), void *data, UNUSED_PARAM(size_t len)) {
+	if (event == WC_EVENT_SET_TIMER && ((struct wc_timerargs *)data)->timer == WC_TIMER_MUX) {
+		last_set = ((struct wc_timerargs *)data)->ms;
+		nset++;
+	} else if (event == WC_EVENT_DEL_TIMER && *(enum wc_timersrc *)data == WC_TIMER_MUX) {
+		ndel++;
+	}
+	return 0;
+}
+
+static char fired[16];
+static int nfired = 0;
+
+static void timer_cb(UNUSED_PARAM(wc_context_t *ctx), struct wc_timer *t) {
+	fired[nfired++] = *(char *)t->data;
+}
+
+/* wheel consistency check with a simulated clock */
+#define NTIMERS 2000
+static struct wc_timer wheel_timers[NTIMERS];
+static int64_t fired_at[NTIMERS];
+static int64_t sim_now, sim_prev;
+static int late = 0;
+
+static void sim_cb(UNUSED_PARAM(wc_context_t *ctx), struct wc_timer *t) {
+	fired_at[t - wheel_timers] = sim_now;
+	/* must fire on the first step reaching its expiry date */
+	late += sim_prev >= t->expires;
+}
+
+static int wheel_check(wc_context_t *ctx) {
+	int64_t start, end, step;
+	int i, ok = 1;
+
+	srand(42);
+	start = wc_timer_now();
+	end = start;
+
+	for (i = 0 ; i < NTIMERS ; i++) {
+		wc_timer_init(&wheel_timers[i], sim_cb, NULL);
+		fired_at[i] = -1;
+		switch (i % 4) {
+		case 0: step = rand() % 64; break;
+		case 1: step = rand() % 5000; break;
+		case 2: step = rand() % 600000; break;
+		default: step = (int64_t)rand() % (8 * 3600 * 1000); break; /* beyond the wheel's span */
+		}
+		wc_timer_arm(ctx, &wheel_timers[i], (long)step);
+		if (wheel_timers[i].expires > end) end = wheel_timers[i].expires;
+	}
+
+	/* cancel some of them */
+	for (i = 0 ; i < NTIMERS ; i += 7) {
+		wc_timer_cancel(ctx, &wheel_timers[i]);
+	}
+
+	for (sim_now = start - 1 ; sim_now <= end ; ) {
+		sim_prev = sim_now;
+		sim_now += 1 + rand() % (sim_now - start < 10000 ? 50 : 100000);
+		wc_timers_advance(ctx, sim_now);
+	}
+
+	for (i = 0 ; i < NTIMERS ; i++) {
+		if (i % 7 == 0) {
+			ok &= fired_at[i] == -1;
+		} else {
+			/* fired once the simulated clock has reached its expiry date, at the
+			 * first step after it */
+			ok &= fired_at[i] >= wheel_timers[i].expires && !wc_timer_is_armed(&wheel_timers[i]);
+		}
+	}
+
+	return ok && late == 0 && ctx->timers.count == 0;
+}
+
+/* same, driving the wheel like an event loop would: the simulated clock
+ * jumps to the next date reported by the wheel */
+static int wheel_next_tick_check(wc_context_t *ctx) {
+	int i, ok = 1, steps = 0;
+
+	srand(1337);
+	late = 0;
+	/* rewind the wheel from the simulated future */
+	ctx->timers.now = 0;
+	for (i = 0 ; i < NTIMERS ; i++) {
+		wc_timer_init(&wheel_timers[i], sim_cb, NULL);
+		fired_at[i] = -1;
+		wc_timer_arm(ctx, &wheel_timers[i], 1 + (long)((int64_t)rand() % (6 * 3600 * 1000)));
+	}
+
+	while (ctx->timers.count > 0) {
+		sim_now = wc_timers_next_tick(&ctx->timers);
+		wc_timers_advance(ctx, sim_now);
+		steps++;
+	}
+
+	for (i = 0 ; i < NTIMERS ; i++) {
+		ok &= fired_at[i] == wheel_timers[i].expires;
+	}
+
+	STFU_INFO("%d timers fired in %d wake-ups", NTIMERS, steps);
+
+	return ok;
+}
+
+static void rearm_cb(wc_context_t *ctx, struct wc_timer *t) {
+	fired[nfired++] = *(char *)t->data;
+	if (nfired < 3) {
+		wc_timer_arm(ctx, t, 0);
+	}
+}
+
+int main(void)
+{
+	wc_context_t ctx;
+	struct wc_timer a, b, c;
+	int ok;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.callback = event_cb;
+
+	wc_timer_init(&a, timer_cb, "a");
+	wc_timer_init(&b, timer_cb, "b");
+	wc_timer_init(&c, timer_cb, "c");
+
+	wc_timer_arm(&ctx, &a, 20);
+	STFU_TRUE("Arming a timer programs the event loop timer", nset == 1 && last_set > 10 && last_set <= 20);
+	wc_timer_arm(&ctx, &b, 60000);
+	STFU_TRUE("A later timer does not reprogram the event loop timer", nset == 1);
+	wc_timer_arm(&ctx, &c, 0);
+	STFU_TRUE("An earlier timer reprograms the event loop timer", nset == 2 && last_set == 0);
+
+	wc_timers_service(&ctx);
+	STFU_TRUE("Only the expired timer fires", nfired == 1 && fired[0] == 'c' && !wc_timer_is_armed(&c));
+
+	wc_timer_cancel(&ctx, &b);
+	STFU_TRUE("Cancelling a timer unarms it", !wc_timer_is_armed(&b));
+
+	usleep(30000);
+	wc_timers_service(&ctx);
+	STFU_TRUE("Expired timers fire", nfired == 2 && fired[1] == 'a' && ctx.timers.count == 0);
+
+	wc_timer_arm(&ctx, &b, 1000);
+	wc_timer_cancel(&ctx, &b);
+	STFU_TRUE("The event loop timer is deleted once no timer is armed", ndel == 1);
+
+	nfired = 0;
+	wc_timer_init(&a, rearm_cb, "r");
+	wc_timer_arm(&ctx, &a, 0);
+	usleep(2000);
+	wc_timers_service(&ctx);
+	STFU_TRUE("A timer re-armed from its callback fires on the next run", nfired == 1 && wc_timer_is_armed(&a));
+	usleep(2000);
+	wc_timers_service(&ctx);
+	usleep(2000);
+	wc_timers_service(&ctx);
+	STFU_TRUE("A timer can be re-armed from its callback", nfired == 3 && !wc_timer_is_armed(&a));
+
+	STFU_TRUE("Timers spanning all the wheel levels fire in time", wheel_check(&ctx));
+	ok = wheel_next_tick_check(&ctx);
+	STFU_TRUE("The next tick reported by the wheel is accurate", ok);
+
+	wc_timer_arm(&ctx, &b, 10);
+	wc_timer_arm(&ctx, &c, 10);
+	wc_timers_cleanup(&ctx);
+	STFU_TRUE("Cleanup unarms all the timers", !wc_timer_is_armed(&b) && !wc_timer_is_armed(&c));
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
@@ -0,0 +1,140 @@
+/*
+ * webcom-sdk-c
+ *
+ * Copyright 2018 Orange
+ * <camille.oudot@orange.com>
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include <string.h>
+
+#include "../lib/datasync/tx_queue.c"
+
+#include "stfu.h"
+
+int main(void)
+{
+	struct tx_queue q, q2;
+	int64_t replaced, spliced_ids[] = {7, 8, 10};
+	struct tx_frame *f;
+	char big[600];
+	int ok, i;
+
+	memset(big, 'x', sizeof(big));
+
+	tx_queue_init(&q, 1000);
+	STFU_TRUE("A new queue is empty", tx_queue_empty(&q) && q.depth == 0 && q.bytes == 0);
+
+	STFU_TRUE("A frame is queued", tx_queue_push(&q, "hello", 5, 0) == 0);
+	STFU_TRUE("A second frame is queued", tx_queue_push(&q, big, sizeof(big), 0) == 0);
+	STFU_TRUE("The depth and size are accounted", q.depth == 2 && q.bytes == 605);
+
+	STFU_TRUE("A frame above the high watermark is refused", tx_queue_push(&q, big, sizeof(big), 0) == 1);
+	STFU_TRUE("The refused frame is accounted", q.rejected == 1 && q.congested && q.depth == 2);
+
+	STFU_TRUE("A forced frame ignores the high watermark", tx_queue_push(&q, "0", 1, 1) == 0);
+	STFU_TRUE("The maximum depth and size are recorded", q.max_depth == 3 && q.max_bytes == 606);
+
+	f = tx_queue_pop(&q);
+	ok = f != NULL && f->len == 5 && memcmp(tx_frame_payload(f), "hello", 5) == 0;
+	STFU_TRUE("Frames are popped in order", ok);
+	STFU_TRUE("The payload is preceded by the libwebsockets padding", tx_frame_payload(f) - f->buf == LWS_SEND_BUFFER_PRE_PADDING);
+	free(f);
+
+	f = tx_queue_pop(&q);
+	STFU_TRUE("The second frame comes next", f != NULL && f->len == sizeof(big));
+	free(f);
+	f = tx_queue_pop(&q);
+	STFU_TRUE("The forced frame comes last", f != NULL && f->len == 1 && *tx_frame_payload(f) == '0');
+	free(f);
+
+	STFU_TRUE("The queue is empty again", tx_queue_empty(&q) && tx_queue_pop(&q) == NULL && q.bytes == 0);
+
+	STFU_TRUE("Frames can be queued after the queue was emptied", tx_queue_push(&q, "a", 1, 0) == 0 && tx_queue_peek(&q) != NULL);
+
+	for (i = 0 ; i < 100 ; i++) {
+		tx_queue_push(&q, "abcdefgh", 8, 0);
+	}
+	tx_queue_clear(&q);
+	STFU_TRUE("Clearing the queue discards all the frames", tx_queue_empty(&q) && q.depth == 0 && q.bytes == 0 && !q.congested);
+
+	tx_queue_init(&q, 0);
+	tx_queue_push_ex(&q, "put a 1", 7, 0, 1, "/a");
+	tx_queue_push_ex(&q, "merge a", 7, 0, 2, NULL);
+	STFU_TRUE("A frame without key is not replaced", tx_queue_replace_last(&q, "put a 2", 7, 3, "/a", &replaced) == 2);
+	tx_queue_push_ex(&q, "put a 3", 7, 0, 4, "/a");
+	STFU_TRUE("A frame with another key is not replaced", tx_queue_replace_last(&q, "put b 1", 7, 5, "/b", &replaced) == 2);
+	ok = tx_queue_replace_last(&q, "put a 4!", 8, 6, "/a", &replaced) == 0 && replaced == 4;
+	STFU_TRUE("The last frame is replaced by a frame with the same key", ok);
+	STFU_TRUE("The replacement is accounted", q.depth == 3 && q.bytes == 22 && q.collapsed == 1);
+	f = tx_queue_pop(&q);
+	STFU_TRUE("The first frame keeps its key and id", f->id == 1 && strcmp(f->key, "/a") == 0);
+	free(f);
+	f = tx_queue_pop(&q);
+	free(f);
+	STFU_TRUE("The last frame is still known when it is the only one", tx_queue_last(&q) == tx_queue_peek(&q) && tx_queue_last(&q)->id == 6);
+	ok = tx_queue_replace_last(&q, "put a 5", 7, 7, "/a", &replaced) == 0 && replaced == 6 && tx_queue_peek(&q)->id == 7;
+	STFU_TRUE("The only frame of the queue can be replaced", ok);
+
+	tx_queue_init(&q2, 0);
+	q2.max_frames = 2;
+	tx_queue_push_ex(&q2, "x", 1, 0, 8, NULL);
+	tx_queue_push_ex(&q2, "y", 1, 0, 9, "/y");
+	STFU_TRUE("The number of frames can be bounded", tx_queue_push(&q2, "z", 1, 0) == 1);
+	STFU_TRUE("A frame can be replaced in a full queue", tx_queue_replace_last(&q2, "Y", 1, 10, "/y", &replaced) == 0);
+	tx_queue_splice(&q, &q2);
+	STFU_TRUE("Splicing moves all the frames", tx_queue_empty(&q2) && q2.depth == 0 && q.depth == 3 && q.bytes == 9);
+	STFU_TRUE("The last frame is tracked across a splice", tx_queue_last(&q)->id == 10);
+	ok = 1;
+	for (i = 0 ; (f = tx_queue_pop(&q)) != NULL ; i++) {
+		ok &= i < 3 && f->id == spliced_ids[i];
+		free(f);
+	}
+	STFU_TRUE("Spliced frames keep their order", ok && i == 3);
+	tx_queue_splice(&q2, &q);
+	STFU_TRUE("Splicing an empty queue does nothing", tx_queue_empty(&q2) && q2.last == NULL);
+
+	tx_queue_push_ex(&q, "put b", 5, 0, 11, "/b");
+	tx_queue_push_ex(&q, "put c", 5, 0, 12, "/c");
+	tx_queue_push_ex(&q, "put d", 5, 0, 13, "/d");
+	tx_queue_push_ex(&q, "put e", 5, 0, 14, "/e");
+	STFU_TRUE("An unknown frame is not removed", tx_queue_remove(&q, 42) == 0 && q.depth == 4);
+	STFU_TRUE("A frame is removed from the middle", tx_queue_remove(&q, 12) == 1 && q.depth == 3 && q.bytes == 15);
+	ok = tx_queue_remove(&q, 14) == 1 && tx_queue_last(&q)->id == 13;
+	STFU_TRUE("The last frame is tracked when it is removed", ok);
+	ok = tx_queue_replace_last(&q, "put d 2", 7, 15, "/d", &replaced) == 0 && replaced == 13;
+	STFU_TRUE("The new last frame can be replaced", ok);
+	ok = tx_queue_remove(&q, 11) == 1 && tx_queue_peek(&q)->id == 15 && tx_queue_last(&q)->id == 15;
+	STFU_TRUE("The first frame is removed", ok);
+	tx_queue_push_ex(&q, "put f", 5, 0, 16, "/f");
+	ok = tx_queue_remove(&q, 15) == 1 && tx_queue_remove(&q, 16) == 1;
+	STFU_TRUE("The queue is emptied by removals", ok && tx_queue_empty(&q) && q.last == NULL && q.depth == 0 && q.bytes == 0);
+	tx_queue_push_ex(&q, "put g", 5, 0, 17, "/g");
+	STFU_TRUE("The queue is usable after removals", tx_queue_peek(&q)->id == 17 && tx_queue_last(&q)->id == 17);
+	tx_queue_clear(&q);
+
+	ok = 1;
+	for (i = 0 ; i < 1000 ; i++) {
+		ok &= tx_queue_push(&q, big, sizeof(big), 0) == 0;
+	}
+	STFU_TRUE("A queue without high watermark accepts any number of frames", ok && q.depth == 1000);
+	tx_queue_clear(&q);
+
+	STFU_SUMMARY();
+
+	return STFU_NUMBER_FAILED;
+}
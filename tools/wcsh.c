@@ -107,13 +107,13 @@ char *on_off_args[] = {"child_added", "child_changed", "child_removed","value",
 char *info_args[] = {"listen", "on", NULL};
 char *help_args[] = {"", "cache", "cd", "connect", "disconnect", "exit", "help", "info", "ls", "merge", "off", "on", "push", "put", NULL};
 char *log_args[] = {"off", "on", "verbose", NULL};
-char *cache_args[] = {"print", "load", "save", NULL};
+char *cache_args[] = {"print", "load", "save", "snapshot", "restore", NULL};
 char *wait_args[] = {"connected", "data", "disconnected", NULL};
 
 /* keep this array in alphabetical order since we use binary search on it */
 static struct command commands[] = {
-		{"cache",      "Prints, loads from a file or stores in a file the contents of the cache",
-		               "cache {print,load,save}",
+		{"cache",      "Prints, loads from a file or stores in a file (as JSON or as a binary snapshot) the contents of the cache",
+		               "cache {print,load,save,snapshot,restore}",
 		               1, 2, exec_cache, cache_args},
 		{"cd",         "Sets the current working path to \"/\", or to the specified path",
 		               "cd [PATH]",
@@ -452,9 +452,21 @@ static void exec_cache_load(int argc, char **argv) {
 	}
 }
 
+static void exec_cache_snapshot(int argc, char **argv) {
+	if (argc == 1 && wc_datasync_cache_save(ctx, *argv) != 0) {
+		fprintf(stderr, "error saving \"%s\"\n", *argv);
+	}
+}
+
+static void exec_cache_restore(int argc, char **argv) {
+	if (argc == 1 && wc_datasync_cache_load(ctx, *argv) != 0) {
+		fprintf(stderr, "error restoring \"%s\"\n", *argv);
+	}
+}
+
 static void exec_cache(int argc, char **argv) {
 	if (argc == 0) {
-		printf("Usage:\n cache {dump,save,load}\n");
+		printf("Usage:\n cache {dump,save,load,snapshot,restore}\n");
 	} else if (strcmp("print", argv[0]) == 0) {
 		ftreenode_to_json(ctx->datasync.cache->root, stdout);
 		puts("");
@@ -462,6 +474,10 @@ static void exec_cache(int argc, char **argv) {
 		exec_cache_load(--argc, ++argv);
 	} else if (strcmp("save", argv[0]) == 0) {
 		exec_cache_save(--argc, ++argv);
+	} else if (strcmp("snapshot", argv[0]) == 0) {
+		exec_cache_snapshot(--argc, ++argv);
+	} else if (strcmp("restore", argv[0]) == 0) {
+		exec_cache_restore(--argc, ++argv);
 	}
 }
 